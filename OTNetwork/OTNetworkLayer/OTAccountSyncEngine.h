@@ -0,0 +1,86 @@
+//
+//  OTAccountSyncEngine.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+@class OTNetworkController;
+
+/** Triggered with the rows (NSDictionary, as returned by the server) that appeared, changed or disappeared since the previous sync.  Removed rows are the last version seen. */
+typedef void (^AccountSyncChangesBlock)(NSArray *added, NSArray *changed, NSArray *removed);
+
+/** Keeps a local copy of the open orders and trades of an account, up to date with the server.
+ 
+ Each poll reads every page of the open orders and trades, with ordersCursorForAccountId:pageSize: and tradesCursorForAccountId:pageSize:,
+ and only then compares the rows with the local tables by id: a row missing from the whole list was closed.  Only the differences are
+ applied, and they are reported through ordersChangedBlock and tradesChangedBlock.  A poll of which a page could not be fetched changes nothing.
+ 
+ The poll interval adapts to activity: back to minPollInterval whenever something changed, doubling up to maxPollInterval while nothing
+ does, so an idle account costs a request per page of each table every maxPollInterval.  Call syncNow after acting on the account to see the result at once.
+ 
+ An engine is not thread safe: use it from the callbackQueue of its network controller (the main queue by default), where the blocks are triggered too.
+ */
+@interface OTAccountSyncEngine : NSObject
+
+/** Creates a stopped engine for an account.
+ 
+ @param networkController **Required**.  The controller polling the server.  Not retained.
+ @param accountId **Required**.  Account Id to keep in sync (must be owned by the user).
+ */
+- (id)initWithNetworkController:(OTNetworkController *)networkController accountId:(NSNumber *)accountId;
+
+@property (nonatomic, readonly, strong) NSNumber *accountId;
+
+/** Open orders and trades of the account, keyed by id. */
+@property (nonatomic, readonly) NSDictionary *orders;
+@property (nonatomic, readonly) NSDictionary *trades;
+
+/** The highest order and trade ids open at the last sync, 0 if none was.  nil before the first sync. */
+@property (nonatomic, readonly, strong) NSNumber *maxOrderId;
+@property (nonatomic, readonly, strong) NSNumber *maxTradeId;
+
+/** Triggered after a sync which changed the orders or the trades.  The first sync reports every row as added. */
+@property (nonatomic, copy) AccountSyncChangesBlock ordersChangedBlock;
+@property (nonatomic, copy) AccountSyncChangesBlock tradesChangedBlock;
+
+/** Shortest and longest time between polls.  Default: 2 and 60 seconds. */
+@property (nonatomic, assign) NSTimeInterval minPollInterval;
+@property (nonatomic, assign) NSTimeInterval maxPollInterval;
+
+/** Time until the next poll, as adapted to the activity on the account. */
+@property (nonatomic, readonly) NSTimeInterval pollInterval;
+
+/** Whether the engine is polling. */
+@property (nonatomic, readonly) BOOL running;
+
+/** Starts polling, beginning with a sync right away. */
+- (void)start;
+
+/** Stops polling.  The tables keep their contents. */
+- (void)stop;
+
+/** Syncs right away (or as soon as the poll in progress is over), and goes back to polling every minPollInterval. */
+- (void)syncNow;
+
+@end
@@ -0,0 +1,250 @@
+//
+//  OTAccountSyncEngine.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTAccountSyncEngine.h"
+#import "OTNetworkController.h"
+
+// One table of rows kept in sync, ie. the orders or the trades.
+@interface OTAccountSyncTable : NSObject {
+@public
+    NSMutableDictionary *_rows;             // id -> NSDictionary
+    NSNumber *_maxId;
+}
+@end
+
+@implementation OTAccountSyncTable
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _rows = [NSMutableDictionary dictionary];
+    }
+
+    return self;
+}
+
+// Applies every open row, as read from all the pages of the list, to the table, and returns whether anything changed.
+- (BOOL)applyRows:(NSArray *)rows changesBlock:(AccountSyncChangesBlock)changesBlock
+{
+    NSMutableArray *added = [NSMutableArray array];
+    NSMutableArray *changed = [NSMutableArray array];
+    NSMutableArray *removed = [NSMutableArray array];
+    NSMutableSet *seenIds = [NSMutableSet setWithCapacity:rows.count];
+    NSNumber *highestId = nil;
+
+    for (NSDictionary *row in rows) {
+        NSNumber *rowId = [row objectForKey:@"id"];
+        if (!rowId) {
+            continue;
+        }
+
+        NSDictionary *knownRow = [_rows objectForKey:rowId];
+        if (!knownRow) {
+            [added addObject:row];
+            [_rows setObject:row forKey:rowId];
+        } else if (![knownRow isEqual:row]) {
+            [changed addObject:row];
+            [_rows setObject:row forKey:rowId];
+        }
+
+        [seenIds addObject:rowId];
+        highestId = (!highestId || [rowId compare:highestId] == NSOrderedDescending) ? rowId : highestId;
+    }
+
+    // the rows are the whole list: whatever is not in it any more was closed
+    for (NSNumber *rowId in [_rows allKeys]) {
+        if (![seenIds containsObject:rowId]) {
+            [removed addObject:[_rows objectForKey:rowId]];
+            [_rows removeObjectForKey:rowId];
+        }
+    }
+
+    _maxId = highestId ?: @0;
+
+    if (added.count == 0 && changed.count == 0 && removed.count == 0) {
+        return NO;
+    }
+    if (changesBlock) {
+        changesBlock(added, changed, removed);
+    }
+    return YES;
+}
+
+@end
+
+
+@interface OTAccountSyncEngine () {
+    OTAccountSyncTable *_ordersTable;
+    OTAccountSyncTable *_tradesTable;
+    NSUInteger _timerGeneration;            // bumped to cancel the scheduled poll
+    BOOL _polling;
+    BOOL _syncRequested;
+}
+
+@property (nonatomic, weak) OTNetworkController *networkController;
+@property (nonatomic, readwrite) NSTimeInterval pollInterval;
+@property (nonatomic, readwrite) BOOL running;
+@end
+
+@implementation OTAccountSyncEngine
+
+- (id)initWithNetworkController:(OTNetworkController *)networkController accountId:(NSNumber *)accountId
+{
+    NSParameterAssert(networkController);
+    NSParameterAssert(accountId);
+
+    self = [super init];
+    if (self) {
+        _networkController = networkController;
+        _accountId = accountId;
+        _minPollInterval = 2.0;
+        _maxPollInterval = 60.0;
+
+        _ordersTable = [[OTAccountSyncTable alloc] init];
+        _tradesTable = [[OTAccountSyncTable alloc] init];
+    }
+
+    return self;
+}
+
+#pragma mark Reading the Tables
+
+- (NSDictionary *)orders
+{
+    return [_ordersTable->_rows copy];
+}
+
+- (NSDictionary *)trades
+{
+    return [_tradesTable->_rows copy];
+}
+
+- (NSNumber *)maxOrderId
+{
+    return _ordersTable->_maxId;
+}
+
+- (NSNumber *)maxTradeId
+{
+    return _tradesTable->_maxId;
+}
+
+#pragma mark Polling
+
+- (void)start
+{
+    if (self.running) {
+        return;
+    }
+
+    self.running = YES;
+    [self syncNow];
+}
+
+- (void)stop
+{
+    self.running = NO;
+    _timerGeneration++;
+}
+
+- (void)syncNow
+{
+    self.pollInterval = _minPollInterval;
+
+    if (_polling) {
+        _syncRequested = YES;
+    } else {
+        [self poll];
+    }
+}
+
+#pragma mark Helper/Private functions
+
+- (void)poll
+{
+    _timerGeneration++;
+    _polling = YES;
+
+    // both tables are polled at once; the next poll is scheduled when the slower one is back
+    __block NSUInteger numPending = 2;
+    __block BOOL anyChanges = NO;
+    void (^tableDone)(BOOL) = ^(BOOL changed) {
+        anyChanges = anyChanges || changed;
+        if (--numPending == 0) {
+            [self pollDidFinishWithChanges:anyChanges];
+        }
+    };
+
+    // every page is read before diffing: a row missing from a partial list is not closed, and one past the first page is not new
+    [self readRowsOfCursor:[self.networkController ordersCursorForAccountId:_accountId pageSize:nil] intoRows:[NSMutableArray array] completion:^(NSArray *rows) {
+        tableDone(rows ? [_ordersTable applyRows:rows changesBlock:self.ordersChangedBlock] : NO);
+    }];
+    [self readRowsOfCursor:[self.networkController tradesCursorForAccountId:_accountId pageSize:nil] intoRows:[NSMutableArray array] completion:^(NSArray *rows) {
+        tableDone(rows ? [_tradesTable applyRows:rows changesBlock:self.tradesChangedBlock] : NO);
+    }];
+}
+
+// Reads the pages of a list one after the other, and hands over all their rows, or nil if a page could not be fetched.
+- (void)readRowsOfCursor:(OTPageCursor *)cursor intoRows:(NSMutableArray *)rows completion:(void (^)(NSArray *rows))completionBlock
+{
+    [cursor nextPageSuccess:^(NSArray *pageRows, BOOL lastPage) {
+        [rows addObjectsFromArray:pageRows];
+        if (lastPage) {
+            completionBlock(rows);
+        } else {
+            [self readRowsOfCursor:cursor intoRows:rows completion:completionBlock];
+        }
+    } failure:^(NSDictionary *error) {
+        [cursor cancel];
+        completionBlock(nil);
+    }];
+}
+
+- (void)pollDidFinishWithChanges:(BOOL)changed
+{
+    _polling = NO;
+
+    if (_syncRequested) {
+        _syncRequested = NO;
+        [self poll];
+        return;
+    }
+
+    self.pollInterval = changed ? _minPollInterval : MIN(MAX(_pollInterval, _minPollInterval) * 2.0, _maxPollInterval);
+
+    if (!self.running) {
+        return;
+    }
+
+    NSUInteger generation = _timerGeneration;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_pollInterval * NSEC_PER_SEC)), self.networkController.callbackQueue ?: dispatch_get_main_queue(), ^{
+        if (generation == _timerGeneration && self.running && !_polling) {
+            [self poll];
+        }
+    });
+}
+
+@end
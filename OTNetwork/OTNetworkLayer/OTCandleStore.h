@@ -0,0 +1,172 @@
+//
+//  OTCandleStore.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import "OTPriceTick.h"
+
+@class OTNetworkController;
+
+// Bumped whenever the layout of cache files changes; files of any other version are ignored.
+#define OTCandleStoreFileVersion    2
+
+extern NSString * const OTCandleStoreErrorDomain;
+
+enum {
+    OTCandleStoreErrorFileCorrupt = 1,      // truncated, bad checksum, unsorted times...
+    OTCandleStoreErrorFileVersion,          // written by another version of the layout
+    OTCandleStoreErrorFileMismatch          // holds another symbol or granularity
+};
+
+typedef enum {
+    OTCandleColumnTime = 0,     // microseconds since 1970, like OTPriceTick
+    OTCandleColumnOpen,         // prices are fixed-point, scaled by OTPriceTickScale
+    OTCandleColumnHigh,
+    OTCandleColumnLow,
+    OTCandleColumnClose,
+    OTCandleColumnVolume,       // number of ticks
+    OTCandleColumnCount
+} OTCandleColumn;
+
+/** A run of consecutive candles, pointing straight into the columns of an OTCandleStore.
+ 
+ Nothing is copied, so a slice is only valid until the store is next updated, merged into or read from a file, whichever part of the
+ columns it covers: any of these may move them.
+ */
+typedef struct {
+    NSUInteger      count;
+    const int64_t   *time;
+    const int64_t   *open;
+    const int64_t   *high;
+    const int64_t   *low;
+    const int64_t   *close;
+    const int64_t   *volume;
+} OTCandleSlice;
+
+/** The price history of one symbol at one granularity, kept as contiguous columns of integers rather than an array of dictionaries.
+ 
+ Candles are sorted by time, with no duplicates.  Only the last one may still be forming (see lastCandleComplete).
+ 
+ Each updateWithSuccess:failure: asks the server only for the candles since the last one stored (including that one, as it may have
+ been forming), paging forward until it has caught up, and merges them in.  Charts read the result through sliceWithRange:, without copying, and slice again after every update.
+ 
+ Given a cachePath, the store starts out with the candles saved there by a previous run (mapped straight from the file, so a chart can
+ be drawn before any request is made), only asks the server for what is newer, and saves itself back after every update that changed something.
+ 
+ A store is not thread safe: use it from the callbackQueue of its network controller (the main queue by default).
+ */
+@interface OTCandleStore : NSObject
+
+/** Returns a store, unbound to any network controller, holding the given candles.
+ 
+ @param candles **Required**.  The "candles" array of a candles response, ie. NSDictionary with time, openMid, highMid, lowMid, closeMid, volume and complete.
+ @return The new store, or nil if a candle has no time.
+ */
++ (OTCandleStore *)candleStoreWithCandles:(NSArray *)candles;
+
+/** Creates an empty store, to be filled from the network by updateWithSuccess:failure:.
+ 
+ @param networkController **Required**.  The controller fetching the candles.  Not retained.
+ @param symbol **Required**.  Which symbol the candles are for (eg. EUR_USD).
+ @param granularity **Required**.  Which granularity the candles are for (eg. S5, M1, H1).
+ */
+- (id)initWithNetworkController:(OTNetworkController *)networkController symbol:(NSString *)symbol granularity:(NSString *)granularity;
+
+/** Creates a store backed by a cache file, filled with whatever a previous run saved there.  This is the designated initializer.
+ 
+ A cache file that cannot be used (corrupt, another version, another symbol) is deleted, and the store starts out empty.
+ 
+ @param networkController **Required**.  The controller fetching the candles.  Not retained.
+ @param symbol **Required**.  Which symbol the candles are for (eg. EUR_USD).
+ @param granularity **Required**.  Which granularity the candles are for (eg. S5, M1, H1).
+ @param cachePath **Optional**.  Where to load and save the candles, eg. from defaultCachePathForSymbol:granularity:.  If nil, nothing is cached.
+ */
+- (id)initWithNetworkController:(OTNetworkController *)networkController symbol:(NSString *)symbol granularity:(NSString *)granularity cachePath:(NSString *)cachePath;
+
+/** Returns a cache path for the symbol and granularity, in the Caches directory of the application. */
++ (NSString *)defaultCachePathForSymbol:(NSString *)symbol granularity:(NSString *)granularity;
+
+/** Where the store is cached, or nil. */
+@property (nonatomic, readonly, copy) NSString *cachePath;
+
+@property (nonatomic, readonly, copy) NSString *symbol;
+@property (nonatomic, readonly, copy) NSString *granularity;
+
+/** Number of candles fetched by the first update of an empty store.  Default: 500. */
+@property (nonatomic, assign) NSUInteger initialCount;
+
+/** Number of candles asked for by each request while catching up.  Default: 5000, the most the server returns at once. */
+@property (nonatomic, assign) NSUInteger pageSize;
+
+/** Number of candles in the store. */
+@property (nonatomic, readonly) NSUInteger count;
+
+/** Whether the last candle is final, rather than still forming. */
+@property (nonatomic, readonly) BOOL lastCandleComplete;
+
+/** Returns the given column, holding count values.  Only valid until the store is next updated or merged into. */
+- (const int64_t *)column:(OTCandleColumn)column;
+
+/** Returns the candles in range, which must lie within count.  Only valid until the store is next updated or merged into. */
+- (OTCandleSlice)sliceWithRange:(NSRange)range;
+
+/** Returns the index of the first candle starting at or after time (microseconds since 1970), or count if there is none. */
+- (NSUInteger)indexOfCandleAtOrAfterTime:(int64_t)time;
+
+/** Merges the candles of another store into this one.  Where both hold a candle for the same time, the other store's wins.
+ 
+ The columns may be moved to make room, so every slice and column pointer taken before the merge is invalid afterwards, even for the
+ candles before the changed range: take them again.
+ 
+ @return The range of candles that were added or changed.  The candles before it are the same as before the merge (though maybe at another address).
+ */
+- (NSRange)mergeCandlesFromStore:(OTCandleStore *)candles;
+
+/** Replaces the candles of the store with the ones saved in a file by writeToFile:error:.
+ 
+ The file is memory-mapped rather than read.  Its header, length, checksum and time ordering are all checked before anything is replaced,
+ in one pass over the file.  The columns are then read straight from the mapping, without copying, until the store is first changed.
+ 
+ @param path **Required**.  The file to read.
+ @param error **Optional**.  Set to an error of OTCandleStoreErrorDomain (or NSCocoaErrorDomain if the file cannot be opened) on failure.
+ @return NO, leaving the store untouched, if the file could not be used.
+ */
+- (BOOL)readFromFile:(NSString *)path error:(NSError **)error;
+
+/** Saves the candles of the store to a file, atomically.
+ 
+ The file holds a fixed-size header (version, symbol, granularity, count, checksum) followed by the OTCandleColumnCount columns one
+ after the other, count integers each, in native byte order.
+ */
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error;
+
+/** To bring the store up to date with the server.
+ 
+ @param successBlock **Optional**.  Triggered once the store has caught up, with the range of candles that were added or changed (empty if none).
+ @param failureBlock **Optional**.  Triggered if a request failed, with the same NSDictionary as the failureBlock of OTNetworkController.  Candles merged before the failure are kept.
+ */
+- (void)updateWithSuccess:(void (^)(NSRange changedRange))successBlock
+                  failure:(void (^)(NSDictionary *error))failureBlock;
+
+@end
@@ -0,0 +1,603 @@
+//
+//  OTCandleStore.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTCandleStore.h"
+#import "OTNetworkController.h"
+#include <math.h>
+#include <stdlib.h>
+
+NSString * const OTCandleStoreErrorDomain = @"OTCandleStoreErrorDomain";
+
+#define kCandleFileMagic    "OTCANDLE"
+
+// Layout of the start of a cache file, followed by the OTCandleColumnCount columns one after the other, count int64_t each, so that a
+// store read from it can point its columns straight into the mapped file.
+typedef struct {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    recordSize;
+    char        symbol[16];             // NUL padded, truncated if need be
+    char        granularity[8];
+    uint64_t    count;
+    uint32_t    lastCandleComplete;
+    uint32_t    reserved;
+    uint64_t    checksum;               // FNV-1a of the columns
+} OTCandleFileHeader;
+
+static uint64_t OTCandleFileChecksum(const void *bytes, size_t length)
+{
+    const unsigned char *p = bytes;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void OTCandleFileCopyName(char *destination, size_t size, NSString *name)
+{
+    memset(destination, 0, size);
+    if (name) {
+        const char *utf8 = [name UTF8String];
+        size_t length = strlen(utf8);
+        memcpy(destination, utf8, (length < size) ? length : size);
+    }
+}
+
+static BOOL OTCandleFileFail(NSError **error, NSInteger code, NSString *path, NSString *reason)
+{
+    if (error) {
+        *error = [NSError errorWithDomain:OTCandleStoreErrorDomain
+                                     code:code
+                                 userInfo:@{ NSFilePathErrorKey : path, NSLocalizedDescriptionKey : reason }];
+    }
+    return NO;
+}
+
+static int64_t OTCandleFixedPointValue(id value, int64_t scale)
+{
+    // the sandbox serves prices as numbers, but has served them as strings too
+    return (int64_t)llround([value doubleValue] * (double)scale);
+}
+
+@interface OTCandleStore () {
+    int64_t *_columns[OTCandleColumnCount];
+    NSUInteger _capacity;
+    NSData *_mappedData;        // the cache file the columns point into, read-only, until the first change copies them to the heap
+
+    BOOL _updating;
+    NSMutableArray *_pendingSuccessBlocks;
+    NSMutableArray *_pendingFailureBlocks;
+}
+
+@property (nonatomic, weak) OTNetworkController *networkController;
+@property (nonatomic, readwrite) NSUInteger count;
+@property (nonatomic, readwrite) BOOL lastCandleComplete;
+@end
+
+@implementation OTCandleStore
+
++ (OTCandleStore *)candleStoreWithCandles:(NSArray *)candles
+{
+    OTCandleStore *store = [[OTCandleStore alloc] init];
+    [store reserveCapacity:candles.count];
+
+    int64_t previousTime = INT64_MIN;
+    BOOL sorted = YES;
+
+    for (NSDictionary *candle in candles) {
+        id time = [candle objectForKey:@"time"];
+        if (!time) {
+            return nil;
+        }
+
+        NSUInteger index = store->_count;
+        store->_columns[OTCandleColumnTime][index] = OTCandleFixedPointValue(time, OTPriceTickScale);
+        store->_columns[OTCandleColumnOpen][index] = OTCandleFixedPointValue([candle objectForKey:@"openMid"], OTPriceTickScale);
+        store->_columns[OTCandleColumnHigh][index] = OTCandleFixedPointValue([candle objectForKey:@"highMid"], OTPriceTickScale);
+        store->_columns[OTCandleColumnLow][index] = OTCandleFixedPointValue([candle objectForKey:@"lowMid"], OTPriceTickScale);
+        store->_columns[OTCandleColumnClose][index] = OTCandleFixedPointValue([candle objectForKey:@"closeMid"], OTPriceTickScale);
+        store->_columns[OTCandleColumnVolume][index] = [[candle objectForKey:@"volume"] longLongValue];
+
+        sorted = sorted && store->_columns[OTCandleColumnTime][index] > previousTime;
+        previousTime = store->_columns[OTCandleColumnTime][index];
+        store->_count++;
+
+        id complete = [candle objectForKey:@"complete"];
+        store->_lastCandleComplete = complete ? [complete boolValue] : YES;
+    }
+
+    if (!sorted) {
+        // the server sends them in order; merging into an empty store sorts anything else and drops duplicates
+        OTCandleStore *sortedStore = [[OTCandleStore alloc] init];
+        for (NSUInteger i = 0; i < store->_count; i++) {
+            [sortedStore mergeCandlesFromStore:[store storeWithRange:NSMakeRange(i, 1)]];
+        }
+        return sortedStore;
+    }
+
+    return store;
+}
+
+- (id)initWithNetworkController:(OTNetworkController *)networkController symbol:(NSString *)symbol granularity:(NSString *)granularity
+{
+    return [self initWithNetworkController:networkController symbol:symbol granularity:granularity cachePath:nil];
+}
+
+- (id)initWithNetworkController:(OTNetworkController *)networkController symbol:(NSString *)symbol granularity:(NSString *)granularity cachePath:(NSString *)cachePath
+{
+    NSParameterAssert(networkController);
+    NSParameterAssert(symbol);
+    NSParameterAssert(granularity);
+
+    self = [self init];
+    if (self) {
+        _networkController = networkController;
+        _symbol = [symbol copy];
+        _granularity = [granularity copy];
+        _cachePath = [cachePath copy];
+
+        if (_cachePath) {
+            [self loadCache];
+        }
+    }
+
+    return self;
+}
+
++ (NSString *)defaultCachePathForSymbol:(NSString *)symbol granularity:(NSString *)granularity
+{
+    NSString *cachesDirectory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+    NSString *fileName = [NSString stringWithFormat:@"%@-%@.candles", symbol, granularity];
+
+    return [[cachesDirectory stringByAppendingPathComponent:@"OTCandleStore"] stringByAppendingPathComponent:fileName];
+}
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _initialCount = 500;
+        _pageSize = 5000;
+        _lastCandleComplete = YES;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [self freeColumns];
+}
+
+#pragma mark Reading Candles
+
+- (const int64_t *)column:(OTCandleColumn)column
+{
+    NSParameterAssert(column < OTCandleColumnCount);
+    return _columns[column];
+}
+
+- (OTCandleSlice)sliceWithRange:(NSRange)range
+{
+    NSAssert(NSMaxRange(range) <= _count, @"%@: range %@ beyond %lu candles", [self class], NSStringFromRange(range), (unsigned long)_count);
+
+    OTCandleSlice slice;
+    slice.count = range.length;
+    slice.time = _columns[OTCandleColumnTime] + range.location;
+    slice.open = _columns[OTCandleColumnOpen] + range.location;
+    slice.high = _columns[OTCandleColumnHigh] + range.location;
+    slice.low = _columns[OTCandleColumnLow] + range.location;
+    slice.close = _columns[OTCandleColumnClose] + range.location;
+    slice.volume = _columns[OTCandleColumnVolume] + range.location;
+
+    return slice;
+}
+
+- (NSUInteger)indexOfCandleAtOrAfterTime:(int64_t)time
+{
+    const int64_t *times = _columns[OTCandleColumnTime];
+    NSUInteger low = 0;
+    NSUInteger high = _count;
+
+    while (low < high) {
+        NSUInteger middle = low + (high - low) / 2;
+        if (times[middle] < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+#pragma mark Merging Candles
+
+- (NSRange)mergeCandlesFromStore:(OTCandleStore *)candles
+{
+    NSParameterAssert(candles);
+
+    NSUInteger incomingCount = candles->_count;
+    if (incomingCount == 0) {
+        return NSMakeRange(_count, 0);
+    }
+
+    int64_t firstIncomingTime = candles->_columns[OTCandleColumnTime][0];
+
+    // the usual case: newer candles, possibly starting with a new version of our last (still forming) one
+    if (_count == 0 || firstIncomingTime >= _columns[OTCandleColumnTime][_count - 1]) {
+        NSUInteger start = _count;
+        NSUInteger firstChanged = _count;
+        if (_count > 0 && firstIncomingTime == _columns[OTCandleColumnTime][_count - 1]) {
+            start--;
+            if (![self isCandleAtIndex:start equalToCandleAtIndex:0 ofStore:candles] ||
+                (incomingCount == 1 && _lastCandleComplete != candles->_lastCandleComplete)) {
+                firstChanged = start;
+            }
+        }
+
+        [self reserveCapacity:start + incomingCount];
+        for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+            memcpy(_columns[column] + start, candles->_columns[column], incomingCount * sizeof(int64_t));
+        }
+        _count = start + incomingCount;
+        _lastCandleComplete = candles->_lastCandleComplete;
+
+        return NSMakeRange(firstChanged, _count - firstChanged);
+    }
+
+    // otherwise merge both sorted runs into new columns, from the first candle the incoming ones can touch
+    NSUInteger start = [self indexOfCandleAtOrAfterTime:firstIncomingTime];
+    NSUInteger capacity = _count + incomingCount;
+    int64_t *merged[OTCandleColumnCount];
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        merged[column] = malloc(capacity * sizeof(int64_t));
+        memcpy(merged[column], _columns[column], start * sizeof(int64_t));
+    }
+
+    const int64_t *times = _columns[OTCandleColumnTime];
+    const int64_t *incomingTimes = candles->_columns[OTCandleColumnTime];
+    NSUInteger i = start;
+    NSUInteger j = 0;
+    NSUInteger k = start;
+    BOOL lastFromIncoming = NO;
+
+    while (i < _count || j < incomingCount) {
+        BOOL takeIncoming;
+        if (i == _count) {
+            takeIncoming = YES;
+        } else if (j == incomingCount) {
+            takeIncoming = NO;
+        } else {
+            takeIncoming = (incomingTimes[j] <= times[i]);
+            if (incomingTimes[j] == times[i]) {
+                i++;    // replaced by the incoming one
+            }
+        }
+
+        for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+            merged[column][k] = takeIncoming ? candles->_columns[column][j] : _columns[column][i];
+        }
+        if (takeIncoming) {
+            j++;
+        } else {
+            i++;
+        }
+        k++;
+        lastFromIncoming = takeIncoming;
+    }
+
+    [self freeColumns];
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        _columns[column] = merged[column];
+    }
+    _capacity = capacity;
+    _count = k;
+    if (lastFromIncoming) {
+        _lastCandleComplete = candles->_lastCandleComplete;
+    }
+
+    return NSMakeRange(start, k - start);
+}
+
+#pragma mark Reading and Writing Files
+
+- (BOOL)readFromFile:(NSString *)path error:(NSError **)error
+{
+    NSParameterAssert(path);
+
+    NSData *data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:error];
+    if (!data) {
+        return NO;
+    }
+
+    OTCandleFileHeader header;
+    if (data.length < sizeof(header)) {
+        return OTCandleFileFail(error, OTCandleStoreErrorFileCorrupt, path, @"File shorter than its header");
+    }
+    memcpy(&header, data.bytes, sizeof(header));
+
+    if (memcmp(header.magic, kCandleFileMagic, sizeof(header.magic)) != 0) {
+        return OTCandleFileFail(error, OTCandleStoreErrorFileCorrupt, path, @"Not a candle file");
+    }
+    if (header.version != OTCandleStoreFileVersion || header.recordSize != OTCandleColumnCount * sizeof(int64_t)) {
+        return OTCandleFileFail(error, OTCandleStoreErrorFileVersion, path, @"Candle file of another version");
+    }
+
+    char symbol[sizeof(header.symbol)];
+    char granularity[sizeof(header.granularity)];
+    OTCandleFileCopyName(symbol, sizeof(symbol), _symbol);
+    OTCandleFileCopyName(granularity, sizeof(granularity), _granularity);
+    if ((_symbol && memcmp(symbol, header.symbol, sizeof(symbol)) != 0) ||
+        (_granularity && memcmp(granularity, header.granularity, sizeof(granularity)) != 0)) {
+        return OTCandleFileFail(error, OTCandleStoreErrorFileMismatch, path, @"Candle file of another symbol or granularity");
+    }
+
+    if (header.count > (data.length - sizeof(header)) / header.recordSize ||
+        sizeof(header) + header.count * header.recordSize != data.length || header.lastCandleComplete > 1) {
+        return OTCandleFileFail(error, OTCandleStoreErrorFileCorrupt, path, @"Candle file truncated or damaged");
+    }
+
+    const int64_t *body = (const int64_t *)((const char *)data.bytes + sizeof(header));
+    NSUInteger count = (NSUInteger)header.count;
+    if (OTCandleFileChecksum(body, (size_t)count * header.recordSize) != header.checksum) {
+        return OTCandleFileFail(error, OTCandleStoreErrorFileCorrupt, path, @"Candle file checksum mismatch");
+    }
+
+    const int64_t *times = body + OTCandleColumnTime * count;
+    for (NSUInteger i = 1; i < count; i++) {
+        if (times[i] <= times[i - 1]) {
+            return OTCandleFileFail(error, OTCandleStoreErrorFileCorrupt, path, @"Candle file times out of order");
+        }
+    }
+
+    // nothing is copied: the columns are read straight from the mapping (which is read-only) until the store is first changed
+    [self freeColumns];
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        _columns[column] = (int64_t *)(body + column * count);
+    }
+    _mappedData = data;
+    _capacity = count;
+    _count = count;
+    _lastCandleComplete = (header.lastCandleComplete != 0);
+
+    return YES;
+}
+
+- (BOOL)writeToFile:(NSString *)path error:(NSError **)error
+{
+    NSParameterAssert(path);
+
+    return [[self fileData] writeToFile:path options:NSDataWritingAtomic error:error];
+}
+
+#pragma mark Updating from the Network
+
+- (void)updateWithSuccess:(void (^)(NSRange changedRange))successBlock
+                  failure:(void (^)(NSDictionary *error))failureBlock
+{
+    NSAssert(self.networkController, @"%@: only stores created with a network controller can be updated", [self class]);
+
+    if (!_pendingSuccessBlocks) {
+        _pendingSuccessBlocks = [NSMutableArray array];
+        _pendingFailureBlocks = [NSMutableArray array];
+    }
+    if (successBlock) {
+        [_pendingSuccessBlocks addObject:[successBlock copy]];
+    }
+    if (failureBlock) {
+        [_pendingFailureBlocks addObject:[failureBlock copy]];
+    }
+
+    // a second caller simply waits for the update already running
+    if (!_updating) {
+        _updating = YES;
+        [self fetchNextPageWithChangedRange:NSMakeRange(_count, 0)];
+    }
+}
+
+#pragma mark Helper/Private functions
+
+- (void)fetchNextPageWithChangedRange:(NSRange)changedRange
+{
+    NSNumber *sinceTime = (_count > 0) ? [NSNumber numberWithLongLong:_columns[OTCandleColumnTime][_count - 1]] : nil;
+    NSUInteger requestedCount = (_count > 0) ? _pageSize : _initialCount;
+
+    [self.networkController rateCandleColumnsForSymbol:_symbol
+                                           granularity:_granularity
+                                             sinceTime:sinceTime
+                                        numberOfPoints:[NSNumber numberWithUnsignedInteger:requestedCount]
+                                               success:^(OTCandleStore *candles)
+     {
+         NSRange mergedRange = [self mergeCandlesFromStore:candles];
+         NSRange totalRange = (changedRange.length == 0) ? mergedRange : NSUnionRange(changedRange, mergedRange);
+
+         // a full page means the server may hold more since then
+         if (sinceTime && candles.count >= requestedCount && candles.count > 1) {
+             [self fetchNextPageWithChangedRange:totalRange];
+             return;
+         }
+
+         if (totalRange.length > 0) {
+             [self saveCache];
+         }
+
+         NSArray *successBlocks = _pendingSuccessBlocks;
+         [self finishUpdate];
+         for (void (^block)(NSRange) in successBlocks) {
+             block(totalRange);
+         }
+     } failure:^(NSDictionary *error) {
+         NSArray *failureBlocks = _pendingFailureBlocks;
+         [self finishUpdate];
+         for (void (^block)(NSDictionary *) in failureBlocks) {
+             block(error);
+         }
+     }];
+}
+
+- (void)loadCache
+{
+    NSError *error = nil;
+    if ([self readFromFile:_cachePath error:&error]) {
+        return;
+    }
+
+    BOOL missing = [error.domain isEqualToString:NSCocoaErrorDomain] && error.code == NSFileReadNoSuchFileError;
+    if (!missing) {
+        NSLog(@"%@: discarding candle cache %@: %@", [self class], _cachePath, error);
+        [[NSFileManager defaultManager] removeItemAtPath:_cachePath error:NULL];
+    }
+}
+
+// The records are copied here, on the caller's queue, and written out on a background queue shared by every store.
+- (void)saveCache
+{
+    if (!_cachePath) {
+        return;
+    }
+
+    static dispatch_queue_t sCacheWriteQueue;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sCacheWriteQueue = dispatch_queue_create("com.oanda.OTCandleStore.cache", DISPATCH_QUEUE_SERIAL);
+    });
+
+    NSData *data = [self fileData];
+    NSString *path = _cachePath;
+    dispatch_async(sCacheWriteQueue, ^{
+        NSError *error = nil;
+        [[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL];
+        if (![data writeToFile:path options:NSDataWritingAtomic error:&error]) {
+            NSLog(@"%@: could not save candle cache %@: %@", [self class], path, error);
+        }
+    });
+}
+
+- (NSData *)fileData
+{
+    size_t recordSize = OTCandleColumnCount * sizeof(int64_t);
+    NSMutableData *data = [NSMutableData dataWithLength:sizeof(OTCandleFileHeader) + _count * recordSize];
+
+    int64_t *body = (int64_t *)((char *)data.mutableBytes + sizeof(OTCandleFileHeader));
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        memcpy(body + column * _count, _columns[column], _count * sizeof(int64_t));
+    }
+
+    OTCandleFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kCandleFileMagic, sizeof(header.magic));
+    header.version = OTCandleStoreFileVersion;
+    header.recordSize = (uint32_t)recordSize;
+    OTCandleFileCopyName(header.symbol, sizeof(header.symbol), _symbol);
+    OTCandleFileCopyName(header.granularity, sizeof(header.granularity), _granularity);
+    header.count = _count;
+    header.lastCandleComplete = _lastCandleComplete ? 1 : 0;
+    header.checksum = OTCandleFileChecksum(body, _count * recordSize);
+    memcpy(data.mutableBytes, &header, sizeof(header));
+
+    return data;
+}
+
+- (void)finishUpdate
+{
+    _updating = NO;
+    _pendingSuccessBlocks = [NSMutableArray array];
+    _pendingFailureBlocks = [NSMutableArray array];
+}
+
+- (void)reserveCapacity:(NSUInteger)capacity
+{
+    if (capacity <= _capacity && _columns[0] && !_mappedData) {
+        return;
+    }
+
+    NSUInteger newCapacity = MAX(_capacity, 64);
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+
+    // the first change to columns read from a file: they move off the mapping, which cannot be written to
+    if (_mappedData) {
+        for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+            int64_t *copied = malloc(newCapacity * sizeof(int64_t));
+            NSAssert(copied, @"%@: out of memory for %lu candles", [self class], (unsigned long)newCapacity);
+            memcpy(copied, _columns[column], _count * sizeof(int64_t));
+            _columns[column] = copied;
+        }
+        _mappedData = nil;
+        _capacity = newCapacity;
+        return;
+    }
+
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        int64_t *grown = realloc(_columns[column], newCapacity * sizeof(int64_t));
+        NSAssert(grown, @"%@: out of memory for %lu candles", [self class], (unsigned long)newCapacity);
+        _columns[column] = grown;
+    }
+    _capacity = newCapacity;
+}
+
+// Frees the columns, or lets go of the file they were read from.
+- (void)freeColumns
+{
+    if (_mappedData) {
+        _mappedData = nil;
+    } else {
+        for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+            free(_columns[column]);
+        }
+    }
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        _columns[column] = NULL;
+    }
+    _capacity = 0;
+}
+
+- (BOOL)isCandleAtIndex:(NSUInteger)index equalToCandleAtIndex:(NSUInteger)otherIndex ofStore:(OTCandleStore *)other
+{
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        if (_columns[column][index] != other->_columns[column][otherIndex]) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (OTCandleStore *)storeWithRange:(NSRange)range
+{
+    OTCandleStore *store = [[OTCandleStore alloc] init];
+    [store reserveCapacity:range.length];
+    for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+        memcpy(store->_columns[column], _columns[column] + range.location, range.length * sizeof(int64_t));
+    }
+    store->_count = range.length;
+    store->_lastCandleComplete = (NSMaxRange(range) == _count) ? _lastCandleComplete : YES;
+
+    return store;
+}
+
+@end
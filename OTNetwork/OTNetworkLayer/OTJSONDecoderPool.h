@@ -0,0 +1,85 @@
+//
+//  OTJSONDecoderPool.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import "JSONKit.h"
+
+/** Lends warm JSONDecoders to the threads parsing responses, so successive parses reuse the object cache of JSONKit (keys, instrument
+ names and recurring values are then created once, not once per response) instead of allocating and throwing away a decoder each time.
+ 
+ A JSONDecoder must not be used by two threads at once, so each parse borrows an idle decoder for its duration, and a new one is made
+ only when every decoder is busy.  The most recently returned decoder is lent first: a steady stream of quotes parsed one at a time on
+ whichever thread the decodeQueue picks keeps reusing the same one, and the pool never holds more decoders than there were parses at once.
+ 
+ Thread safe.
+ */
+@interface OTJSONDecoderPool : NSObject
+
+/** Creates a pool of decoders created with the given options, eg. JKParseOptionNone.  This is the designated initializer. */
+- (id)initWithParseOptions:(JKParseOptionFlags)parseOptions;
+
+@property (nonatomic, readonly) JKParseOptionFlags parseOptions;
+
+/** Most decoders kept while idle; any returned beyond that are released.  Default: 4, as many as parses on the default decodeQueue at once. */
+@property (atomic, assign) NSUInteger maxIdleDecoders;
+
+// The cache geometry and statistics are an extension of the JSONKit in ThirdParty/JSONKit: built against the JSONKit pod, the pool goes without.
+#ifdef JK_CACHE_MAX_SLOTS_BITS
+/** Geometry of the object cache of the decoders created from now on (see setCacheSlotsBits:probes: in JSONKit.h).  Default: 0 for either,
+ meaning the JSONKit default.  Call removeIdleDecoders after changing them for the decoders already made to be replaced.
+ */
+@property (atomic, assign) NSUInteger cacheSlotsBits;
+@property (atomic, assign) NSUInteger cacheProbes;
+
+/** Returns the cache hits, misses and evictions of the idle decoders added up, eg. to check the cache geometry suits the responses parsed. */
+- (JKCacheStatistics)cacheStatistics;
+#endif
+
+/** Parses UTF8 encoded JSON with a decoder of the pool.
+ 
+ @param data **Required**.  The JSON.
+ @param error **Optional**.  Set to the JSONKit error if the JSON is malformed.
+ @return The immutable collection, or nil if the JSON is malformed.
+ */
+- (id)objectWithData:(NSData *)data error:(NSError **)error;
+
+/** Lends a decoder of the pool for the duration of a block, eg. for schema-directed decoding.
+ 
+ @param block **Required**.  Triggered right away, on this thread, with a decoder used by nobody else until it returns.
+ @return What the block returned.
+ */
+- (id)performWithDecoder:(id (^)(JSONDecoder *decoder))block;
+
+/** Releases the idle decoders and their caches, eg. on a memory warning.  Busy ones are kept until they are returned. */
+- (void)removeIdleDecoders;
+
+/** Decoders created since the pool was, and parses they were lent for. */
+@property (atomic, readonly) NSUInteger numDecodersCreated;
+@property (atomic, readonly) NSUInteger numDecodersLent;
+
+/** Decoders idle in the pool now. */
+@property (nonatomic, readonly) NSUInteger numIdleDecoders;
+
+@end
@@ -0,0 +1,141 @@
+//
+//  OTJSONDecoderPool.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTJSONDecoderPool.h"
+
+@interface OTJSONDecoderPool () {
+    NSMutableArray *_idleDecoders;      // most recently returned last; guarded by @synchronized(self)
+}
+@property (atomic, readwrite) NSUInteger numDecodersCreated;
+@property (atomic, readwrite) NSUInteger numDecodersLent;
+@end
+
+@implementation OTJSONDecoderPool
+
+- (id)init
+{
+    return [self initWithParseOptions:JKParseOptionNone];
+}
+
+- (id)initWithParseOptions:(JKParseOptionFlags)parseOptions
+{
+    self = [super init];
+    if (self) {
+        _parseOptions = parseOptions;
+        _maxIdleDecoders = 4;
+        _idleDecoders = [NSMutableArray array];
+    }
+
+    return self;
+}
+
+- (id)performWithDecoder:(id (^)(JSONDecoder *decoder))block
+{
+    NSParameterAssert(block);
+
+    JSONDecoder *decoder = nil;
+    @synchronized(self) {
+        decoder = [_idleDecoders lastObject];
+        if (decoder) {
+            [_idleDecoders removeLastObject];
+        }
+        self.numDecodersLent++;
+    }
+    if (!decoder) {
+        decoder = [[JSONDecoder alloc] initWithParseOptions:_parseOptions];
+#ifdef JK_CACHE_MAX_SLOTS_BITS
+        NSUInteger slotsBits = self.cacheSlotsBits, probes = self.cacheProbes;
+        if (slotsBits || probes) {
+            [decoder setCacheSlotsBits:(slotsBits ?: [decoder cacheSlotsBits]) probes:(probes ?: [decoder cacheProbes])];
+        }
+#endif
+        @synchronized(self) {
+            self.numDecodersCreated++;
+        }
+    }
+
+    id result = block(decoder);
+
+    @synchronized(self) {
+        if (_idleDecoders.count < self.maxIdleDecoders) {
+            [_idleDecoders addObject:decoder];
+        }
+    }
+
+    return result;
+}
+
+- (id)objectWithData:(NSData *)data error:(NSError **)error
+{
+    NSParameterAssert(data);
+
+    __block NSError *parseError = nil;
+    id object = [self performWithDecoder:^id (JSONDecoder *decoder) {
+        NSError *decoderError = nil;
+        id decodedObject = [decoder objectWithData:data error:&decoderError];
+        parseError = decoderError;
+        return decodedObject;
+    }];
+    if (error) {
+        *error = parseError;
+    }
+
+    return object;
+}
+
+- (void)removeIdleDecoders
+{
+    @synchronized(self) {
+        [_idleDecoders removeAllObjects];
+    }
+}
+
+#ifdef JK_CACHE_MAX_SLOTS_BITS
+- (JKCacheStatistics)cacheStatistics
+{
+    JKCacheStatistics total = { 0, 0, 0, 0, 0 };
+    @synchronized(self) {
+        for (JSONDecoder *decoder in _idleDecoders) {
+            JKCacheStatistics statistics = [decoder cacheStatistics];
+            total.hits += statistics.hits;
+            total.misses += statistics.misses;
+            total.evictions += statistics.evictions;
+            total.uncachedMisses += statistics.uncachedMisses;
+            total.slotsInUse += statistics.slotsInUse;
+        }
+    }
+
+    return total;
+}
+#endif
+
+- (NSUInteger)numIdleDecoders
+{
+    @synchronized(self) {
+        return _idleDecoders.count;
+    }
+}
+
+@end
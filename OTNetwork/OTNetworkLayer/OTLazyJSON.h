@@ -0,0 +1,77 @@
+//
+//  OTLazyJSON.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+extern NSString * const OTLazyJSONErrorDomain;
+
+enum {
+    OTLazyJSONErrorMalformed = 1,       // not JSON, or neither an object nor an array at the top
+    OTLazyJSONErrorTooLarge             // 4GB or more, beyond the 32-bit offsets of the index
+};
+
+/** A read-only view of a JSON response that only decodes the values which are read.
+ 
+ Creating the view makes a single pass over the bytes, checking they are well-formed JSON and recording where each value starts
+ and ends.  The bytes are not copied (the NSData is retained) and no object is created.  Objects and arrays are then handed over
+ as NSDictionary and NSArray subclasses, so objectForKey:, objectAtIndex:, subscripting, valueForKey:, fast enumeration and isEqual:
+ work as they do on the result of NSJSONSerialization.  A string, number, true, false or null is decoded the first time it is read,
+ and the same object is returned from then on.
+ 
+ Reading two or three fields of each element of a list of positions or orders thus creates two or three objects per element,
+ where a full parse creates one per field.  In exchange, the views keep the whole response in memory until the last of them is gone.
+ 
+ Views are immutable: copy returns the same view, and mutableCopy an NSMutableDictionary or NSMutableArray of the (still lazy) values.
+ They may be read from any thread.  Where an object has the same key more than once, count includes every member and objectForKey:
+ returns the first value.  An unpaired surrogate in a \u escape is decoded as U+FFFD.
+ */
+@interface OTLazyJSON : NSObject
+
+/** Returns a view of UTF8 encoded JSON.
+ 
+ @param data **Required**.  The JSON, whose top level must be an object or an array.  Retained rather than copied, unless mutable.
+ @param error **Optional**.  Set to an error of OTLazyJSONErrorDomain, whose description gives the offset of the problem, if the JSON is malformed.
+ @return An NSDictionary or NSArray, or nil if the JSON is malformed.
+ */
++ (id)objectWithData:(NSData *)data error:(NSError **)error;
+
+/** Indexes UTF8 encoded JSON, as objectWithData:error: does.  This is the designated initializer.
+ 
+ @return The document, or nil if the JSON is malformed.
+ */
+- (id)initWithData:(NSData *)data error:(NSError **)error;
+
+@property (nonatomic, readonly, strong) NSData *data;
+
+/** The view of the top-level object or array.  Views hold on to their document rather than the other way round, so a new one is made if the last one was released. */
+@property (nonatomic, readonly) id rootObject;
+
+/** Number of values (keys included) recorded by the index. */
+@property (nonatomic, readonly) NSUInteger numIndexedValues;
+
+/** Strings (keys included), numbers, true, false and null decoded so far through the views of the document. */
+@property (atomic, readonly) NSUInteger numDecodedValues;
+
+@end
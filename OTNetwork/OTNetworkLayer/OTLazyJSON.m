@@ -0,0 +1,773 @@
+//
+//  OTLazyJSON.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTLazyJSON.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+NSString * const OTLazyJSONErrorDomain = @"OTLazyJSONErrorDomain";
+
+typedef enum {
+    OTLazyJSONTypeObject = 0,
+    OTLazyJSONTypeArray,
+    OTLazyJSONTypeString,
+    OTLazyJSONTypeNumber,
+    OTLazyJSONTypeTrue,
+    OTLazyJSONTypeFalse,
+    OTLazyJSONTypeNull
+} OTLazyJSONType;
+
+#define OTLazyJSONFlagEscaped   0x01        // a string holding backslash escapes
+#define OTLazyJSONFlagInteger   0x02        // a number with neither fraction nor exponent
+
+// One value of the document, in the order they appear.  The members of an object alternate a key node and a value node.
+typedef struct {
+    uint32_t    offset;         // of the first byte: quote, digit, bracket...
+    uint32_t    length;         // up to and including the closing quote or bracket
+    uint32_t    next;           // index of the node following this one and everything inside it
+    uint32_t    count;          // members of an object, elements of an array
+    uint8_t     type;
+    uint8_t     flags;
+} OTLazyJSONNode;
+
+typedef struct {
+    const uint8_t   *bytes;
+    size_t          length;
+    size_t          pos;        // of the next byte to read, or of the problem once failed
+    const char      *problem;
+    OTLazyJSONNode  *nodes;
+    size_t          numNodes;
+    size_t          capacity;
+} OTLazyJSONScanner;
+
+#define OTLazyJSONIsBlank(c)    ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+#define OTLazyJSONIsDigit(c)    ((c) >= '0' && (c) <= '9')
+
+static int OTLazyJSONFail(OTLazyJSONScanner *scanner, const char *problem)
+{
+    scanner->problem = problem;
+    return 0;
+}
+
+static void OTLazyJSONSkipBlanks(OTLazyJSONScanner *scanner)
+{
+    while (scanner->pos < scanner->length && OTLazyJSONIsBlank(scanner->bytes[scanner->pos])) {
+        scanner->pos++;
+    }
+}
+
+static int OTLazyJSONAddNode(OTLazyJSONScanner *scanner, OTLazyJSONType type, uint8_t flags, size_t offset, size_t length)
+{
+    if (scanner->numNodes == scanner->capacity) {
+        size_t capacity = scanner->capacity ? scanner->capacity * 2 : 64;
+        OTLazyJSONNode *nodes = realloc(scanner->nodes, capacity * sizeof(OTLazyJSONNode));
+        if (!nodes || capacity > UINT32_MAX) {
+            free(nodes);
+            scanner->nodes = NULL;
+            return OTLazyJSONFail(scanner, "out of memory");
+        }
+        scanner->nodes = nodes;
+        scanner->capacity = capacity;
+    }
+    OTLazyJSONNode *node = &scanner->nodes[scanner->numNodes];
+    node->offset = (uint32_t)offset;
+    node->length = (uint32_t)length;
+    node->next = (uint32_t)(scanner->numNodes + 1);
+    node->count = 0;
+    node->type = type;
+    node->flags = flags;
+    scanner->numNodes++;
+    return 1;
+}
+
+// Length of the UTF8 sequence starting with the byte at p (0x80 or more), or 0 if it is not well-formed.
+static size_t OTLazyJSONSequenceLength(const uint8_t *p, const uint8_t *end)
+{
+    uint8_t min = 0x80, max = 0xBF;
+    size_t length;
+    if (p[0] >= 0xC2 && p[0] <= 0xDF) {
+        length = 2;
+    } else if (p[0] >= 0xE0 && p[0] <= 0xEF) {
+        length = 3;
+        if (p[0] == 0xE0) min = 0xA0;           // overlong
+        if (p[0] == 0xED) max = 0x9F;           // surrogates
+    } else if (p[0] >= 0xF0 && p[0] <= 0xF4) {
+        length = 4;
+        if (p[0] == 0xF0) min = 0x90;           // overlong
+        if (p[0] == 0xF4) max = 0x8F;           // beyond U+10FFFF
+    } else {
+        return 0;
+    }
+    if ((size_t)(end - p) < length || p[1] < min || p[1] > max) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; i++) {
+        if ((p[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+static int OTLazyJSONIsHex(uint8_t c)
+{
+    return OTLazyJSONIsDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+static int OTLazyJSONScanString(OTLazyJSONScanner *scanner)
+{
+    const uint8_t *bytes = scanner->bytes;
+    size_t start = scanner->pos, pos = start + 1, length = scanner->length;
+    uint8_t flags = 0;
+    
+    for (;;) {
+        // the bulk of a string is plain ASCII
+        while (pos < length && bytes[pos] >= 0x20 && bytes[pos] < 0x80 && bytes[pos] != '"' && bytes[pos] != '\\') {
+            pos++;
+        }
+        scanner->pos = pos;
+        if (pos >= length) {
+            return OTLazyJSONFail(scanner, "unterminated string");
+        }
+        uint8_t c = bytes[pos];
+        if (c == '"') {
+            break;
+        } else if (c == '\\') {
+            flags |= OTLazyJSONFlagEscaped;
+            uint8_t escaped = (pos + 1 < length) ? bytes[pos + 1] : 0;
+            if (escaped == 'u') {
+                if (pos + 6 > length || !OTLazyJSONIsHex(bytes[pos + 2]) || !OTLazyJSONIsHex(bytes[pos + 3]) ||
+                    !OTLazyJSONIsHex(bytes[pos + 4]) || !OTLazyJSONIsHex(bytes[pos + 5])) {
+                    return OTLazyJSONFail(scanner, "malformed \\u escape");
+                }
+                pos += 6;
+            } else if (escaped && strchr("\"\\/bfnrt", escaped)) {
+                pos += 2;
+            } else {
+                return OTLazyJSONFail(scanner, "malformed escape");
+            }
+        } else if (c < 0x20) {
+            return OTLazyJSONFail(scanner, "control character in string");
+        } else {
+            size_t sequenceLength = OTLazyJSONSequenceLength(bytes + pos, bytes + length);
+            if (!sequenceLength) {
+                return OTLazyJSONFail(scanner, "malformed UTF8");
+            }
+            pos += sequenceLength;
+        }
+    }
+    
+    scanner->pos = pos + 1;
+    return OTLazyJSONAddNode(scanner, OTLazyJSONTypeString, flags, start, scanner->pos - start);
+}
+
+static int OTLazyJSONScanNumber(OTLazyJSONScanner *scanner)
+{
+    const uint8_t *bytes = scanner->bytes;
+    size_t start = scanner->pos, pos = start, length = scanner->length;
+    uint8_t flags = OTLazyJSONFlagInteger;
+    
+    if (bytes[pos] == '-') {
+        pos++;
+    }
+    if (pos >= length || !OTLazyJSONIsDigit(bytes[pos])) {
+        scanner->pos = pos;
+        return OTLazyJSONFail(scanner, "malformed number");
+    }
+    if (bytes[pos] == '0') {
+        pos++;
+    } else {
+        while (pos < length && OTLazyJSONIsDigit(bytes[pos])) pos++;
+    }
+    if (pos < length && bytes[pos] == '.') {
+        flags = 0;
+        pos++;
+        if (pos >= length || !OTLazyJSONIsDigit(bytes[pos])) {
+            scanner->pos = pos;
+            return OTLazyJSONFail(scanner, "malformed number");
+        }
+        while (pos < length && OTLazyJSONIsDigit(bytes[pos])) pos++;
+    }
+    if (pos < length && (bytes[pos] | 0x20) == 'e') {
+        flags = 0;
+        pos++;
+        if (pos < length && (bytes[pos] == '+' || bytes[pos] == '-')) pos++;
+        if (pos >= length || !OTLazyJSONIsDigit(bytes[pos])) {
+            scanner->pos = pos;
+            return OTLazyJSONFail(scanner, "malformed number");
+        }
+        while (pos < length && OTLazyJSONIsDigit(bytes[pos])) pos++;
+    }
+    
+    scanner->pos = pos;
+    return OTLazyJSONAddNode(scanner, OTLazyJSONTypeNumber, flags, start, pos - start);
+}
+
+static int OTLazyJSONScanLiteral(OTLazyJSONScanner *scanner, const char *literal, OTLazyJSONType type)
+{
+    size_t literalLength = strlen(literal), start = scanner->pos;
+    if (scanner->length - start < literalLength || memcmp(scanner->bytes + start, literal, literalLength) != 0) {
+        return OTLazyJSONFail(scanner, "expected a value");
+    }
+    scanner->pos = start + literalLength;
+    return OTLazyJSONAddNode(scanner, type, 0, start, literalLength);
+}
+
+static void OTLazyJSONCloseContainer(OTLazyJSONScanner *scanner, size_t index)
+{
+    OTLazyJSONNode *node = &scanner->nodes[index];
+    node->length = (uint32_t)(scanner->pos - node->offset);
+    node->next = (uint32_t)scanner->numNodes;
+}
+
+// Records every value of the JSON in scanner->nodes, in one pass and without recursing, checking the JSON is well-formed.
+static int OTLazyJSONScanDocument(OTLazyJSONScanner *scanner)
+{
+    enum { OTLazyJSONExpectValue, OTLazyJSONExpectKey, OTLazyJSONAfterValue } state = OTLazyJSONExpectValue;
+    size_t *openNodes = NULL, depth = 0, maxDepth = 0;
+    const uint8_t *bytes = scanner->bytes;
+    int ok = 1;
+    
+    // a byte order mark is allowed, like NSJSONSerialization does
+    if (scanner->length >= 3 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0) {
+        scanner->pos = 3;
+    }
+    OTLazyJSONSkipBlanks(scanner);
+    if (scanner->pos >= scanner->length || (bytes[scanner->pos] != '{' && bytes[scanner->pos] != '[')) {
+        return OTLazyJSONFail(scanner, "expected an object or an array");
+    }
+    
+    while (ok) {
+        OTLazyJSONSkipBlanks(scanner);
+        
+        if (state == OTLazyJSONAfterValue) {
+            if (depth == 0) {
+                if (scanner->pos < scanner->length) {
+                    ok = OTLazyJSONFail(scanner, "unexpected data after the JSON");
+                }
+                break;
+            }
+            OTLazyJSONNode *container = &scanner->nodes[openNodes[depth - 1]];
+            BOOL isObject = (container->type == OTLazyJSONTypeObject);
+            container->count++;
+            if (scanner->pos >= scanner->length) {
+                ok = OTLazyJSONFail(scanner, "unexpected end of the JSON");
+            } else if (bytes[scanner->pos] == ',') {
+                scanner->pos++;
+                state = isObject ? OTLazyJSONExpectKey : OTLazyJSONExpectValue;
+            } else if (bytes[scanner->pos] == (isObject ? '}' : ']')) {
+                scanner->pos++;
+                OTLazyJSONCloseContainer(scanner, openNodes[--depth]);
+            } else {
+                ok = OTLazyJSONFail(scanner, isObject ? "expected , or }" : "expected , or ]");
+            }
+            continue;
+        }
+        
+        if (scanner->pos >= scanner->length) {
+            ok = OTLazyJSONFail(scanner, "unexpected end of the JSON");
+            continue;
+        }
+        uint8_t c = bytes[scanner->pos];
+        
+        if (state == OTLazyJSONExpectKey) {
+            if (c != '"') {
+                ok = OTLazyJSONFail(scanner, "expected a key");
+            } else if ((ok = OTLazyJSONScanString(scanner))) {
+                OTLazyJSONSkipBlanks(scanner);
+                if (scanner->pos < scanner->length && bytes[scanner->pos] == ':') {
+                    scanner->pos++;
+                    state = OTLazyJSONExpectValue;
+                } else {
+                    ok = OTLazyJSONFail(scanner, "expected :");
+                }
+            }
+            continue;
+        }
+        
+        state = OTLazyJSONAfterValue;
+        if (c == '{' || c == '[') {
+            size_t index = scanner->numNodes;
+            if (!(ok = OTLazyJSONAddNode(scanner, (c == '{') ? OTLazyJSONTypeObject : OTLazyJSONTypeArray, 0, scanner->pos, 0))) {
+                continue;
+            }
+            scanner->pos++;
+            OTLazyJSONSkipBlanks(scanner);
+            if (scanner->pos < scanner->length && bytes[scanner->pos] == ((c == '{') ? '}' : ']')) {
+                scanner->pos++;
+                OTLazyJSONCloseContainer(scanner, index);
+                continue;
+            }
+            if (depth == maxDepth) {
+                maxDepth = maxDepth ? maxDepth * 2 : 32;
+                size_t *grown = realloc(openNodes, maxDepth * sizeof(size_t));
+                if (!grown) {
+                    ok = OTLazyJSONFail(scanner, "out of memory");
+                    continue;
+                }
+                openNodes = grown;
+            }
+            openNodes[depth++] = index;
+            state = (c == '{') ? OTLazyJSONExpectKey : OTLazyJSONExpectValue;
+        } else if (c == '"') {
+            ok = OTLazyJSONScanString(scanner);
+        } else if (c == '-' || OTLazyJSONIsDigit(c)) {
+            ok = OTLazyJSONScanNumber(scanner);
+        } else if (c == 't') {
+            ok = OTLazyJSONScanLiteral(scanner, "true", OTLazyJSONTypeTrue);
+        } else if (c == 'f') {
+            ok = OTLazyJSONScanLiteral(scanner, "false", OTLazyJSONTypeFalse);
+        } else if (c == 'n') {
+            ok = OTLazyJSONScanLiteral(scanner, "null", OTLazyJSONTypeNull);
+        } else {
+            ok = OTLazyJSONFail(scanner, "expected a value");
+        }
+    }
+    
+    free(openNodes);
+    return ok;
+}
+
+static uint32_t OTLazyJSONHexValue(const uint8_t *p)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value = (value << 4) | (uint32_t)(OTLazyJSONIsDigit(p[i]) ? p[i] - '0' : (p[i] | 0x20) - 'a' + 10);
+    }
+    return value;
+}
+
+// Decodes the escapes of a string scanned by OTLazyJSONScanString into UTF8, returning its length, never more than the escaped one.
+static size_t OTLazyJSONUnescape(const uint8_t *p, size_t length, uint8_t *out)
+{
+    const uint8_t *end = p + length;
+    uint8_t *o = out;
+    
+    while (p < end) {
+        const uint8_t *backslash = memchr(p, '\\', (size_t)(end - p));
+        size_t run = (size_t)((backslash ? backslash : end) - p);
+        memcpy(o, p, run);
+        o += run;
+        p += run;
+        if (!backslash) {
+            break;
+        }
+        uint8_t escaped = p[1];
+        p += 2;
+        switch (escaped) {
+            case 'b': *o++ = '\b'; break;
+            case 'f': *o++ = '\f'; break;
+            case 'n': *o++ = '\n'; break;
+            case 'r': *o++ = '\r'; break;
+            case 't': *o++ = '\t'; break;
+            case 'u': {
+                uint32_t c = OTLazyJSONHexValue(p);
+                p += 4;
+                if (c >= 0xD800 && c <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    uint32_t low = OTLazyJSONHexValue(p + 2);
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                if (c >= 0xD800 && c <= 0xDFFF) {
+                    c = 0xFFFD;
+                }
+                if (c < 0x80) {
+                    *o++ = (uint8_t)c;
+                } else if (c < 0x800) {
+                    *o++ = (uint8_t)(0xC0 | (c >> 6));
+                    *o++ = (uint8_t)(0x80 | (c & 0x3F));
+                } else if (c < 0x10000) {
+                    *o++ = (uint8_t)(0xE0 | (c >> 12));
+                    *o++ = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+                    *o++ = (uint8_t)(0x80 | (c & 0x3F));
+                } else {
+                    *o++ = (uint8_t)(0xF0 | (c >> 18));
+                    *o++ = (uint8_t)(0x80 | ((c >> 12) & 0x3F));
+                    *o++ = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+                    *o++ = (uint8_t)(0x80 | (c & 0x3F));
+                }
+                break;
+            }
+            default: *o++ = escaped; break;     // " \ /
+        }
+    }
+    return (size_t)(o - out);
+}
+
+static NSString *OTLazyJSONCreateString(const uint8_t *bytes, const OTLazyJSONNode *node)
+{
+    const uint8_t *start = bytes + node->offset + 1;
+    size_t length = node->length - 2;
+    if (!(node->flags & OTLazyJSONFlagEscaped)) {
+        return [[NSString alloc] initWithBytes:start length:length encoding:NSUTF8StringEncoding];
+    }
+    
+    uint8_t stackBuffer[256];
+    uint8_t *buffer = (length <= sizeof(stackBuffer)) ? stackBuffer : malloc(length);
+    NSString *string = [[NSString alloc] initWithBytes:buffer length:OTLazyJSONUnescape(start, length, buffer) encoding:NSUTF8StringEncoding];
+    if (buffer != stackBuffer) {
+        free(buffer);
+    }
+    return string;
+}
+
+static NSNumber *OTLazyJSONCreateNumber(const uint8_t *bytes, const OTLazyJSONNode *node)
+{
+    char stackBuffer[64];
+    char *buffer = (node->length < sizeof(stackBuffer)) ? stackBuffer : malloc(node->length + 1);
+    memcpy(buffer, bytes + node->offset, node->length);
+    buffer[node->length] = '\0';
+    
+    // integers too large for a long long (or an unsigned one) end up as doubles, as with NSJSONSerialization
+    NSNumber *number = nil;
+    if (node->flags & OTLazyJSONFlagInteger) {
+        errno = 0;
+        long long value = strtoll(buffer, NULL, 10);
+        if (errno != ERANGE) {
+            number = [[NSNumber alloc] initWithLongLong:value];
+        } else if (buffer[0] != '-') {
+            errno = 0;
+            unsigned long long unsignedValue = strtoull(buffer, NULL, 10);
+            if (errno != ERANGE) {
+                number = [[NSNumber alloc] initWithUnsignedLongLong:unsignedValue];
+            }
+        }
+    }
+    if (!number) {
+        number = [[NSNumber alloc] initWithDouble:strtod(buffer, NULL)];
+    }
+    
+    if (buffer != stackBuffer) {
+        free(buffer);
+    }
+    return number;
+}
+
+@interface OTLazyJSON () {
+    OTLazyJSONNode *_nodes;
+    __weak id _rootObject;          // guarded by @synchronized(self)
+}
+@property (atomic, readwrite) NSUInteger numDecodedValues;
+
+// Returns the value of a node: a new view for an object or an array, a decoded object otherwise.  The caller holds @synchronized(self).
+- (id)objectAtNode:(uint32_t)index;
+
+- (const OTLazyJSONNode *)nodes;
+@end
+
+// The views hold on to their document and to the values read through them, never the other way round.
+// Both are guarded by @synchronized(_document), which also guards the counters of the document.
+@interface OTLazyJSONDictionary : NSDictionary {
+    OTLazyJSON *_document;
+    const OTLazyJSONNode *_nodes;
+    const uint8_t *_bytes;
+    uint32_t _node;
+    NSUInteger _count;
+    uint32_t *_keyNodes;            // the key node of each member, the value node following it
+    __strong id *_keys;
+    __strong id *_values;
+}
+- (id)initWithDocument:(OTLazyJSON *)document node:(uint32_t)node;
+@end
+
+@interface OTLazyJSONArray : NSArray {
+    OTLazyJSON *_document;
+    uint32_t _node;
+    NSUInteger _count;
+    uint32_t *_elementNodes;
+    __strong id *_values;
+}
+- (id)initWithDocument:(OTLazyJSON *)document node:(uint32_t)node;
+@end
+
+@implementation OTLazyJSON
+
++ (id)objectWithData:(NSData *)data error:(NSError **)error
+{
+    return [[[self alloc] initWithData:data error:error] rootObject];
+}
+
+- (id)initWithData:(NSData *)data error:(NSError **)error
+{
+    NSParameterAssert(data);
+    
+    self = [super init];
+    if (self) {
+        _data = [data copy];
+        
+        if (_data.length >= UINT32_MAX) {
+            if (error) {
+                *error = [NSError errorWithDomain:OTLazyJSONErrorDomain
+                                             code:OTLazyJSONErrorTooLarge
+                                         userInfo:@{ NSLocalizedDescriptionKey : @"JSON too large to be indexed" }];
+            }
+            return nil;
+        }
+        
+        OTLazyJSONScanner scanner = { .bytes = _data.bytes, .length = _data.length };
+        if (!OTLazyJSONScanDocument(&scanner)) {
+            free(scanner.nodes);
+            if (error) {
+                NSString *reason = [NSString stringWithFormat:@"Malformed JSON at offset %lu: %s", (unsigned long)scanner.pos, scanner.problem];
+                *error = [NSError errorWithDomain:OTLazyJSONErrorDomain
+                                             code:OTLazyJSONErrorMalformed
+                                         userInfo:@{ NSLocalizedDescriptionKey : reason }];
+            }
+            return nil;
+        }
+        
+        // give back what the doubling of the index overshot
+        _nodes = realloc(scanner.nodes, scanner.numNodes * sizeof(OTLazyJSONNode)) ?: scanner.nodes;
+        _numIndexedValues = scanner.numNodes;
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_nodes);
+}
+
+- (id)rootObject
+{
+    @synchronized(self) {
+        id rootObject = _rootObject;
+        if (!rootObject) {
+            rootObject = [self objectAtNode:0];
+            _rootObject = rootObject;
+        }
+        return rootObject;
+    }
+}
+
+- (const OTLazyJSONNode *)nodes
+{
+    return _nodes;
+}
+
+- (id)objectAtNode:(uint32_t)index
+{
+    const OTLazyJSONNode *node = &_nodes[index];
+    id object = nil;
+    
+    switch (node->type) {
+        case OTLazyJSONTypeObject:
+            return [[OTLazyJSONDictionary alloc] initWithDocument:self node:index];
+        case OTLazyJSONTypeArray:
+            return [[OTLazyJSONArray alloc] initWithDocument:self node:index];
+        case OTLazyJSONTypeString:
+            object = OTLazyJSONCreateString(_data.bytes, node);
+            break;
+        case OTLazyJSONTypeNumber:
+            object = OTLazyJSONCreateNumber(_data.bytes, node);
+            break;
+        case OTLazyJSONTypeTrue:
+            object = @YES;
+            break;
+        case OTLazyJSONTypeFalse:
+            object = @NO;
+            break;
+        default:
+            object = [NSNull null];
+            break;
+    }
+    self.numDecodedValues++;
+    
+    return object;
+}
+
+@end
+
+@implementation OTLazyJSONDictionary
+
+- (id)initWithDocument:(OTLazyJSON *)document node:(uint32_t)node
+{
+    self = [super init];
+    if (self) {
+        _document = document;
+        _nodes = [document nodes];
+        _bytes = document.data.bytes;
+        _node = node;
+        _count = _nodes[node].count;
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger i = 0; i < _count; i++) {
+        if (_keys) _keys[i] = nil;
+        if (_values) _values[i] = nil;
+    }
+    free(_keys);
+    free(_values);
+    free(_keyNodes);
+}
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+// The caller holds @synchronized(_document).
+- (void)loadKeyNodes
+{
+    if (!_keyNodes && _count) {
+        _keyNodes = malloc(_count * sizeof(uint32_t));
+        uint32_t child = _node + 1;
+        for (NSUInteger i = 0; i < _count; i++) {
+            _keyNodes[i] = child;
+            child = _nodes[child + 1].next;
+        }
+    }
+}
+
+// The caller holds @synchronized(_document).
+- (id)keyAtIndex:(NSUInteger)index
+{
+    if (!_keys) {
+        _keys = (__strong id *)calloc(_count, sizeof(id));
+    }
+    if (!_keys[index]) {
+        _keys[index] = [_document objectAtNode:_keyNodes[index]];
+    }
+    return _keys[index];
+}
+
+- (id)objectForKey:(id)key
+{
+    if (![key isKindOfClass:[NSString class]]) {
+        return nil;
+    }
+    const char *keyBytes = CFStringGetCStringPtr((__bridge CFStringRef)key, kCFStringEncodingUTF8) ?: [key UTF8String];
+    size_t keyLength = strlen(keyBytes);
+    
+    @synchronized(_document) {
+        [self loadKeyNodes];
+        for (NSUInteger i = 0; i < _count; i++) {
+            // keys are compared as they appear in the JSON, unless escaped
+            const OTLazyJSONNode *keyNode = &_nodes[_keyNodes[i]];
+            BOOL found;
+            if (keyNode->flags & OTLazyJSONFlagEscaped) {
+                found = [[self keyAtIndex:i] isEqualToString:key];
+            } else {
+                found = (keyNode->length - 2 == keyLength && memcmp(_bytes + keyNode->offset + 1, keyBytes, keyLength) == 0);
+            }
+            if (found) {
+                if (!_values) {
+                    _values = (__strong id *)calloc(_count, sizeof(id));
+                }
+                if (!_values[i]) {
+                    _values[i] = [_document objectAtNode:_keyNodes[i] + 1];
+                }
+                return _values[i];
+            }
+        }
+    }
+    return nil;
+}
+
+- (NSEnumerator *)keyEnumerator
+{
+    @synchronized(_document) {
+        [self loadKeyNodes];
+        for (NSUInteger i = 0; i < _count; i++) {
+            [self keyAtIndex:i];
+        }
+        return [[NSArray arrayWithObjects:_keys count:_count] objectEnumerator];
+    }
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+@end
+
+@implementation OTLazyJSONArray
+
+- (id)initWithDocument:(OTLazyJSON *)document node:(uint32_t)node
+{
+    self = [super init];
+    if (self) {
+        _document = document;
+        _node = node;
+        _count = [document nodes][node].count;
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger i = 0; _values && i < _count; i++) {
+        _values[i] = nil;
+    }
+    free(_values);
+    free(_elementNodes);
+}
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"%@: index %lu beyond bounds of %lu elements", [self class], (unsigned long)index, (unsigned long)_count];
+    }
+    
+    @synchronized(_document) {
+        if (!_values) {
+            // one walk over the siblings gives random access to every element
+            const OTLazyJSONNode *nodes = [_document nodes];
+            _elementNodes = malloc(_count * sizeof(uint32_t));
+            uint32_t child = _node + 1;
+            for (NSUInteger i = 0; i < _count; i++) {
+                _elementNodes[i] = child;
+                child = nodes[child].next;
+            }
+            _values = (__strong id *)calloc(_count, sizeof(id));
+        }
+        if (!_values[index]) {
+            _values[index] = [_document objectAtNode:_elementNodes[index]];
+        }
+        return _values[index];
+    }
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return self;
+}
+
+@end
@@ -26,6 +26,17 @@
 
 #import <Foundation/Foundation.h>
 #import "AFHTTPClient.h"
+#import "OTPriceTick.h"
+#import "OTPrice.h"
+#import "OTPriceStream.h"
+#import "OTCandleStore.h"
+#import "OTAccountSyncEngine.h"
+#import "OTPageCursor.h"
+#import "OTOrderTicket.h"
+#import "OTRequestScheduler.h"
+#import "OTRequestMetrics.h"
+#import "OTJSONDecoderPool.h"
+#import "OTLazyJSON.h"
 
 #define REST_API_VERSION @"v1"
 #define kSessionToken @"session_token"
@@ -33,6 +44,10 @@
 
 typedef void (^NetworkSuccessBlock)(NSDictionary *result);
 typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
+typedef void (^NetworkTicksSuccessBlock)(OTPriceTickList *ticks);
+typedef void (^NetworkCandlesSuccessBlock)(OTCandleStore *candles);
+typedef void (^NetworkBatchProgressBlock)(NSUInteger numberOfFinishedRequests, NSUInteger totalNumberOfRequests);
+typedef void (^NetworkBatchCompletionBlock)(NSArray *results, NSArray *errors);
 
 /** This class is a wrapper for low level REST API network calls, and is meant to provide a consistent means for higher networking layers to send and receive data.
   
@@ -72,10 +87,154 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
  For additional information on Objective-C blocks, please refer to
  http://developer.apple.com/library/ios/documentation/Cocoa/Conceptual/Blocks/
  
+ Response bodies are parsed on decodeQueue, never on the main thread, and the blocks are then triggered on callbackQueue (the main queue unless you say otherwise).
+ 
  Although it is not a singleton, we strongly discourage having multiple instances operating simultaneously, because their competition to access the same network would result in us not being able to guarantee an acceptable Quality of Service.
 */
 @interface OTNetworkController : NSObject
 
+/** Creates a controller talking to the OANDA sandbox (http://api-sandbox.oanda.com/v1/ and http://stream-sandbox.oanda.com/v1/). */
+- (id)init;
+
+/** Creates a controller talking to other servers, eg. a local test server.  This is the designated initializer.
+ 
+ @param serverUrl **Required**.  Base URL of the REST API, ending with a slash (eg. @"http://api-sandbox.oanda.com/v1/").
+ @param streamUrl **Required**.  Base URL of the streaming API used by priceStream, ending with a slash (eg. @"http://stream-sandbox.oanda.com/v1/").
+ */
+- (id)initWithServerUrl:(NSString *)serverUrl streamUrl:(NSString *)streamUrl;
+
+#pragma mark Configuring Response Delivery
+/** @name Configuring Response Delivery */
+
+/** The dispatch queue on which every response body is parsed before being handed to the caller.
+ 
+ Defaults to a private concurrent queue, so several large payloads (eg. candles, transactions) can be parsed at once without stalling the UI.  Replace it with a queue of your own to limit or share that work.  Must not be NULL.
+ */
+@property (nonatomic, assign) dispatch_queue_t decodeQueue;
+
+/** The dispatch queue on which the successBlock and failureBlock are triggered.
+ 
+ Defaults to NULL, meaning the main queue.  Set it to a background queue if the caller does further heavy processing of the result.
+ */
+@property (nonatomic, assign) dispatch_queue_t callbackQueue;
+
+/** The JSONDecoders responses are parsed with, when the library is built with USE_JSONKIT (otherwise NSJSONSerialization is used).
+ 
+ Reusing decoders keeps the object cache of JSONKit warm from one response to the next, so a steady stream of quotes or candles stops
+ creating the same keys and instrument names over and over.  Call removeIdleDecoders on it to give their memory back.
+ */
+@property (nonatomic, readonly, strong) OTJSONDecoderPool *decoderPool;
+
+/** Whether the lists of accounts, orders and positions are handed over as OTLazyJSON views of the response, rather than fully parsed.
+ 
+ Callers of these typically read two or three fields of each element: a view only indexes the response, and decodes the fields
+ that are read.  Unlike the full parse, the dictionaries and arrays of a view are immutable (mutableCopy them to edit), so callers
+ which edit these lists in place must be checked before turning it on.  Default: NO.
+ */
+@property (atomic, assign) BOOL decodesListsLazily;
+
+/** Whether the responses of history endpoints (candles, transactions, instruments) are written to a temporary file as they arrive, rather than kept in memory.
+ 
+ The body is then parsed from a memory-mapped view of the file, so a candle or transaction download of several megabytes never sits in
+ the heap: its pages are read in as the parse reaches them, and the system can drop them again under memory pressure.  The file is
+ deleted as soon as it is mapped.  Only the body is kept out of the heap: what the parse builds from it still grows with the download.
+ Costs a file per request, which only pays off for large downloads.  Default: NO.
+ */
+@property (atomic, assign) BOOL downloadsHistoryToFile;
+
+/** Whether the lists of transactions are parsed as they download, chunk by chunk, rather than once the whole body is in.
+
+ The parse then runs alongside the download, and the list is ready moments after its last byte arrives instead of a full parse later.
+ It takes the JSONStreamDecoder of the JSONKit in ThirdParty/JSONKit: built against the JSONKit pod, this has no effect.  Neither has it
+ with downloadsHistoryToFile, whose responses are parsed from the file.  Default: YES.
+ */
+@property (atomic, assign) BOOL parsesTransactionsWhileDownloading;
+
+/** Sets whether the calls of a class ask the server for a compressed (gzip or deflate) response, with the Accept-Encoding they send.
+
+ A compressed body is inflated by NSURLConnection as it arrives, and streamed on to the parse like any other.  It pays off for the large
+ JSON of account state and history; trading and quote responses are a few hundred bytes, and asking for them uncompressed
+ (Accept-Encoding: identity) saves the server and the device the work for no gain.  Default: YES for account and history calls, NO for
+ trading and quotes.  See the bytesOnWire and bytesDecoded of requestMetrics for what it saves.
+
+ @param acceptsCompression **Required**.  Whether to ask for a compressed response.
+ @param priority **Required**.  The class of calls, as used by the requestScheduler.
+ */
+- (void)setAcceptsCompression:(BOOL)acceptsCompression forPriority:(OTRequestPriority)priority;
+
+/** Returns whether the calls of a class ask for a compressed response.  See setAcceptsCompression:forPriority:. */
+- (BOOL)acceptsCompressionForPriority:(OTRequestPriority)priority;
+
+
+#pragma mark Coalescing Requests
+/** @name Coalescing Requests */
+
+/** Whether identical GET requests made while one is still on the network share it, rather than each being sent.
+ 
+ Requests are identical when their method, path and parameters (in any order) are.  Every caller gets its own successBlock or
+ failureBlock triggered, and callers of the same method share one parsed result: treat it as read-only.  Default: YES.
+ */
+@property (atomic, assign) BOOL coalescesRequests;
+
+/** Number of requests actually sent to the network. */
+@property (atomic, readonly) NSUInteger numRequestsSent;
+
+/** Number of requests answered by joining an identical one already on the network, ie. requests saved. */
+@property (atomic, readonly) NSUInteger numRequestsCoalesced;
+
+/** Sets numRequestsSent and numRequestsCoalesced back to 0. */
+- (void)resetRequestCounters;
+
+/** How long rateQuote:success:failure: holds on to a request, so that the calls made meanwhile are merged into it.
+ 
+ All the calls of one window are answered by a single request for the union of their symbols, and each successBlock gets a
+ response holding only the symbols its caller asked for.  This trades up to that much latency for far fewer requests when many
+ views each quote a few symbols at once.  Default: 0, meaning every call is sent right away.
+ */
+@property (atomic, assign) NSTimeInterval quoteBatchingWindow;
+
+
+#pragma mark Scheduling Requests
+/** @name Scheduling Requests */
+
+/** Decides when each call goes on the network: no more than its maxConcurrentRequests at once, the most urgent class of calls first
+ (trading, then account state, then quotes, then history), each class within the rate set by its token bucket, if any.
+ 
+ Configure it to stay under the rates the server accepts, and watch its statsForPriority: for queue depths and wait times.  The requests of
+ createOrdersForAccount:... and deleteOrdersForAccount:... batches are trading calls like any other, their own maxConcurrentRequests a further cap.
+ */
+@property (nonatomic, readonly, strong) OTRequestScheduler *requestScheduler;
+
+
+#pragma mark Measuring Requests
+/** @name Measuring Requests */
+
+/** Whether every call is timed, phase by phase (queueing, server, download, decode, dispatch), into requestMetrics.
+ 
+ When off, a call costs no more than checking this flag.  The requests of createOrdersForAccount:... and deleteOrdersForAccount:...
+ batches are timed one by one, each delivered with its progressBlock; those cancelled before being sent are left out.  Default: NO.
+ */
+@property (atomic, assign) BOOL collectsMetrics;
+
+/** Histograms of the time spent in each phase by the calls to each endpoint, while collectsMetrics is on.
+ 
+ Set its delegate to be told about every call as it completes, eg. to log the slow ones.
+ */
+@property (nonatomic, readonly, strong) OTRequestMetrics *requestMetrics;
+
+/** Returns what the calls to each endpoint have been through so far: OTEndpointMetrics keyed by endpoint, eg. @"GET prices". */
+- (NSDictionary *)metricsSnapshot;
+
+#pragma mark Streaming Prices
+/** @name Streaming Prices */
+
+/** Live prices pushed over a single long-lived connection, falling back to polling rateQuoteTicks:success:failure: when streaming is unavailable.
+ 
+ Prefer subscribing to this over calling rateQuote:success:failure: on a timer.  See OTPriceStream.
+ */
+@property (nonatomic, readonly, strong) OTPriceStream *priceStream;
+
+
 #pragma mark Accessing and Managing User Accounts
 /** @name Accessing and Managing User Accounts */
 
@@ -188,6 +347,14 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
 - (void)rateListSymbolsSuccess:(NetworkSuccessBlock)successBlock
                        failure:(NetworkFailBlock)failureBlock;
 
+/** Number of decimals prices of a symbol are sent with in orders and trades: one past its pip, eg. 5 for EUR_USD and 3 for USD_JPY.
+ 
+ Learnt from the pip of every instrument each time rateListSymbolsSuccess:failure: succeeds.  Until then, or for an unknown symbol, OTPriceDefaultDigits.
+ 
+ @param symbol **Optional**.  The symbol (eg. EUR_USD).
+ */
+- (unsigned int)priceDigitsForSymbol:(NSString *)symbol;
+
 /** To retrieve the current market rate for a set of symbols.
  
  @param symbolPairList **Required**.  An NSArray of NSStrings, representing the symbols to retrieve prices for.  An example of this list would look like this:
@@ -239,6 +406,29 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
           success:(NetworkSuccessBlock)successBlock
           failure:(NetworkFailBlock)failureBlock;
 
+/** To retrieve the current market rate for a set of symbols, as a compact array of fixed-point ticks.
+ 
+ Same request as rateQuote:success:failure:, but the response is scanned straight into an OTPriceTickList instead of a tree of NSDictionary/NSString/NSNumber.  Prefer this one when polling many symbols frequently.
+ 
+ @param symbolPairList **Required**.  An NSArray of NSStrings, representing the symbols to retrieve prices for.
+ @param successBlock **Required**.  An Objective-C block passed in, to be triggered upon a successful network call.  The block has an
+ argument of type **OTPriceTickList***.
+ @param failureBlock **Required**.  An Objective-C block passed in, to be triggered upon a failed network call.  The block has an
+ argument of type **NSError***.
+ @return The function itself returns nothing.  A successful operation would trigger instead the successBlock, passing back an OTPriceTickList* as argument, holding one OTPriceTick per symbol.  For example, the EUR_USD tick above would hold:
+     {
+         instrument = "EUR_USD";
+         bid = 1295640;              // 1.29564 * OTPriceTickScale
+         ask = 1295960;              // 1.29596 * OTPriceTickScale
+         time = 1354208555548539;    // microseconds since 1970
+     }
+ @return Similarly, any problem with the network would trigger the failureBlock, passing back an NSError.
+ @see rateQuote:success:failure:
+ */
+- (void)rateQuoteTicks:(NSArray *)symbolPairList
+               success:(NetworkTicksSuccessBlock)successBlock
+               failure:(NetworkFailBlock)failureBlock;
+
 /** To retrieve the historical pricing for a symbol (ie. candles).
  
  @param symbol **Required**.  Which symbol to retrieve prices for (eg. EUR/USD)
@@ -311,6 +501,28 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
                      success:(NetworkSuccessBlock)successBlock
                      failure:(NetworkFailBlock)failureBlock;
 
+/** To retrieve the historical pricing for a symbol as columns of fixed-point integers, optionally only from a given time onwards.
+ 
+ Same request as rateCandlesForSymbol:granularity:numberOfPoints:success:failure: (with midpoint candles), but the candles are handed back in an OTCandleStore instead of an array of NSDictionary.  Rather than calling this directly, keep an OTCandleStore per chart and let it fetch only what it is missing.
+ 
+ @param symbol **Required**.  Which symbol to retrieve prices for (eg. EUR_USD)
+ @param granularity **Required**.  Specifies the pricing interval to use (see rateCandlesForSymbol:granularity:numberOfPoints:success:failure:).
+ @param sinceTime **Optional**.  Time of the first candle to return, in microseconds since 1970.  The candle starting at that time is included.  If nil, the most recent candles are returned.
+ @param count **Optional**.  Specifies the maximum number of price points to return. Default is 500, max is 5000.
+ @param successBlock **Required**.  An Objective-C block passed in, to be triggered upon a successful network call.  The block has an
+ argument of type **OTCandleStore***, unbound to any network controller.
+ @param failureBlock **Required**.  An Objective-C block passed in, to be triggered upon a failed network call.  The block has an
+ argument of type **NSError***.
+ @return The function itself returns nothing.  A successful operation would trigger instead the successBlock.
+ @see OTCandleStore
+ */
+- (void)rateCandleColumnsForSymbol:(NSString *)symbol
+                       granularity:(NSString *)granularity
+                         sinceTime:(NSNumber *)sinceTime
+                    numberOfPoints:(NSNumber *)count
+                           success:(NetworkCandlesSuccessBlock)successBlock
+                           failure:(NetworkFailBlock)failureBlock;
+
 
 #pragma mark Getting Reports on Past and Current Activities
 /** @name Getting Reports on Past and Current Activities */
@@ -462,6 +674,39 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
                        success:(NetworkSuccessBlock)successBlock
                        failure:(NetworkFailBlock)failureBlock;
 
+/** To read through every transaction of the given account, one page at a time.
+ 
+ transactionListForAccountId:success:failure: only returns the most recent page.  The cursor follows the nextPage links to the older ones,
+ prefetching in the background while the caller works on the current page.
+ 
+ @param accountId **Required**.  Account Id to get transactions of (must be owned by the user).
+ @param count **Optional**.  Number of transactions per page.  Default is 50, max is 500.
+ @return A cursor, which fetches nothing until its first nextPageSuccess:failure:.
+ @see OTPageCursor
+ */
+- (OTPageCursor *)transactionCursorForAccountId:(NSNumber *)accountId
+                                       pageSize:(NSNumber *)count;
+
+/** To read through every open trade of the given account, one page at a time.
+ 
+ @param accountId **Required**.  Account Id to get trades of (must be owned by the user).
+ @param count **Optional**.  Number of trades per page.  Default is 50, max is 500.
+ @return A cursor, which fetches nothing until its first nextPageSuccess:failure:.
+ @see tradesListForAccountId:success:failure:
+ */
+- (OTPageCursor *)tradesCursorForAccountId:(NSNumber *)accountId
+                                  pageSize:(NSNumber *)count;
+
+/** To read through every open order of the given account, one page at a time.
+ 
+ @param accountId **Required**.  Account Id to get orders of (must be owned by the user).
+ @param count **Optional**.  Number of orders per page.  Default is 50, max is 500.
+ @return A cursor, which fetches nothing until its first nextPageSuccess:failure:.
+ @see ordersListForAccountId:success:failure:
+ */
+- (OTPageCursor *)ordersCursorForAccountId:(NSNumber *)accountId
+                                  pageSize:(NSNumber *)count;
+
 /** To retrieve the open price alerts for the given account.
  
  @param accountId **Required**.  Account Id to get price alerts of (must be owned by the user).
@@ -639,6 +884,28 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
                       success:(NetworkSuccessBlock)successBlock
                       failure:(NetworkFailBlock)failureBlock;
 
+/** To create many LimitOrders for the given account in one call, eg. a ladder of orders.
+ 
+ The orders are sent as one batch, no more than maxConcurrentRequests at a time, in the order given, each one a trading call of the
+ requestScheduler (so also within its maxConcurrentRequests and the token bucket of trading calls).  If the server turns down the
+ credentials (HTTP 401 or 403), the orders not sent yet are cancelled rather than sent to be turned down as well.
+ 
+ @param accountId **Required**. Account Id to create the orders for (must be owned by the user).
+ @param orders **Required**.  One NSDictionary per order, with the arguments of createOrderForAccount:symbol:units:side:type:price:expiry:minExecutionPrice:maxExecutionPrice:stopLoss:takeProfit:trailingStop:success:failure:
+ under the names of the API: instrument, units, side, type, price and expiry, and optionally lowLimit, highLimit, stopLoss, takeProfit and trailingStop.
+ @param maxConcurrentRequests **Optional**.  Most orders on the network at once.  0 for the default, 4.
+ @param progressBlock **Optional**.  Triggered each time an order is done, with how many are done out of how many.
+ @param completionBlock **Required**.  Triggered once every order is done, with two arrays in the order of orders: results holds the NSDictionary
+ returned for each order that was created and NSNull for the others, errors holds NSNull for each order created and the failure NSDictionary (as passed to
+ a NetworkFailBlock) for the others.  The "net error" of the orders cancelled after an authorization failure has the code NSURLErrorCancelled.
+ @see deleteOrdersForAccount:orderIds:maxConcurrentRequests:progress:completion:
+ */
+- (void)createOrdersForAccount:(NSNumber *)accountId
+                        orders:(NSArray *)orders
+         maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                      progress:(NetworkBatchProgressBlock)progressBlock
+                    completion:(NetworkBatchCompletionBlock)completionBlock;
+
 /** To modify an existing LimitOrder for the given account
  
  @param accountId **Required**. Account Id to create the order for (must be owned by the user).
@@ -760,6 +1027,23 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
                       success:(NetworkSuccessBlock)successBlock
                       failure:(NetworkFailBlock)failureBlock;
 
+/** To cancel many orders of the given account in one call, eg. all of them.
+ 
+ Works like createOrdersForAccount:orders:maxConcurrentRequests:progress:completion:, one DELETE per order.
+ 
+ @param accountId **Required**. Account Id to cancel the orders for (must be owned by the user).
+ @param orderIds **Required**.  NSNumber Ids of the orders to cancel (must belong to the account specified by accountId).
+ @param maxConcurrentRequests **Optional**.  Most requests on the network at once.  0 for the default, 4.
+ @param progressBlock **Optional**.  Triggered each time an order is done, with how many are done out of how many.
+ @param completionBlock **Required**.  Triggered once every order is done, with the results and errors of each, in the order of orderIds.
+ @see createOrdersForAccount:orders:maxConcurrentRequests:progress:completion:
+ */
+- (void)deleteOrdersForAccount:(NSNumber *)accountId
+                      orderIds:(NSArray *)orderIds
+         maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                      progress:(NetworkBatchProgressBlock)progressBlock
+                    completion:(NetworkBatchCompletionBlock)completionBlock;
+
 
 #pragma mark Creating and Managing MarketOrders Trades
 /** @name Creating and Managing MarketOrders Trades */
@@ -809,6 +1093,18 @@ typedef void (^NetworkFailBlock)(NSDictionary *error); //(NSDictionary *error);
                     success:(NetworkSuccessBlock)successBlock
                     failure:(NetworkFailBlock)failureBlock;
 
+/** To prepare a MarketOrder trade for the given account and symbol, to be fired later with the least possible latency.
+ 
+ The request is built ahead of time: firing the ticket only fills in the units, side and price.
+ 
+ @param accountId **Required**. Account Id to execute the trade as (must be owned by the user).
+ @param symbol **Required**.  Symbol to buy/sell (eg. EUR_USD).
+ @return A ticket to fire with fireWithUnits:side:price:success:failure: as many times as needed.
+ @see openTradeForAccount:symbol:units:type:price:minExecutionPrice:maxExecutionPrice:stopLoss:takeProfit:trailingStop:success:failure:
+ */
+- (OTOrderTicket *)orderTicketForAccount:(NSNumber *)accountId
+                                  symbol:(NSString *)symbol;
+
 /** To modify an existing MarketOrder trade for the user
  
  @param accountId **Required**. Account Id to which the trade belongs (must be owned by the user).
@@ -28,17 +28,339 @@
 //#import "AFJSONRequestOperation.h"
 #import "AFHTTPRequestOperation.h"
 #import "JSONKit.h"
+#import "OTPriceTick.h"
 
 // TODO: for now we keep all these properties as private, need to review overall design to decide which to expose, if any.
-@interface OTNetworkController ()
+@interface OTNetworkController () {
+    // declared by hand (rather than synthesized) so ARC retains them on SDKs where GCD objects are Objective-C objects
+    dispatch_queue_t _decodeQueue;
+    dispatch_queue_t _callbackQueue;
+    
+    // coalescing key -> NSMutableArray of OTRequestWaiter, for every GET request on the network; guarded by @synchronized
+    NSMutableDictionary *_inFlightRequests;
+    
+    // rateQuote: callers waiting for the current batching window to close; guarded by @synchronized(self)
+    OTQuoteBatch *_pendingQuoteBatch;
+    
+    // instrument -> NSNumber of decimals its prices are quoted with, learnt from rateListSymbolsSuccess:; guarded by @synchronized
+    NSMutableDictionary *_priceDigits;
+    
+    // whether the calls of each class ask for a compressed response; guarded by @synchronized(self)
+    BOOL _acceptsCompression[OTRequestPriorityCount];
+}
 
 @property (atomic, strong) AFHTTPClient *afc;
 @property (atomic, copy) NSString *userName;
 @property (atomic, copy) NSString *userAccountId;
 //@property (atomic, copy) NSString *userPassword;
 @property (nonatomic, copy) NSString *serverUrl;
+@property (nonatomic, copy) NSString *streamUrl;
+@property (atomic, readwrite) NSUInteger numRequestsSent;
+@property (atomic, readwrite) NSUInteger numRequestsCoalesced;
+@end
+
+// When a request reached each stage, and how much its response weighed, while collectsMetrics is on.  Each stamp is written by one stage
+// only, before handing over to the next; the transfer only by the NSURLConnection callbacks, before the response is handed over.
+@interface OTRequestTiming : NSObject {
+@public
+    OTRequestTimestamps timestamps;
+    OTRequestTransfer transfer;
+}
+@property (nonatomic, strong) NSURLRequest *request;
+@end
+
+@implementation OTRequestTiming
+@end
+
+// Stamps when NSURLConnection sends the request, gets the response headers and the last byte, and counts the bytes of the body as sent
+// and as decoded, for requests being timed (timing is not nil).
+@interface OTTimedRequestOperation : AFHTTPRequestOperation
+@property (nonatomic, strong) OTRequestTiming *timing;
+@end
+
+@implementation OTTimedRequestOperation
+
+- (NSURLRequest *)connection:(NSURLConnection *)connection willSendRequest:(NSURLRequest *)request redirectResponse:(NSURLResponse *)redirectResponse
+{
+    // a redirect is part of the time spent on the server
+    if (_timing && !redirectResponse) {
+        _timing->timestamps.sent = CFAbsoluteTimeGetCurrent();
+    }
+    
+    return [super connection:connection willSendRequest:request redirectResponse:redirectResponse];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    if (_timing) {
+        _timing->timestamps.responded = CFAbsoluteTimeGetCurrent();
+        // a redirect or a retry starts the body over
+        _timing->transfer = (OTRequestTransfer){ 0 };
+        if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+            NSDictionary *headers = [(NSHTTPURLResponse *)response allHeaderFields];
+            NSString *contentEncoding = [headers objectForKey:@"Content-Encoding"];
+            _timing->transfer.compressed = contentEncoding.length > 0 && ![contentEncoding isEqualToString:@"identity"];
+            // NSURLConnection inflates a compressed body before handing it over: only the header tells its size on the wire (and not when chunked)
+            NSString *contentLength = [headers objectForKey:@"Content-Length"];
+            if (_timing->transfer.compressed) {
+                _timing->transfer.wireBytes = contentLength ? [contentLength longLongValue] : -1;
+            }
+        }
+    }
+    [super connection:connection didReceiveResponse:response];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+    if (_timing) {
+        _timing->transfer.decodedBytes += data.length;
+        if (!_timing->transfer.compressed) {
+            _timing->transfer.wireBytes = _timing->transfer.decodedBytes;
+        }
+    }
+    [super connection:connection didReceiveData:data];
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+    if (_timing) {
+        _timing->timestamps.finished = CFAbsoluteTimeGetCurrent();
+    }
+    [super connectionDidFinishLoading:connection];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+    if (_timing) {
+        _timing->timestamps.finished = CFAbsoluteTimeGetCurrent();
+    }
+    [super connection:connection didFailWithError:error];
+}
+
+@end
+
+// Writes the body to a file as it arrives, rather than to memory, and hands it over as a view of the file mapped into memory: the
+// pages of the body are read in as the parse reaches them, and the system can drop them again, instead of the heap holding all of it.
+// The file is deleted once mapped (the mapping outlives it), or when the operation goes away without having been.
+@interface OTFileBackedRequestOperation : OTTimedRequestOperation {
+    NSData *_mappedData;            // guarded by @synchronized(self)
+}
+- (id)initWithRequest:(NSURLRequest *)urlRequest downloadPath:(NSString *)downloadPath;
+@property (nonatomic, readonly, copy) NSString *downloadPath;
+@end
+
+@implementation OTFileBackedRequestOperation
+
+- (id)initWithRequest:(NSURLRequest *)urlRequest downloadPath:(NSString *)downloadPath
+{
+    self = [super initWithRequest:urlRequest];
+    if (self) {
+        _downloadPath = [downloadPath copy];
+        self.outputStream = [NSOutputStream outputStreamToFileAtPath:_downloadPath append:NO];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSFileManager defaultManager] removeItemAtPath:_downloadPath error:NULL];
+}
+
+// What AFNetworking hands to the success and failure blocks, and what errorDictionaryForOperation:withError: reads the server's error from.
+- (NSData *)responseData
+{
+    @synchronized(self) {
+        if (!_mappedData && [self isFinished]) {
+            _mappedData = [NSData dataWithContentsOfFile:_downloadPath options:NSDataReadingMappedAlways error:NULL] ?: [NSData data];
+            [[NSFileManager defaultManager] removeItemAtPath:_downloadPath error:NULL];
+        }
+        return _mappedData;
+    }
+}
+
+@end
+
+// Parsing while downloading takes the JSONStreamDecoder of the JSONKit in ThirdParty/JSONKit: built against the JSONKit pod, bodies are
+// parsed once they are in, as before.
+#if defined(JK_STREAM_DECODER_AVAILABLE)
+
+// Builds the tree of objects of a document from the events of a JSONStreamDecoder, with mutable containers like the default parse.
+@interface OTJSONTreeBuilder : NSObject <JSONStreamDecoderDelegate> {
+    NSMutableArray *_containers;    // the open objects and arrays, innermost last
+    NSMutableArray *_keys;          // the key of the value to come, for each open object
+}
+@property (nonatomic, readonly, strong) id rootObject;
+@end
+
+@implementation OTJSONTreeBuilder
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _containers = [NSMutableArray array];
+        _keys = [NSMutableArray array];
+    }
+
+    return self;
+}
+
+- (void)addValue:(id)value
+{
+    id container = [_containers lastObject];
+    if (!container) {
+        _rootObject = value;
+    } else if ([container isKindOfClass:[NSMutableDictionary class]]) {
+        [container setObject:value forKey:[_keys lastObject]];
+        [_keys removeLastObject];
+    } else {
+        [container addObject:value];
+    }
+}
+
+- (void)startContainer:(id)container
+{
+    [self addValue:container];
+    [_containers addObject:container];
+}
+
+- (void)decoderDidStartObject:(JSONStreamDecoder *)decoder { [self startContainer:[NSMutableDictionary dictionary]]; }
+- (void)decoderDidStartArray:(JSONStreamDecoder *)decoder { [self startContainer:[NSMutableArray array]]; }
+- (void)decoderDidEndObject:(JSONStreamDecoder *)decoder { [_containers removeLastObject]; }
+- (void)decoderDidEndArray:(JSONStreamDecoder *)decoder { [_containers removeLastObject]; }
+- (void)decoder:(JSONStreamDecoder *)decoder foundKey:(NSString *)key { [_keys addObject:key]; }
+- (void)decoder:(JSONStreamDecoder *)decoder foundValue:(id)value { [self addValue:value]; }
+
+@end
+
+// Parses the body as it arrives, so the parse is over moments after the last byte rather than starting then.  The chunks are pushed on a
+// queue of the operation's own: NSURLConnection calls back on the one network thread of AFNetworking, which must not wait on a parse.
+// The body is still kept as usual, for the failure blocks and in case the parse fails.
+@interface OTStreamingRequestOperation : OTTimedRequestOperation {
+    dispatch_queue_t _parseQueue;
+    JSONStreamDecoder *_streamDecoder;      // used on the parseQueue only, like the ivars below
+    OTJSONTreeBuilder *_treeBuilder;
+    BOOL _parseFailed;
+}
+// The parsed body, once the operation is finished; nil if it was not valid JSON.  Waits for the chunks still being parsed.
+- (id)parsedObject;
+@end
+
+@implementation OTStreamingRequestOperation
+
+- (id)initWithRequest:(NSURLRequest *)urlRequest
+{
+    self = [super initWithRequest:urlRequest];
+    if (self) {
+        _parseQueue = dispatch_queue_create("com.oanda.OTNetworkController.parse", DISPATCH_QUEUE_SERIAL);
+        _treeBuilder = [[OTJSONTreeBuilder alloc] init];
+        _streamDecoder = [JSONStreamDecoder streamDecoderWithDelegate:_treeBuilder];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(_parseQueue);
+#endif
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    // a redirect or a retry starts the body over
+    dispatch_async(_parseQueue, ^{
+        _treeBuilder = [[OTJSONTreeBuilder alloc] init];
+        [_streamDecoder setDelegate:_treeBuilder];
+        [_streamDecoder reset];
+        _parseFailed = NO;
+    });
+    [super connection:connection didReceiveResponse:response];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+    [super connection:connection didReceiveData:data];
+
+    NSData *chunk = [data copy];
+    dispatch_async(_parseQueue, ^{
+        if (!_parseFailed) {
+            _parseFailed = ![_streamDecoder pushData:chunk error:NULL];
+        }
+    });
+}
+
+- (id)parsedObject
+{
+    __block id parsedObject = nil;
+    dispatch_sync(_parseQueue, ^{
+        if (!_parseFailed && ![_streamDecoder isFinished]) {
+            _parseFailed = ![_streamDecoder finishWithError:NULL];
+        }
+        parsedObject = _parseFailed ? nil : _treeBuilder.rootObject;
+    });
+
+    return parsedObject;
+}
+
 @end
 
+#endif
+
+// Turns a raw response body into the object handed to the successBlock, or an NSError to hand the failureBlock instead.  Always runs on
+// the decodeQueue.
+typedef id (^OTResponseDecodeBlock)(NSData *responseData);
+typedef void (^OTResponseResultBlock)(id result);
+
+// One caller waiting on a request, possibly sharing it with other callers.
+@interface OTRequestWaiter : NSObject
+@property (nonatomic, copy) OTResponseDecodeBlock decodeBlock;
+@property (nonatomic, copy) OTResponseResultBlock successBlock;
+@property (nonatomic, copy) NetworkFailBlock failureBlock;
+@end
+
+@implementation OTRequestWaiter
+@end
+
+// What a decode block returns for a body it cannot read, so the caller gets its failureBlock rather than a nil result.
+static NSError *OTMalformedResponseError(NSError *underlyingError)
+{
+    NSDictionary *userInfo = underlyingError ? [NSDictionary dictionaryWithObject:underlyingError forKey:NSUnderlyingErrorKey] : nil;
+    return [NSError errorWithDomain:NSCocoaErrorDomain code:NSPropertyListReadCorruptError userInfo:userInfo];
+}
+
+// rateQuote: callers collected during one quoteBatchingWindow, to be answered by a single request.
+@interface OTQuoteBatch : NSObject
+@property (nonatomic, strong) NSMutableOrderedSet *symbols;    // union of every caller's symbols, in the order first asked for
+@property (nonatomic, strong) NSMutableArray *symbolLists;      // each caller's own symbols
+@property (nonatomic, strong) NSMutableArray *successBlocks;
+@property (nonatomic, strong) NSMutableArray *failureBlocks;
+@end
+
+@implementation OTQuoteBatch
+@end
+
+// The requests of a createOrdersForAccount:... or deleteOrdersForAccount:... batch, and what has come of them so far; guarded by @synchronized.
+@interface OTRequestBatch : NSObject
+@property (nonatomic, copy) NSArray *requests;
+@property (nonatomic, strong) NSMutableArray *results;          // in the order of requests, NSNull until created
+@property (nonatomic, strong) NSMutableArray *errors;           // in the order of requests, NSNull unless failed
+@property (nonatomic, strong) NSMutableSet *operations;         // the operations on the network now
+@property (nonatomic, assign) NSUInteger numScheduled;          // requests handed to the requestScheduler, from the first
+@property (nonatomic, assign) NSUInteger numFinished;
+@property (nonatomic, assign) BOOL cancelled;                   // the server turned the credentials down: nothing more is sent
+@property (nonatomic, copy) NetworkBatchProgressBlock progressBlock;
+@property (nonatomic, copy) NetworkBatchCompletionBlock completionBlock;
+@end
+
+@implementation OTRequestBatch
+@end
+
+// how many requests of a batch are on the network at once when the caller does not say
+#define kDefaultMaxConcurrentBatchRequests 4
+
 static NSDateFormatter *sRFC3339DateFormatter;
 
 @implementation OTNetworkController
@@ -48,17 +370,139 @@ static NSDateFormatter *sRFC3339DateFormatter;
 
 - (id)init
 {
+    return [self initWithServerUrl:@"http://api-sandbox.oanda.com/v1/" streamUrl:@"http://stream-sandbox.oanda.com/v1/"];
+}
+
+- (id)initWithServerUrl:(NSString *)serverUrl streamUrl:(NSString *)streamUrl
+{
+    NSParameterAssert(serverUrl);
+    NSParameterAssert(streamUrl);
+    
     self = [super init];
     if (self) {
-        _serverUrl = @"http://api-sandbox.oanda.com/v1/";
+        _serverUrl = [serverUrl copy];
+        _streamUrl = [streamUrl copy];
         
         NSURL *url = [NSURL URLWithString:_serverUrl];
         _afc = [AFHTTPClient clientWithBaseURL:url];
+        
+        // responses are parsed off the main thread, then handed back on the main queue by default
+        _decodeQueue = dispatch_queue_create("com.oanda.OTNetworkController.decode", DISPATCH_QUEUE_CONCURRENT);
+        
+        _coalescesRequests = YES;
+        _inFlightRequests = [NSMutableDictionary dictionary];
+        _priceDigits = [NSMutableDictionary dictionary];
+        _requestScheduler = [[OTRequestScheduler alloc] init];
+        _requestMetrics = [[OTRequestMetrics alloc] init];
+        _decoderPool = [[OTJSONDecoderPool alloc] initWithParseOptions:JKParseOptionNone];
+        _decodesListsLazily = NO;
+        _parsesTransactionsWhileDownloading = YES;
+        _acceptsCompression[OTRequestPriorityAccount] = YES;
+        _acceptsCompression[OTRequestPriorityHistory] = YES;
     }
     
     return self;
 }
 
+- (void)dealloc
+{
+#if !OS_OBJECT_USE_OBJC
+    if (_decodeQueue) {
+        dispatch_release(_decodeQueue);
+    }
+    if (_callbackQueue) {
+        dispatch_release(_callbackQueue);
+    }
+#endif
+}
+
+#pragma mark Configuring Response Delivery
+
+- (dispatch_queue_t)decodeQueue
+{
+    return _decodeQueue;
+}
+
+- (void)setDecodeQueue:(dispatch_queue_t)decodeQueue
+{
+    NSParameterAssert(decodeQueue);
+    
+    if (decodeQueue != _decodeQueue) {
+#if !OS_OBJECT_USE_OBJC
+        dispatch_retain(decodeQueue);
+        dispatch_release(_decodeQueue);
+#endif
+        _decodeQueue = decodeQueue;
+    }
+}
+
+- (dispatch_queue_t)callbackQueue
+{
+    return _callbackQueue;
+}
+
+- (void)setCallbackQueue:(dispatch_queue_t)callbackQueue
+{
+    if (callbackQueue != _callbackQueue) {
+#if !OS_OBJECT_USE_OBJC
+        if (callbackQueue) {
+            dispatch_retain(callbackQueue);
+        }
+        if (_callbackQueue) {
+            dispatch_release(_callbackQueue);
+        }
+#endif
+        _callbackQueue = callbackQueue;
+    }
+}
+
+- (void)setAcceptsCompression:(BOOL)acceptsCompression forPriority:(OTRequestPriority)priority
+{
+    NSAssert(priority < OTRequestPriorityCount, @"Unknown request priority %d", priority);
+    
+    @synchronized(self) {
+        _acceptsCompression[priority] = acceptsCompression;
+    }
+}
+
+- (BOOL)acceptsCompressionForPriority:(OTRequestPriority)priority
+{
+    NSAssert(priority < OTRequestPriorityCount, @"Unknown request priority %d", priority);
+    
+    @synchronized(self) {
+        return _acceptsCompression[priority];
+    }
+}
+
+#pragma mark Coalescing Requests
+
+- (void)resetRequestCounters
+{
+    self.numRequestsSent = 0;
+    self.numRequestsCoalesced = 0;
+}
+
+#pragma mark Measuring Requests
+
+- (NSDictionary *)metricsSnapshot
+{
+    return [_requestMetrics snapshot];
+}
+
+#pragma mark Streaming Prices
+
+@synthesize priceStream = _priceStream;
+
+- (OTPriceStream *)priceStream
+{
+    @synchronized(self) {
+        if (!_priceStream) {
+            _priceStream = [[OTPriceStream alloc] initWithNetworkController:self streamUrl:_streamUrl];
+        }
+        return _priceStream;
+    }
+}
+
 #pragma mark Accessing and Managing User Accounts
 
 - (void)accountListForUsername:(NSString *)username
@@ -72,26 +516,7 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
     
     NSString *pathString = [@"users" stringByAppendingFormat:@"/%@/accounts", _userName];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and extract the list from the JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSArray* jsonArray = [decoder objectWithData:responseObject];
-        NSAssert1(jsonArray, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSArray *jsonArray = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonArray, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        NSDictionary *jsonDict = [NSDictionary dictionaryWithObject:jsonArray forKey:@"array"];
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:[self accountListDecodeBlock] success:successBlock failure:failureBlock];
 }
 
 - (void)accountStatusForAccountId:(NSNumber *)accountId
@@ -102,25 +527,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and return the whole response, which represents the whole status info
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // parse and return the whole response, which represents the whole status info
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 #pragma mark Quoting Tradable Instruments
@@ -130,67 +538,91 @@ static NSDateFormatter *sRFC3339DateFormatter;
     NSMutableDictionary *parameters;
     parameters = [self setupDefaultParams];
     
-    [_afc getPath:@"instruments" parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
+    // extract the list of all symbol pairs available for trading, noting the precision of each for the prices sent with orders
+    [self requestWithMethod:@"GET" path:@"instruments" parameters:parameters decode:^id(NSData *responseData) {
         
-        // extract the list of all symbol pairs available for trading
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
+        NSDictionary *jsonDict = [self JSONObjectWithData:responseData];
+        NSArray *instruments = [jsonDict objectForKey:@"instruments"];
+        if ([instruments isKindOfClass:[NSArray class]]) {
+            @synchronized(_priceDigits) {
+                for (NSDictionary *instrument in instruments) {
+                    unsigned int digits = OTPriceDigitsForPip([instrument objectForKey:@"pip"]);
+                    NSString *symbol = [instrument objectForKey:@"instrument"];
+                    if (digits && symbol) {
+                        [_priceDigits setObject:[NSNumber numberWithUnsignedInt:digits] forKey:symbol];
+                    }
+                }
+            }
+        }
+        return jsonDict;
         
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    } success:successBlock failure:failureBlock];
+}
+
+- (unsigned int)priceDigitsForSymbol:(NSString *)symbol
+{
+    NSNumber *digits = nil;
+    if (symbol) {
+        @synchronized(_priceDigits) {
+            digits = [_priceDigits objectForKey:symbol];
+        }
+    }
+    
+    return digits ? [digits unsignedIntValue] : OTPriceDefaultDigits;
 }
 
 - (void)rateQuote:(NSArray *)symbolPairList
           success:(NetworkSuccessBlock)successBlock
           failure:(NetworkFailBlock)failureBlock
+{
+    NSTimeInterval batchingWindow = self.quoteBatchingWindow;
+    if (batchingWindow <= 0) {
+        NSMutableDictionary *parameters;
+        parameters = [self setupDefaultParams];
+        [parameters setObject:[self instrumentsParameterForSymbols:symbolPairList] forKey:@"instruments"];
+        
+        // extract the list of prices, then pass it up the chain
+        [self requestWithMethod:@"GET" path:@"prices" parameters:parameters decode:nil success:successBlock failure:failureBlock];
+        return;
+    }
+    
+    // join the batch of this window, opening one if need be; the first caller of a window schedules its request
+    @synchronized(self) {
+        OTQuoteBatch *batch = _pendingQuoteBatch;
+        if (!batch) {
+            batch = [[OTQuoteBatch alloc] init];
+            batch.symbols = [NSMutableOrderedSet orderedSet];
+            batch.symbolLists = [NSMutableArray array];
+            batch.successBlocks = [NSMutableArray array];
+            batch.failureBlocks = [NSMutableArray array];
+            _pendingQuoteBatch = batch;
+            
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(batchingWindow * NSEC_PER_SEC)), _decodeQueue, ^{
+                [self sendQuoteBatch:batch];
+            });
+        }
+        
+        [batch.symbols addObjectsFromArray:symbolPairList];
+        [batch.symbolLists addObject:[symbolPairList copy]];
+        [batch.successBlocks addObject:[successBlock copy]];
+        [batch.failureBlocks addObject:failureBlock ? [failureBlock copy] : (id)[NSNull null]];
+    }
+}
+
+- (void)rateQuoteTicks:(NSArray *)symbolPairList
+               success:(NetworkTicksSuccessBlock)successBlock
+               failure:(NetworkFailBlock)failureBlock
 {
     NSMutableDictionary *parameters;
     parameters = [self setupDefaultParams];
+    [parameters setObject:[self instrumentsParameterForSymbols:symbolPairList] forKey:@"instruments"];
     
-    // extract from passed-in strings, construct the list of symbol lists as a single string
-    NSString *symbolsString = @"";
-    
-    for (NSString *symbol in symbolPairList)
-    {
-        symbolsString = [symbolsString stringByAppendingString:symbol];
-        symbolsString = [symbolsString stringByAppendingString:@","];
-    }
-    symbolsString = [symbolsString substringToIndex:[symbolsString length] - 1];
-    //symbolsString = [symbolsString stringByAppendingString:@"EUR_GBP"];
-    [parameters setObject:symbolsString forKey:@"instruments"];
-
-    [_afc getPath:@"prices"
-        parameters:parameters
-           success:^(AFHTTPRequestOperation *operation, id responseObject)
-     {
-         // extract the list of prices, then pass it up the chain
-#if defined(USE_JSONKIT)
-         JSONDecoder* decoder = [[JSONDecoder alloc]
-                                 initWithParseOptions:JKParseOptionNone];
-         NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-         NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-         NSError *error = nil;
-         NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-         NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-         
-         successBlock(jsonDict);
-         
-     } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-         [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-     }];
+    [self requestWithMethod:@"GET" path:@"prices" parameters:parameters decode:^id(NSData *responseData) {
+        
+        // scan the prices straight out of the body, skipping the dictionary tree altogether
+        return [OTPriceTickList tickListWithPricesData:responseData] ?: OTMalformedResponseError(nil);
+        
+    } success:successBlock failure:failureBlock];
 }
 
 - (void)rateCandlesForSymbol:(NSString *)symbol
@@ -210,25 +642,45 @@ static NSDateFormatter *sRFC3339DateFormatter;
     }
     
     NSString *pathString = [NSString stringWithFormat:@"candles?instrument=%@", symbol];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
+}
+
+- (void)rateCandleColumnsForSymbol:(NSString *)symbol
+                       granularity:(NSString *)granularity
+                         sinceTime:(NSNumber *)sinceTime
+                    numberOfPoints:(NSNumber *)count
+                           success:(NetworkCandlesSuccessBlock)successBlock
+                           failure:(NetworkFailBlock)failureBlock
+{
+    NSMutableDictionary *parameters;
+    parameters = [self setupDefaultParams];
+    [parameters setObject:granularity forKey:@"granularity"];
+    [parameters setObject:@"midpoint" forKey:@"candleFormat"];
+    
+    if (count)
+    {
+        [parameters setObject:[count stringValue] forKey:@"count"];
+    }
+    
+    if (sinceTime)
+    {
+        // the server takes seconds; the candle starting exactly then is wanted too, as it may have been forming
+        long long microseconds = [sinceTime longLongValue];
+        [parameters setObject:[NSString stringWithFormat:@"%lld.%06lld", microseconds / OTPriceTickScale, microseconds % OTPriceTickScale] forKey:@"start"];
+        [parameters setObject:@"true" forKey:@"includeFirst"];
+    }
+    
+    NSString *pathString = [NSString stringWithFormat:@"candles?instrument=%@", symbol];
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:^id(NSData *responseData) {
         
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
         NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
+        NSDictionary *jsonDict = [self JSONObjectWithData:responseData error:&error];
+        NSArray *candleList = [jsonDict isKindOfClass:[NSDictionary class]] ? [jsonDict objectForKey:@"candles"] : nil;
+        OTCandleStore *candles = [candleList isKindOfClass:[NSArray class]] ? [OTCandleStore candleStoreWithCandles:candleList] : nil;
+        return candles ?: OTMalformedResponseError(error);
         
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    } success:successBlock failure:failureBlock];
 }
 
 #pragma mark Getting Reports on Past and Current Activities
@@ -240,25 +692,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
 	
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/transactions", [accountId stringValue]];    
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and extract the list from the JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // parse and extract the list from the JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 - (void)tradesListForAccountId:(NSNumber *)accountId
@@ -269,25 +704,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/trades", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and extract the list from the JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary *jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // parse and extract the list from the JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 - (void)ordersListForAccountId:(NSNumber *)accountId
@@ -298,25 +716,29 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and extract the list from the JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary *jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // parse and extract the list from the JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:[self listDecodeBlock] success:successBlock failure:failureBlock];
+}
+
+- (OTPageCursor *)transactionCursorForAccountId:(NSNumber *)accountId
+                                       pageSize:(NSNumber *)count
+{
+    NSString *pathString = [NSString stringWithFormat:@"accounts/%@/transactions", [accountId stringValue]];
+    return [self pageCursorForPath:pathString listKey:@"transactions" pageSize:count];
+}
+
+- (OTPageCursor *)tradesCursorForAccountId:(NSNumber *)accountId
+                                  pageSize:(NSNumber *)count
+{
+    NSString *pathString = [NSString stringWithFormat:@"accounts/%@/trades", [accountId stringValue]];
+    return [self pageCursorForPath:pathString listKey:@"trades" pageSize:count];
+}
+
+- (OTPageCursor *)ordersCursorForAccountId:(NSNumber *)accountId
+                                  pageSize:(NSNumber *)count
+{
+    NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders", [accountId stringValue]];
+    return [self pageCursorForPath:pathString listKey:@"orders" pageSize:count];
 }
 
 - (void)priceAlertsListForAccountId:(NSNumber *)accountId
@@ -327,25 +749,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
 
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/alerts", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and extract the list from the JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary *jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // parse and extract the list from the JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 - (void)positionsListForAccountId:(NSNumber *)accountId
@@ -357,25 +762,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
 	[parameters setObject:[accountId stringValue] forKey:@"account_id"];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/positions", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and extract the list from the JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary *jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // parse and extract the list from the JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:[self listDecodeBlock] success:successBlock failure:failureBlock];
 }
 
 - (void)rateLimitsListSuccess:(NetworkSuccessBlock)successBlock
@@ -387,25 +775,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/limits", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // parse and extract the list from the JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary *jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-     } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-     }];
+    // parse and extract the list from the JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
     */
 }
 
@@ -427,25 +798,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
         [parameters setObject:[price description] forKey:@"price"];
 	}
     
-    [_afc postPath:@"position/close.json" parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"POST" path:@"position/close.json" parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 #pragma mark Creating and Managing LimitOrders
@@ -464,59 +818,40 @@ static NSDateFormatter *sRFC3339DateFormatter;
                       success:(NetworkSuccessBlock)successBlock
                       failure:(NetworkFailBlock)failureBlock
 {
-    NSMutableDictionary *parameters;
-    parameters = [self setupDefaultParams];
-    
-    // set the mandatory params
-	[parameters setObject:symbol forKey:@"instrument"];
-    [parameters setObject:[units stringValue] forKey:@"units"];
-    [parameters setObject:[NSString stringWithFormat:@"%.5f", [price floatValue]] forKey:@"price"];
-	[parameters setObject:side forKey:@"side"];
-	[parameters setObject:type forKey:@"type"];
-
-    NSString *expiryTimeTemp = [NSString stringWithFormat:@"%ld", (long)[[NSDate date] timeIntervalSince1970] + [expiryInSeconds intValue]];
-    NSString *expiryTime = [self dateFromRFC3339Date:expiryTimeTemp];
-
-    [parameters setObject:expiryTime forKey:@"expiry"];
-    
-    // set the optional params
-	if (lowPrice) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [lowPrice floatValue]] forKey:@"lowLimit"];
-	}
-	if (highPrice) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [highPrice floatValue]] forKey:@"highLimit"];
-	}
-	if (stopLoss) {
-		[parameters setObject:[NSString stringWithFormat:@"%.5f", [stopLoss floatValue]] forKey:@"stopLoss"];
-	}
-	if (takeProfit) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [takeProfit floatValue]] forKey:@"takeProfit"];
-	}
-	if (trailingStop) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [trailingStop floatValue]] forKey:@"trailingStop"];
-	}
+    NSMutableDictionary *parameters = [self orderParametersForSymbol:symbol units:units side:side type:type price:price expiry:expiryInSeconds
+                                                   minExecutionPrice:lowPrice maxExecutionPrice:highPrice stopLoss:stopLoss takeProfit:takeProfit trailingStop:trailingStop];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders", [accountId stringValue]];
     _afc.parameterEncoding = AFFormURLParameterEncoding;
-    [_afc postPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"POST" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
+}
+
+- (void)createOrdersForAccount:(NSNumber *)accountId
+                        orders:(NSArray *)orders
+         maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                      progress:(NetworkBatchProgressBlock)progressBlock
+                    completion:(NetworkBatchCompletionBlock)completionBlock
+{
+    NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders", [accountId stringValue]];
+    NSMutableArray *requests = [NSMutableArray arrayWithCapacity:orders.count];
+    
+    for (NSDictionary *order in orders) {
+        NSMutableDictionary *parameters = [self orderParametersForSymbol:[order objectForKey:@"instrument"]
+                                                                   units:[order objectForKey:@"units"]
+                                                                    side:[order objectForKey:@"side"]
+                                                                    type:[order objectForKey:@"type"]
+                                                                   price:[order objectForKey:@"price"]
+                                                                  expiry:[order objectForKey:@"expiry"]
+                                                       minExecutionPrice:[order objectForKey:@"lowLimit"]
+                                                       maxExecutionPrice:[order objectForKey:@"highLimit"]
+                                                                stopLoss:[order objectForKey:@"stopLoss"]
+                                                              takeProfit:[order objectForKey:@"takeProfit"]
+                                                            trailingStop:[order objectForKey:@"trailingStop"]];
+        [requests addObject:[self requestWithMethod:@"POST" path:pathString parameters:parameters priority:OTRequestPriorityTrading]];
+    }
+    
+    [self enqueueBatchOfRequests:requests maxConcurrentRequests:maxConcurrentRequests progress:progressBlock completion:completionBlock];
 }
 
 - (void)changeOrderForAccount:(NSNumber *)accountId
@@ -540,7 +875,7 @@ static NSDateFormatter *sRFC3339DateFormatter;
     // set the mandatory params
 	[parameters setObject:symbol forKey:@"instrument"];
     [parameters setObject:[units stringValue] forKey:@"units"];
-    [parameters setObject:[NSString stringWithFormat:@"%.5f", [price floatValue]] forKey:@"price"];
+    [parameters setObject:[self priceParameter:price symbol:symbol] forKey:@"price"];
 	[parameters setObject:type forKey:@"side"];
         
     NSString *expiryTimeTemp = [NSString stringWithFormat:@"%ld", (long)[[NSDate date] timeIntervalSince1970] + [expiryInSeconds intValue]];
@@ -550,30 +885,28 @@ static NSDateFormatter *sRFC3339DateFormatter;
     
     // set the optional params
 	if (lowPrice) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [lowPrice floatValue]] forKey:@"lowLimit"];
+        [parameters setObject:[self priceParameter:lowPrice symbol:symbol] forKey:@"lowLimit"];
 	}
 	if (highPrice) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [highPrice floatValue]] forKey:@"highLimit"];
+        [parameters setObject:[self priceParameter:highPrice symbol:symbol] forKey:@"highLimit"];
 	}
 	if (stopLoss) {
-		[parameters setObject:[NSString stringWithFormat:@"%.5f", [stopLoss floatValue]] forKey:@"stopLoss"];
+		[parameters setObject:[self priceParameter:stopLoss symbol:symbol] forKey:@"stopLoss"];
 	}
 	if (takeProfit) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [takeProfit floatValue]] forKey:@"takeProfit"];
+        [parameters setObject:[self priceParameter:takeProfit symbol:symbol] forKey:@"takeProfit"];
 	}
 	if (trailingStop) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [trailingStop floatValue]] forKey:@"trailingStop"];
+        [parameters setObject:[self priceParameter:trailingStop symbol:symbol] forKey:@"trailingStop"];
 	}
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders/%@", [accountId stringValue], [orderId stringValue]];
-    [_afc patchPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
+    [self requestWithMethod:@"PATCH" path:pathString parameters:parameters decode:^id(NSData *responseData) {
         
         // the response would be empty in this case
-        successBlock(nil);
+        return nil;
         
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    } success:successBlock failure:failureBlock];
 }
 
 - (void)pollOrderForAccount:(NSNumber *)accountId
@@ -590,25 +923,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
 	[parameters setObject:[maxOrderId stringValue] forKey:@"maxOrderId"];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 - (void)deleteOrderForAccount:(NSNumber *)accountId
@@ -620,25 +936,24 @@ static NSDateFormatter *sRFC3339DateFormatter;
     parameters = [self setupDefaultParams];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders/%@", [accountId stringValue], [orderId stringValue]];
-    [_afc deletePath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"DELETE" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
+}
+
+- (void)deleteOrdersForAccount:(NSNumber *)accountId
+                      orderIds:(NSArray *)orderIds
+         maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                      progress:(NetworkBatchProgressBlock)progressBlock
+                    completion:(NetworkBatchCompletionBlock)completionBlock
+{
+    NSMutableArray *requests = [NSMutableArray arrayWithCapacity:orderIds.count];
+    
+    for (NSNumber *orderId in orderIds) {
+        NSString *pathString = [NSString stringWithFormat:@"accounts/%@/orders/%@", [accountId stringValue], [orderId stringValue]];
+        [requests addObject:[self requestWithMethod:@"DELETE" path:pathString parameters:[self setupDefaultParams] priority:OTRequestPriorityTrading]];
+    }
+    
+    [self enqueueBatchOfRequests:requests maxConcurrentRequests:maxConcurrentRequests progress:progressBlock completion:completionBlock];
 }
 
 #pragma mark Creating and Managing MarketOrders Trades
@@ -663,46 +978,49 @@ static NSDateFormatter *sRFC3339DateFormatter;
     
     // set the optional params
     if (price) {
-		[parameters setObject:[NSString stringWithFormat:@"%.5f", [price floatValue]] forKey:@"price"];
+		[parameters setObject:[self priceParameter:price symbol:symbol] forKey:@"price"];
  	}
     if (type) {
         [parameters setObject:type forKey:@"side"];
     }
 	if (lowPrice) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [lowPrice floatValue]] forKey:@"lowLimit"];
+        [parameters setObject:[self priceParameter:lowPrice symbol:symbol] forKey:@"lowLimit"];
 	}
 	if (highPrice) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [highPrice floatValue]] forKey:@"highLimit"];
+        [parameters setObject:[self priceParameter:highPrice symbol:symbol] forKey:@"highLimit"];
 	}
 	if (stopLoss) {
-		[parameters setObject:[NSString stringWithFormat:@"%.5f", [stopLoss floatValue]] forKey:@"stopLoss"];
+		[parameters setObject:[self priceParameter:stopLoss symbol:symbol] forKey:@"stopLoss"];
 	}
 	if (takeProfit) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [takeProfit floatValue]] forKey:@"takeProfit"];
+        [parameters setObject:[self priceParameter:takeProfit symbol:symbol] forKey:@"takeProfit"];
 	}
 	if (trailingStop) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [trailingStop floatValue]] forKey:@"trailingStop"];
+        [parameters setObject:[self priceParameter:trailingStop symbol:symbol] forKey:@"trailingStop"];
 	}
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/trades", [accountId stringValue]];
-    [_afc postPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"POST" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
+}
+
+- (OTOrderTicket *)orderTicketForAccount:(NSNumber *)accountId
+                                  symbol:(NSString *)symbol
+{
+    NSMutableDictionary *parameters;
+    parameters = [self setupDefaultParams];
+    
+    // everything but the units, side and price, encoded once and for all
+	[parameters setObject:symbol forKey:@"instrument"];
+    
+    NSString *pathString = [NSString stringWithFormat:@"accounts/%@/trades", [accountId stringValue]];
+    NSURLRequest *requestTemplate = [self requestWithMethod:@"POST" path:pathString parameters:parameters priority:OTRequestPriorityTrading];
+    
+    return [[OTOrderTicket alloc] initWithSymbol:symbol priceDigits:[self priceDigitsForSymbol:symbol] requestTemplate:requestTemplate sendBlock:^(NSURLRequest *request, NetworkSuccessBlock successBlock, NetworkFailBlock failureBlock) {
+        OTRequestWaiter *waiter = [[OTRequestWaiter alloc] init];
+        waiter.successBlock = successBlock;
+        waiter.failureBlock = failureBlock;
+        [self enqueueRequest:request priority:OTRequestPriorityTrading coalescingKey:nil waiter:waiter];
     }];
 }
 
@@ -719,24 +1037,22 @@ static NSDateFormatter *sRFC3339DateFormatter;
         
     // set the optional params
 	if (stopLoss) {
-		[parameters setObject:[NSString stringWithFormat:@"%.5f", [stopLoss floatValue]] forKey:@"stopLoss"];
+		[parameters setObject:[self priceParameter:stopLoss symbol:nil] forKey:@"stopLoss"];
 	}
 	if (takeProfit) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [takeProfit floatValue]] forKey:@"takeProfit"];
+        [parameters setObject:[self priceParameter:takeProfit symbol:nil] forKey:@"takeProfit"];
 	}
 	if (trailingStop) {
-        [parameters setObject:[NSString stringWithFormat:@"%.5f", [trailingStop floatValue]] forKey:@"trailingStop"];
+        [parameters setObject:[self priceParameter:trailingStop symbol:nil] forKey:@"trailingStop"];
 	}
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/trades/%@", [accountId stringValue], [tradeId stringValue]];
-    [_afc patchPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
+    [self requestWithMethod:@"PATCH" path:pathString parameters:parameters decode:^id(NSData *responseData) {
         
         // the response would be empty in this case
-        successBlock(nil);
+        return nil;
         
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    } success:successBlock failure:failureBlock];
 }
 
 - (void)pollTradeForAccount:(NSNumber *)accountId
@@ -753,25 +1069,8 @@ static NSDateFormatter *sRFC3339DateFormatter;
 	[parameters setObject:[maxTradeId stringValue] forKey:@"maxTradeId"];
     
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/trades", [accountId stringValue]];
-    [_afc getPath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 - (void)closeTradeForAccount:(NSNumber *)accountId
@@ -785,29 +1084,12 @@ static NSDateFormatter *sRFC3339DateFormatter;
 
     // set the optional param
     if (price) {
-		[parameters setObject:[NSString stringWithFormat:@"%.5f", [price floatValue]] forKey:@"price"];
+		[parameters setObject:[self priceParameter:price symbol:nil] forKey:@"price"];
  	}
     //tradeId =[NSNumber numberWithInt:176199739];
     NSString *pathString = [NSString stringWithFormat:@"accounts/%@/trades/%@", [accountId stringValue], [tradeId stringValue]];
-    [_afc deletePath:pathString parameters:parameters success:^(AFHTTPRequestOperation *operation, id responseObject) {
-        
-        // return the whole parsed JSON object
-#if defined(USE_JSONKIT)
-        JSONDecoder* decoder = [[JSONDecoder alloc]
-                                initWithParseOptions:JKParseOptionNone];
-        NSDictionary* jsonDict = [decoder objectWithData:responseObject];
-        NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-        NSError *error = nil;
-        NSDictionary *jsonDict = [NSJSONSerialization JSONObjectWithData:responseObject options: NSJSONReadingMutableContainers error:&error];
-        NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
-        
-        successBlock(jsonDict);
-        
-    } failure:^(AFHTTPRequestOperation *operation, NSError *error) {
-        [self handleFailureUsingBlock:failureBlock withOperation:operation withError:error];
-    }];
+    // return the whole parsed JSON object
+    [self requestWithMethod:@"DELETE" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
 }
 
 ///////////////////////////////////////////////////////////////
@@ -828,6 +1110,629 @@ static NSDateFormatter *sRFC3339DateFormatter;
 }
 */
 
+- (void)requestWithMethod:(NSString *)method
+                     path:(NSString *)path
+               parameters:(NSDictionary *)parameters
+                   decode:(OTResponseDecodeBlock)decodeBlock
+                  success:(OTResponseResultBlock)successBlock
+                  failure:(NetworkFailBlock)failureBlock
+{
+    OTRequestWaiter *waiter = [[OTRequestWaiter alloc] init];
+    waiter.decodeBlock = decodeBlock;
+    waiter.successBlock = successBlock;
+    waiter.failureBlock = failureBlock;
+    
+    // an identical GET already on the network will answer this one too
+    NSString *coalescingKey = nil;
+    if (self.coalescesRequests && [method isEqualToString:@"GET"]) {
+        coalescingKey = [self coalescingKeyForMethod:method path:path parameters:parameters];
+        @synchronized(_inFlightRequests) {
+            NSMutableArray *waiters = [_inFlightRequests objectForKey:coalescingKey];
+            if (waiters) {
+                [waiters addObject:waiter];
+                self.numRequestsCoalesced++;
+                return;
+            }
+            [_inFlightRequests setObject:[NSMutableArray arrayWithObject:waiter] forKey:coalescingKey];
+        }
+    }
+    
+    OTRequestPriority priority = [self priorityForMethod:method path:path];
+    NSURLRequest *request = [self requestWithMethod:method path:path parameters:parameters priority:priority];
+    [self enqueueRequest:request priority:priority coalescingKey:coalescingKey waiter:waiter];
+}
+
+// The request for a call of the given class, asking for a compressed response or not, as set by setAcceptsCompression:forPriority:.
+- (NSMutableURLRequest *)requestWithMethod:(NSString *)method path:(NSString *)path parameters:(NSDictionary *)parameters priority:(OTRequestPriority)priority
+{
+    NSMutableURLRequest *request = [_afc requestWithMethod:method path:path parameters:parameters];
+    // explicit either way, as NSURLConnection would otherwise ask for gzip on its own
+    [request setValue:([self acceptsCompressionForPriority:priority] ? @"gzip, deflate" : @"identity") forHTTPHeaderField:@"Accept-Encoding"];
+    
+    return request;
+}
+
+// Puts a request on the network once the requestScheduler says so, for the waiter and whoever joins it under coalescingKey (if any).
+- (void)enqueueRequest:(NSURLRequest *)request priority:(OTRequestPriority)priority coalescingKey:(NSString *)coalescingKey waiter:(OTRequestWaiter *)waiter
+{
+    self.numRequestsSent++;
+    
+    // with collectsMetrics off, this check is all a request pays
+    OTRequestTiming *timing = nil;
+    if (self.collectsMetrics) {
+        timing = [[OTRequestTiming alloc] init];
+        timing.request = request;
+        timing->timestamps.queued = CFAbsoluteTimeGetCurrent();
+    }
+    
+    // candles and transactions can run to megabytes: those go to a file rather than the heap, if asked to
+    BOOL downloadsToFile = (priority == OTRequestPriorityHistory && self.downloadsHistoryToFile);
+    // transactions take the default parse, which can run as the body comes in (candle decode blocks read the whole body themselves)
+    BOOL parsesWhileDownloading = (!downloadsToFile && self.parsesTransactionsWhileDownloading && [request.URL.path hasSuffix:@"/transactions"]);
+    
+    [_requestScheduler scheduleRequestWithPriority:priority startBlock:^(RequestSchedulerDoneBlock doneBlock) {
+        [self startRequest:request coalescingKey:coalescingKey waiter:waiter timing:timing
+           downloadsToFile:downloadsToFile parsesWhileDownloading:parsesWhileDownloading doneBlock:doneBlock];
+    }];
+}
+
+- (void)startRequest:(NSURLRequest *)request
+          coalescingKey:(NSString *)coalescingKey
+                 waiter:(OTRequestWaiter *)waiter
+                 timing:(OTRequestTiming *)timing
+        downloadsToFile:(BOOL)downloadsToFile
+ parsesWhileDownloading:(BOOL)parsesWhileDownloading
+              doneBlock:(RequestSchedulerDoneBlock)doneBlock
+{
+    void (^successBlock)(AFHTTPRequestOperation *, id) = ^(AFHTTPRequestOperation *operation, id responseObject) {
+        doneBlock();
+        id parsedObject = nil;
+#if defined(JK_STREAM_DECODER_AVAILABLE)
+        if ([operation isKindOfClass:[OTStreamingRequestOperation class]]) {
+            parsedObject = [(OTStreamingRequestOperation *)operation parsedObject];
+        }
+#endif
+        [self completeWithResponseData:responseObject parsedObject:parsedObject waiters:[self waitersForKey:coalescingKey orWaiter:waiter] timing:timing];
+    };
+    void (^failureBlock)(AFHTTPRequestOperation *, NSError *) = ^(AFHTTPRequestOperation *operation, NSError *error) {
+        doneBlock();
+        NSMutableArray *failureBlocks = [NSMutableArray array];
+        for (OTRequestWaiter *failedWaiter in [self waitersForKey:coalescingKey orWaiter:waiter]) {
+            if (failedWaiter.failureBlock) {
+                [failureBlocks addObject:failedWaiter.failureBlock];
+            }
+        }
+        [self handleFailureUsingBlocks:failureBlocks withOperation:operation withError:error timing:timing];
+    };
+    
+    AFHTTPRequestOperation *requestOperation;
+    if (downloadsToFile) {
+        NSString *fileName = [NSString stringWithFormat:@"OTNetwork-%@.json", [[NSProcessInfo processInfo] globallyUniqueString]];
+        OTFileBackedRequestOperation *fileBackedOperation = [[OTFileBackedRequestOperation alloc] initWithRequest:request
+                                                                                                     downloadPath:[NSTemporaryDirectory() stringByAppendingPathComponent:fileName]];
+        fileBackedOperation.timing = timing;
+        [fileBackedOperation setCompletionBlockWithSuccess:successBlock failure:failureBlock];
+        requestOperation = fileBackedOperation;
+#if defined(JK_STREAM_DECODER_AVAILABLE)
+    } else if (parsesWhileDownloading) {
+        OTStreamingRequestOperation *streamingOperation = [[OTStreamingRequestOperation alloc] initWithRequest:request];
+        streamingOperation.timing = timing;
+        [streamingOperation setCompletionBlockWithSuccess:successBlock failure:failureBlock];
+        requestOperation = streamingOperation;
+#endif
+    } else if (timing) {
+        OTTimedRequestOperation *timedOperation = [[OTTimedRequestOperation alloc] initWithRequest:request];
+        timedOperation.timing = timing;
+        [timedOperation setCompletionBlockWithSuccess:successBlock failure:failureBlock];
+        requestOperation = timedOperation;
+    } else {
+        requestOperation = [_afc HTTPRequestOperationWithRequest:request success:successBlock failure:failureBlock];
+    }
+    
+    // have AFNetworking deliver straight onto the decode stage, so the main queue never sees the raw body
+    requestOperation.successCallbackQueue = _decodeQueue;
+    requestOperation.failureCallbackQueue = _decodeQueue;
+    
+    [_afc enqueueHTTPRequestOperation:requestOperation];
+}
+
+// Puts a batch of requests on the network, at most maxConcurrentRequests at a time, and reports the outcome of each once all are done.
+- (void)enqueueBatchOfRequests:(NSArray *)requests
+         maxConcurrentRequests:(NSUInteger)maxConcurrentRequests
+                      progress:(NetworkBatchProgressBlock)progressBlock
+                    completion:(NetworkBatchCompletionBlock)completionBlock
+{
+    OTRequestBatch *batch = [[OTRequestBatch alloc] init];
+    batch.requests = requests;
+    batch.results = [NSMutableArray arrayWithCapacity:requests.count];
+    batch.errors = [NSMutableArray arrayWithCapacity:requests.count];
+    for (NSUInteger i = 0; i < requests.count; i++) {
+        [batch.results addObject:[NSNull null]];
+        [batch.errors addObject:[NSNull null]];
+    }
+    batch.operations = [NSMutableSet set];
+    batch.progressBlock = progressBlock;
+    batch.completionBlock = completionBlock;
+    
+    if (requests.count == 0) {
+        if (completionBlock) {
+            dispatch_async(_callbackQueue ?: dispatch_get_main_queue(), ^{
+                completionBlock(@[], @[]);
+            });
+        }
+        return;
+    }
+    
+    // every request goes through the requestScheduler as a trading call; the window of the batch is a cap on top, so a
+    // large batch never takes every slot from the other trading calls
+    NSUInteger windowSize = maxConcurrentRequests ?: kDefaultMaxConcurrentBatchRequests;
+    for (NSUInteger i = 0; i < MIN(windowSize, requests.count); i++) {
+        [self scheduleNextRequestOfBatch:batch];
+    }
+}
+
+// Hands the next request of a batch, if any is left, to the requestScheduler.
+- (void)scheduleNextRequestOfBatch:(OTRequestBatch *)batch
+{
+    NSUInteger index;
+    @synchronized(batch) {
+        if (batch.numScheduled == batch.requests.count) {
+            return;
+        }
+        index = batch.numScheduled++;
+    }
+    
+    // timed like any other call, from the moment it is handed to the requestScheduler
+    OTRequestTiming *timing = nil;
+    if (self.collectsMetrics) {
+        timing = [[OTRequestTiming alloc] init];
+        timing.request = [batch.requests objectAtIndex:index];
+        timing->timestamps.queued = CFAbsoluteTimeGetCurrent();
+    }
+    
+    [_requestScheduler scheduleRequestWithPriority:OTRequestPriorityTrading startBlock:^(RequestSchedulerDoneBlock doneBlock) {
+        [self startRequestAtIndex:index ofBatch:batch timing:timing doneBlock:doneBlock];
+    }];
+}
+
+- (void)startRequestAtIndex:(NSUInteger)index ofBatch:(OTRequestBatch *)batch timing:(OTRequestTiming *)timing doneBlock:(RequestSchedulerDoneBlock)doneBlock
+{
+    // the server turned the credentials down while this one was waiting for its turn: it would only be turned down too
+    BOOL cancelled;
+    @synchronized(batch) {
+        cancelled = batch.cancelled;
+    }
+    if (cancelled) {
+        doneBlock();
+        dispatch_async(_decodeQueue, ^{
+            NSDictionary *error = [self errorDictionaryForOperation:nil withError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+            // never sent, so not timed either
+            [self finishRequestAtIndex:index ofBatch:batch result:nil error:error timing:nil];
+        });
+        return;
+    }
+    
+    NSURLRequest *request = [batch.requests objectAtIndex:index];
+    AFHTTPRequestOperation *requestOperation;
+    if (timing) {
+        OTTimedRequestOperation *timedOperation = [[OTTimedRequestOperation alloc] initWithRequest:request];
+        timedOperation.timing = timing;
+        requestOperation = timedOperation;
+    } else {
+        requestOperation = [_afc HTTPRequestOperationWithRequest:request success:nil failure:nil];
+    }
+    
+    // the batch holds on to the operation until it is done, so it can be cancelled, and so the completion block can use it weakly
+    __weak AFHTTPRequestOperation *weakOperation = requestOperation;
+    requestOperation.completionBlock = ^{
+        AFHTTPRequestOperation *operation = weakOperation;
+        doneBlock();
+        
+        // fail fast: once the server turns down our credentials, the rest of the batch would only be turned down too
+        NSInteger statusCode = [operation.response statusCode];
+        NSArray *operationsToCancel = nil;
+        @synchronized(batch) {
+            if ((statusCode == 401 || statusCode == 403) && !batch.cancelled) {
+                batch.cancelled = YES;
+                operationsToCancel = [batch.operations allObjects];
+            }
+        }
+        for (AFHTTPRequestOperation *otherOperation in operationsToCancel) {
+            if (otherOperation != operation && ![otherOperation isFinished]) {
+                [otherOperation cancel];
+            }
+        }
+        
+        // NSOperation completes on a thread of its own: go on to the decode stage to parse the response
+        dispatch_async(_decodeQueue, ^{
+            id result = nil;
+            NSDictionary *error = nil;
+            if ([operation isCancelled]) {
+                error = [self errorDictionaryForOperation:operation
+                                                withError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+            } else if (operation.error) {
+                error = [self errorDictionaryForOperation:operation withError:operation.error];
+            } else {
+                result = [operation.responseData length] > 0 ? [self JSONObjectWithData:operation.responseData] : nil;
+                result = result ?: [NSDictionary dictionary];
+            }
+            if (timing) {
+                timing->timestamps.decoded = CFAbsoluteTimeGetCurrent();
+            }
+            @synchronized(batch) {
+                [batch.operations removeObject:operation];
+            }
+            [self finishRequestAtIndex:index ofBatch:batch result:result error:error timing:timing];
+        });
+    };
+    
+    @synchronized(batch) {
+        [batch.operations addObject:requestOperation];
+    }
+    self.numRequestsSent++;
+    [_afc enqueueHTTPRequestOperation:requestOperation];
+}
+
+// Records the outcome of a request of a batch, and sends the next one; on the decodeQueue.  A timed request counts as delivered with its progressBlock.
+- (void)finishRequestAtIndex:(NSUInteger)index ofBatch:(OTRequestBatch *)batch result:(id)result error:(NSDictionary *)error timing:(OTRequestTiming *)timing
+{
+    NSUInteger numRequests = batch.requests.count;
+    NSUInteger numFinished;
+    BOOL cancelled;
+    @synchronized(batch) {
+        [batch.results replaceObjectAtIndex:index withObject:(result ?: [NSNull null])];
+        [batch.errors replaceObjectAtIndex:index withObject:(error ?: [NSNull null])];
+        batch.numFinished++;
+        
+        // once the credentials are turned down, what is not scheduled yet is not even queued
+        cancelled = batch.cancelled;
+        if (cancelled && batch.numScheduled < numRequests) {
+            NSDictionary *cancelledError = [self errorDictionaryForOperation:nil withError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+            for (NSUInteger i = batch.numScheduled; i < numRequests; i++) {
+                [batch.errors replaceObjectAtIndex:i withObject:cancelledError];
+            }
+            batch.numFinished += numRequests - batch.numScheduled;
+            batch.numScheduled = numRequests;
+        }
+        numFinished = batch.numFinished;
+    }
+    
+    dispatch_queue_t callbackQueue = _callbackQueue ?: dispatch_get_main_queue();
+    NetworkBatchProgressBlock progressBlock = batch.progressBlock;
+    if (progressBlock || timing) {
+        dispatch_async(callbackQueue, ^{
+            if (timing) {
+                timing->timestamps.delivered = CFAbsoluteTimeGetCurrent();
+            }
+            if (progressBlock) {
+                progressBlock(numFinished, numRequests);
+            }
+            if (timing) {
+                [self recordTiming:timing failed:(error != nil)];
+            }
+        });
+    }
+    
+    if (numFinished < numRequests) {
+        if (!cancelled) {
+            [self scheduleNextRequestOfBatch:batch];
+        }
+        return;
+    }
+    
+    NetworkBatchCompletionBlock completionBlock = batch.completionBlock;
+    if (completionBlock) {
+        NSArray *results = [batch.results copy];
+        NSArray *errors = [batch.errors copy];
+        dispatch_async(callbackQueue, ^{
+            completionBlock(results, errors);
+        });
+    }
+}
+
+- (void)sendQuoteBatch:(OTQuoteBatch *)batch
+{
+    @synchronized(self) {
+        if (_pendingQuoteBatch == batch) {
+            _pendingQuoteBatch = nil;
+        }
+    }
+    
+    NSMutableDictionary *parameters;
+    parameters = [self setupDefaultParams];
+    [parameters setObject:[self instrumentsParameterForSymbols:[batch.symbols array]] forKey:@"instruments"];
+    
+    [self requestWithMethod:@"GET" path:@"prices" parameters:parameters decode:^id(NSData *responseData) {
+        
+        // split the prices of the union back into one response per caller, with only the symbols it asked for; a body without a list
+        // of prices is no answer for anybody
+        NSError *error = nil;
+        NSDictionary *jsonDict = [self JSONObjectWithData:responseData error:&error];
+        NSArray *prices = [jsonDict isKindOfClass:[NSDictionary class]] ? [jsonDict objectForKey:@"prices"] : nil;
+        if (![prices isKindOfClass:[NSArray class]]) {
+            return OTMalformedResponseError(error);
+        }
+        NSMutableDictionary *pricesBySymbol = [NSMutableDictionary dictionaryWithCapacity:prices.count];
+        for (NSDictionary *price in prices) {
+            // an entry without an instrument cannot be anybody's
+            NSString *symbol = [price isKindOfClass:[NSDictionary class]] ? [price objectForKey:@"instrument"] : nil;
+            if (symbol) {
+                [pricesBySymbol setObject:price forKey:symbol];
+            }
+        }
+        
+        NSMutableArray *results = [NSMutableArray arrayWithCapacity:batch.symbolLists.count];
+        for (NSArray *symbolList in batch.symbolLists) {
+            NSMutableArray *callerPrices = [NSMutableArray arrayWithCapacity:symbolList.count];
+            for (NSString *symbol in symbolList) {
+                NSDictionary *price = [pricesBySymbol objectForKey:symbol];
+                if (price) {
+                    [callerPrices addObject:price];
+                }
+            }
+            [results addObject:[NSMutableDictionary dictionaryWithObject:callerPrices forKey:@"prices"]];
+        }
+        return results;
+        
+    } success:^(NSArray *results) {
+        [batch.successBlocks enumerateObjectsUsingBlock:^(NetworkSuccessBlock successBlock, NSUInteger idx, BOOL *stop) {
+            successBlock([results objectAtIndex:idx]);
+        }];
+    } failure:^(NSDictionary *error) {
+        for (id failureBlock in batch.failureBlocks) {
+            if (failureBlock != [NSNull null]) {
+                ((NetworkFailBlock)failureBlock)(error);
+            }
+        }
+    }];
+}
+
+// Every page is requested through the same path, with the query of the previous page's nextPage link on top of the default parameters.
+- (OTPageCursor *)pageCursorForPath:(NSString *)pathString listKey:(NSString *)listKey pageSize:(NSNumber *)count
+{
+    return [[OTPageCursor alloc] initWithListKey:listKey fetchBlock:^(NSDictionary *pageParameters, NetworkSuccessBlock successBlock, NetworkFailBlock failureBlock) {
+        NSMutableDictionary *parameters = [self setupDefaultParams];
+        if (count) {
+            [parameters setObject:[count stringValue] forKey:@"count"];
+        }
+        [parameters addEntriesFromDictionary:pageParameters];
+        
+        [self requestWithMethod:@"GET" path:pathString parameters:parameters decode:nil success:successBlock failure:failureBlock];
+    }];
+}
+
+// Which class of the requestScheduler a call belongs to: anything changing the account is trading, then come account state, prices and history.
+- (OTRequestPriority)priorityForMethod:(NSString *)method path:(NSString *)path
+{
+    if (![method isEqualToString:@"GET"]) {
+        return OTRequestPriorityTrading;
+    }
+    if ([path hasPrefix:@"prices"]) {
+        return OTRequestPriorityQuotes;
+    }
+    if ([path hasPrefix:@"candles"] || [path hasPrefix:@"instruments"] || [path hasSuffix:@"/transactions"]) {
+        return OTRequestPriorityHistory;
+    }
+    
+    return OTRequestPriorityAccount;
+}
+
+// Method, path and parameters sorted by name, so the same request always gets the same key whatever order the parameters were set in.
+- (NSString *)coalescingKeyForMethod:(NSString *)method path:(NSString *)path parameters:(NSDictionary *)parameters
+{
+    NSMutableString *key = [NSMutableString stringWithFormat:@"%@ %@", method, path];
+    for (NSString *name in [[parameters allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        [key appendFormat:@"&%@=%@", name, [parameters objectForKey:name]];
+    }
+    
+    return key;
+}
+
+// Takes every waiter off the in-flight table entry, so a request made from now on goes back to the network.
+- (NSArray *)waitersForKey:(NSString *)coalescingKey orWaiter:(OTRequestWaiter *)waiter
+{
+    if (!coalescingKey) {
+        return [NSArray arrayWithObject:waiter];
+    }
+    
+    @synchronized(_inFlightRequests) {
+        NSArray *waiters = [_inFlightRequests objectForKey:coalescingKey];
+        [_inFlightRequests removeObjectForKey:coalescingKey];
+        return waiters;
+    }
+}
+
+- (void)completeWithResponseData:(NSData *)responseData
+                          decode:(OTResponseDecodeBlock)decodeBlock
+                         success:(OTResponseResultBlock)successBlock
+{
+    OTRequestWaiter *waiter = [[OTRequestWaiter alloc] init];
+    waiter.decodeBlock = decodeBlock;
+    waiter.successBlock = successBlock;
+    
+    [self completeWithResponseData:responseData parsedObject:nil waiters:[NSArray arrayWithObject:waiter] timing:nil];
+}
+
+// parsedObject, if not nil, is the body as already parsed while it downloaded, and stands for the default parse.
+- (void)completeWithResponseData:(NSData *)responseData parsedObject:(id)parsedObject waiters:(NSArray *)waiters timing:(OTRequestTiming *)timing
+{
+    // the default is to return the whole parsed JSON object; waiters with the same decoder share one decoded result
+    NSMutableArray *decodeBlocks = [NSMutableArray arrayWithCapacity:1];
+    NSMutableArray *decodedResults = [NSMutableArray arrayWithCapacity:1];
+    NSMutableArray *results = [NSMutableArray arrayWithCapacity:waiters.count];
+    
+    for (OTRequestWaiter *waiter in waiters) {
+        id decodeKey = waiter.decodeBlock ?: (id)[NSNull null];
+        NSUInteger decodedIndex = [decodeBlocks indexOfObjectIdenticalTo:decodeKey];
+        if (decodedIndex == NSNotFound) {
+            id result = parsedObject;
+            if (waiter.decodeBlock) {
+                result = waiter.decodeBlock(responseData);
+            } else if (!result) {
+                NSError *error = nil;
+                result = [self JSONObjectWithData:responseData error:&error] ?: OTMalformedResponseError(error);
+            }
+            [decodeBlocks addObject:decodeKey];
+            [decodedResults addObject:result ?: [NSNull null]];
+            decodedIndex = decodeBlocks.count - 1;
+        }
+        [results addObject:[decodedResults objectAtIndex:decodedIndex]];
+    }
+    if (timing) {
+        timing->timestamps.decoded = CFAbsoluteTimeGetCurrent();
+    }
+    
+    dispatch_async(_callbackQueue ?: dispatch_get_main_queue(), ^{
+        if (timing) {
+            timing->timestamps.delivered = CFAbsoluteTimeGetCurrent();
+        }
+        __block BOOL failed = NO;
+        [waiters enumerateObjectsUsingBlock:^(OTRequestWaiter *waiter, NSUInteger idx, BOOL *stop) {
+            id result = [results objectAtIndex:idx];
+            if ([result isKindOfClass:[NSError class]]) {
+                failed = YES;
+                if (waiter.failureBlock) {
+                    waiter.failureBlock([self errorDictionaryForOperation:nil withError:result]);
+                }
+            } else {
+                waiter.successBlock(result == [NSNull null] ? nil : result);
+            }
+        }];
+        if (timing) {
+            [self recordTiming:timing failed:failed];
+        }
+    });
+}
+
+- (id)JSONObjectWithData:(NSData *)data
+{
+#if defined(USE_JSONKIT)
+    id jsonObject = [self.decoderPool objectWithData:data error:NULL];
+    NSAssert1(jsonObject, @"%@: Error parsing with JSONKit", [self class]);
+#else
+    NSError *error = nil;
+    id jsonObject = [NSJSONSerialization JSONObjectWithData:data options: NSJSONReadingMutableContainers error:&error];
+    NSAssert2(jsonObject, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
+#endif
+    
+    return jsonObject;
+}
+
+// Like JSONObjectWithData:, for bodies which may not be JSON: returns nil and sets error rather than asserting.
+- (id)JSONObjectWithData:(NSData *)data error:(NSError **)error
+{
+#if defined(USE_JSONKIT)
+    return [self.decoderPool objectWithData:data ?: [NSData data] error:error];
+#else
+    return [NSJSONSerialization JSONObjectWithData:data ?: [NSData data] options:NSJSONReadingMutableContainers error:error];
+#endif
+}
+
+// What the lists of orders and positions are decoded with: nil for the default parse, or one block shared by every call, so coalesced callers share one view.
+- (OTResponseDecodeBlock)listDecodeBlock
+{
+    static OTResponseDecodeBlock sLazyDecodeBlock;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sLazyDecodeBlock = ^id(NSData *responseData) {
+            NSError *error = nil;
+            return [OTLazyJSON objectWithData:responseData error:&error] ?: OTMalformedResponseError(error);
+        };
+    });
+    
+    return self.decodesListsLazily ? sLazyDecodeBlock : nil;
+}
+
+// What the list of accounts is decoded with: the array wrapped as {"array": ...}, or an error if the body is not JSON.  Lazily, one block
+// shared by every call, like listDecodeBlock.
+- (OTResponseDecodeBlock)accountListDecodeBlock
+{
+    static OTResponseDecodeBlock sLazyDecodeBlock;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sLazyDecodeBlock = ^id(NSData *responseData) {
+            NSError *error = nil;
+            id jsonArray = [OTLazyJSON objectWithData:responseData error:&error];
+            return jsonArray ? [NSDictionary dictionaryWithObject:jsonArray forKey:@"array"] : OTMalformedResponseError(error);
+        };
+    });
+    
+    if (self.decodesListsLazily) {
+        return sLazyDecodeBlock;
+    }
+    return ^id(NSData *responseData) {
+        NSError *error = nil;
+        id jsonArray = [self JSONObjectWithData:responseData error:&error];
+        return jsonArray ? [NSDictionary dictionaryWithObject:jsonArray forKey:@"array"] : OTMalformedResponseError(error);
+    };
+}
+
+- (NSString *)instrumentsParameterForSymbols:(NSArray *)symbolPairList
+{
+    // extract from passed-in strings, construct the list of symbol lists as a single string
+    return [symbolPairList componentsJoinedByString:@","];
+}
+
+// The parameters of a new LimitOrder, as sent by createOrderForAccount:... and createOrdersForAccount:...
+- (NSMutableDictionary *)orderParametersForSymbol:(NSString *)symbol
+                                            units:(NSNumber *)units
+                                             side:(NSString *)side
+                                             type:(NSString *)type
+                                            price:(NSDecimalNumber *)price
+                                           expiry:(NSNumber *)expiryInSeconds
+                                minExecutionPrice:(NSDecimalNumber *)lowPrice
+                                maxExecutionPrice:(NSDecimalNumber *)highPrice
+                                         stopLoss:(NSDecimalNumber *)stopLoss
+                                       takeProfit:(NSDecimalNumber *)takeProfit
+                                     trailingStop:(NSDecimalNumber *)trailingStop
+{
+    NSMutableDictionary *parameters;
+    parameters = [self setupDefaultParams];
+    
+    // set the mandatory params
+	[parameters setObject:symbol forKey:@"instrument"];
+    [parameters setObject:[units stringValue] forKey:@"units"];
+    [parameters setObject:[self priceParameter:price symbol:symbol] forKey:@"price"];
+	[parameters setObject:side forKey:@"side"];
+	[parameters setObject:type forKey:@"type"];
+
+    NSString *expiryTimeTemp = [NSString stringWithFormat:@"%ld", (long)[[NSDate date] timeIntervalSince1970] + [expiryInSeconds intValue]];
+    NSString *expiryTime = [self dateFromRFC3339Date:expiryTimeTemp];
+
+    [parameters setObject:expiryTime forKey:@"expiry"];
+    
+    // set the optional params
+	if (lowPrice) {
+        [parameters setObject:[self priceParameter:lowPrice symbol:symbol] forKey:@"lowLimit"];
+	}
+	if (highPrice) {
+        [parameters setObject:[self priceParameter:highPrice symbol:symbol] forKey:@"highLimit"];
+	}
+	if (stopLoss) {
+		[parameters setObject:[self priceParameter:stopLoss symbol:symbol] forKey:@"stopLoss"];
+	}
+	if (takeProfit) {
+        [parameters setObject:[self priceParameter:takeProfit symbol:symbol] forKey:@"takeProfit"];
+	}
+	if (trailingStop) {
+        [parameters setObject:[self priceParameter:trailingStop symbol:symbol] forKey:@"trailingStop"];
+	}
+    
+    return parameters;
+}
+
+// Formats a price exactly, to the precision of its instrument (OTPriceDefaultDigits when the instrument is not known).
+- (NSString *)priceParameter:(NSDecimalNumber *)price symbol:(NSString *)symbol
+{
+    OTPrice fixedPrice;
+    if (!OTPriceFromDecimalNumber(price, [self priceDigitsForSymbol:symbol], &fixedPrice)) {
+        NSAssert1(NO, @"Price %@ cannot be sent", price);
+        return [price stringValue];
+    }
+    
+    return OTPriceString(fixedPrice);
+}
+
 - (NSMutableDictionary *)setupDefaultParams
 {
     NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
@@ -840,30 +1745,55 @@ static NSDateFormatter *sRFC3339DateFormatter;
     return parameters;
 }
 
-- (void) handleFailureUsingBlock:(NetworkFailBlock)failureBlock
-                   withOperation:(AFHTTPRequestOperation *)operation
-                       withError:(NSError *)error
+- (void) handleFailureUsingBlocks:(NSArray *)failureBlocks
+                    withOperation:(AFHTTPRequestOperation *)operation
+                        withError:(NSError *)error
+                           timing:(OTRequestTiming *)timing
 {
-    // parse and extract the struct describing the error
-#if defined(USE_JSONKIT)
-    NSDictionary *jsonDict = [operation.responseString objectFromJSONString];
-    NSAssert1(jsonDict, @"%@: Error parsing with JSONKit", [self class]);
-#else
-    NSError *jsonParseError = nil;
-    NSDictionary *jsonDict =
-    [NSJSONSerialization JSONObjectWithData: [operation.responseString dataUsingEncoding:NSUTF8StringEncoding]
-                                    options: NSJSONReadingMutableContainers
-                                      error: &jsonParseError];
-    NSAssert2(jsonDict, @"%@: Error parsing JSON: %@", [self class], [error localizedDescription]);
-#endif
+    NSDictionary *returnDict = [self errorDictionaryForOperation:operation withError:error];
+    
+    NSLog(@"%@ FAILURE : %@", NSStringFromSelector(_cmd), returnDict);
+    if (timing) {
+        timing->timestamps.decoded = CFAbsoluteTimeGetCurrent();
+    }
+    
+    dispatch_async(_callbackQueue ?: dispatch_get_main_queue(), ^{
+        if (timing) {
+            timing->timestamps.delivered = CFAbsoluteTimeGetCurrent();
+        }
+        for (NetworkFailBlock failureBlock in failureBlocks) {
+            failureBlock(returnDict);
+        }
+        if (timing) {
+            [self recordTiming:timing failed:YES];
+        }
+    });
+}
+
+// Adds a timed request to the histograms of its endpoint, eg. "GET accounts/:id/trades".
+- (void)recordTiming:(OTRequestTiming *)timing failed:(BOOL)failed
+{
+    NSURLRequest *request = timing.request;
+    NSString *endpoint = [OTRequestMetrics endpointForMethod:request.HTTPMethod path:request.URL.path basePath:_afc.baseURL.path];
+    
+    [_requestMetrics recordRequestToEndpoint:endpoint timestamps:&timing->timestamps transfer:&timing->transfer failed:failed];
+}
+
+// The dictionary handed to failure blocks: the error body sent by the server, if any, plus the HTTP status code and the NSError.
+- (NSDictionary *)errorDictionaryForOperation:(AFHTTPRequestOperation *)operation
+                                    withError:(NSError *)error
+{
+    // parse and extract the struct describing the error (a dropped connection has no body at all)
+    NSDictionary *jsonDict = nil;
+    if ([operation.responseData length] > 0) {
+        jsonDict = [self JSONObjectWithData:operation.responseData];
+    }
     
-    NSMutableDictionary *returnDict = [jsonDict mutableCopy];
+    NSMutableDictionary *returnDict = jsonDict ? [jsonDict mutableCopy] : [NSMutableDictionary dictionary];
     [returnDict setObject:[NSNumber numberWithInteger:[operation.response statusCode]] forKey:@"http status code"];
     [returnDict setObject:error forKey:@"net error"];
     
-    NSLog(@"%@ FAILURE : %@", NSStringFromSelector(_cmd), returnDict);
-    
-    failureBlock(returnDict);
+    return returnDict;
 }
 
 -(NSString *)dateFromRFC3339Date:(NSString *)date
@@ -0,0 +1,83 @@
+//
+//  OTOrderTicket.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import "OTPrice.h"
+
+typedef enum {
+    OTOrderSideBuy = 0,
+    OTOrderSideSell
+} OTOrderSide;
+
+/** Sends a request built from the ticket's template to the server, as OTNetworkController does for any other call. */
+typedef void (^OrderTicketSendBlock)(NSURLRequest *request, void (^successBlock)(NSDictionary *result), void (^failureBlock)(NSDictionary *error));
+
+/** A market order for one account and instrument, armed ahead of time so firing it costs as little as possible.
+ 
+ openTradeForAccount:symbol:units:type:price:minExecutionPrice:maxExecutionPrice:stopLoss:takeProfit:trailingStop:success:failure: builds
+ a parameter dictionary, formats every field and has AFHTTPClient percent-escape and form-encode them on every call.  A ticket does all of
+ that once, when it is created: the URL, the headers and the body up to the instrument are kept ready, and firing only writes the units,
+ the side and the price into the end of a reused body buffer before the request is queued.
+ 
+ The body sent is byte for byte the one openTradeForAccount:... would send for the same order.
+ 
+ Get a ticket from orderTicketForAccount:symbol: of OTNetworkController, ideally as soon as the user opens the order screen.  A ticket can
+ be fired any number of times, from any thread.
+ */
+@interface OTOrderTicket : NSObject
+
+/** Creates a ticket from a template request holding everything but the units, side and price, with the form-encoded instrument as its body. */
+- (id)initWithSymbol:(NSString *)symbol priceDigits:(unsigned int)priceDigits requestTemplate:(NSURLRequest *)requestTemplate sendBlock:(OrderTicketSendBlock)sendBlock;
+
+/** The instrument traded (eg. EUR_USD). */
+@property (nonatomic, readonly, copy) NSString *symbol;
+
+/** Number of decimals the instrument is quoted with, to build the OTPrice passed to fireWithUnits:side:price:success:failure:. */
+@property (nonatomic, readonly) unsigned int priceDigits;
+
+/** To open a trade at the market price.
+ 
+ @param units **Required**.  Number of units to buy/sell.  Must be more than 0.
+ @param side **Required**.  OTOrderSideBuy or OTOrderSideSell.
+ @param successBlock **Required**.  Triggered with the outcome, as for openTradeForAccount:..., on the network controller's callbackQueue.
+ @param failureBlock **Required**.  Triggered if the trade could not be opened.
+ */
+- (void)fireWithUnits:(NSUInteger)units
+                 side:(OTOrderSide)side
+              success:(void (^)(NSDictionary *result))successBlock
+              failure:(void (^)(NSDictionary *error))failureBlock;
+
+/** To open a trade, passing the price the user saw.
+ 
+ @param price **Required**.  User price (informational, will be executed at server price), sent with its own number of decimals.
+ @see fireWithUnits:side:success:failure:
+ */
+- (void)fireWithUnits:(NSUInteger)units
+                 side:(OTOrderSide)side
+                price:(OTPrice)price
+              success:(void (^)(NSDictionary *result))successBlock
+              failure:(void (^)(NSDictionary *error))failureBlock;
+
+@end
@@ -0,0 +1,109 @@
+//
+//  OTOrderTicket.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTOrderTicket.h"
+
+@interface OTOrderTicket () {
+    NSURLRequest *_requestTemplate;
+    OrderTicketSendBlock _sendBlock;
+    NSMutableData *_body;                   // the encoded instrument, then the fields of the order being fired; guarded by @synchronized
+    NSUInteger _prefixLength;
+}
+@end
+
+@implementation OTOrderTicket
+
+- (id)initWithSymbol:(NSString *)symbol priceDigits:(unsigned int)priceDigits requestTemplate:(NSURLRequest *)requestTemplate sendBlock:(OrderTicketSendBlock)sendBlock
+{
+    NSAssert(symbol && requestTemplate && sendBlock, @"An order ticket needs a symbol, a request template and a send block");
+
+    self = [super init];
+    if (self) {
+        _symbol = [symbol copy];
+        _priceDigits = priceDigits;
+        _requestTemplate = [requestTemplate copy];
+        _sendBlock = [sendBlock copy];
+
+        // room for the longest price, side and units, so firing never grows the buffer
+        _prefixLength = requestTemplate.HTTPBody.length;
+        _body = [NSMutableData dataWithCapacity:_prefixLength + 2 * OTPriceMaxLength + 32];
+        [_body appendData:requestTemplate.HTTPBody];
+    }
+
+    return self;
+}
+
+- (void)fireWithUnits:(NSUInteger)units
+                 side:(OTOrderSide)side
+              success:(void (^)(NSDictionary *result))successBlock
+              failure:(void (^)(NSDictionary *error))failureBlock
+{
+    [self sendOrderWithUnits:units side:side price:NULL success:successBlock failure:failureBlock];
+}
+
+- (void)fireWithUnits:(NSUInteger)units
+                 side:(OTOrderSide)side
+                price:(OTPrice)price
+              success:(void (^)(NSDictionary *result))successBlock
+              failure:(void (^)(NSDictionary *error))failureBlock
+{
+    [self sendOrderWithUnits:units side:side price:&price success:successBlock failure:failureBlock];
+}
+
+#pragma mark - Private Methods
+
+- (void)sendOrderWithUnits:(NSUInteger)units
+                      side:(OTOrderSide)side
+                     price:(const OTPrice *)price
+                   success:(void (^)(NSDictionary *result))successBlock
+                   failure:(void (^)(NSDictionary *error))failureBlock
+{
+    NSAssert(units > 0, @"An order needs some units");
+
+    NSMutableURLRequest *request = [_requestTemplate mutableCopy];
+    char number[OTPriceMaxLength];
+
+    @synchronized(self) {
+        // same fields, in the same (sorted) order, as AFHTTPClient would encode them
+        [_body setLength:_prefixLength];
+        if (price) {
+            [_body appendBytes:"&price=" length:7];
+            [_body appendBytes:number length:OTPriceFormat(*price, number)];
+        }
+        if (side == OTOrderSideSell) {
+            [_body appendBytes:"&side=sell" length:10];
+        } else {
+            [_body appendBytes:"&side=buy" length:9];
+        }
+        [_body appendBytes:"&units=" length:7];
+        [_body appendBytes:number length:OTPriceFormat(OTPriceMake((int64_t)units, 0), number)];
+
+        [request setHTTPBody:_body];
+    }
+
+    _sendBlock(request, successBlock, failureBlock);
+}
+
+@end
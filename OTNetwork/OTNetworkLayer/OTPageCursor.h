@@ -0,0 +1,75 @@
+//
+//  OTPageCursor.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+/** Triggered with the rows of one page (NSDictionary each, as returned by the server), and whether it was the last one. */
+typedef void (^PageCursorSuccessBlock)(NSArray *rows, BOOL lastPage);
+
+/** Requests one page of a list, with the parameters taken from the nextPage link of the page before (none for the first page). */
+typedef void (^PageCursorFetchBlock)(NSDictionary *pageParameters, void (^successBlock)(NSDictionary *result), void (^failureBlock)(NSDictionary *error));
+
+/** Reads a long list (transactions, trades, orders) one page at a time, following the nextPage links returned by the server.
+ 
+ While the caller works on a page, the cursor is already fetching the ones after it, so a list of thousands of rows can be read
+ through at network speed.  Only up to maxBufferedPages pages are held besides the one handed out, which caps the memory used
+ however long the list is.
+ 
+ Get a cursor from transactionCursorForAccountId:pageSize:, tradesCursorForAccountId:pageSize: or ordersCursorForAccountId:pageSize:
+ of OTNetworkController.  A cursor is not thread safe: use it from the callbackQueue of its network controller (the main queue by default),
+ where the blocks are triggered too.
+ */
+@interface OTPageCursor : NSObject
+
+/** Creates a cursor over the rows found under listKey (eg. @"transactions") in every page returned through fetchBlock.  Nothing is fetched until the first nextPageSuccess:failure:. */
+- (id)initWithListKey:(NSString *)listKey fetchBlock:(PageCursorFetchBlock)fetchBlock;
+
+@property (nonatomic, readonly, copy) NSString *listKey;
+
+/** Most pages fetched ahead of the caller.  0 only fetches a page when it is asked for.  Default: 1. */
+@property (nonatomic, assign) NSUInteger maxBufferedPages;
+
+/** Pages fetched ahead and not handed out yet. */
+@property (nonatomic, readonly) NSUInteger numBufferedPages;
+
+/** Pages received from the server so far. */
+@property (nonatomic, readonly) NSUInteger numPagesFetched;
+
+/** NO once the last page has been handed out. */
+@property (nonatomic, readonly) BOOL hasMorePages;
+
+/** To get the next page of the list.
+ 
+ Only one call may be outstanding at a time: call again from the successBlock (or later) for the page after.
+ 
+ @param successBlock **Required**.  Triggered with the rows of the page, right away if the page was already fetched.  Once the list is over, triggered with no rows.
+ @param failureBlock **Optional**.  Triggered if the page could not be fetched.  Calling nextPageSuccess:failure: again retries it.
+ */
+- (void)nextPageSuccess:(PageCursorSuccessBlock)successBlock failure:(void (^)(NSDictionary *error))failureBlock;
+
+/** Drops the buffered pages and stops fetching.  Any outstanding blocks are not triggered. */
+- (void)cancel;
+
+@end
@@ -0,0 +1,217 @@
+//
+//  OTPageCursor.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTPageCursor.h"
+#import "OTNetworkController.h"
+
+@interface OTPageCursor () {
+    PageCursorFetchBlock _fetchBlock;
+    NSMutableArray *_bufferedPages;         // NSArray of rows per page, oldest first
+    NSDictionary *_nextPageParameters;      // query of the last nextPage link
+    NSDictionary *_fetchError;              // failure of a prefetch, handed to the next caller
+    PageCursorSuccessBlock _waitingSuccessBlock;
+    NetworkFailBlock _waitingFailureBlock;
+    NSUInteger _generation;                 // bumped by cancel, so late responses are ignored
+    BOOL _fetching;
+    BOOL _exhausted;                        // the server has no page after the last one fetched
+    BOOL _cancelled;
+}
+@end
+
+@implementation OTPageCursor
+
+- (id)initWithListKey:(NSString *)listKey fetchBlock:(PageCursorFetchBlock)fetchBlock
+{
+    NSAssert(listKey && fetchBlock, @"A page cursor needs a list key and a fetch block");
+
+    self = [super init];
+    if (self) {
+        _listKey = [listKey copy];
+        _fetchBlock = [fetchBlock copy];
+        _bufferedPages = [NSMutableArray array];
+        _maxBufferedPages = 1;
+    }
+
+    return self;
+}
+
+- (NSUInteger)numBufferedPages
+{
+    return _bufferedPages.count;
+}
+
+- (BOOL)hasMorePages
+{
+    return !_cancelled && (!_exhausted || _bufferedPages.count > 0);
+}
+
+- (void)nextPageSuccess:(PageCursorSuccessBlock)successBlock failure:(NetworkFailBlock)failureBlock
+{
+    NSAssert(successBlock, @"nextPageSuccess:failure: needs a successBlock");
+    NSAssert(!_waitingSuccessBlock, @"nextPageSuccess:failure: called again before the previous page arrived");
+
+    if (_bufferedPages.count > 0) {
+        NSArray *rows = [_bufferedPages objectAtIndex:0];
+        [_bufferedPages removeObjectAtIndex:0];
+        BOOL lastPage = _exhausted && _bufferedPages.count == 0;
+
+        // refill the buffer before handing out the page, so the caller's work overlaps the request
+        [self fetchIfNeeded];
+        successBlock(rows, lastPage);
+        return;
+    }
+
+    if (_fetchError) {
+        NSDictionary *error = _fetchError;
+        _fetchError = nil;
+        if (failureBlock) {
+            failureBlock(error);
+        }
+        return;
+    }
+
+    if (_exhausted || _cancelled) {
+        successBlock(@[], YES);
+        return;
+    }
+
+    _waitingSuccessBlock = [successBlock copy];
+    _waitingFailureBlock = [failureBlock copy];
+    [self fetchIfNeeded];
+}
+
+- (void)cancel
+{
+    _cancelled = YES;
+    _generation++;
+    _fetching = NO;
+    [_bufferedPages removeAllObjects];
+    _waitingSuccessBlock = nil;
+    _waitingFailureBlock = nil;
+}
+
+#pragma mark - Private Methods
+
+// Fetches the next page if somebody is waiting for it, or if there is room for it in the buffer.
+- (void)fetchIfNeeded
+{
+    if (_fetching || _exhausted || _cancelled || _fetchError) {
+        return;
+    }
+    if (!_waitingSuccessBlock && _bufferedPages.count >= _maxBufferedPages) {
+        return;
+    }
+
+    _fetching = YES;
+    NSUInteger generation = _generation;
+    NSDictionary *pageParameters = _nextPageParameters ?: @{};
+
+    _fetchBlock(pageParameters, ^(NSDictionary *result) {
+        if (generation == _generation) {
+            [self didFetchPage:result];
+        }
+    }, ^(NSDictionary *error) {
+        if (generation == _generation) {
+            [self didFailToFetchPage:error];
+        }
+    });
+}
+
+- (void)didFetchPage:(NSDictionary *)result
+{
+    _fetching = NO;
+    _numPagesFetched++;
+
+    id rows = [result objectForKey:_listKey];
+    if (![rows isKindOfClass:[NSArray class]]) {
+        rows = @[];
+    }
+
+    // stop at the end of the list, and rather than loop forever on a server repeating the same link
+    NSDictionary *nextPageParameters = [self parametersFromPageLink:[result objectForKey:@"nextPage"]];
+    if (!nextPageParameters || [rows count] == 0 || [nextPageParameters isEqualToDictionary:_nextPageParameters]) {
+        _exhausted = YES;
+    }
+    _nextPageParameters = nextPageParameters;
+
+    PageCursorSuccessBlock successBlock = _waitingSuccessBlock;
+    _waitingSuccessBlock = nil;
+    _waitingFailureBlock = nil;
+
+    if (successBlock) {
+        [self fetchIfNeeded];
+        successBlock(rows, _exhausted);
+    } else {
+        [_bufferedPages addObject:rows];
+        [self fetchIfNeeded];
+    }
+}
+
+- (void)didFailToFetchPage:(NSDictionary *)error
+{
+    _fetching = NO;
+
+    NetworkFailBlock failureBlock = _waitingFailureBlock;
+    BOOL waiting = (_waitingSuccessBlock != nil);
+    _waitingSuccessBlock = nil;
+    _waitingFailureBlock = nil;
+
+    if (!waiting) {
+        // keep it for whoever asks for this page, who may then retry
+        _fetchError = error;
+    } else if (failureBlock) {
+        failureBlock(error);
+    }
+}
+
+// Returns the query parameters of a nextPage link (eg. "http://api-sandbox.oanda.com/v1/accounts/506005/transactions?maxTransId=177809412"),
+// or nil if there is no next page.  Only the query is kept: the link is requested through the same path as the first page.
+- (NSDictionary *)parametersFromPageLink:(id)link
+{
+    if (![link isKindOfClass:[NSString class]] || [link length] == 0) {
+        return nil;
+    }
+
+    NSString *query = [[NSURL URLWithString:link] query];
+    if ([query length] == 0) {
+        return nil;
+    }
+
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    for (NSString *parameter in [query componentsSeparatedByString:@"&"]) {
+        NSRange equals = [parameter rangeOfString:@"="];
+        if (equals.location != NSNotFound) {
+            NSString *name = [[parameter substringToIndex:equals.location] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+            NSString *value = [[parameter substringFromIndex:NSMaxRange(equals)] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+            if (name && value) {
+                [parameters setObject:value forKey:name];
+            }
+        }
+    }
+
+    return parameters.count > 0 ? parameters : nil;
+}
+
+@end
@@ -0,0 +1,69 @@
+//
+//  OTPrice.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+#define OTPriceDefaultDigits    5       // enough for both JPY crosses (3) and most currency pairs (5)
+#define OTPriceMaxDigits        9
+#define OTPriceMaxLength        24      // longest formatted price, including the sign, the point and the NUL
+
+/** An exact price to send with an order or a trade, as a fixed-point integer scaled by the precision of its instrument.
+ 
+ The precision is one digit past the pip of the instrument, as listed by rateListSymbolsSuccess:failure:, so 1.29564 EUR_USD (pip 0.0001)
+ is held as { 129564, 5 } and 82.123 USD_JPY (pip 0.01) as { 82123, 3 }.  Unlike a float, which only holds about 7 significant
+ digits, this is exact for every quoted price.
+ */
+typedef struct {
+    int64_t  value;         // the price multiplied by 10^digits
+    uint32_t digits;        // number of decimals, at most OTPriceMaxDigits
+} OTPrice;
+
+static inline OTPrice OTPriceMake(int64_t value, unsigned int digits)
+{
+    OTPrice price = { value, digits };
+    return price;
+}
+
+/** Returns the number of decimals prices of an instrument are quoted with, given its pip (eg. @"0.0001" gives 5), or 0 if pip is not a valid pip. */
+unsigned int OTPriceDigitsForPip(NSString *pip);
+
+/** Converts a decimal number to a price with the given number of decimals, rounding half away from zero.
+ 
+ Exact, and without allocating.  Returns NO if number is not a number, or too large for digits decimals.
+ */
+BOOL OTPriceFromDecimalNumber(NSDecimalNumber *number, unsigned int digits, OTPrice *price);
+
+/** Writes a price as a plain NUL terminated decimal with exactly price.digits decimals (eg. "1.29564", "-0.50000", "82.123").
+ 
+ Built from the integer alone, without printf or any allocation, so the same buffer can be reused for every field of an order.
+ buffer must hold at least OTPriceMaxLength bytes.  Returns the length written, not counting the NUL.
+ */
+size_t OTPriceFormat(OTPrice price, char *buffer);
+
+/** Returns a price formatted by OTPriceFormat as an NSString, eg. for a request parameter. */
+NSString *OTPriceString(OTPrice price);
+
+/** Returns an exact NSDecimalNumber for a price. */
+NSDecimalNumber *OTPriceDecimalNumber(OTPrice price);
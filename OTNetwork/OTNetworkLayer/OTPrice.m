@@ -0,0 +1,131 @@
+//
+//  OTPrice.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTPrice.h"
+
+unsigned int OTPriceDigitsForPip(NSString *pip)
+{
+    if (![pip isKindOfClass:[NSString class]]) {
+        return 0;
+    }
+
+    // a pip is a power of ten, eg. "0.0001", "0.01" or "1"
+    NSRange point = [pip rangeOfString:@"."];
+    NSUInteger decimals = (point.location == NSNotFound) ? 0 : pip.length - NSMaxRange(point);
+    if (decimals + 1 > OTPriceMaxDigits || ![pip hasSuffix:@"1"]) {
+        return 0;
+    }
+
+    return (unsigned int)decimals + 1;
+}
+
+BOOL OTPriceFromDecimalNumber(NSDecimalNumber *number, unsigned int digits, OTPrice *price)
+{
+    NSDecimal decimal = [number decimalValue];
+    if (!number || NSDecimalIsNotANumber(&decimal) || digits > OTPriceMaxDigits) {
+        return NO;
+    }
+
+    NSDecimal scaled, rounded;
+    if (NSDecimalMultiplyByPowerOf10(&scaled, &decimal, (short)digits, NSRoundPlain) != NSCalculationNoError) {
+        return NO;
+    }
+    NSDecimalRound(&rounded, &scaled, 0, NSRoundPlain);
+
+    // what is left is an integer: a mantissa of up to eight 16 bit words, times 10^exponent
+    if (rounded._length > 4) {
+        return NO;
+    }
+    uint64_t magnitude = 0;
+    for (int i = (int)rounded._length - 1; i >= 0; i--) {
+        magnitude = (magnitude << 16) | rounded._mantissa[i];
+    }
+    for (int exponent = rounded._exponent; exponent > 0; exponent--) {
+        if (magnitude > (uint64_t)(INT64_MAX / 10)) {
+            return NO;
+        }
+        magnitude *= 10;
+    }
+    for (int exponent = rounded._exponent; exponent < 0; exponent++) {
+        magnitude /= 10;
+    }
+    if (magnitude > (uint64_t)INT64_MAX) {
+        return NO;
+    }
+
+    price->value = rounded._isNegative ? -(int64_t)magnitude : (int64_t)magnitude;
+    price->digits = digits;
+    return YES;
+}
+
+size_t OTPriceFormat(OTPrice price, char *buffer)
+{
+    char reversed[OTPriceMaxLength];
+    size_t count = 0;
+    size_t length = 0;
+    uint64_t magnitude = (price.value < 0) ? (uint64_t)0 - (uint64_t)price.value : (uint64_t)price.value;
+
+    do {
+        reversed[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    // at least one digit before the point
+    while (count <= price.digits) {
+        reversed[count++] = '0';
+    }
+
+    if (price.value < 0) {
+        buffer[length++] = '-';
+    }
+    while (count > price.digits) {
+        buffer[length++] = reversed[--count];
+    }
+    if (price.digits > 0) {
+        buffer[length++] = '.';
+        while (count > 0) {
+            buffer[length++] = reversed[--count];
+        }
+    }
+    buffer[length] = '\0';
+
+    return length;
+}
+
+NSString *OTPriceString(OTPrice price)
+{
+    char buffer[OTPriceMaxLength];
+    size_t length = OTPriceFormat(price, buffer);
+
+    return [[NSString alloc] initWithBytes:buffer length:length encoding:NSASCIIStringEncoding];
+}
+
+NSDecimalNumber *OTPriceDecimalNumber(OTPrice price)
+{
+    BOOL negative = (price.value < 0);
+    unsigned long long mantissa = negative ? (unsigned long long)(-(price.value + 1)) + 1ULL : (unsigned long long)price.value;
+
+    return [NSDecimalNumber decimalNumberWithMantissa:mantissa exponent:-(short)price.digits isNegative:negative];
+}
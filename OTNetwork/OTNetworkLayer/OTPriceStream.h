@@ -0,0 +1,93 @@
+//
+//  OTPriceStream.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import "OTPriceTick.h"
+
+@class OTNetworkController;
+
+typedef void (^PriceStreamTickBlock)(OTPriceTick tick);
+
+typedef enum {
+    OTPriceStreamStateStopped = 0,  // nobody is subscribed
+    OTPriceStreamStateConnecting,   // opening (or re-opening) the streaming connection
+    OTPriceStreamStateStreaming,    // ticks are arriving over the streaming connection
+    OTPriceStreamStatePolling       // streaming is unavailable, prices are polled with rateQuoteTicks:success:failure:
+} OTPriceStreamState;
+
+/** Pushes live prices to subscribers, replacing a timer that repeatedly calls rateQuote:success:failure:.
+
+ While anyone is subscribed, the stream keeps one long-lived chunked HTTP connection open to the OANDA streaming
+ server.  The server sends one JSON message per line, eg.
+
+     {"tick":{"instrument":"EUR_USD","time":"1354208555.548539","bid":1.29564,"ask":1.29596}}
+     {"heartbeat":{"time":"1354208560.000000"}}
+
+ and each tick is handed to the subscribers of its instrument as an OTPriceTick, on the network controller's callbackQueue.
+
+ A dropped connection is re-opened with an increasing delay.  After maxReconnectAttempts failures in a row (or straight away
+ if the server has no streaming endpoint), the stream falls back to polling: it polls every minPollInterval while prices are
+ moving, backs off towards maxPollInterval while they are not, and tries streaming again every streamRetryInterval.
+
+ Get the instance bound to your OTNetworkController from its priceStream property, rather than creating your own.
+ */
+@interface OTPriceStream : NSObject
+
+/** Creates a stream which connects to the given streaming server (eg. @"http://stream-sandbox.oanda.com/v1/") and polls through networkController when it cannot. */
+- (id)initWithNetworkController:(OTNetworkController *)networkController streamUrl:(NSString *)streamUrl;
+
+/** Base URL of the streaming server. */
+@property (nonatomic, readonly, copy) NSString *streamUrl;
+
+/** What the stream is currently doing. */
+@property (nonatomic, readonly) OTPriceStreamState state;
+
+/** Number of failed streaming connections in a row before falling back to polling.  Default: 3. */
+@property (nonatomic, assign) NSUInteger maxReconnectAttempts;
+
+/** Delay before the first reconnect; doubled after every further failure.  Default: 1 second. */
+@property (nonatomic, assign) NSTimeInterval reconnectDelay;
+
+/** Shortest and longest time between polls while falling back to polling.  Default: 1 and 10 seconds. */
+@property (nonatomic, assign) NSTimeInterval minPollInterval;
+@property (nonatomic, assign) NSTimeInterval maxPollInterval;
+
+/** While polling, how often to try streaming again.  Default: 60 seconds. */
+@property (nonatomic, assign) NSTimeInterval streamRetryInterval;
+
+/** To receive every new price of an instrument.
+
+ The first subscription starts the stream, and subscribing to an instrument nobody was watching re-opens the connection with the new list.
+
+ @param instrument **Required**.  The symbol to receive prices for (eg. EUR_USD).
+ @param tickBlock **Required**.  Triggered with each new OTPriceTick of the instrument, on the network controller's callbackQueue.
+ @return An opaque subscription, to be passed to unsubscribe: when the prices are no longer needed.
+ */
+- (id)subscribeToInstrument:(NSString *)instrument tickBlock:(PriceStreamTickBlock)tickBlock;
+
+/** To stop receiving prices for a subscription returned by subscribeToInstrument:tickBlock:.  The last one to go stops the stream. */
+- (void)unsubscribe:(id)subscription;
+
+@end
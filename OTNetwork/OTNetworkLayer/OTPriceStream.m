@@ -0,0 +1,405 @@
+//
+//  OTPriceStream.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTPriceStream.h"
+#import "OTNetworkController.h"
+
+// The streaming server sends a heartbeat every few seconds, so a connection silent for this long is dead.
+#define kPriceStreamIdleTimeout 20.0
+
+@interface OTPriceStreamSubscription : NSObject
+@property (nonatomic, readonly, copy) NSString *instrument;
+@property (nonatomic, readonly, copy) PriceStreamTickBlock tickBlock;
+@property (atomic, assign) BOOL cancelled;
+@end
+
+@implementation OTPriceStreamSubscription
+
+- (id)initWithInstrument:(NSString *)instrument tickBlock:(PriceStreamTickBlock)tickBlock
+{
+    self = [super init];
+    if (self) {
+        _instrument = [instrument copy];
+        _tickBlock = [tickBlock copy];
+    }
+
+    return self;
+}
+
+@end
+
+
+// All the state below is only touched on _stateQueue; NSURLConnection calls back on _connectionQueue and hops over.
+@interface OTPriceStream () {
+    dispatch_queue_t _stateQueue;
+    NSOperationQueue *_connectionQueue;
+
+    NSMutableDictionary *_subscriptions;        // instrument -> NSMutableArray of OTPriceStreamSubscription
+    NSURLConnection *_connection;
+    NSMutableData *_lineBuffer;                 // bytes received after the last complete line
+    NSUInteger _numFailures;                    // failed streaming connections in a row
+    NSUInteger _timerGeneration;                // bumped to invalidate every pending retry and poll
+    BOOL _restartPending;
+
+    NSTimeInterval _pollInterval;
+    CFAbsoluteTime _pollingSince;
+    NSMutableDictionary *_lastPolledTicks;      // instrument -> NSData holding the last OTPriceTick delivered by a poll
+}
+
+@property (nonatomic, weak) OTNetworkController *networkController;
+@property (atomic, assign) OTPriceStreamState state;
+@end
+
+@implementation OTPriceStream
+
+- (id)initWithNetworkController:(OTNetworkController *)networkController streamUrl:(NSString *)streamUrl
+{
+    self = [super init];
+    if (self) {
+        _networkController = networkController;
+        _streamUrl = [streamUrl copy];
+
+        _maxReconnectAttempts = 3;
+        _reconnectDelay = 1.0;
+        _minPollInterval = 1.0;
+        _maxPollInterval = 10.0;
+        _streamRetryInterval = 60.0;
+
+        _stateQueue = dispatch_queue_create("com.oanda.OTPriceStream.state", DISPATCH_QUEUE_SERIAL);
+        _connectionQueue = [[NSOperationQueue alloc] init];
+        [_connectionQueue setMaxConcurrentOperationCount:1];
+
+        _subscriptions = [NSMutableDictionary dictionary];
+        _lineBuffer = [NSMutableData data];
+        _lastPolledTicks = [NSMutableDictionary dictionary];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+#if !OS_OBJECT_USE_OBJC
+    dispatch_release(_stateQueue);
+#endif
+}
+
+#pragma mark Subscribing
+
+- (id)subscribeToInstrument:(NSString *)instrument tickBlock:(PriceStreamTickBlock)tickBlock
+{
+    NSParameterAssert(instrument);
+    NSParameterAssert(tickBlock);
+
+    OTPriceStreamSubscription *subscription = [[OTPriceStreamSubscription alloc] initWithInstrument:instrument tickBlock:tickBlock];
+    dispatch_async(_stateQueue, ^{
+        NSMutableArray *subscribers = [_subscriptions objectForKey:instrument];
+        if (!subscribers) {
+            subscribers = [NSMutableArray array];
+            [_subscriptions setObject:subscribers forKey:instrument];
+            [self instrumentsDidChange];
+        }
+        [subscribers addObject:subscription];
+    });
+
+    return subscription;
+}
+
+- (void)unsubscribe:(id)subscription
+{
+    OTPriceStreamSubscription *streamSubscription = subscription;
+
+    // ticks already on their way to the callbackQueue check this before being delivered
+    streamSubscription.cancelled = YES;
+
+    dispatch_async(_stateQueue, ^{
+        NSMutableArray *subscribers = [_subscriptions objectForKey:streamSubscription.instrument];
+        [subscribers removeObjectIdenticalTo:streamSubscription];
+        if (subscribers && subscribers.count == 0) {
+            [_subscriptions removeObjectForKey:streamSubscription.instrument];
+            [self instrumentsDidChange];
+        }
+    });
+}
+
+- (void)instrumentsDidChange
+{
+    if (_subscriptions.count == 0) {
+        [self stop];
+        return;
+    }
+
+    switch (self.state) {
+        case OTPriceStreamStateStopped:
+            _numFailures = 0;
+            [self startStreaming];
+            break;
+
+        case OTPriceStreamStateConnecting:
+        case OTPriceStreamStateStreaming:
+            // the instrument list is part of the URL, so re-open the connection once this burst of (un)subscribing is over
+            if (!_restartPending) {
+                _restartPending = YES;
+                dispatch_async(_stateQueue, ^{
+                    _restartPending = NO;
+                    if (self.state == OTPriceStreamStateConnecting || self.state == OTPriceStreamStateStreaming) {
+                        [self startStreaming];
+                    }
+                });
+            }
+            break;
+
+        case OTPriceStreamStatePolling:
+            // the next poll picks up the new list
+            break;
+    }
+}
+
+- (void)stop
+{
+    [self cancelConnection];
+    _timerGeneration++;
+    [_lastPolledTicks removeAllObjects];
+    self.state = OTPriceStreamStateStopped;
+}
+
+#pragma mark Streaming
+
+- (void)startStreaming
+{
+    [self cancelConnection];
+    _timerGeneration++;
+    self.state = OTPriceStreamStateConnecting;
+
+    NSArray *instruments = [[_subscriptions allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    NSString *instrumentsString = [[instruments componentsJoinedByString:@","] stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+    NSURL *url = [NSURL URLWithString:[_streamUrl stringByAppendingFormat:@"prices?instruments=%@", instrumentsString]];
+
+    NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:url];
+    [request setTimeoutInterval:kPriceStreamIdleTimeout];
+
+    _connection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
+    [_connection setDelegateQueue:_connectionQueue];
+    [_connection start];
+}
+
+- (void)cancelConnection
+{
+    [_connection cancel];
+    _connection = nil;
+    [_lineBuffer setLength:0];
+}
+
+- (void)connectionFailed
+{
+    [self cancelConnection];
+    _numFailures++;
+
+    if (_numFailures >= _maxReconnectAttempts) {
+        [self startPolling];
+        return;
+    }
+
+    self.state = OTPriceStreamStateConnecting;
+    NSTimeInterval delay = _reconnectDelay * (NSTimeInterval)(1UL << MIN(_numFailures - 1, 5UL));
+    [self afterDelay:delay perform:^{
+        [self startStreaming];
+    }];
+}
+
+- (void)receivedData:(NSData *)data
+{
+    [_lineBuffer appendData:data];
+
+    // hand over every complete line, keep the partial one for the next chunk
+    const char *bytes = [_lineBuffer bytes];
+    size_t length = [_lineBuffer length];
+    size_t lineStart = 0;
+    const char *newline;
+
+    while ((newline = memchr(bytes + lineStart, '\n', length - lineStart)) != NULL) {
+        size_t lineEnd = (size_t)(newline - bytes);
+
+        OTPriceTick tick;
+        switch (OTPriceTickScanMessage(bytes + lineStart, lineEnd - lineStart, &tick)) {
+            case OTPriceTickMessageTick:
+                [self deliverTick:tick];
+                _numFailures = 0;
+                break;
+
+            case OTPriceTickMessageHeartbeat:
+                _numFailures = 0;
+                break;
+
+            case OTPriceTickMessageInvalid:
+                break;
+        }
+        lineStart = lineEnd + 1;
+    }
+
+    [_lineBuffer replaceBytesInRange:NSMakeRange(0, lineStart) withBytes:NULL length:0];
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+    NSInteger statusCode = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response statusCode] : 200;
+
+    dispatch_async(_stateQueue, ^{
+        if (connection != _connection) {
+            return;
+        }
+
+        if (statusCode == 200) {
+            self.state = OTPriceStreamStateStreaming;
+        } else if (statusCode == 404 || statusCode == 405 || statusCode == 501) {
+            // this server has no streaming endpoint at all, so retrying would be pointless
+            [self startPolling];
+        } else {
+            [self connectionFailed];
+        }
+    });
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+    dispatch_async(_stateQueue, ^{
+        if (connection == _connection) {
+            [self receivedData:data];
+        }
+    });
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+    dispatch_async(_stateQueue, ^{
+        if (connection == _connection) {
+            NSLog(@"%@ price stream dropped: %@", NSStringFromSelector(_cmd), error);
+            [self connectionFailed];
+        }
+    });
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+    // the server is never supposed to end the stream
+    dispatch_async(_stateQueue, ^{
+        if (connection == _connection) {
+            [self connectionFailed];
+        }
+    });
+}
+
+#pragma mark Polling
+
+- (void)startPolling
+{
+    [self cancelConnection];
+    _timerGeneration++;
+    self.state = OTPriceStreamStatePolling;
+
+    _pollInterval = _minPollInterval;
+    _pollingSince = CFAbsoluteTimeGetCurrent();
+    [self poll];
+}
+
+- (void)poll
+{
+    if (CFAbsoluteTimeGetCurrent() - _pollingSince >= _streamRetryInterval) {
+        // give streaming one more chance; a single failure brings us straight back here
+        _numFailures = MAX(_maxReconnectAttempts, 1UL) - 1;
+        [self startStreaming];
+        return;
+    }
+
+    NSUInteger generation = _timerGeneration;
+    [self.networkController rateQuoteTicks:[_subscriptions allKeys] success:^(OTPriceTickList *ticks) {
+        dispatch_async(_stateQueue, ^{
+            if (generation != _timerGeneration) {
+                return;
+            }
+
+            // only pass on what changed since the previous poll, and poll less often while nothing does
+            BOOL moved = NO;
+            for (NSUInteger i = 0; i < ticks.count; i++) {
+                const OTPriceTick *tick = [ticks tickAtIndex:i];
+                NSString *instrument = [NSString stringWithUTF8String:tick->instrument];
+                NSData *lastTick = [_lastPolledTicks objectForKey:instrument];
+
+                if (!lastTick || memcmp([lastTick bytes], tick, sizeof(OTPriceTick)) != 0) {
+                    [_lastPolledTicks setObject:[NSData dataWithBytes:tick length:sizeof(OTPriceTick)] forKey:instrument];
+                    [self deliverTick:*tick];
+                    moved = YES;
+                }
+            }
+
+            _pollInterval = moved ? _minPollInterval : MIN(_pollInterval * 1.5, _maxPollInterval);
+            [self afterDelay:_pollInterval perform:^{
+                [self poll];
+            }];
+        });
+    } failure:^(NSDictionary *error) {
+        dispatch_async(_stateQueue, ^{
+            if (generation != _timerGeneration) {
+                return;
+            }
+
+            _pollInterval = _maxPollInterval;
+            [self afterDelay:_pollInterval perform:^{
+                [self poll];
+            }];
+        });
+    }];
+}
+
+#pragma mark Helper/Private functions
+
+- (void)deliverTick:(OTPriceTick)tick
+{
+    NSArray *subscribers = [[_subscriptions objectForKey:[NSString stringWithUTF8String:tick.instrument]] copy];
+    if (subscribers.count == 0) {
+        return;
+    }
+
+    dispatch_async(self.networkController.callbackQueue ?: dispatch_get_main_queue(), ^{
+        for (OTPriceStreamSubscription *subscription in subscribers) {
+            if (!subscription.cancelled) {
+                subscription.tickBlock(tick);
+            }
+        }
+    });
+}
+
+- (void)afterDelay:(NSTimeInterval)delay perform:(dispatch_block_t)block
+{
+    NSUInteger generation = _timerGeneration;
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _stateQueue, ^{
+        if (generation == _timerGeneration) {
+            block();
+        }
+    });
+}
+
+@end
@@ -0,0 +1,98 @@
+//
+//  OTPriceTick.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+#define OTPriceTickScaleDigits      6
+#define OTPriceTickScale            1000000LL
+#define OTPriceTickInstrumentSize   16
+
+/** A single quote, as returned by the prices endpoint, held without any Objective-C objects.
+
+ Prices and time are fixed-point integers scaled by OTPriceTickScale, so a bid of 1.29564 is stored as 1295640 and
+ a time of 1354208555.370971 is stored as microseconds since 1970.  Six decimals cover every instrument quoted by OANDA
+ (JPY crosses use 3, most currency pairs use 5), so no precision is lost.
+ */
+typedef struct {
+    char    instrument[OTPriceTickInstrumentSize];  // NUL terminated, eg. "EUR_USD"
+    int64_t bid;
+    int64_t ask;
+    int64_t time;
+} OTPriceTick;
+
+/** Scans a JSON decimal number (eg. 1.29564, -0.5, 85.57299999999999) straight from its bytes into a fixed-point integer.
+
+ The result is the number multiplied by 10^scaleDigits, rounded half away from zero on the first digit dropped.
+ Returns the number of bytes consumed, or 0 if the bytes do not start with a plain decimal (exponents are not handled here) or the value would overflow.
+ */
+size_t OTPriceScanDecimal(const char *bytes, size_t length, unsigned int scaleDigits, int64_t *outValue);
+
+/** Returns an exact NSDecimalNumber for a fixed-point value scaled by OTPriceTickScale. */
+NSDecimalNumber *OTPriceTickDecimalNumber(int64_t value);
+
+typedef enum {
+    OTPriceTickMessageInvalid = 0,
+    OTPriceTickMessageTick,
+    OTPriceTickMessageHeartbeat
+} OTPriceTickMessageType;
+
+/** Scans one newline-delimited message from the price stream, either {"tick":{...}} or {"heartbeat":{...}}.
+
+ A bare tick object (as found in the prices array) is accepted as well.  tick is only filled in for OTPriceTickMessageTick.
+ */
+OTPriceTickMessageType OTPriceTickScanMessage(const char *bytes, size_t length, OTPriceTick *tick);
+
+static inline double OTPriceTickDoubleValue(int64_t value)
+{
+    return (double)value / (double)OTPriceTickScale;
+}
+
+
+/** A contiguous array of OTPriceTick, decoded directly from the body of a prices response.
+
+ Decoding a response of N instruments costs a single buffer (reused by updateWithPricesData:) instead of the 4N+2 objects
+ built by NSJSONSerialization for the same payload.
+ */
+@interface OTPriceTickList : NSObject
+
+/** Returns a new list decoded from the body of a prices response, or nil if the body is not a valid prices response. */
++ (OTPriceTickList *)tickListWithPricesData:(NSData *)data;
+
+/** Decodes the body of a prices response into this list, reusing its storage.  Returns NO, leaving the list empty, if the body could not be decoded. */
+- (BOOL)updateWithPricesData:(NSData *)data;
+
+/** Number of ticks in the list. */
+@property (nonatomic, readonly) NSUInteger count;
+
+/** The ticks themselves, in the order they appeared in the response.  Only valid until the next call to updateWithPricesData:. */
+@property (nonatomic, readonly) const OTPriceTick *ticks;
+
+/** Returns the tick at the given index, which must be less than count. */
+- (const OTPriceTick *)tickAtIndex:(NSUInteger)index;
+
+/** Returns the tick for the given instrument (eg. @"EUR_USD"), or NULL if the list does not contain it or instrument is nil. */
+- (const OTPriceTick *)tickForInstrument:(NSString *)instrument;
+
+@end
@@ -0,0 +1,438 @@
+//
+//  OTPriceTick.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTPriceTick.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////
+//
+// Fixed-point scanning
+//
+///////////////////////////////////////////////////////////////
+#pragma mark Fixed-point scanning
+
+size_t OTPriceScanDecimal(const char *bytes, size_t length, unsigned int scaleDigits, int64_t *outValue)
+{
+    const char *p = bytes;
+    const char *end = bytes + length;
+    uint64_t value = 0;
+    unsigned int fractionDigits = 0;
+    BOOL negative = NO;
+    BOOL sawDigit = NO;
+    BOOL roundUp = NO;
+
+    if (p < end && *p == '-') {
+        negative = YES;
+        p++;
+    }
+
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (value > (uint64_t)(INT64_MAX / 10)) {
+            return 0;
+        }
+        value = value * 10 + (uint64_t)(*p - '0');
+        sawDigit = YES;
+        p++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (fractionDigits < scaleDigits) {
+                if (value > (uint64_t)(INT64_MAX / 10)) {
+                    return 0;
+                }
+                value = value * 10 + (uint64_t)(*p - '0');
+                fractionDigits++;
+            } else if (fractionDigits == scaleDigits) {
+                // only the first dropped digit decides the rounding
+                roundUp = (*p >= '5');
+                fractionDigits++;
+            }
+            sawDigit = YES;
+            p++;
+        }
+    }
+
+    if (!sawDigit || (p < end && (*p == 'e' || *p == 'E'))) {
+        return 0;
+    }
+
+    for (; fractionDigits < scaleDigits; fractionDigits++) {
+        if (value > (uint64_t)(INT64_MAX / 10)) {
+            return 0;
+        }
+        value *= 10;
+    }
+    if (roundUp) {
+        value++;
+    }
+    if (value > (uint64_t)INT64_MAX) {
+        return 0;
+    }
+
+    *outValue = negative ? -(int64_t)value : (int64_t)value;
+    return (size_t)(p - bytes);
+}
+
+NSDecimalNumber *OTPriceTickDecimalNumber(int64_t value)
+{
+    BOOL negative = (value < 0);
+    unsigned long long mantissa = negative ? (unsigned long long)(-(value + 1)) + 1ULL : (unsigned long long)value;
+
+    return [NSDecimalNumber decimalNumberWithMantissa:mantissa exponent:-OTPriceTickScaleDigits isNegative:negative];
+}
+
+///////////////////////////////////////////////////////////////
+//
+// Prices response scanning
+//
+///////////////////////////////////////////////////////////////
+#pragma mark Prices response scanning
+
+// A forward-only cursor over the raw response body.  The scanner only understands as much JSON as the
+// prices response needs, and skips over everything else without creating any objects.
+typedef struct {
+    const char *p;
+    const char *end;
+} OTTickScanner;
+
+static void OTTickScannerSkipWhitespace(OTTickScanner *scanner)
+{
+    while (scanner->p < scanner->end && (*scanner->p == ' ' || *scanner->p == '\t' || *scanner->p == '\n' || *scanner->p == '\r')) {
+        scanner->p++;
+    }
+}
+
+static BOOL OTTickScannerConsume(OTTickScanner *scanner, char c)
+{
+    OTTickScannerSkipWhitespace(scanner);
+    if (scanner->p < scanner->end && *scanner->p == c) {
+        scanner->p++;
+        return YES;
+    }
+    return NO;
+}
+
+// Returns the raw (still escaped) bytes between the quotes.
+static BOOL OTTickScannerScanString(OTTickScanner *scanner, const char **outStart, size_t *outLength)
+{
+    if (!OTTickScannerConsume(scanner, '"')) {
+        return NO;
+    }
+
+    const char *start = scanner->p;
+    while (scanner->p < scanner->end && *scanner->p != '"') {
+        if (*scanner->p == '\\') {
+            scanner->p++;
+        }
+        scanner->p++;
+    }
+    if (scanner->p >= scanner->end) {
+        return NO;
+    }
+
+    *outStart = start;
+    *outLength = (size_t)(scanner->p - start);
+    scanner->p++;
+    return YES;
+}
+
+static BOOL OTTickScannerSkipValue(OTTickScanner *scanner)
+{
+    OTTickScannerSkipWhitespace(scanner);
+    if (scanner->p >= scanner->end) {
+        return NO;
+    }
+
+    if (*scanner->p == '"') {
+        const char *start;
+        size_t length;
+        return OTTickScannerScanString(scanner, &start, &length);
+    }
+
+    if (*scanner->p == '{' || *scanner->p == '[') {
+        char close = (*scanner->p == '{') ? '}' : ']';
+        scanner->p++;
+        if (OTTickScannerConsume(scanner, close)) {
+            return YES;
+        }
+        do {
+            if (close == '}') {
+                const char *key;
+                size_t keyLength;
+                if (!OTTickScannerScanString(scanner, &key, &keyLength) || !OTTickScannerConsume(scanner, ':')) {
+                    return NO;
+                }
+            }
+            if (!OTTickScannerSkipValue(scanner)) {
+                return NO;
+            }
+        } while (OTTickScannerConsume(scanner, ','));
+        return OTTickScannerConsume(scanner, close);
+    }
+
+    // numbers, true, false, null
+    const char *start = scanner->p;
+    while (scanner->p < scanner->end && *scanner->p != ',' && *scanner->p != '}' && *scanner->p != ']' &&
+           *scanner->p != ' ' && *scanner->p != '\t' && *scanner->p != '\n' && *scanner->p != '\r') {
+        scanner->p++;
+    }
+    return (scanner->p > start);
+}
+
+// Accepts both 1.29564 and "1.29564", since the API has served either form for prices and times.
+static BOOL OTTickScannerScanFixedPoint(OTTickScanner *scanner, int64_t *outValue)
+{
+    OTTickScannerSkipWhitespace(scanner);
+    BOOL quoted = (scanner->p < scanner->end && *scanner->p == '"');
+    if (quoted) {
+        scanner->p++;
+    }
+
+    size_t consumed = OTPriceScanDecimal(scanner->p, (size_t)(scanner->end - scanner->p), OTPriceTickScaleDigits, outValue);
+    if (consumed == 0) {
+        // rare forms (eg. exponents) fall back to libc; anything else leaves the field at 0
+        char buffer[64];
+        size_t length = 0;
+        while (scanner->p + length < scanner->end && length < sizeof(buffer) - 1 &&
+               strchr("+-.0123456789eE", scanner->p[length]) != NULL) {
+            buffer[length] = scanner->p[length];
+            length++;
+        }
+        buffer[length] = '\0';
+        *outValue = (length > 0) ? (int64_t)llround(strtod(buffer, NULL) * (double)OTPriceTickScale) : 0;
+        scanner->p += length;
+    } else {
+        scanner->p += consumed;
+    }
+
+    if (quoted) {
+        while (scanner->p < scanner->end && *scanner->p != '"') {
+            scanner->p++;
+        }
+        return OTTickScannerConsume(scanner, '"');
+    }
+    return YES;
+}
+
+static BOOL OTTickScannerScanTick(OTTickScanner *scanner, OTPriceTick *tick)
+{
+    memset(tick, 0, sizeof(*tick));
+
+    if (!OTTickScannerConsume(scanner, '{')) {
+        return NO;
+    }
+    if (OTTickScannerConsume(scanner, '}')) {
+        return YES;
+    }
+
+    do {
+        const char *key;
+        size_t keyLength;
+        if (!OTTickScannerScanString(scanner, &key, &keyLength) || !OTTickScannerConsume(scanner, ':')) {
+            return NO;
+        }
+
+        BOOL scanned;
+        if (keyLength == 10 && memcmp(key, "instrument", 10) == 0) {
+            const char *value;
+            size_t valueLength;
+            scanned = OTTickScannerScanString(scanner, &value, &valueLength);
+            if (scanned) {
+                size_t copyLength = (valueLength < OTPriceTickInstrumentSize - 1) ? valueLength : OTPriceTickInstrumentSize - 1;
+                memcpy(tick->instrument, value, copyLength);
+                tick->instrument[copyLength] = '\0';
+            }
+        } else if (keyLength == 3 && memcmp(key, "bid", 3) == 0) {
+            scanned = OTTickScannerScanFixedPoint(scanner, &tick->bid);
+        } else if (keyLength == 3 && memcmp(key, "ask", 3) == 0) {
+            scanned = OTTickScannerScanFixedPoint(scanner, &tick->ask);
+        } else if (keyLength == 4 && memcmp(key, "time", 4) == 0) {
+            scanned = OTTickScannerScanFixedPoint(scanner, &tick->time);
+        } else {
+            scanned = OTTickScannerSkipValue(scanner);
+        }
+        if (!scanned) {
+            return NO;
+        }
+    } while (OTTickScannerConsume(scanner, ','));
+
+    return OTTickScannerConsume(scanner, '}');
+}
+
+OTPriceTickMessageType OTPriceTickScanMessage(const char *bytes, size_t length, OTPriceTick *tick)
+{
+    OTTickScanner scanner = { bytes, bytes + length };
+    OTTickScanner peek = scanner;
+    const char *key;
+    size_t keyLength;
+
+    if (!OTTickScannerConsume(&peek, '{') || !OTTickScannerScanString(&peek, &key, &keyLength) || !OTTickScannerConsume(&peek, ':')) {
+        return OTPriceTickMessageInvalid;
+    }
+
+    if (keyLength == 9 && memcmp(key, "heartbeat", 9) == 0) {
+        return OTPriceTickMessageHeartbeat;
+    }
+    if (keyLength == 4 && memcmp(key, "tick", 4) == 0) {
+        // unwrap {"tick":{...}}
+        scanner = peek;
+    }
+
+    return OTTickScannerScanTick(&scanner, tick) ? OTPriceTickMessageTick : OTPriceTickMessageInvalid;
+}
+
+///////////////////////////////////////////////////////////////
+//
+// OTPriceTickList
+//
+///////////////////////////////////////////////////////////////
+#pragma mark OTPriceTickList
+
+@interface OTPriceTickList () {
+    OTPriceTick *_ticks;
+    NSUInteger _count;
+    NSUInteger _capacity;
+}
+@end
+
+@implementation OTPriceTickList
+
++ (OTPriceTickList *)tickListWithPricesData:(NSData *)data
+{
+    OTPriceTickList *tickList = [[OTPriceTickList alloc] init];
+    return [tickList updateWithPricesData:data] ? tickList : nil;
+}
+
+- (void)dealloc
+{
+    free(_ticks);
+}
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+- (const OTPriceTick *)ticks
+{
+    return _ticks;
+}
+
+- (const OTPriceTick *)tickAtIndex:(NSUInteger)index
+{
+    NSParameterAssert(index < _count);
+    return &_ticks[index];
+}
+
+- (const OTPriceTick *)tickForInstrument:(NSString *)instrument
+{
+    const char *name = [instrument UTF8String];
+    if (!name) {
+        return NULL;
+    }
+    for (NSUInteger i = 0; i < _count; i++) {
+        if (strcmp(_ticks[i].instrument, name) == 0) {
+            return &_ticks[i];
+        }
+    }
+    return NULL;
+}
+
+- (BOOL)ensureCapacity:(NSUInteger)capacity
+{
+    if (capacity <= _capacity) {
+        return YES;
+    }
+
+    NSUInteger newCapacity = _capacity ? _capacity * 2 : 32;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+    OTPriceTick *newTicks = realloc(_ticks, newCapacity * sizeof(OTPriceTick));
+    if (!newTicks) {
+        return NO;
+    }
+
+    _ticks = newTicks;
+    _capacity = newCapacity;
+    return YES;
+}
+
+- (BOOL)updateWithPricesData:(NSData *)data
+{
+    _count = 0;
+
+    OTTickScanner scanner = { [data bytes], (const char *)[data bytes] + [data length] };
+    if (!OTTickScannerConsume(&scanner, '{')) {
+        return NO;
+    }
+    if (OTTickScannerConsume(&scanner, '}')) {
+        return YES;
+    }
+
+    do {
+        const char *key;
+        size_t keyLength;
+        if (!OTTickScannerScanString(&scanner, &key, &keyLength) || !OTTickScannerConsume(&scanner, ':')) {
+            _count = 0;
+            return NO;
+        }
+
+        if (keyLength == 6 && memcmp(key, "prices", 6) == 0) {
+            if (!OTTickScannerConsume(&scanner, '[')) {
+                return NO;
+            }
+            if (OTTickScannerConsume(&scanner, ']')) {
+                continue;
+            }
+            do {
+                if (![self ensureCapacity:_count + 1] || !OTTickScannerScanTick(&scanner, &_ticks[_count])) {
+                    _count = 0;
+                    return NO;
+                }
+                _count++;
+            } while (OTTickScannerConsume(&scanner, ','));
+            if (!OTTickScannerConsume(&scanner, ']')) {
+                _count = 0;
+                return NO;
+            }
+        } else if (!OTTickScannerSkipValue(&scanner)) {
+            _count = 0;
+            return NO;
+        }
+    } while (OTTickScannerConsume(&scanner, ','));
+
+    if (!OTTickScannerConsume(&scanner, '}')) {
+        _count = 0;
+        return NO;
+    }
+    return YES;
+}
+
+@end
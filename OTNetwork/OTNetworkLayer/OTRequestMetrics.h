@@ -0,0 +1,149 @@
+//
+//  OTRequestMetrics.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+/** The stages a request goes through, each timed from the end of the one before. */
+typedef enum {
+    OTRequestPhaseQueueing = 0,     // waiting for the requestScheduler, then for AFNetworking to send it
+    OTRequestPhaseServer,           // from sending the request to the response headers: DNS, connect and the server, which NSURLConnection does not tell apart
+    OTRequestPhaseDownload,         // from the response headers to the last byte of the body
+    OTRequestPhaseDecode,           // JSON parse and decode block, on the decodeQueue
+    OTRequestPhaseDispatch,         // waiting for the callbackQueue
+    OTRequestPhaseTotal,            // the whole request, from the call to the callback
+    OTRequestPhaseCount
+} OTRequestPhase;
+
+/** When a request reached each stage, as CFAbsoluteTimeGetCurrent().  0 for a stage it did not reach (eg. no response for a dropped connection). */
+typedef struct {
+    CFAbsoluteTime  queued;         // the call was made
+    CFAbsoluteTime  sent;           // NSURLConnection started sending
+    CFAbsoluteTime  responded;      // the response headers arrived
+    CFAbsoluteTime  finished;       // the last byte of the body arrived
+    CFAbsoluteTime  decoded;        // the result was ready to be handed back
+    CFAbsoluteTime  delivered;      // the callbackQueue got to the callbacks
+} OTRequestTimestamps;
+
+/** How much the body of a response weighed, as it came over the network and once decoded (inflated, if it came compressed). */
+typedef struct {
+    int64_t         wireBytes;      // as sent by the server; -1 if unknown (a compressed body sent in chunks)
+    int64_t         decodedBytes;   // as handed to the parse
+    BOOL            compressed;     // came with a Content-Encoding, eg. gzip
+} OTRequestTransfer;
+
+/** Returns how long the request spent in a phase, or 0 if it did not get through it. */
+NSTimeInterval OTRequestTimestampsDuration(const OTRequestTimestamps *timestamps, OTRequestPhase phase);
+
+/** Number of buckets of each histogram.  Bucket 0 counts durations under 1 microsecond, and bucket i (from 1) durations from 2^(i-1) up
+ to 2^i microseconds, the last one also counting anything longer (about 67 seconds). */
+#define OTRequestMetricsBucketCount     28
+
+/** What the requests to one endpoint have been through, as of a snapshot.  Immutable. */
+@interface OTEndpointMetrics : NSObject
+
+/** Method and path of the endpoint, with ids replaced by :id, eg. @"GET accounts/:id/trades". */
+@property (nonatomic, readonly, copy) NSString *endpoint;
+
+/** Requests answered, successfully or not, and how many of them failed. */
+@property (nonatomic, readonly) NSUInteger numRequests;
+@property (nonatomic, readonly) NSUInteger numFailures;
+
+/** Bytes of the response bodies as they came over the network, and once decoded.  Both only count the responses whose size on the wire is
+ known, so their ratio is what compression saved on this endpoint. */
+@property (nonatomic, readonly) int64_t bytesOnWire;
+@property (nonatomic, readonly) int64_t bytesDecoded;
+
+/** Responses which came compressed. */
+@property (nonatomic, readonly) NSUInteger numCompressedResponses;
+
+/** Returns the OTRequestMetricsBucketCount counts of the histogram of a phase.  Valid as long as the OTEndpointMetrics is. */
+- (const uint32_t *)histogramForPhase:(OTRequestPhase)phase;
+
+/** Returns the given percentile (0 to 100) of the durations of a phase, to within the bucket it falls in (the upper bound of the bucket, or
+ the longest duration if smaller).  0 if no request went through the phase. */
+- (NSTimeInterval)percentile:(double)percentile forPhase:(OTRequestPhase)phase;
+
+/** Returns the mean and longest duration of a phase. */
+- (NSTimeInterval)meanDurationForPhase:(OTRequestPhase)phase;
+- (NSTimeInterval)maxDurationForPhase:(OTRequestPhase)phase;
+
+@end
+
+@class OTRequestMetrics;
+
+@protocol OTRequestMetricsDelegate <NSObject>
+
+/** Triggered once the callbacks of a request have run, on the callbackQueue of the network controller.
+ 
+ @param metrics The metrics the request was just added to.
+ @param endpoint Method and path of the endpoint, as in OTEndpointMetrics.
+ @param timestamps When the request reached each stage.
+ @param failed Whether the failureBlock was triggered.
+ */
+- (void)requestMetrics:(OTRequestMetrics *)metrics didRecordRequestToEndpoint:(NSString *)endpoint timestamps:(OTRequestTimestamps)timestamps failed:(BOOL)failed;
+
+@end
+
+/** Histograms of the time each phase of a request takes, one set per endpoint.
+ 
+ Get the instance of your OTNetworkController from its requestMetrics property, and turn on its collectsMetrics.  Every method is thread safe.
+ */
+@interface OTRequestMetrics : NSObject
+
+/** Told about every request recorded.  Not retained. */
+@property (atomic, weak) id<OTRequestMetricsDelegate> delegate;
+
+/** Returns the endpoint a request belongs to: its method and URL path relative to basePath, with every numeric component replaced by :id.
+ 
+ @param method **Required**.  eg. @"GET".
+ @param path **Required**.  Path of the request URL, eg. @"/v1/accounts/506005/trades".
+ @param basePath **Optional**.  Path of the server URL, eg. @"/v1/", to leave out.
+ */
++ (NSString *)endpointForMethod:(NSString *)method path:(NSString *)path basePath:(NSString *)basePath;
+
+/** Adds a request to the histograms of its endpoint, then tells the delegate.
+ 
+ @param endpoint **Required**.  From endpointForMethod:path:basePath:.
+ @param timestamps **Required**.  When the request reached each stage.
+ @param failed **Required**.  Whether the request failed.
+ */
+- (void)recordRequestToEndpoint:(NSString *)endpoint timestamps:(const OTRequestTimestamps *)timestamps failed:(BOOL)failed;
+
+/** Adds a request to the histograms of its endpoint, along with the bytes of its response, then tells the delegate.
+ 
+ @param endpoint **Required**.  From endpointForMethod:path:basePath:.
+ @param timestamps **Required**.  When the request reached each stage.
+ @param transfer **Optional**.  How much the response weighed.  If NULL, no bytes are counted.
+ @param failed **Required**.  Whether the request failed.
+ */
+- (void)recordRequestToEndpoint:(NSString *)endpoint timestamps:(const OTRequestTimestamps *)timestamps transfer:(const OTRequestTransfer *)transfer failed:(BOOL)failed;
+
+/** Returns the metrics of every endpoint requested so far (or since reset), OTEndpointMetrics keyed by endpoint. */
+- (NSDictionary *)snapshot;
+
+/** Forgets every request recorded so far. */
+- (void)reset;
+
+@end
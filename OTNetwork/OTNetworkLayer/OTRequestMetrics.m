@@ -0,0 +1,278 @@
+//
+//  OTRequestMetrics.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTRequestMetrics.h"
+
+// Everything recorded for one endpoint.
+typedef struct {
+    NSUInteger      numRequests;
+    NSUInteger      numFailures;
+    NSUInteger      numSamples[OTRequestPhaseCount];        // requests which got through each phase
+    NSTimeInterval  totalDuration[OTRequestPhaseCount];
+    NSTimeInterval  maxDuration[OTRequestPhaseCount];
+    uint32_t        buckets[OTRequestPhaseCount][OTRequestMetricsBucketCount];
+    int64_t         bytesOnWire;                            // of the responses whose size on the wire is known
+    int64_t         bytesDecoded;                           // of the same responses
+    NSUInteger      numCompressedResponses;
+} OTEndpointHistograms;
+
+// When a phase started and ended; NO if the request did not get through it.
+static BOOL OTRequestPhaseBounds(const OTRequestTimestamps *timestamps, OTRequestPhase phase, CFAbsoluteTime *start, CFAbsoluteTime *end)
+{
+    switch (phase) {
+        case OTRequestPhaseQueueing:    *start = timestamps->queued;     *end = timestamps->sent;        break;
+        case OTRequestPhaseServer:      *start = timestamps->sent;       *end = timestamps->responded;   break;
+        case OTRequestPhaseDownload:    *start = timestamps->responded;  *end = timestamps->finished;    break;
+        case OTRequestPhaseDecode:      *start = timestamps->finished;   *end = timestamps->decoded;     break;
+        case OTRequestPhaseDispatch:    *start = timestamps->decoded;    *end = timestamps->delivered;   break;
+        case OTRequestPhaseTotal:       *start = timestamps->queued;     *end = timestamps->delivered;   break;
+        default:
+            return NO;
+    }
+
+    return *start > 0 && *end >= *start;
+}
+
+NSTimeInterval OTRequestTimestampsDuration(const OTRequestTimestamps *timestamps, OTRequestPhase phase)
+{
+    CFAbsoluteTime start, end;
+
+    return OTRequestPhaseBounds(timestamps, phase, &start, &end) ? end - start : 0;
+}
+
+static NSUInteger OTRequestMetricsBucket(NSTimeInterval duration)
+{
+    double microseconds = duration * 1e6;
+    if (microseconds < 1.0) {
+        return 0;
+    }
+
+    // microseconds lies in [2^(exponent-1), 2^exponent)
+    int exponent;
+    frexp(microseconds, &exponent);
+
+    return MIN((NSUInteger)exponent, (NSUInteger)(OTRequestMetricsBucketCount - 1));
+}
+
+@interface OTEndpointMetrics () {
+    OTEndpointHistograms _histograms;
+}
+- (id)initWithEndpoint:(NSString *)endpoint histograms:(const OTEndpointHistograms *)histograms;
+@end
+
+@implementation OTEndpointMetrics
+
+- (id)initWithEndpoint:(NSString *)endpoint histograms:(const OTEndpointHistograms *)histograms
+{
+    self = [super init];
+    if (self) {
+        _endpoint = [endpoint copy];
+        _histograms = *histograms;
+    }
+
+    return self;
+}
+
+- (NSUInteger)numRequests
+{
+    return _histograms.numRequests;
+}
+
+- (NSUInteger)numFailures
+{
+    return _histograms.numFailures;
+}
+
+- (int64_t)bytesOnWire
+{
+    return _histograms.bytesOnWire;
+}
+
+- (int64_t)bytesDecoded
+{
+    return _histograms.bytesDecoded;
+}
+
+- (NSUInteger)numCompressedResponses
+{
+    return _histograms.numCompressedResponses;
+}
+
+- (const uint32_t *)histogramForPhase:(OTRequestPhase)phase
+{
+    NSParameterAssert(phase < OTRequestPhaseCount);
+
+    return _histograms.buckets[phase];
+}
+
+- (NSTimeInterval)percentile:(double)percentile forPhase:(OTRequestPhase)phase
+{
+    NSParameterAssert(phase < OTRequestPhaseCount);
+
+    NSUInteger numSamples = _histograms.numSamples[phase];
+    if (numSamples == 0) {
+        return 0;
+    }
+
+    NSUInteger rank = MAX((NSUInteger)1, (NSUInteger)ceil(MIN(MAX(percentile, 0.0), 100.0) / 100.0 * numSamples));
+    NSUInteger count = 0;
+    for (NSUInteger bucket = 0; bucket < OTRequestMetricsBucketCount; bucket++) {
+        count += _histograms.buckets[phase][bucket];
+        if (count >= rank) {
+            return MIN(ldexp(1e-6, (int)bucket), _histograms.maxDuration[phase]);
+        }
+    }
+
+    return _histograms.maxDuration[phase];
+}
+
+- (NSTimeInterval)meanDurationForPhase:(OTRequestPhase)phase
+{
+    NSParameterAssert(phase < OTRequestPhaseCount);
+
+    NSUInteger numSamples = _histograms.numSamples[phase];
+    return numSamples ? _histograms.totalDuration[phase] / numSamples : 0;
+}
+
+- (NSTimeInterval)maxDurationForPhase:(OTRequestPhase)phase
+{
+    NSParameterAssert(phase < OTRequestPhaseCount);
+
+    return _histograms.maxDuration[phase];
+}
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@ %@: %lu requests, %lu failed, p50 %.1f ms, p99 %.1f ms, %lld of %lld bytes on the wire>", [self class], _endpoint,
+            (unsigned long)_histograms.numRequests, (unsigned long)_histograms.numFailures,
+            [self percentile:50 forPhase:OTRequestPhaseTotal] * 1000.0, [self percentile:99 forPhase:OTRequestPhaseTotal] * 1000.0,
+            _histograms.bytesOnWire, _histograms.bytesDecoded];
+}
+
+@end
+
+@interface OTRequestMetrics () {
+    NSMutableDictionary *_histograms;   // endpoint -> NSMutableData holding an OTEndpointHistograms; guarded by @synchronized(self)
+}
+@end
+
+@implementation OTRequestMetrics
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _histograms = [NSMutableDictionary dictionary];
+    }
+
+    return self;
+}
+
++ (NSString *)endpointForMethod:(NSString *)method path:(NSString *)path basePath:(NSString *)basePath
+{
+    NSParameterAssert(method);
+    NSParameterAssert(path);
+
+    if (basePath.length > 0 && [path hasPrefix:basePath]) {
+        path = [path substringFromIndex:basePath.length];
+    }
+
+    NSCharacterSet *nonDigits = [[NSCharacterSet decimalDigitCharacterSet] invertedSet];
+    NSMutableArray *components = [NSMutableArray array];
+    for (NSString *component in [path componentsSeparatedByString:@"/"]) {
+        if (component.length == 0) {
+            continue;
+        }
+        [components addObject:([component rangeOfCharacterFromSet:nonDigits].location == NSNotFound ? @":id" : component)];
+    }
+
+    return [NSString stringWithFormat:@"%@ %@", method, [components componentsJoinedByString:@"/"]];
+}
+
+- (void)recordRequestToEndpoint:(NSString *)endpoint timestamps:(const OTRequestTimestamps *)timestamps failed:(BOOL)failed
+{
+    [self recordRequestToEndpoint:endpoint timestamps:timestamps transfer:NULL failed:failed];
+}
+
+- (void)recordRequestToEndpoint:(NSString *)endpoint timestamps:(const OTRequestTimestamps *)timestamps transfer:(const OTRequestTransfer *)transfer failed:(BOOL)failed
+{
+    NSParameterAssert(endpoint);
+    NSParameterAssert(timestamps);
+
+    @synchronized(self) {
+        NSMutableData *data = [_histograms objectForKey:endpoint];
+        if (!data) {
+            data = [NSMutableData dataWithLength:sizeof(OTEndpointHistograms)];
+            [_histograms setObject:data forKey:endpoint];
+        }
+        OTEndpointHistograms *histograms = (OTEndpointHistograms *)[data mutableBytes];
+
+        histograms->numRequests++;
+        if (failed) {
+            histograms->numFailures++;
+        }
+        for (OTRequestPhase phase = 0; phase < OTRequestPhaseCount; phase++) {
+            CFAbsoluteTime start, end;
+            if (OTRequestPhaseBounds(timestamps, phase, &start, &end)) {
+                NSTimeInterval duration = end - start;
+                histograms->numSamples[phase]++;
+                histograms->totalDuration[phase] += duration;
+                histograms->maxDuration[phase] = MAX(histograms->maxDuration[phase], duration);
+                histograms->buckets[phase][OTRequestMetricsBucket(duration)]++;
+            }
+        }
+        if (transfer) {
+            if (transfer->compressed) {
+                histograms->numCompressedResponses++;
+            }
+            if (transfer->wireBytes >= 0) {
+                histograms->bytesOnWire += transfer->wireBytes;
+                histograms->bytesDecoded += transfer->decodedBytes;
+            }
+        }
+    }
+
+    [self.delegate requestMetrics:self didRecordRequestToEndpoint:endpoint timestamps:*timestamps failed:failed];
+}
+
+- (NSDictionary *)snapshot
+{
+    @synchronized(self) {
+        NSMutableDictionary *snapshot = [NSMutableDictionary dictionaryWithCapacity:_histograms.count];
+        [_histograms enumerateKeysAndObjectsUsingBlock:^(NSString *endpoint, NSData *data, BOOL *stop) {
+            [snapshot setObject:[[OTEndpointMetrics alloc] initWithEndpoint:endpoint histograms:(const OTEndpointHistograms *)[data bytes]] forKey:endpoint];
+        }];
+        return snapshot;
+    }
+}
+
+- (void)reset
+{
+    @synchronized(self) {
+        [_histograms removeAllObjects];
+    }
+}
+
+@end
@@ -0,0 +1,94 @@
+//
+//  OTRequestScheduler.h
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+/** Classes of API calls, most urgent first. */
+typedef enum {
+    OTRequestPriorityTrading = 0,   // creating, changing and closing orders, trades and positions
+    OTRequestPriorityAccount,       // account state: orders, trades, positions, alerts
+    OTRequestPriorityQuotes,        // current prices
+    OTRequestPriorityHistory,       // candles, transactions, instruments
+    OTRequestPriorityCount
+} OTRequestPriority;
+
+/** What a class of requests has been through so far. */
+typedef struct {
+    NSUInteger      queueDepth;     // requests waiting to start
+    NSUInteger      numStarted;     // requests started
+    NSTimeInterval  totalWaitTime;  // time spent waiting by the requests started, so the average wait is totalWaitTime / numStarted
+    NSTimeInterval  maxWaitTime;    // longest wait of a request started
+} OTRequestClassStats;
+
+/** Handed to a request when it may go on the network; to be triggered once it is done, so the next one can start. */
+typedef void (^RequestSchedulerDoneBlock)(void);
+typedef void (^RequestSchedulerStartBlock)(RequestSchedulerDoneBlock doneBlock);
+
+/** Decides when each request of an OTNetworkController goes on the network.
+ 
+ No more than maxConcurrentRequests are on the network at once.  When a slot frees up, it goes to the oldest request of the most urgent
+ class which may start, so polling can no longer hold up an order.
+ 
+ Each class can also be given a token bucket, to stay under the rate the server accepts: a request takes a token to start, and tokens come
+ back at tokensPerSecond, up to burst.  A class out of tokens waits without holding up the classes after it.
+ 
+ The time comes from clock, which specs replace to play with time.  Every method is thread safe.
+ */
+@interface OTRequestScheduler : NSObject
+
+/** Most requests on the network at once.  Default: 4. */
+@property (atomic, assign) NSUInteger maxConcurrentRequests;
+
+/** Returns the current time, in seconds.  Default: CFAbsoluteTimeGetCurrent(). */
+@property (atomic, copy) NSTimeInterval (^clock)(void);
+
+/** Limits a class of requests to tokensPerSecond on average, with bursts of up to burst requests.  0 tokensPerSecond (the default) for no limit.
+ 
+ @param tokensPerSecond **Required**.  Rate at which the class may start requests, eg. 2 for 2 requests per second.  0 for no limit.
+ @param burst **Required**.  Most requests the class may start at once after being idle.  At least 1.
+ @param priority **Required**.  The class of requests.
+ */
+- (void)setTokensPerSecond:(double)tokensPerSecond burst:(NSUInteger)burst forPriority:(OTRequestPriority)priority;
+
+/** To have a request start as soon as its turn comes.
+ 
+ @param priority **Required**.  The class of the request.
+ @param startBlock **Required**.  Triggered when the request may go on the network (maybe right away, on this thread), with the block to trigger once it is done.
+ */
+- (void)scheduleRequestWithPriority:(OTRequestPriority)priority startBlock:(RequestSchedulerStartBlock)startBlock;
+
+/** Starts every request whose turn has come.  Done automatically as requests finish and tokens come back, but specs using their own clock call it after moving time. */
+- (void)startPendingRequests;
+
+/** Requests on the network now. */
+@property (atomic, readonly) NSUInteger numActiveRequests;
+
+/** Queue depth and wait times of a class of requests. */
+- (OTRequestClassStats)statsForPriority:(OTRequestPriority)priority;
+
+/** Clears the counts and wait times of every class (not the queues). */
+- (void)resetStats;
+
+@end
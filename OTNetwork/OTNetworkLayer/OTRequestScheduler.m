@@ -0,0 +1,204 @@
+//
+//  OTRequestScheduler.m
+//  OTNetworkLayer
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTRequestScheduler.h"
+
+typedef struct {
+    double          tokensPerSecond;    // 0 for no limit
+    double          burst;
+    double          tokens;
+    NSTimeInterval  lastRefillTime;
+} OTTokenBucket;
+
+// A request waiting for its turn.
+@interface OTScheduledRequest : NSObject
+@property (nonatomic, copy) RequestSchedulerStartBlock startBlock;
+@property (nonatomic, assign) NSTimeInterval scheduleTime;
+@end
+
+@implementation OTScheduledRequest
+@end
+
+// Everything below is guarded by @synchronized(self).
+@interface OTRequestScheduler () {
+    NSMutableArray *_queues[OTRequestPriorityCount];
+    OTTokenBucket _buckets[OTRequestPriorityCount];
+    OTRequestClassStats _stats[OTRequestPriorityCount];
+    NSTimeInterval _wakeUpTime;                 // when the timer waiting for tokens fires, 0 if there is none
+}
+@property (atomic, readwrite) NSUInteger numActiveRequests;
+@end
+
+@implementation OTRequestScheduler
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        for (NSUInteger priority = 0; priority < OTRequestPriorityCount; priority++) {
+            _queues[priority] = [NSMutableArray array];
+        }
+        _maxConcurrentRequests = 4;
+        _clock = [^NSTimeInterval {
+            return CFAbsoluteTimeGetCurrent();
+        } copy];
+    }
+
+    return self;
+}
+
+- (void)setTokensPerSecond:(double)tokensPerSecond burst:(NSUInteger)burst forPriority:(OTRequestPriority)priority
+{
+    NSAssert(priority < OTRequestPriorityCount, @"Unknown request priority %d", priority);
+    NSAssert(burst >= 1, @"A token bucket must hold at least one token");
+
+    @synchronized(self) {
+        OTTokenBucket *bucket = &_buckets[priority];
+        bucket->tokensPerSecond = MAX(tokensPerSecond, 0);
+        bucket->burst = MAX(burst, 1);
+        bucket->tokens = bucket->burst;
+        bucket->lastRefillTime = self.clock();
+    }
+
+    [self startPendingRequests];
+}
+
+- (void)scheduleRequestWithPriority:(OTRequestPriority)priority startBlock:(RequestSchedulerStartBlock)startBlock
+{
+    NSAssert(priority < OTRequestPriorityCount, @"Unknown request priority %d", priority);
+
+    OTScheduledRequest *request = [[OTScheduledRequest alloc] init];
+    request.startBlock = startBlock;
+
+    @synchronized(self) {
+        request.scheduleTime = self.clock();
+        [_queues[priority] addObject:request];
+    }
+
+    [self startPendingRequests];
+}
+
+- (void)startPendingRequests
+{
+    NSMutableArray *requestsToStart = [NSMutableArray array];
+    NSTimeInterval wakeUpDelay = 0;
+
+    @synchronized(self) {
+        NSTimeInterval now = self.clock();
+
+        while (self.numActiveRequests < self.maxConcurrentRequests) {
+            OTScheduledRequest *nextRequest = nil;
+            wakeUpDelay = 0;
+
+            for (NSUInteger priority = 0; priority < OTRequestPriorityCount && !nextRequest; priority++) {
+                if ([_queues[priority] count] == 0) {
+                    continue;
+                }
+
+                OTTokenBucket *bucket = &_buckets[priority];
+                if (bucket->tokensPerSecond > 0) {
+                    bucket->tokens = MIN(bucket->burst, bucket->tokens + (now - bucket->lastRefillTime) * bucket->tokensPerSecond);
+                    bucket->lastRefillTime = now;
+                    if (bucket->tokens < 1) {
+                        // this class waits for its next token, the ones after it may still go
+                        NSTimeInterval delay = (1 - bucket->tokens) / bucket->tokensPerSecond;
+                        wakeUpDelay = (wakeUpDelay > 0) ? MIN(wakeUpDelay, delay) : delay;
+                        continue;
+                    }
+                    bucket->tokens -= 1;
+                }
+
+                nextRequest = [_queues[priority] objectAtIndex:0];
+                [_queues[priority] removeObjectAtIndex:0];
+
+                NSTimeInterval waitTime = now - nextRequest.scheduleTime;
+                _stats[priority].numStarted++;
+                _stats[priority].totalWaitTime += waitTime;
+                _stats[priority].maxWaitTime = MAX(_stats[priority].maxWaitTime, waitTime);
+            }
+
+            if (!nextRequest) {
+                break;
+            }
+            self.numActiveRequests++;
+            [requestsToStart addObject:nextRequest];
+        }
+
+        // only one timer at a time, for the earliest token awaited
+        if (wakeUpDelay > 0 && (_wakeUpTime == 0 || now + wakeUpDelay < _wakeUpTime)) {
+            _wakeUpTime = now + wakeUpDelay;
+        } else {
+            wakeUpDelay = 0;
+        }
+    }
+
+    if (wakeUpDelay > 0) {
+        __weak OTRequestScheduler *weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(wakeUpDelay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            OTRequestScheduler *strongSelf = weakSelf;
+            if (strongSelf) {
+                @synchronized(strongSelf) {
+                    strongSelf->_wakeUpTime = 0;
+                }
+                [strongSelf startPendingRequests];
+            }
+        });
+    }
+
+    for (OTScheduledRequest *request in requestsToStart) {
+        __block BOOL done = NO;
+        request.startBlock(^{
+            @synchronized(self) {
+                NSAssert(!done, @"A scheduled request was finished twice");
+                if (done) {
+                    return;
+                }
+                done = YES;
+                self.numActiveRequests--;
+            }
+            [self startPendingRequests];
+        });
+    }
+}
+
+- (OTRequestClassStats)statsForPriority:(OTRequestPriority)priority
+{
+    NSAssert(priority < OTRequestPriorityCount, @"Unknown request priority %d", priority);
+
+    @synchronized(self) {
+        OTRequestClassStats stats = _stats[priority];
+        stats.queueDepth = [_queues[priority] count];
+        return stats;
+    }
+}
+
+- (void)resetStats
+{
+    @synchronized(self) {
+        memset(_stats, 0, sizeof(_stats));
+    }
+}
+
+@end
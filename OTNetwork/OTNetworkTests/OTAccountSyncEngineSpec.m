@@ -0,0 +1,164 @@
+//
+//  OTAccountSyncEngineSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTAccountSyncEngine.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTAccountSyncEngineSpec)
+
+describe(@"The Account Sync Engine", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+    __block OTAccountSyncEngine *syncEngine = nil;
+    __block NSMutableArray *orderChanges = nil;     // one @[added, changed, removed] per event
+    __block NSMutableArray *tradeChanges = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        server.orders = @[ @{ @"id" : @1, @"instrument" : @"EUR_USD", @"units" : @100, @"price" : @1.29 },
+                           @{ @"id" : @2, @"instrument" : @"EUR_USD", @"units" : @200, @"price" : @1.28 } ];
+        server.trades = @[ @{ @"id" : @10, @"instrument" : @"USD_JPY", @"units" : @50, @"price" : @82.5 } ];
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        syncEngine = [[OTAccountSyncEngine alloc] initWithNetworkController:networkController accountId:@1234];
+        syncEngine.minPollInterval = 0.05;
+        syncEngine.maxPollInterval = 0.4;
+
+        orderChanges = [NSMutableArray array];
+        tradeChanges = [NSMutableArray array];
+        syncEngine.ordersChangedBlock = ^(NSArray *added, NSArray *changed, NSArray *removed) {
+            [orderChanges addObject:@[added, changed, removed]];
+        };
+        syncEngine.tradesChangedBlock = ^(NSArray *added, NSArray *changed, NSArray *removed) {
+            [tradeChanges addObject:@[added, changed, removed]];
+        };
+    });
+
+    afterEach(^{
+        [syncEngine stop];
+        [server stop];
+    });
+
+    it(@"should report every open order and trade as added on the first sync", ^{
+        [syncEngine start];
+
+        [[expectFutureValue(theValue(orderChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(1)];
+        [[expectFutureValue(theValue(tradeChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(1)];
+        [[[[orderChanges objectAtIndex:0] objectAtIndex:0] should] haveCountOf:2];
+        [[[[tradeChanges objectAtIndex:0] objectAtIndex:0] should] haveCountOf:1];
+        [[[syncEngine.orders allKeys] should] containObjects:@1, @2, nil];
+        [[syncEngine.maxOrderId shouldNot] beNil];
+    });
+
+    it(@"should only report what was added, changed or removed since", ^{
+        [syncEngine start];
+        [[expectFutureValue(theValue(orderChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(1)];
+
+        server.orders = @[ @{ @"id" : @1, @"instrument" : @"EUR_USD", @"units" : @150, @"price" : @1.29 },
+                           @{ @"id" : @3, @"instrument" : @"GBP_USD", @"units" : @300, @"price" : @1.61 } ];
+        [syncEngine syncNow];
+
+        [[expectFutureValue(theValue(orderChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(2)];
+        NSArray *changes = [orderChanges objectAtIndex:1];
+        [[[[changes objectAtIndex:0] valueForKey:@"id"] should] equal:@[@3]];
+        [[[[changes objectAtIndex:1] valueForKey:@"id"] should] equal:@[@1]];
+        [[[[changes objectAtIndex:2] valueForKey:@"id"] should] equal:@[@2]];
+        [[[[syncEngine.orders objectForKey:@1] objectForKey:@"units"] should] equal:@150];
+        [[theValue(syncEngine.orders.count) should] equal:theValue(2)];
+
+        // nothing happened to the trades
+        [[theValue(tradeChanges.count) should] equal:theValue(1)];
+    });
+
+    it(@"should see rows change or go away while the max id stays the same", ^{
+        [syncEngine start];
+        [[expectFutureValue(theValue(orderChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(1)];
+        [[syncEngine.maxOrderId should] equal:@2];
+
+        server.orders = @[ @{ @"id" : @2, @"instrument" : @"EUR_USD", @"units" : @250, @"price" : @1.28 } ];
+        [syncEngine syncNow];
+
+        [[expectFutureValue(theValue(orderChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(2)];
+        NSArray *changes = [orderChanges objectAtIndex:1];
+        [[[changes objectAtIndex:0] should] beEmpty];
+        [[[[changes objectAtIndex:1] valueForKey:@"id"] should] equal:@[@2]];
+        [[[[changes objectAtIndex:2] valueForKey:@"id"] should] equal:@[@1]];
+        [[[syncEngine.orders allKeys] should] equal:@[@2]];
+        [[syncEngine.maxOrderId should] equal:@2];
+    });
+
+    it(@"should see new rows, and rows closed past the first page", ^{
+        // 60 orders: the newest 50 on the first page, ids 10 to 1 on the second
+        NSMutableArray *orders = [NSMutableArray array];
+        for (NSUInteger i = 1; i <= 60; i++) {
+            [orders addObject:@{ @"id" : @(i), @"instrument" : @"EUR_USD", @"units" : @(100 * i), @"price" : @1.29 }];
+        }
+        server.orders = orders;
+        [syncEngine start];
+
+        [[expectFutureValue(theValue(orderChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(1)];
+        [[[[orderChanges objectAtIndex:0] objectAtIndex:0] should] haveCountOf:60];
+        [[syncEngine.maxOrderId should] equal:@60];
+
+        // one opened after the first sync, one closed on the second page
+        [orders removeObjectAtIndex:4];
+        [orders addObject:@{ @"id" : @61, @"instrument" : @"USD_JPY", @"units" : @500, @"price" : @82.5 }];
+        server.orders = orders;
+        [syncEngine syncNow];
+
+        [[expectFutureValue([syncEngine.orders objectForKey:@61]) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[expectFutureValue([syncEngine.orders objectForKey:@5]) shouldEventuallyBeforeTimingOutAfter(5.0)] beNil];
+
+        // a poll running while the orders were swapped may see one change before the other
+        NSMutableArray *addedIds = [NSMutableArray array];
+        NSMutableArray *removedIds = [NSMutableArray array];
+        for (NSArray *changes in [orderChanges subarrayWithRange:NSMakeRange(1, orderChanges.count - 1)]) {
+            [addedIds addObjectsFromArray:[[changes objectAtIndex:0] valueForKey:@"id"]];
+            [removedIds addObjectsFromArray:[[changes objectAtIndex:2] valueForKey:@"id"]];
+        }
+        [[addedIds should] equal:@[@61]];
+        [[removedIds should] equal:@[@5]];
+        [[theValue(syncEngine.orders.count) should] equal:theValue(60)];
+        [[syncEngine.maxOrderId should] equal:@61];
+    });
+
+    it(@"should poll less and less while the account is idle, and speed up on activity", ^{
+        [syncEngine start];
+
+        [[expectFutureValue(theValue(syncEngine.pollInterval)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(syncEngine.maxPollInterval)];
+        NSUInteger numOrderRequests = server.numOrderRequests;
+        [[theValue(numOrderRequests) should] beLessThan:theValue(10)];
+
+        server.trades = @[];
+        [[expectFutureValue(theValue(tradeChanges.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(2)];
+        [[expectFutureValue(theValue(syncEngine.pollInterval)) shouldEventuallyBeforeTimingOutAfter(1.0)] beLessThan:theValue(syncEngine.maxPollInterval)];
+    });
+});
+
+SPEC_END
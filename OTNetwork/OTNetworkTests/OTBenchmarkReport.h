@@ -0,0 +1,71 @@
+//
+//  OTBenchmarkReport.h
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+/** Collects the results of the benchmarks into one machine-readable report, so runs of different releases can be compared.
+ 
+ The report is a JSON file, rewritten after every result so an interrupted run still leaves one behind:
+ 
+     {"version":1,"machine":"x86_64","date":"2012-12-14T10:05:12Z","results":[
+         {"benchmark":"rateCandles","size":1000,"payloadBytes":131890,"iterations":100,
+          "p50Us":2012.4,"p99Us":3410.9,"meanUs":2101.7,"callsPerSecond":475.8,"megabytesPerSecond":62.7,"peakBytes":1482752}, ...]}
+ 
+ It is written to the path in the OT_BENCHMARK_REPORT environment variable, or to OTNetworkBenchmarks.json in the temporary directory.
+ Each result is also logged on a line of its own, starting with "BENCHMARK ".
+ */
+@interface OTBenchmarkReport : NSObject
+
+/** The report of this run. */
++ (OTBenchmarkReport *)sharedReport;
+
+/** Where the report is written. */
+@property (nonatomic, readonly, copy) NSString *path;
+
+/** The results so far, NSDictionary each, in the order they were recorded. */
+@property (nonatomic, readonly) NSArray *results;
+
+/** Bytes allocated through malloc by the whole process, to compare before and after a call. */
++ (int64_t)bytesInUse;
+
+/** Blocks allocated through malloc by the whole process and not yet freed, to count the allocations a call leaves alive. */
++ (int64_t)blocksInUse;
+
+/** Adds a result to the report, and rewrites it.
+ 
+ @param name **Required**.  What was measured, usually the OTNetworkController method (eg. @"rateCandles").
+ @param size **Required**.  How big the canned response was, in rows (candles, instruments, transactions...).
+ @param payloadLength **Optional**.  Length of the canned response in bytes, for the throughput in MB/s.  0 if unknown.
+ @param samples **Required**.  The time taken by each call, NSNumber of seconds.
+ @param peakBytes **Optional**.  The most bytes in use above the baseline during any of the calls.
+ @return The result, as written to the report.
+ */
+- (NSDictionary *)recordBenchmark:(NSString *)name
+                             size:(NSUInteger)size
+                    payloadLength:(NSUInteger)payloadLength
+                          samples:(NSArray *)samples
+                        peakBytes:(int64_t)peakBytes;
+
+@end
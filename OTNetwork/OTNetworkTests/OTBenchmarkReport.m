@@ -0,0 +1,143 @@
+//
+//  OTBenchmarkReport.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTBenchmarkReport.h"
+#import <malloc/malloc.h>
+#import <sys/utsname.h>
+
+#define OTBenchmarkReportVersion    1
+
+@interface OTBenchmarkReport () {
+    NSMutableArray *_results;
+}
+@property (nonatomic, copy) NSString *path;
+@end
+
+@implementation OTBenchmarkReport
+
++ (OTBenchmarkReport *)sharedReport
+{
+    static OTBenchmarkReport *sharedReport = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        sharedReport = [[OTBenchmarkReport alloc] init];
+    });
+
+    return sharedReport;
+}
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _results = [NSMutableArray array];
+        _path = [[[NSProcessInfo processInfo] environment] objectForKey:@"OT_BENCHMARK_REPORT"]
+            ?: [NSTemporaryDirectory() stringByAppendingPathComponent:@"OTNetworkBenchmarks.json"];
+    }
+
+    return self;
+}
+
+- (NSArray *)results
+{
+    @synchronized(self) {
+        return [_results copy];
+    }
+}
+
++ (int64_t)bytesInUse
+{
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(NULL, &statistics);
+
+    return (int64_t)statistics.size_in_use;
+}
+
++ (int64_t)blocksInUse
+{
+    malloc_statistics_t statistics;
+    malloc_zone_statistics(NULL, &statistics);
+
+    return (int64_t)statistics.blocks_in_use;
+}
+
+- (NSDictionary *)recordBenchmark:(NSString *)name
+                             size:(NSUInteger)size
+                    payloadLength:(NSUInteger)payloadLength
+                          samples:(NSArray *)samples
+                        peakBytes:(int64_t)peakBytes
+{
+    NSAssert(name && samples.count > 0, @"a name and at least one sample are required");
+
+    NSArray *sorted = [samples sortedArrayUsingSelector:@selector(compare:)];
+    double total = [[sorted valueForKeyPath:@"@sum.doubleValue"] doubleValue];
+    double p50 = [[sorted objectAtIndex:MIN(sorted.count / 2, sorted.count - 1)] doubleValue];
+    double p99 = [[sorted objectAtIndex:MIN((NSUInteger)(0.99 * sorted.count), sorted.count - 1)] doubleValue];
+
+    NSDictionary *result = @{ @"benchmark" : name,
+                              @"size" : @(size),
+                              @"payloadBytes" : @(payloadLength),
+                              @"iterations" : @(sorted.count),
+                              @"p50Us" : @(round(p50 * 1e7) / 10.0),
+                              @"p99Us" : @(round(p99 * 1e7) / 10.0),
+                              @"meanUs" : @(round(total / sorted.count * 1e7) / 10.0),
+                              @"callsPerSecond" : @(total > 0 ? round(sorted.count / total * 10.0) / 10.0 : 0),
+                              @"megabytesPerSecond" : @(total > 0 ? round((double)payloadLength * sorted.count / total / 1e5) / 10.0 : 0),
+                              @"peakBytes" : @(MAX(peakBytes, 0)) };
+
+    NSData *line = [NSJSONSerialization dataWithJSONObject:result options:0 error:NULL];
+    NSLog(@"BENCHMARK %@", [[NSString alloc] initWithData:line encoding:NSUTF8StringEncoding]);
+
+    @synchronized(self) {
+        [_results addObject:result];
+        [self write];
+    }
+
+    return result;
+}
+
+#pragma mark Helper/Private functions
+
+- (void)write
+{
+    struct utsname name;
+    uname(&name);
+
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone timeZoneWithName:@"UTC"];
+    formatter.dateFormat = @"yyyy-MM-dd'T'HH:mm:ss'Z'";
+
+    NSDictionary *report = @{ @"version" : @(OTBenchmarkReportVersion),
+                              @"machine" : [NSString stringWithUTF8String:name.machine],
+                              @"date" : [formatter stringFromDate:[NSDate date]],
+                              @"results" : _results };
+    NSData *data = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:NULL];
+    if (![data writeToFile:self.path atomically:YES]) {
+        NSLog(@"Could not write the benchmark report to %@", self.path);
+    }
+}
+
+@end
@@ -0,0 +1,308 @@
+//
+//  OTCandleStoreSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+#import "OTBenchmarkReport.h"
+
+// Builds a store of candles at the given offsets (in seconds) from OTStubServerCandleEpoch, all closing at close.
+static OTCandleStore *OTCandleStoreWithTimes(NSArray *times, double close, BOOL lastComplete)
+{
+    NSMutableArray *candles = [NSMutableArray array];
+    [times enumerateObjectsUsingBlock:^(NSNumber *time, NSUInteger idx, BOOL *stop) {
+        [candles addObject:@{ @"time" : @(OTStubServerCandleEpoch + [time longLongValue]),
+                              @"openMid" : @1.2, @"highMid" : @1.3, @"lowMid" : @1.1, @"closeMid" : @(close),
+                              @"volume" : @10, @"complete" : @(idx + 1 < times.count || lastComplete) }];
+    }];
+    return [OTCandleStore candleStoreWithCandles:candles];
+}
+
+static BOOL OTCandleStoreIsContiguous(OTCandleStore *store, int64_t step)
+{
+    OTCandleSlice slice = [store sliceWithRange:NSMakeRange(0, store.count)];
+    for (NSUInteger i = 1; i < slice.count; i++) {
+        if (slice.time[i] - slice.time[i - 1] != step) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+SPEC_BEGIN(OTCandleStoreSpec)
+
+describe(@"The Candle Store", ^{
+
+    const int64_t candleStep = OTStubServerCandleSeconds * OTPriceTickScale;
+
+    context(@"when merging candles", ^{
+
+        it(@"should append newer candles after the ones it holds", ^{
+            OTCandleStore *store = OTCandleStoreWithTimes(@[@0, @5, @10], 1.25, YES);
+            NSRange changed = [store mergeCandlesFromStore:OTCandleStoreWithTimes(@[@15, @20], 1.26, NO)];
+
+            [[theValue(store.count) should] equal:theValue(5)];
+            [[theValue(changed) should] equal:theValue(NSMakeRange(3, 2))];
+            [[theValue(OTCandleStoreIsContiguous(store, candleStep)) should] beYes];
+            [[theValue(store.lastCandleComplete) should] beNo];
+        });
+
+        it(@"should replace the still-forming last candle rather than duplicate it", ^{
+            OTCandleStore *store = OTCandleStoreWithTimes(@[@0, @5, @10], 1.25, NO);
+            const int64_t *closeBefore = [store column:OTCandleColumnClose];
+
+            NSRange changed = [store mergeCandlesFromStore:OTCandleStoreWithTimes(@[@10], 1.27, NO)];
+            [[theValue(store.count) should] equal:theValue(3)];
+            [[theValue(changed) should] equal:theValue(NSMakeRange(2, 1))];
+            [[theValue([store column:OTCandleColumnClose][2]) should] equal:theValue(1270000LL)];
+            [[theValue([store column:OTCandleColumnClose] == closeBefore) should] beYes];
+
+            // the same version again changes nothing
+            changed = [store mergeCandlesFromStore:OTCandleStoreWithTimes(@[@10], 1.27, NO)];
+            [[theValue(changed.length) should] equal:theValue(0)];
+
+            // then it completes, and the next one starts forming
+            changed = [store mergeCandlesFromStore:OTCandleStoreWithTimes(@[@10, @15], 1.28, NO)];
+            [[theValue(store.count) should] equal:theValue(4)];
+            [[theValue(changed) should] equal:theValue(NSMakeRange(2, 2))];
+            [[theValue([store column:OTCandleColumnClose][2]) should] equal:theValue(1280000LL)];
+            [[theValue(store.lastCandleComplete) should] beNo];
+        });
+
+        it(@"should fill a gap with older candles arriving late", ^{
+            OTCandleStore *store = OTCandleStoreWithTimes(@[@0, @5, @25, @30], 1.25, YES);
+            NSRange changed = [store mergeCandlesFromStore:OTCandleStoreWithTimes(@[@10, @15, @20], 1.26, YES)];
+
+            [[theValue(store.count) should] equal:theValue(7)];
+            [[theValue(changed.location) should] equal:theValue(2)];
+            [[theValue(OTCandleStoreIsContiguous(store, candleStep)) should] beYes];
+            [[theValue([store column:OTCandleColumnClose][3]) should] equal:theValue(1260000LL)];
+            [[theValue([store column:OTCandleColumnClose][6]) should] equal:theValue(1250000LL)];
+            [[theValue([store indexOfCandleAtOrAfterTime:(OTStubServerCandleEpoch + 12) * OTPriceTickScale]) should] equal:theValue(3)];
+        });
+
+        it(@"should slice its columns without copying", ^{
+            OTCandleStore *store = OTCandleStoreWithTimes(@[@0, @5, @10, @15], 1.25, YES);
+            OTCandleSlice slice = [store sliceWithRange:NSMakeRange(1, 2)];
+
+            [[theValue(slice.count) should] equal:theValue(2)];
+            [[theValue(slice.time == [store column:OTCandleColumnTime] + 1) should] beYes];
+            [[theValue(slice.close == [store column:OTCandleColumnClose] + 1) should] beYes];
+            [[theValue(slice.time[0]) should] equal:theValue((OTStubServerCandleEpoch + 5) * OTPriceTickScale)];
+        });
+    });
+
+    context(@"when updating from the server", ^{
+
+        __block OTStubServer *server = nil;
+        __block OTNetworkController *networkController = nil;
+        __block OTCandleStore *store = nil;
+        __block NSValue *changedRange = nil;
+
+        void (^update)(void) = ^{
+            changedRange = nil;
+            [store updateWithSuccess:^(NSRange range) {
+                changedRange = [NSValue valueWithRange:range];
+            } failure:^(NSDictionary *error) {
+                NSLog(@"Failure %@", error);
+            }];
+            [[expectFutureValue(changedRange) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        };
+
+        beforeEach(^{
+            server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+            [[theValue([server start]) should] beYes];
+
+            networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+            store = [[OTCandleStore alloc] initWithNetworkController:networkController symbol:@"EUR_USD" granularity:@"S5"];
+            store.initialCount = 50;
+        });
+
+        afterEach(^{
+            [server stop];
+        });
+
+        it(@"should fetch the most recent candles first", ^{
+            update();
+
+            [[theValue(store.count) should] equal:theValue(50)];
+            [[theValue(OTCandleStoreIsContiguous(store, candleStep)) should] beYes];
+            [[theValue([store column:OTCandleColumnTime][49]) should] equal:theValue((OTStubServerCandleEpoch + 999 * OTStubServerCandleSeconds) * OTPriceTickScale)];
+            [[theValue(store.lastCandleComplete) should] beNo];
+        });
+
+        it(@"should only fetch the forming candle again when nothing else is new", ^{
+            update();
+            server.formingCandleRevision = 3;
+            update();
+
+            [[theValue(store.count) should] equal:theValue(50)];
+            [[theValue([changedRange rangeValue]) should] equal:theValue(NSMakeRange(49, 1))];
+            [[theValue(server.numCandleRequests) should] equal:theValue(2)];
+
+            // the forming candle closes, and a new one starts
+            server.candleCount = 1001;
+            update();
+
+            [[theValue(store.count) should] equal:theValue(51)];
+            [[theValue([changedRange rangeValue]) should] equal:theValue(NSMakeRange(49, 2))];
+            [[theValue(OTCandleStoreIsContiguous(store, candleStep)) should] beYes];
+        });
+
+        it(@"should page forward to fill the gap since its last candle", ^{
+            update();
+            server.candleCount = 2000;
+            store.pageSize = 300;
+            update();
+
+            // the candle that was forming had already reached its final close, so it does not count as changed
+            [[theValue(store.count) should] equal:theValue(1050)];
+            [[theValue([changedRange rangeValue]) should] equal:theValue(NSMakeRange(50, 1000))];
+            [[theValue(OTCandleStoreIsContiguous(store, candleStep)) should] beYes];
+            [[theValue(store.lastCandleComplete) should] beNo];
+            [[theValue(server.numCandleRequests) should] equal:theValue(5)];
+        });
+    });
+
+    context(@"when cached on disk", ^{
+
+        __block NSString *cachePath = nil;
+        OTNetworkController *offlineController = [[OTNetworkController alloc] init];
+
+        beforeEach(^{
+            cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"OTCandleStoreSpec-%@.candles", [[NSProcessInfo processInfo] globallyUniqueString]]];
+        });
+
+        afterEach(^{
+            [[NSFileManager defaultManager] removeItemAtPath:cachePath error:NULL];
+        });
+
+        it(@"should read back exactly what it wrote", ^{
+            OTCandleStore *written = OTCandleStoreWithTimes(@[@0, @5, @10, @15], 1.25, NO);
+            [[theValue([written writeToFile:cachePath error:NULL]) should] beYes];
+
+            OTCandleStore *read = [[OTCandleStore alloc] init];
+            [[theValue([read readFromFile:cachePath error:NULL]) should] beYes];
+            [[theValue(read.count) should] equal:theValue(written.count)];
+            [[theValue(read.lastCandleComplete) should] beNo];
+            for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+                [[theValue(memcmp([read column:column], [written column:column], written.count * sizeof(int64_t))) should] equal:theValue(0)];
+            }
+        });
+
+        it(@"should read its columns straight from the file until it is changed", ^{
+            NSMutableArray *times = [NSMutableArray array];
+            for (NSUInteger i = 0; i < 50000; i++) {
+                [times addObject:@(i * 5)];
+            }
+            OTCandleStore *written = OTCandleStoreWithTimes(times, 1.25, YES);
+            [[theValue([written writeToFile:cachePath error:NULL]) should] beYes];
+
+            // 50000 candles take 2.4MB of columns: reading them must not copy them to the heap
+            OTCandleStore *read = [[OTCandleStore alloc] init];
+            int64_t baseline = [OTBenchmarkReport bytesInUse];
+            [[theValue([read readFromFile:cachePath error:NULL]) should] beYes];
+            int64_t heapGrowth = [OTBenchmarkReport bytesInUse] - baseline;
+            [[theValue(heapGrowth) should] beLessThan:theValue((int64_t)256 * 1024)];
+            for (NSUInteger column = 0; column < OTCandleColumnCount; column++) {
+                [[theValue(memcmp([read column:column], [written column:column], written.count * sizeof(int64_t))) should] equal:theValue(0)];
+            }
+
+            // replacing the last candle, then appending, moves the columns off the read-only mapping
+            [read mergeCandlesFromStore:OTCandleStoreWithTimes(@[@249995, @250000], 1.26, NO)];
+            [[theValue(read.count) should] equal:theValue(50001)];
+            [[theValue([read column:OTCandleColumnClose][49998]) should] equal:theValue(1250000LL)];
+            [[theValue([read column:OTCandleColumnClose][49999]) should] equal:theValue(1260000LL)];
+            [[theValue([read column:OTCandleColumnClose][50000]) should] equal:theValue(1260000LL)];
+            [[theValue(read.lastCandleComplete) should] beNo];
+        });
+
+        it(@"should reject damaged files and leave itself untouched", ^{
+            [OTCandleStoreWithTimes(@[@0, @5, @10, @15], 1.25, YES) writeToFile:cachePath error:NULL];
+            NSMutableData *bytes = [NSMutableData dataWithContentsOfFile:cachePath];
+            OTCandleStore *store = OTCandleStoreWithTimes(@[@100], 1.25, YES);
+            NSError *error = nil;
+
+            // one flipped bit in a price
+            NSMutableData *flipped = [bytes mutableCopy];
+            ((unsigned char *)flipped.mutableBytes)[flipped.length - 20] ^= 0x01;
+            [flipped writeToFile:cachePath atomically:YES];
+            [[theValue([store readFromFile:cachePath error:&error]) should] beNo];
+            [[theValue(error.code) should] equal:theValue(OTCandleStoreErrorFileCorrupt)];
+
+            // cut short
+            [[bytes subdataWithRange:NSMakeRange(0, bytes.length - 8)] writeToFile:cachePath atomically:YES];
+            [[theValue([store readFromFile:cachePath error:&error]) should] beNo];
+            [[theValue(error.code) should] equal:theValue(OTCandleStoreErrorFileCorrupt)];
+
+            // another version
+            NSMutableData *otherVersion = [bytes mutableCopy];
+            ((uint32_t *)otherVersion.mutableBytes)[2] = OTCandleStoreFileVersion + 1;
+            [otherVersion writeToFile:cachePath atomically:YES];
+            [[theValue([store readFromFile:cachePath error:&error]) should] beNo];
+            [[theValue(error.code) should] equal:theValue(OTCandleStoreErrorFileVersion)];
+
+            [[theValue(store.count) should] equal:theValue(1)];
+        });
+
+        it(@"should discard a cache file of another symbol", ^{
+            OTCandleStore *gbpStore = [[OTCandleStore alloc] initWithNetworkController:offlineController symbol:@"GBP_USD" granularity:@"S5"];
+            [gbpStore mergeCandlesFromStore:OTCandleStoreWithTimes(@[@0, @5], 1.25, YES)];
+            [[theValue([gbpStore writeToFile:cachePath error:NULL]) should] beYes];
+
+            OTCandleStore *eurStore = [[OTCandleStore alloc] initWithNetworkController:offlineController symbol:@"EUR_USD" granularity:@"S5" cachePath:cachePath];
+            [[theValue(eurStore.count) should] equal:theValue(0)];
+            [[theValue([[NSFileManager defaultManager] fileExistsAtPath:cachePath]) should] beNo];
+        });
+
+        it(@"should start from the cache and only fetch the missing tail", ^{
+            OTStubServer *server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+            [[theValue([server start]) should] beYes];
+            OTNetworkController *networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+
+            OTCandleStore *firstRun = [[OTCandleStore alloc] initWithNetworkController:networkController symbol:@"EUR_USD" granularity:@"S5" cachePath:cachePath];
+            firstRun.initialCount = 200;
+            __block BOOL updated = NO;
+            [firstRun updateWithSuccess:^(NSRange changedRange) { updated = YES; } failure:nil];
+            [[expectFutureValue(theValue(updated)) shouldEventuallyBeforeTimingOutAfter(5.0)] beYes];
+            [[expectFutureValue(theValue([[NSFileManager defaultManager] fileExistsAtPath:cachePath])) shouldEventuallyBeforeTimingOutAfter(5.0)] beYes];
+
+            server.candleCount += 30;
+            OTCandleStore *secondRun = [[OTCandleStore alloc] initWithNetworkController:networkController symbol:@"EUR_USD" granularity:@"S5" cachePath:cachePath];
+            [[theValue(secondRun.count) should] equal:theValue(200)];
+
+            updated = NO;
+            [secondRun updateWithSuccess:^(NSRange changedRange) { updated = YES; } failure:nil];
+            [[expectFutureValue(theValue(updated)) shouldEventuallyBeforeTimingOutAfter(5.0)] beYes];
+            [[theValue(secondRun.count) should] equal:theValue(230)];
+            [[theValue(server.numCandleRequests) should] equal:theValue(2)];
+            [[theValue(OTCandleStoreIsContiguous(secondRun, candleStep)) should] beYes];
+
+            [server stop];
+        });
+    });
+});
+
+SPEC_END
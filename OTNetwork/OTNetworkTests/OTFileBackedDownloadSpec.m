@@ -0,0 +1,232 @@
+//
+//  OTFileBackedDownloadSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+#import "OTBenchmarkReport.h"
+
+// The request stage is private to OTNetworkController; the specs hand it a decode block of their own, to look at the body as the parse would get it.
+@interface OTNetworkController (FileBackedDownloadAccess)
+- (void)requestWithMethod:(NSString *)method
+                     path:(NSString *)path
+               parameters:(NSDictionary *)parameters
+                   decode:(id (^)(NSData *responseData))decodeBlock
+                  success:(void (^)(id result))successBlock
+                  failure:(NetworkFailBlock)failureBlock;
+@end
+
+// Builds a /candles response of count candles, shaped like the sandbox output.
+static NSData *OTFileBackedCandlesPayload(NSUInteger count)
+{
+    const char *head = "{\"instrument\":\"EUR_USD\",\"granularity\":\"S5\",\"candles\":[";
+    NSMutableData *json = [NSMutableData dataWithCapacity:count * 140];
+    char candle[160];
+    [json appendBytes:head length:strlen(head)];
+    for (NSUInteger i = 0; i < count; i++) {
+        int length = snprintf(candle, sizeof(candle), "%s{\"time\":%lu,\"openMid\":1.3%04lu5,\"highMid\":1.3%04lu9,\"lowMid\":1.3%04lu1,\"closeMid\":1.3%04lu7,\"volume\":%lu,\"complete\":true}",
+                              (i ? "," : ""), (unsigned long)(1355000000 + i * 5), (unsigned long)(i % 10000), (unsigned long)(i % 10000),
+                              (unsigned long)(i % 10000), (unsigned long)(i % 10000), (unsigned long)(i % 97));
+        [json appendBytes:candle length:(NSUInteger)length];
+    }
+    [json appendBytes:"]}" length:2];
+
+    return json;
+}
+
+// Number of files a download may have left in the temporary directory.
+static NSUInteger OTFileBackedNumDownloadFiles(void)
+{
+    NSArray *files = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:NSTemporaryDirectory() error:NULL];
+    return [[files filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"SELF BEGINSWITH 'OTNetwork-'"]] count];
+}
+
+SPEC_BEGIN(OTFileBackedDownloadSpec)
+
+describe(@"The Network Controller file-backed downloads", ^{
+
+    // about 16MB, far more than the heap growth allowed while downloading it
+    NSData *payload = OTFileBackedCandlesPayload(120000);
+    const int64_t heapCeiling = 4 * 1024 * 1024;
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        [server setFixtureData:payload forMethod:@"GET" pathPattern:@"/v1/candles"];
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    // Downloads the candles, and returns in heapGrowth how much more of the heap was in use once the body reached the decode stage.  Only
+    // the transfer is measured: the decode block looks at the body without parsing it.
+    void (^downloadCandles)(int64_t *, BOOL *) = ^(int64_t *heapGrowth, BOOL *sameBody) {
+        __block int64_t growth = 0;
+        __block BOOL same = NO;
+        __block BOOL done = NO;
+        int64_t baseline = [OTBenchmarkReport bytesInUse];
+
+        [networkController requestWithMethod:@"GET" path:@"candles" parameters:@{ @"instrument" : @"EUR_USD" } decode:^id(NSData *responseData) {
+            growth = [OTBenchmarkReport bytesInUse] - baseline;
+            same = [responseData isEqualToData:payload];
+            return @(responseData.length);
+        } success:^(id result) {
+            done = YES;
+        } failure:^(NSDictionary *error) {
+            NSLog(@"Failure %@", error);
+        }];
+
+        [[expectFutureValue(theValue(done)) shouldEventuallyBeforeTimingOutAfter(30.0)] beYes];
+        *heapGrowth = growth;
+        *sameBody = same;
+    };
+
+    // Parses the candles with rateCandleColumnsForSymbol:, and returns the most the heap grew by from the request to the result, sampled
+    // every millisecond.
+    int64_t (^peakHeapGrowthOfCandleColumns)(void) = ^int64_t(void) {
+        __block int64_t peak = 0;
+        __block OTCandleStore *candles = nil;
+        int64_t baseline = [OTBenchmarkReport bytesInUse];
+
+        dispatch_queue_t samplingQueue = dispatch_queue_create("com.oanda.OTFileBackedDownloadSpec.sampling", DISPATCH_QUEUE_SERIAL);
+        dispatch_source_t sampler = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, samplingQueue);
+        dispatch_source_set_timer(sampler, DISPATCH_TIME_NOW, NSEC_PER_MSEC, NSEC_PER_MSEC / 10);
+        dispatch_source_set_event_handler(sampler, ^{
+            peak = MAX(peak, [OTBenchmarkReport bytesInUse] - baseline);
+        });
+        dispatch_resume(sampler);
+
+        [networkController rateCandleColumnsForSymbol:@"EUR_USD" granularity:@"S5" sinceTime:nil numberOfPoints:@10 success:^(OTCandleStore *result) {
+            candles = result;
+        } failure:^(NSDictionary *error) {
+            NSLog(@"Failure %@", error);
+        }];
+
+        [[expectFutureValue(candles) shouldEventuallyBeforeTimingOutAfter(30.0)] beNonNil];
+        dispatch_source_cancel(sampler);
+        __block int64_t result = 0;
+        dispatch_sync(samplingQueue, ^{
+            result = peak;
+        });
+#if !OS_OBJECT_USE_OBJC
+        dispatch_release(sampler);
+        dispatch_release(samplingQueue);
+#endif
+        [[theValue(candles.count) should] equal:theValue(120000)];
+        return result;
+    };
+
+    it(@"should keep a large history download out of the heap", ^{
+        int64_t heapGrowth = 0;
+        BOOL sameBody = NO;
+        NSUInteger numFilesBefore = OTFileBackedNumDownloadFiles();
+
+        networkController.downloadsHistoryToFile = YES;
+        downloadCandles(&heapGrowth, &sameBody);
+
+        NSLog(@"file-backed download of %lu bytes: heap grew by %lld bytes", (unsigned long)payload.length, (long long)heapGrowth);
+        [[theValue(sameBody) should] beYes];
+        [[theValue(heapGrowth) should] beLessThan:theValue(heapCeiling)];
+        // the file goes as soon as it is mapped
+        [[theValue(OTFileBackedNumDownloadFiles()) should] equal:theValue(numFilesBefore)];
+    });
+
+    it(@"should hold the whole body in the heap otherwise", ^{
+        int64_t heapGrowth = 0;
+        BOOL sameBody = NO;
+
+        [[theValue(networkController.downloadsHistoryToFile) should] beNo];
+        downloadCandles(&heapGrowth, &sameBody);
+
+        NSLog(@"in-memory download of %lu bytes: heap grew by %lld bytes", (unsigned long)payload.length, (long long)heapGrowth);
+        [[theValue(sameBody) should] beYes];
+        [[theValue(heapGrowth) should] beGreaterThan:theValue((int64_t)payload.length)];
+    });
+
+    it(@"should still hand over the error the server sent", ^{
+        __block NSDictionary *failure = nil;
+        NSUInteger numFilesBefore = OTFileBackedNumDownloadFiles();
+        server.errorRate = 1.0;
+        networkController.downloadsHistoryToFile = YES;
+
+        [networkController rateCandlesForSymbol:@"EUR_USD" granularity:@"S5" numberOfPoints:@10 success:^(NSDictionary *result) {
+            NSLog(@"Unexpected success");
+        } failure:^(NSDictionary *error) {
+            failure = error;
+        }];
+
+        [[expectFutureValue([failure objectForKey:@"http status code"]) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:@500];
+        [[[failure objectForKey:@"message"] should] equal:@"Internal Server Error"];
+        [[expectFutureValue(theValue(OTFileBackedNumDownloadFiles())) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(numFilesBefore)];
+    });
+
+    it(@"should parse the candles from the mapped file", ^{
+        __block OTCandleStore *candles = nil;
+        networkController.downloadsHistoryToFile = YES;
+
+        [networkController rateCandleColumnsForSymbol:@"EUR_USD" granularity:@"S5" sinceTime:nil numberOfPoints:@10 success:^(OTCandleStore *result) {
+            candles = result;
+        } failure:^(NSDictionary *error) {
+            NSLog(@"Failure %@", error);
+        }];
+
+        [[expectFutureValue(candles) shouldEventuallyBeforeTimingOutAfter(30.0)] beNonNil];
+        [[theValue(candles.count) should] equal:theValue(120000)];
+    });
+
+    it(@"should only spare the heap the body, the parse still growing with the payload", ^{
+        int64_t inMemoryPeak = peakHeapGrowthOfCandleColumns();
+        networkController.downloadsHistoryToFile = YES;
+        int64_t fileBackedPeak = peakHeapGrowthOfCandleColumns();
+
+        NSLog(@"candle columns of %lu bytes: heap peaked %lld bytes up in memory, %lld bytes up file-backed",
+              (unsigned long)payload.length, (long long)inMemoryPeak, (long long)fileBackedPeak);
+        [[theValue(fileBackedPeak) should] beGreaterThan:theValue(heapCeiling)];
+        [[theValue(fileBackedPeak) should] beLessThan:theValue(inMemoryPeak - (int64_t)payload.length / 2)];
+    });
+
+    it(@"should fail the candles when the body is not JSON", ^{
+        __block NSDictionary *failure = nil;
+        [server setFixtureData:[@"<html>Bad Gateway</html>" dataUsingEncoding:NSUTF8StringEncoding] forMethod:@"GET" pathPattern:@"/v1/candles"];
+        networkController.downloadsHistoryToFile = YES;
+
+        [networkController rateCandleColumnsForSymbol:@"EUR_USD" granularity:@"S5" sinceTime:nil numberOfPoints:@10 success:^(OTCandleStore *result) {
+            NSLog(@"Unexpected success %@", result);
+        } failure:^(NSDictionary *error) {
+            failure = error;
+        }];
+
+        [[expectFutureValue(failure) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[theValue([[failure objectForKey:@"net error"] code]) should] equal:theValue(NSPropertyListReadCorruptError)];
+    });
+});
+
+SPEC_END
@@ -0,0 +1,108 @@
+//
+//  OTJSONCacheSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "JSONKit.h"
+
+SPEC_BEGIN(OTJSONCacheSpec)
+
+describe(@"The JSONKit object cache", ^{
+
+    NSData *json = [@"[{\"a\":\"x\",\"b\":1},{\"a\":\"x\",\"b\":2}]" dataUsingEncoding:NSUTF8StringEncoding];
+    id expected = @[ @{ @"a" : @"x", @"b" : @1 }, @{ @"a" : @"x", @"b" : @2 } ];
+
+    it(@"should start with the compiled-in geometry and nothing counted", ^{
+        JSONDecoder *decoder = [JSONDecoder decoder];
+        JKCacheStatistics statistics = [decoder cacheStatistics];
+
+        [[theValue([decoder cacheSlotsBits]) should] equal:theValue(10)];
+        [[theValue([decoder cacheProbes]) should] equal:theValue(4)];
+        [[theValue(statistics.hits + statistics.misses + statistics.evictions + statistics.uncachedMisses + statistics.slotsInUse) should] equal:theValue(0)];
+    });
+
+    it(@"should count what it finds and what it creates", ^{
+        JSONDecoder *decoder = [JSONDecoder decoder];
+
+        // "a", "x", "b" and 1 are created, then found again in the second object; 2 is created
+        [[[decoder objectWithData:json] should] equal:expected];
+        JKCacheStatistics statistics = [decoder cacheStatistics];
+        [[theValue(statistics.misses) should] equal:theValue(5)];
+        [[theValue(statistics.hits) should] equal:theValue(3)];
+        [[theValue(statistics.evictions) should] equal:theValue(0)];
+        [[theValue(statistics.uncachedMisses) should] equal:theValue(0)];
+        [[theValue(statistics.slotsInUse) should] equal:theValue(5)];
+
+        // the next response finds everything
+        [[[decoder objectWithData:json] should] equal:expected];
+        statistics = [decoder cacheStatistics];
+        [[theValue(statistics.misses) should] equal:theValue(5)];
+        [[theValue(statistics.hits) should] equal:theValue(11)];
+
+        [decoder resetCacheStatistics];
+        statistics = [decoder cacheStatistics];
+        [[theValue(statistics.hits + statistics.misses) should] equal:theValue(0)];
+        [[theValue(statistics.slotsInUse) should] equal:theValue(5)];
+    });
+
+    it(@"should evict, or skip caching, when it is too small", ^{
+        NSMutableArray *strings = [NSMutableArray array];
+        for (NSUInteger i = 0; i < 100; i++) {
+            [strings addObject:[NSString stringWithFormat:@"s%lu", (unsigned long)i]];
+        }
+        NSData *manyStrings = [NSJSONSerialization dataWithJSONObject:strings options:0 error:NULL];
+        JSONDecoder *decoder = [JSONDecoder decoder];
+        [[theValue([decoder setCacheSlotsBits:1 probes:1]) should] beYes];
+
+        [[[decoder objectWithData:manyStrings] should] equal:strings];
+        JKCacheStatistics statistics = [decoder cacheStatistics];
+        [[theValue(statistics.hits + statistics.misses) should] equal:theValue(100)];
+        [[theValue(statistics.evictions + statistics.uncachedMisses) should] beGreaterThan:theValue(0)];
+        [[theValue(statistics.slotsInUse) should] beLessThanOrEqualTo:theValue(2)];
+    });
+
+    it(@"should empty the cache when resized", ^{
+        JSONDecoder *decoder = [JSONDecoder decoder];
+        [decoder objectWithData:json];
+
+        [[theValue([decoder setCacheSlotsBits:12 probes:2]) should] beYes];
+        [[theValue([decoder cacheSlotsBits]) should] equal:theValue(12)];
+        [[theValue([decoder cacheProbes]) should] equal:theValue(2)];
+        [[theValue([decoder cacheStatistics].slotsInUse) should] equal:theValue(0)];
+        [[[decoder objectWithData:json] should] equal:expected];
+        [[theValue([decoder cacheStatistics].slotsInUse) should] equal:theValue(5)];
+    });
+
+    it(@"should refuse a geometry out of range", ^{
+        JSONDecoder *decoder = [JSONDecoder decoder];
+
+        [[theBlock(^{ [decoder setCacheSlotsBits:0 probes:4]; }) should] raise];
+        [[theBlock(^{ [decoder setCacheSlotsBits:JK_CACHE_MAX_SLOTS_BITS + 1 probes:4]; }) should] raise];
+        [[theBlock(^{ [decoder setCacheSlotsBits:10 probes:0]; }) should] raise];
+        [[theBlock(^{ [decoder setCacheSlotsBits:10 probes:JK_CACHE_MAX_PROBES + 1]; }) should] raise];
+        [[theValue([decoder cacheSlotsBits]) should] equal:theValue(10)];
+    });
+});
+
+SPEC_END
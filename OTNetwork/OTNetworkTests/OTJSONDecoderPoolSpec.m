@@ -0,0 +1,118 @@
+//
+//  OTJSONDecoderPoolSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTJSONDecoderPool.h"
+
+SPEC_BEGIN(OTJSONDecoderPoolSpec)
+
+describe(@"The JSON Decoder Pool", ^{
+
+    NSData *json = [@"{\"prices\":[{\"instrument\":\"EUR_USD\",\"bid\":1.29564,\"ask\":1.29596}]}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSDictionary *expected = @{ @"prices" : @[ @{ @"instrument" : @"EUR_USD", @"bid" : @1.29564, @"ask" : @1.29596 } ] };
+
+    it(@"should keep lending the same decoder to parses made one at a time", ^{
+        OTJSONDecoderPool *pool = [[OTJSONDecoderPool alloc] initWithParseOptions:JKParseOptionNone];
+        dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+        for (NSUInteger i = 0; i < 50; i++) {
+            __block id object = nil;
+            dispatch_sync(queue, ^{
+                object = [pool objectWithData:json error:NULL];
+            });
+            [[object should] equal:expected];
+        }
+
+        [[theValue(pool.numDecodersCreated) should] equal:theValue(1)];
+        [[theValue(pool.numDecodersLent) should] equal:theValue(50)];
+        [[theValue(pool.numIdleDecoders) should] equal:theValue(1)];
+    });
+
+    it(@"should never lend a decoder to two parses at once", ^{
+        OTJSONDecoderPool *pool = [[OTJSONDecoderPool alloc] initWithParseOptions:JKParseOptionNone];
+        NSMutableSet *busyDecoders = [NSMutableSet set];
+        __block BOOL shared = NO;
+
+        dispatch_apply(200, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t i) {
+            [pool performWithDecoder:^id (JSONDecoder *decoder) {
+                NSValue *key = [NSValue valueWithNonretainedObject:decoder];
+                @synchronized(busyDecoders) {
+                    shared = shared || [busyDecoders containsObject:key];
+                    [busyDecoders addObject:key];
+                }
+                id object = [decoder objectWithData:json];
+                @synchronized(busyDecoders) {
+                    [busyDecoders removeObject:key];
+                }
+                return object;
+            }];
+        });
+
+        [[theValue(shared) should] beNo];
+        [[theValue(pool.numDecodersLent) should] equal:theValue(200)];
+        [[theValue(pool.numIdleDecoders) should] beLessThanOrEqualTo:theValue(pool.maxIdleDecoders)];
+
+        [pool removeIdleDecoders];
+        [[theValue(pool.numIdleDecoders) should] equal:theValue(0)];
+    });
+
+    it(@"should hand back the error of malformed JSON", ^{
+        OTJSONDecoderPool *pool = [[OTJSONDecoderPool alloc] init];
+        NSError *error = nil;
+
+        [[[pool objectWithData:[@"{\"prices\":[" dataUsingEncoding:NSUTF8StringEncoding] error:&error] should] beNil];
+        [[error should] beNonNil];
+        // and the decoder is still good for the next one
+        [[[pool objectWithData:json error:&error] should] equal:expected];
+        [[theValue(pool.numDecodersCreated) should] equal:theValue(1)];
+    });
+
+    it(@"should size the caches of its decoders, and add up their statistics", ^{
+        OTJSONDecoderPool *pool = [[OTJSONDecoderPool alloc] initWithParseOptions:JKParseOptionNone];
+        pool.cacheSlotsBits = 8;
+
+        [pool performWithDecoder:^id (JSONDecoder *decoder) {
+            [[theValue([decoder cacheSlotsBits]) should] equal:theValue(8)];
+            [[theValue([decoder cacheProbes]) should] equal:theValue(4)];
+            return nil;
+        }];
+        [pool objectWithData:json error:NULL];
+        [pool objectWithData:json error:NULL];
+
+        // the second parse finds every key and value of the first
+        JKCacheStatistics statistics = [pool cacheStatistics];
+        [[theValue(statistics.misses) should] equal:theValue(7)];
+        [[theValue(statistics.hits) should] equal:theValue(7)];
+    });
+
+    it(@"should belong to the network controller", ^{
+        OTNetworkController *networkController = [[OTNetworkController alloc] init];
+        [[networkController.decoderPool should] beNonNil];
+        [[theValue(networkController.decoderPool.parseOptions) should] equal:theValue(JKParseOptionNone)];
+    });
+});
+
+SPEC_END
@@ -0,0 +1,238 @@
+//
+//  OTJSONNumberSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "JSONKit.h"
+
+// Writes a random number to buffer (which must hold 40 bytes): 1 to 10 integer digits and 0 to 11 fraction digits, so that plain
+// decimals, decimals with too many fraction digits and the odd exponent all come up.  Returns its length.
+static size_t OTNumberTestRandomDecimal(char *buffer, NSUInteger maxFractionDigits)
+{
+    size_t length = 0;
+    long integerDigits = 1 + random() % 10, fractionDigits = random() % (maxFractionDigits + 1);
+
+    if (random() % 2) {
+        buffer[length++] = '-';
+    }
+    for (long i = 0; i < integerDigits; i++) {
+        buffer[length++] = (char)('0' + ((i == 0 && integerDigits > 1) ? 1 + random() % 9 : random() % 10));
+    }
+    if (fractionDigits > 0) {
+        buffer[length++] = '.';
+        for (long i = 0; i < fractionDigits; i++) {
+            buffer[length++] = (char)('0' + random() % 10);
+        }
+    }
+    if (maxFractionDigits > JK_FIXED_DECIMAL_MAX_DIGITS && random() % 50 == 0) {
+        length += (size_t)sprintf(buffer + length, "e-%ld", random() % 20);
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+// What JKScanFixedDecimal must return, worked out on the digits themselves: truncate to scaleDigits (or pad), then round half away from zero.
+static int64_t OTNumberTestScaled(const char *decimal, NSUInteger scaleDigits)
+{
+    char digits[40];
+    size_t length = 0;
+    NSUInteger fractionDigits = 0;
+    BOOL inFraction = NO, roundUp = NO;
+
+    for (const char *p = (*decimal == '-') ? decimal + 1 : decimal; *p; p++) {
+        if (*p == '.') {
+            inFraction = YES;
+        } else if (!inFraction || fractionDigits < scaleDigits) {
+            digits[length++] = *p;
+            fractionDigits += inFraction ? 1 : 0;
+        } else if (fractionDigits++ == scaleDigits) {
+            roundUp = (*p >= '5');
+        }
+    }
+    for (; fractionDigits < scaleDigits; fractionDigits++) {
+        digits[length++] = '0';
+    }
+    digits[length] = '\0';
+
+    int64_t value = strtoll(digits, NULL, 10) + (roundUp ? 1 : 0);
+    return (*decimal == '-') ? -value : value;
+}
+
+SPEC_BEGIN(OTJSONNumberSpec)
+
+describe(@"The JSONKit number parser", ^{
+
+    it(@"should convert numbers to the same double or integer as strtod and strtoll", ^{
+        srandom(20);
+        const NSUInteger numbersPerDocument = 2000;
+        char (*numbers)[40] = malloc(numbersPerDocument * sizeof(*numbers));
+        NSUInteger mismatches = 0;
+
+        // 2 million numbers, 2000 to a document
+        for (NSUInteger document = 0; document < 1000; document++) {
+            @autoreleasepool {
+                NSMutableData *json = [NSMutableData dataWithBytes:"[" length:1];
+                for (NSUInteger i = 0; i < numbersPerDocument; i++) {
+                    size_t length = OTNumberTestRandomDecimal(numbers[i], 11);
+                    [json appendBytes:(i ? "," : "") length:(i ? 1 : 0)];
+                    [json appendBytes:numbers[i] length:length];
+                }
+                [json appendBytes:"]" length:1];
+
+                NSArray *decoded = [[JSONDecoder decoder] objectWithData:json];
+                [[theValue(decoded.count) should] equal:theValue(numbersPerDocument)];
+
+                for (NSUInteger i = 0; i < decoded.count; i++) {
+                    NSNumber *number = [decoded objectAtIndex:i];
+                    if (strpbrk(numbers[i], ".e") != NULL || strcmp(numbers[i], "-0") == 0) {
+                        double expected = strtod(numbers[i], NULL), actual = number.doubleValue;
+                        mismatches += (memcmp(&expected, &actual, sizeof(double)) != 0);
+                    } else {
+                        mismatches += (number.longLongValue != strtoll(numbers[i], NULL, 10));
+                    }
+                }
+            }
+        }
+        free(numbers);
+
+        [[theValue(mismatches) should] equal:theValue(0)];
+    });
+
+    it(@"should scale plain decimals to int64 exactly", ^{
+        srandom(21);
+        const double powersOfTen[JK_FIXED_DECIMAL_MAX_DIGITS + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+        NSUInteger mismatches = 0;
+        char decimal[40];
+
+        for (NSUInteger i = 0; i < 2000000; i++) {
+            size_t length = OTNumberTestRandomDecimal(decimal, JK_FIXED_DECIMAL_MAX_DIGITS);
+            const char *point = strchr(decimal, '.');
+            NSUInteger fractionDigits = point ? strlen(point + 1) : 0, scaleDigits = (NSUInteger)(random() % (JK_FIXED_DECIMAL_MAX_DIGITS + 1));
+            NSUInteger integerDigits = (point ? (NSUInteger)(point - decimal) : length) - (decimal[0] == '-' ? 1 : 0);
+            int64_t value = 0;
+
+            // at its own number of fraction digits the value is exact, and dividing it back is the very double strtod returns
+            if (!JKScanFixedDecimal((const unsigned char *)decimal, length, fractionDigits, &value)) {
+                mismatches += (integerDigits + fractionDigits < 19); // 19 digits may not fit an int64_t
+                continue;
+            }
+            double expected = strtod(decimal, NULL), actual = (double)value / powersOfTen[fractionDigits];
+            mismatches += (llabs(value) <= (1LL << 53) && memcmp(&expected, &actual, sizeof(double)) != 0);
+
+            // at any other scale it is rounded (or padded) exactly like the digits say
+            if (integerDigits + JK_FIXED_DECIMAL_MAX_DIGITS < 19) {
+                mismatches += (!JKScanFixedDecimal((const unsigned char *)decimal, length, scaleDigits, &value) || value != OTNumberTestScaled(decimal, scaleDigits));
+            }
+        }
+
+        [[theValue(mismatches) should] equal:theValue(0)];
+    });
+
+    it(@"should only scale plain decimals that fit", ^{
+        int64_t value = 42;
+        [[theValue(JKScanFixedDecimal((const unsigned char *)"-9223372036854775808", 20, 0, &value)) should] beYes];
+        [[theValue(value) should] equal:theValue(INT64_MIN)];
+        [[theValue(JKScanFixedDecimal((const unsigned char *)"1.5", 3, 0, &value)) should] beYes];
+        [[theValue(value) should] equal:theValue(2)];
+        [[theValue(JKScanFixedDecimal((const unsigned char *)"-0.0000005", 10, 6, &value)) should] beYes];
+        [[theValue(value) should] equal:theValue(-1)];
+
+        for (NSString *notPlain in @[ @"", @"-", @".5", @"1.", @"+1", @"1e5", @"1.5 ", @"0x10", @"0.0000000001", @"9223372036854775808", @"12345678901234567890" ]) {
+            [[theValue(JKScanFixedDecimal((const unsigned char *)[notPlain UTF8String], [notPlain length], 0, &value)) should] beNo];
+        }
+        [[theValue(JKScanFixedDecimal((const unsigned char *)"92233720368.5477", 16, 9, &value)) should] beNo];
+        [[theValue(JKScanFixedDecimal((const unsigned char *)"1", 1, JK_FIXED_DECIMAL_MAX_DIGITS + 1, &value)) should] beNo];
+    });
+
+    it(@"should return NSDecimalNumber holding the digits of the JSON with JKParseOptionDecimalNumbers", ^{
+        NSString *json = @"[1.32145,-0.5,1.50,-0.0,42,-7,1234567890.123456789,1234567890.123456788,1.5e-3,0.1234567890123,1.5]";
+        NSArray *decoded = [[JSONDecoder decoderWithParseOptions:JKParseOptionDecimalNumbers] objectWithData:[json dataUsingEncoding:NSUTF8StringEncoding]];
+        NSDictionary *locale = @{ NSLocaleDecimalSeparator : @"." };
+
+        for (NSUInteger i = 0; i < decoded.count; i++) {
+            if (i == 4 || i == 5) {
+                [[[decoded objectAtIndex:i] shouldNot] beKindOfClass:[NSDecimalNumber class]];
+                continue;
+            }
+            NSString *digits = [[json substringWithRange:NSMakeRange(1, json.length - 2)] componentsSeparatedByString:@","][i];
+            [[[decoded objectAtIndex:i] should] beKindOfClass:[NSDecimalNumber class]];
+            [[[decoded objectAtIndex:i] should] equal:[NSDecimalNumber decimalNumberWithString:digits locale:locale]];
+        }
+        [[[decoded objectAtIndex:4] should] equal:@42];
+        [[[decoded objectAtIndex:3] should] equal:[NSDecimalNumber zero]];
+        // the same double, but not the same decimal
+        [[[decoded objectAtIndex:6] shouldNot] equal:[decoded objectAtIndex:7]];
+    });
+});
+
+describe(@"The schema-directed JSON decoder", ^{
+
+    typedef struct {
+        int64_t bid;
+        int64_t time;
+        double  ask;
+    } OTNumberTestRecord;
+
+    const JKSchemaField fields[] = {
+        { JKSchemaFieldTypeFixed, offsetof(OTNumberTestRecord, bid), sizeof(int64_t), 6 },
+        { JKSchemaFieldTypeFixed, offsetof(OTNumberTestRecord, time), sizeof(int64_t), 6 },
+        { JKSchemaFieldTypeDouble, offsetof(OTNumberTestRecord, ask), sizeof(double) },
+    };
+    JKSchema *schema = [JKSchema schemaWithString:@"prices[].{bid,time,ask}" fields:fields recordSize:sizeof(OTNumberTestRecord) error:NULL];
+
+    it(@"should scale fixed fields from numbers and strings", ^{
+        NSString *json = @"{\"prices\":[{\"bid\":1.29564,\"time\":\"1354208555.548539\",\"ask\":1.29596},{\"bid\":-0.0000005,\"time\":\"1\",\"ask\":2},{\"bid\":null}]}";
+        OTNumberTestRecord records[3];
+
+        // the doubles must not depend on JKParseOptionDecimalNumbers
+        for (NSNumber *parseOptions in @[ @(JKParseOptionNone), @(JKParseOptionDecimalNumbers) ]) {
+            JSONDecoder *decoder = [JSONDecoder decoderWithParseOptions:parseOptions.unsignedIntegerValue];
+            NSUInteger count = [decoder decodeRecordsWithData:[json dataUsingEncoding:NSUTF8StringEncoding] schema:schema records:records capacity:3 error:NULL];
+
+            [[theValue(count) should] equal:theValue(3)];
+            [[theValue(records[0].bid) should] equal:theValue(1295640)];
+            [[theValue(records[0].time) should] equal:theValue(1354208555548539LL)];
+            [[theValue(records[0].ask) should] equal:theValue(1.29596)];
+            [[theValue(records[1].bid) should] equal:theValue(-1)];
+            [[theValue(records[1].time) should] equal:theValue(1000000)];
+            [[theValue(records[2].bid) should] equal:theValue(0)];
+        }
+    });
+
+    it(@"should fail on fixed fields that are not plain decimals", ^{
+        OTNumberTestRecord record;
+        NSError *error = nil;
+
+        for (NSString *json in @[ @"{\"prices\":[{\"bid\":1e-5}]}", @"{\"prices\":[{\"time\":\"soon\"}]}", @"{\"prices\":[{\"bid\":true}]}" ]) {
+            NSUInteger count = [[JSONDecoder decoder] decodeRecordsWithData:[json dataUsingEncoding:NSUTF8StringEncoding] schema:schema records:&record capacity:1 error:&error];
+            [[theValue(count) should] equal:theValue(NSNotFound)];
+            [[error should] beNonNil];
+        }
+
+        const JKSchemaField tooPrecise[] = { { JKSchemaFieldTypeFixed, 0, sizeof(int64_t), JK_FIXED_DECIMAL_MAX_DIGITS + 1 } };
+        [[[JKSchema schemaWithString:@"[].{bid}" fields:tooPrecise recordSize:sizeof(int64_t) error:NULL] should] beNil];
+    });
+});
+
+SPEC_END
@@ -0,0 +1,122 @@
+//
+//  OTJSONScanSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "JSONKit.h"
+
+// Builds a document of strings made of the given alphabet, with runs of blanks between tokens, so every combination of
+// plain characters, escapes, UTF8 sequences, control characters, 16-byte block boundaries and buffer ends comes up.
+static NSData *OTScanTestDocument(NSUInteger numStrings, NSArray *alphabet)
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"["];
+    for (NSUInteger i = 0; i < numStrings; i++) {
+        [json appendString:(i ? @"," : @"")];
+        for (long blanks = random() % 40; blanks > 0; blanks--) {
+            [json appendString:(random() % 8 ? @" " : (random() % 2 ? @"\t" : @"\n"))];
+        }
+        [json appendString:@"\""];
+        for (long length = random() % 70; length > 0; length--) {
+            [json appendString:[alphabet objectAtIndex:random() % alphabet.count]];
+        }
+        [json appendString:@"\""];
+    }
+    [json appendString:@"]"];
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+SPEC_BEGIN(OTJSONScanSpec)
+
+describe(@"The JSONKit tokenizer", ^{
+
+    // The byte at a time loops are the oracle: with vector scanning on, every document must decode to the same objects, or fail
+    // with the same error at the same place.
+    id (^decode)(NSData *, BOOL, NSError **) = ^id (NSData *data, BOOL vectorScan, NSError **error) {
+        JKSetVectorScanEnabled(vectorScan);
+        id object = [[JSONDecoder decoderWithParseOptions:JKParseOptionNone] objectWithData:data error:error];
+        JKSetVectorScanEnabled(YES);
+        return object;
+    };
+
+    void (^compare)(NSData *) = ^(NSData *data) {
+        NSError *scalarError = nil, *vectorError = nil;
+        id scalarObject = decode(data, NO, &scalarError);
+        id vectorObject = decode(data, YES, &vectorError);
+
+        if (scalarObject) {
+            [[vectorObject should] equal:scalarObject];
+        } else {
+            [[vectorObject should] beNil];
+            [[vectorError.localizedDescription should] equal:scalarError.localizedDescription];
+            [[[vectorError.userInfo objectForKey:@"JKAtIndexKey"] should] equal:[scalarError.userInfo objectForKey:@"JKAtIndexKey"]];
+            [[[vectorError.userInfo objectForKey:@"JKLineNumberKey"] should] equal:[scalarError.userInfo objectForKey:@"JKLineNumberKey"]];
+        }
+    };
+
+    it(@"should say whether vector scanning is compiled in", ^{
+#if defined(__SSE2__) || defined(__ARM_NEON__) || defined(__ARM_NEON)
+        [[theValue(JKVectorScanAvailable()) should] beYes];
+#else
+        [[theValue(JKVectorScanAvailable()) should] beNo];
+#endif
+    });
+
+    it(@"should decode valid strings the same either way", ^{
+        srandom(19);
+        NSArray *alphabet = @[ @"a", @"Z", @"0", @" ", @"_", @"~", @"\\\"", @"\\\\", @"\\/", @"\\n", @"\\t", @"\\u00e9", @"\\ud83d\\ude00", @"é", @"€", @"😀" ];
+
+        for (NSUInteger i = 0; i < 500; i++) {
+            compare(OTScanTestDocument(1 + random() % 30, alphabet));
+        }
+    });
+
+    it(@"should fail on invalid strings the same way either way", ^{
+        srandom(20);
+        NSArray *alphabet = @[ @"a", @"b", @" ", @"é", @"\\n", @"\\q", @"\x01", @"\x1f", @"\t", @"\\u12", @"\\ud800x" ];
+
+        for (NSUInteger i = 0; i < 500; i++) {
+            NSMutableData *data = [OTScanTestDocument(1 + random() % 10, alphabet) mutableCopy];
+            // the odd broken UTF8 sequence, or a document cut anywhere
+            if (random() % 3 == 0) {
+                ((unsigned char *)data.mutableBytes)[random() % data.length] = 0xc3;
+            } else if (random() % 2 == 0) {
+                data.length = random() % data.length;
+            }
+            compare(data);
+        }
+    });
+
+    it(@"should skip long runs of indentation and count the lines in between", ^{
+        NSString *indentation = [@"" stringByPaddingToLength:100 withString:@" \t" startingAtIndex:0];
+        NSString *json = [NSString stringWithFormat:@"{%@\n%@\"a\"%@:%@[1,%@\r\n%@2]%@\n%@}", indentation, indentation, indentation, indentation, indentation, indentation, indentation, indentation];
+        compare([json dataUsingEncoding:NSUTF8StringEncoding]);
+        [[decode([json dataUsingEncoding:NSUTF8StringEncoding], YES, NULL) should] equal:@{ @"a" : @[ @1, @2 ] }];
+
+        // an error after the blanks must point at the same line and character
+        compare([[json stringByAppendingString:[indentation stringByAppendingString:@"\n\n   x"]] dataUsingEncoding:NSUTF8StringEncoding]);
+    });
+});
+
+SPEC_END
@@ -0,0 +1,149 @@
+//
+//  OTJSONSchemaSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "JSONKit.h"
+
+typedef struct {
+    char    name[8];
+    double  price;
+    int64_t units;
+    BOOL    open;
+} OTSchemaTestRecord;
+
+static JKSchema *OTSchemaTestSchema(NSString *schemaString)
+{
+    const JKSchemaField fields[] = {
+        { JKSchemaFieldTypeString, offsetof(OTSchemaTestRecord, name), sizeof(((OTSchemaTestRecord *)0)->name) },
+        { JKSchemaFieldTypeDouble, offsetof(OTSchemaTestRecord, price), sizeof(double) },
+        { JKSchemaFieldTypeInt64, offsetof(OTSchemaTestRecord, units), sizeof(int64_t) },
+        { JKSchemaFieldTypeBool, offsetof(OTSchemaTestRecord, open), sizeof(BOOL) },
+    };
+    return [JKSchema schemaWithString:schemaString fields:fields recordSize:sizeof(OTSchemaTestRecord) error:NULL];
+}
+
+static NSUInteger OTSchemaTestDecode(NSString *json, JKSchema *schema, OTSchemaTestRecord *records, NSUInteger capacity, NSError **error)
+{
+    NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+    return [[JSONDecoder decoder] decodeRecordsWithData:data schema:schema records:records capacity:capacity error:error];
+}
+
+SPEC_BEGIN(OTJSONSchemaSpec)
+
+describe(@"The schema-directed JSON decoder", ^{
+
+    JKSchema *schema = OTSchemaTestSchema(@"result.orders[].{name,price,units,open}");
+
+    it(@"should compile well-formed schemas only", ^{
+        [[OTSchemaTestSchema(@"[].{name,price,units,open}") should] beNonNil];
+        [[theValue([OTSchemaTestSchema(@" a . b [].{ name , price,units,open}") fieldCount]) should] equal:theValue(4)];
+
+        NSError *error = nil;
+        const JKSchemaField badSize[] = { { JKSchemaFieldTypeDouble, 0, sizeof(float) } };
+        [[[JKSchema schemaWithString:@"[].{price}" fields:badSize recordSize:sizeof(double) error:&error] should] beNil];
+        [[error should] beNonNil];
+
+        const JKSchemaField tooFar[] = { { JKSchemaFieldTypeInt64, sizeof(int64_t), sizeof(int64_t) } };
+        [[[JKSchema schemaWithString:@"[].{units}" fields:tooFar recordSize:sizeof(int64_t) error:NULL] should] beNil];
+
+        for (NSString *malformed in @[ @"orders", @"orders[]", @"orders[].name", @"orders[].{}", @"a..b[].{name,price,units,open}", @"[].{name,,units,open}" ]) {
+            [[OTSchemaTestSchema(malformed) should] beNil];
+        }
+    });
+
+    it(@"should write matched fields into the records and skip everything else", ^{
+        NSString *json = @"{\"before\":{\"deep\":[1,[2,{\"x\":\"]\"}]],\"y\":null},\"result\":{\"count\":2,\"orders\":["
+                          "{\"id\":1,\"name\":\"EUR_USD\",\"extra\":{\"a\":[true,false]},\"price\":1.29564,\"units\":100,\"open\":true},"
+                          "{\"name\":\"US\\u0044_JPY\",\"units\":\"-2500\",\"price\":\"82.123\",\"tags\":[],\"open\":false}"
+                          "]},\"after\":[1,2,3]}";
+        OTSchemaTestRecord records[2];
+        memset(records, 0xff, sizeof(records));
+
+        NSError *error = nil;
+        [[theValue(OTSchemaTestDecode(json, schema, records, 2, &error)) should] equal:theValue(2)];
+        [[error should] beNil];
+
+        [[[NSString stringWithUTF8String:records[0].name] should] equal:@"EUR_USD"];
+        [[theValue(records[0].price) should] equal:theValue(1.29564)];
+        [[theValue(records[0].units) should] equal:theValue(100)];
+        [[theValue(records[0].open) should] beYes];
+
+        [[[NSString stringWithUTF8String:records[1].name] should] equal:@"USD_JPY"];
+        [[theValue(records[1].price) should] equal:theValue(82.123)];
+        [[theValue(records[1].units) should] equal:theValue(-2500)];
+        [[theValue(records[1].open) should] beNo];
+    });
+
+    it(@"should leave missing and null fields zeroed, and truncate long strings", ^{
+        OTSchemaTestRecord record;
+        memset(&record, 0xff, sizeof(record));
+
+        [[theValue(OTSchemaTestDecode(@"[{\"name\":\"A_VERY_LONG_NAME\",\"price\":null}]", OTSchemaTestSchema(@"[].{name,price,units,open}"), &record, 1, NULL)) should] equal:theValue(1)];
+        [[[NSString stringWithUTF8String:record.name] should] equal:@"A_VERY_"];
+        [[theValue(record.price) should] equal:theValue(0.0)];
+        [[theValue(record.units) should] equal:theValue(0)];
+        [[theValue(record.open) should] beNo];
+    });
+
+    it(@"should count every record but only write as many as fit", ^{
+        OTSchemaTestRecord records[3];
+        memset(records, 0xff, sizeof(records));
+
+        NSString *json = @"{\"result\":{\"orders\":[{\"units\":1},{\"units\":2},{\"units\":3},{\"units\":4}]}}";
+        [[theValue(OTSchemaTestDecode(json, schema, records, 2, NULL)) should] equal:theValue(4)];
+        [[theValue(records[1].units) should] equal:theValue(2)];
+        [[theValue(records[2].units) should] equal:theValue(-1)];
+
+        [[theValue(OTSchemaTestDecode(json, schema, NULL, 0, NULL)) should] equal:theValue(4)];
+    });
+
+    it(@"should find no records where there is no array", ^{
+        [[theValue(OTSchemaTestDecode(@"{\"result\":{\"other\":[{\"units\":1}]}}", schema, NULL, 0, NULL)) should] equal:theValue(0)];
+        [[theValue(OTSchemaTestDecode(@"{\"result\":{\"orders\":null}}", schema, NULL, 0, NULL)) should] equal:theValue(0)];
+        [[theValue(OTSchemaTestDecode(@"{\"result\":{\"orders\":[]}}", schema, NULL, 0, NULL)) should] equal:theValue(0)];
+    });
+
+    it(@"should fail on malformed JSON and on values of the wrong type", ^{
+        OTSchemaTestRecord records[2];
+        NSArray *badJSON = @[ @"{\"result\":{\"orders\":[{\"units\":1},]}}",
+                              @"{\"result\":{\"orders\":[{\"units\" 1}]}}",
+                              @"{\"result\":{\"orders\":[1,2]}}",
+                              @"{\"result\":{\"orders\":{\"units\":1}}}",
+                              @"{\"result\":{\"skipped\":[1,2},\"orders\":[]}}",
+                              @"{\"result\":{\"orders\":[{\"units\":1}",
+                              @"{\"result\":{\"orders\":[{\"units\":1.5}]}}",
+                              @"{\"result\":{\"orders\":[{\"price\":\"1.2x\"}]}}",
+                              @"{\"result\":{\"orders\":[{\"name\":42}]}}",
+                              @"{\"result\":{\"orders\":[{\"open\":{}}]}}" ];
+
+        for (NSString *json in badJSON) {
+            NSError *error = nil;
+            [[theValue(OTSchemaTestDecode(json, schema, records, 2, &error)) should] equal:theValue(NSNotFound)];
+            [[error should] beNonNil];
+        }
+    });
+});
+
+SPEC_END
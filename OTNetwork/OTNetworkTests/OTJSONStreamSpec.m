@@ -0,0 +1,200 @@
+//
+//  OTJSONStreamSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "JSONKit.h"
+
+// Rebuilds the tree of objects from the events of a JSONStreamDecoder, to compare with objectWithData:.
+@interface OTStreamTreeBuilder : NSObject <JSONStreamDecoderDelegate>
+@property (nonatomic, strong) id root;
+@property (nonatomic, strong) NSMutableArray *containers;
+@property (nonatomic, strong) NSMutableArray *keys;
+@property (nonatomic, assign) NSUInteger deepest;
+@end
+
+@implementation OTStreamTreeBuilder
+
+- (id)init
+{
+    self = [super init];
+    if (self) {
+        _containers = [NSMutableArray array];
+        _keys = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)addValue:(id)value
+{
+    id container = [self.containers lastObject];
+    if (!container) {
+        self.root = value;
+    } else if ([container isKindOfClass:[NSMutableArray class]]) {
+        [container addObject:value];
+    } else {
+        [container setObject:value forKey:[self.keys lastObject]];
+        [self.keys removeLastObject];
+    }
+}
+
+- (void)startContainer:(id)container decoder:(JSONStreamDecoder *)decoder
+{
+    [self addValue:container];
+    [self.containers addObject:container];
+    self.deepest = MAX(self.deepest, [decoder depth]);
+}
+
+- (void)decoderDidStartObject:(JSONStreamDecoder *)decoder { [self startContainer:[NSMutableDictionary dictionary] decoder:decoder]; }
+- (void)decoderDidStartArray:(JSONStreamDecoder *)decoder { [self startContainer:[NSMutableArray array] decoder:decoder]; }
+- (void)decoderDidEndObject:(JSONStreamDecoder *)decoder { [self.containers removeLastObject]; }
+- (void)decoderDidEndArray:(JSONStreamDecoder *)decoder { [self.containers removeLastObject]; }
+- (void)decoder:(JSONStreamDecoder *)decoder foundKey:(NSString *)key { [self.keys addObject:key]; }
+- (void)decoder:(JSONStreamDecoder *)decoder foundValue:(id)value { [self addValue:value]; }
+
+@end
+
+// A page of transaction history, with the odd escaped string, nested object and literal thrown in.
+static NSData *OTStreamTestTransactionsPayload(NSUInteger count)
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"transactions\" : [\n"];
+    for (NSUInteger i = 0; i < count; i++) {
+        [json appendFormat:@"%@  {\"id\":%lu,\"type\":\"MarketOrderCreate\",\"instrument\":\"EUR_USD\",\"units\":%lu,\"side\":\"%@\",\"price\":1.2%04lu,"
+                            "\"time\":\"%lu.000000\",\"pl\":-%lu.25e-1,\"note\":\"tab\\there \\\"quoted\\\" \\u00e9t\\u00e9 €\",\"tags\":[true,false,null,[]],"
+                            "\"takeProfit\":{\"price\":0,\"distance\":{}}}",
+         (i ? @",\n" : @""), (unsigned long)(177809412 - i), (unsigned long)(100 * (i % 10 + 1)), (i % 2 ? @"buy" : @"sell"),
+         (unsigned long)(i % 10000), (unsigned long)(1354208555 - i), (unsigned long)(i % 7)];
+    }
+    [json appendString:@"\n], \"nextPage\":null}\n"];
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Pushes the data in chunks of the sizes given by chunkSizeBlock, and returns the largest number of bytes buffered between two pushes.
+static NSUInteger OTStreamTestPush(JSONStreamDecoder *decoder, NSData *data, NSUInteger (^chunkSizeBlock)(void), NSError **error)
+{
+    NSUInteger mostBuffered = 0;
+    for (NSUInteger offset = 0; offset < data.length; ) {
+        NSUInteger chunkSize = MIN(chunkSizeBlock(), data.length - offset);
+        if (![decoder pushUTF8String:(const unsigned char *)data.bytes + offset length:chunkSize error:error]) {
+            return NSNotFound;
+        }
+        mostBuffered = MAX(mostBuffered, [decoder bufferedLength]);
+        offset += chunkSize;
+    }
+    return mostBuffered;
+}
+
+SPEC_BEGIN(OTJSONStreamSpec)
+
+describe(@"The streaming JSON decoder", ^{
+
+    NSData *payload = OTStreamTestTransactionsPayload(200);
+    id expected = [[JSONDecoder decoder] objectWithData:payload];
+
+    it(@"should report the same document as objectWithData:, however it is cut", ^{
+        srandom(42);
+        NSArray *chunkSizeBlocks = @[ ^NSUInteger { return 1; },
+                                      ^NSUInteger { return 7; },
+                                      ^NSUInteger { return 1 + random() % 64; },
+                                      ^NSUInteger { return 1 + random() % 4096; },
+                                      ^NSUInteger { return NSUIntegerMax; } ];
+
+        for (id block in chunkSizeBlocks) {
+            NSUInteger (^chunkSizeBlock)(void) = block;
+            OTStreamTreeBuilder *builder = [[OTStreamTreeBuilder alloc] init];
+            JSONStreamDecoder *decoder = [JSONStreamDecoder streamDecoderWithDelegate:builder];
+            NSError *error = nil;
+
+            NSUInteger mostBuffered = OTStreamTestPush(decoder, payload, chunkSizeBlock, &error);
+            [[error should] beNil];
+            [[theValue([decoder finishWithError:&error]) should] beYes];
+            [[error should] beNil];
+
+            [[builder.root should] equal:expected];
+            [[theValue(builder.deepest) should] equal:theValue(5)];
+            [[theValue([decoder depth]) should] equal:theValue(0)];
+            [[theValue([decoder isFinished]) should] beYes];
+            // only ever the one token cut in two by the end of a chunk, never the document
+            [[theValue(mostBuffered) should] beLessThan:theValue(64)];
+        }
+    });
+
+    it(@"should be reusable once reset", ^{
+        OTStreamTreeBuilder *builder = [[OTStreamTreeBuilder alloc] init];
+        JSONStreamDecoder *decoder = [JSONStreamDecoder streamDecoderWithDelegate:builder];
+
+        [[theValue([decoder pushData:[@"[1,2" dataUsingEncoding:NSUTF8StringEncoding] error:NULL]) should] beYes];
+        [[theValue([decoder isFinished]) should] beNo];
+        [decoder reset];
+
+        builder.root = nil;
+        [builder.containers removeAllObjects];
+        [[theValue([decoder pushData:payload error:NULL]) should] beYes];
+        [[theValue([decoder finishWithError:NULL]) should] beYes];
+        [[builder.root should] equal:expected];
+    });
+
+    it(@"should fail on malformed JSON, whichever chunk it is in", ^{
+        NSArray *badJSON = @[ @"{\"a\":[1,2}", @"{\"a\" 1}", @"{\"a\":1,}", @"[1 2]", @"{1:2}", @"\"top level\"", @"[1]]", @"[tru]", @"[\"bad \\q escape\"]", @"{} {}" ];
+
+        for (NSString *json in badJSON) {
+            JSONStreamDecoder *decoder = [JSONStreamDecoder streamDecoderWithDelegate:nil];
+            NSData *data = [json dataUsingEncoding:NSUTF8StringEncoding];
+            NSError *error = nil;
+
+            BOOL pushed = (OTStreamTestPush(decoder, data, ^NSUInteger { return 3; }, &error) != NSNotFound);
+            BOOL finished = pushed && [decoder finishWithError:&error];
+            [[theValue(finished) should] beNo];
+            [[error should] beNonNil];
+
+            // and keeps failing with the same error
+            NSError *laterError = nil;
+            [[theValue([decoder pushData:[@"[]" dataUsingEncoding:NSUTF8StringEncoding] error:&laterError]) should] beNo];
+            [[laterError should] equal:error];
+        }
+    });
+
+    it(@"should fail on a document cut short", ^{
+        for (NSString *json in @[ @"", @"{\"a\":[1,2]", @"[\"unterminated", @"[12" ]) {
+            JSONStreamDecoder *decoder = [JSONStreamDecoder streamDecoderWithDelegate:nil];
+            NSError *error = nil;
+
+            [[theValue([decoder pushData:[json dataUsingEncoding:NSUTF8StringEncoding] error:&error]) should] beYes];
+            [[theValue([decoder finishWithError:&error]) should] beNo];
+            [[error should] beNonNil];
+        }
+    });
+
+    it(@"should report where the error is in the whole document", ^{
+        JSONStreamDecoder *decoder = [JSONStreamDecoder streamDecoderWithDelegate:nil];
+        NSError *error = nil;
+
+        [[theValue([decoder pushData:[@"{\"abc\":[1,2,3,4" dataUsingEncoding:NSUTF8StringEncoding] error:&error]) should] beYes];
+        [[theValue([decoder pushData:[@"]]" dataUsingEncoding:NSUTF8StringEncoding] error:&error]) should] beNo];
+        [[[error.userInfo objectForKey:@"JKAtIndexKey"] should] equal:@16];
+    });
+});
+
+SPEC_END
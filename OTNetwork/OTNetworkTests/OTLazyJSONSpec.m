@@ -0,0 +1,248 @@
+//
+//  OTLazyJSONSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTLazyJSON.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTLazyJSONSpec)
+
+describe(@"The lazy JSON view", ^{
+
+    NSData *(^dataOf)(NSString *) = ^NSData *(NSString *json) {
+        return [json dataUsingEncoding:NSUTF8StringEncoding];
+    };
+
+    it(@"should read the same as NSJSONSerialization", ^{
+        NSArray *documents = @[ @"{\"positions\":[{\"instrument\":\"EUR_USD\",\"units\":100,\"side\":\"buy\",\"avgPrice\":1.29564}]}",
+                                @"[1, -2, 0, -0.5, 3.25e2, 1E-3, 9223372036854775807, -9223372036854775807]",
+                                @"[true, false, null, \"\", [], {}, [[[]]], {\"a\":{\"b\":{\"c\":[1]}}}]",
+                                @" \n\t{ \"spaced\" : [ 1 , \"two\" , { } ] } \r\n",
+                                @"{\"escapes\":\"\\\" \\\\ \\/ \\b \\f \\n \\r \\t \\u00e9 \\u20ac \\ud83d\\ude00\",\"plain\":\"caf\u00e9 \u20ac\"}",
+                                @"{\"k\\u0065y2\":\"escaped key\",\"key\":\"plain key\"}" ];
+
+        for (NSString *json in documents) {
+            id expected = [NSJSONSerialization JSONObjectWithData:dataOf(json) options:0 error:NULL];
+            id view = [OTLazyJSON objectWithData:dataOf(json) error:NULL];
+            [[view should] equal:expected];
+            [[expected should] equal:view];
+        }
+    });
+
+    it(@"should only decode the values which are read", ^{
+        NSMutableArray *positions = [NSMutableArray array];
+        for (NSUInteger i = 0; i < 100; i++) {
+            [positions addObject:@{ @"id" : @(i), @"instrument" : @"EUR_USD", @"units" : @(i * 10), @"side" : @"buy", @"avgPrice" : @1.29564 }];
+        }
+        NSData *data = [NSJSONSerialization dataWithJSONObject:@{ @"positions" : positions } options:0 error:NULL];
+        OTLazyJSON *document = [[OTLazyJSON alloc] initWithData:data error:NULL];
+
+        // the object, its key, the array, and 100 objects of 5 members
+        [[theValue(document.numIndexedValues) should] equal:theValue(3 + 100 * 11)];
+        [[theValue(document.numDecodedValues) should] equal:theValue(0)];
+
+        NSDictionary *root = document.rootObject;
+        NSArray *list = root[@"positions"];
+        [[theValue(list.count) should] equal:theValue(100)];
+        [[list[42][@"units"] should] equal:@420];
+        [[list[42][@"side"] should] equal:@"buy"];
+        [[theValue(document.numDecodedValues) should] equal:theValue(2)];
+
+        // values are decoded once, and views made once
+        [[theValue(list[42][@"units"] == list[42][@"units"]) should] beYes];
+        [[theValue(root[@"positions"] == list) should] beYes];
+        [[theValue(document.numDecodedValues) should] equal:theValue(2)];
+        [[theValue(document.rootObject == root) should] beYes];
+    });
+
+    it(@"should behave as an immutable NSDictionary or NSArray", ^{
+        NSDictionary *view = [OTLazyJSON objectWithData:dataOf(@"{\"a\":1,\"b\":[\"x\",\"y\"],\"c\":{\"d\":null}}") error:NULL];
+
+        [[view should] beKindOfClass:[NSDictionary class]];
+        [[[view valueForKey:@"a"] should] equal:@1];
+        [[[view valueForKeyPath:@"c.d"] should] equal:[NSNull null]];
+        [[view[@"missing"] should] beNil];
+        [[[view objectForKey:@1] should] beNil];
+        [[[[view allKeys] sortedArrayUsingSelector:@selector(compare:)] should] equal:@[@"a", @"b", @"c"]];
+
+        NSMutableArray *elements = [NSMutableArray array];
+        for (NSString *element in view[@"b"]) {
+            [elements addObject:element];
+        }
+        [[elements should] equal:@[@"x", @"y"]];
+        [[theValue([view[@"b"] indexOfObject:@"y"]) should] equal:theValue(1)];
+        [[theBlock(^{ [view[@"b"] objectAtIndex:2]; }) should] raiseWithName:NSRangeException];
+
+        [[theValue([view copy] == view) should] beYes];
+        NSMutableDictionary *mutableView = [view mutableCopy];
+        [mutableView setObject:@2 forKey:@"a"];
+        [[mutableView[@"a"] should] equal:@2];
+        [[view[@"a"] should] equal:@1];
+    });
+
+    it(@"should be readable from several threads at once", ^{
+        NSMutableArray *rows = [NSMutableArray array];
+        for (NSUInteger i = 0; i < 1000; i++) {
+            [rows addObject:@{ @"id" : @(i), @"price" : @(1.0 + i / 1e5) }];
+        }
+        NSArray *view = [OTLazyJSON objectWithData:[NSJSONSerialization dataWithJSONObject:rows options:0 error:NULL] error:NULL];
+        __block NSUInteger numMismatches = 0;
+
+        dispatch_apply(8, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t thread) {
+            for (NSUInteger i = 0; i < view.count; i++) {
+                if (![view[i][@"id"] isEqual:@(i)]) {
+                    @synchronized(rows) {
+                        numMismatches++;
+                    }
+                }
+            }
+        });
+
+        [[theValue(numMismatches) should] equal:theValue(0)];
+    });
+
+    it(@"should turn down malformed JSON with the offset of the problem", ^{
+        NSArray *documents = @[ @"", @"   ", @"\"fragment\"", @"42", @"{", @"[1,]", @"{\"a\" 1}", @"{\"a\":1,}", @"[01]", @"[1.]",
+                                @"[-]", @"[1e]", @"[tru]", @"[nul]", @"[\"\\x\"]", @"[\"\\u12\"]", @"[\"unterminated]", @"[1] [2]", @"{'a':1}" ];
+
+        for (NSString *json in documents) {
+            NSError *error = nil;
+            [[[OTLazyJSON objectWithData:dataOf(json) error:&error] should] beNil];
+            [[error.domain should] equal:OTLazyJSONErrorDomain];
+            [[theValue(error.code) should] equal:theValue(OTLazyJSONErrorMalformed)];
+        }
+
+        NSError *error = nil;
+        [OTLazyJSON objectWithData:dataOf(@"[1, 2, x]") error:&error];
+        [[theValue([[error localizedDescription] rangeOfString:@"offset 7"].location != NSNotFound) should] beYes];
+
+        // control characters and malformed UTF8 inside strings
+        const char *badStrings[] = { "[\"a\x01\"]", "[\"\xC3\"]", "[\"\xC0\xAF\"]", "[\"\xED\xA0\x80\"]", "[\"\xF5\x80\x80\x80\"]" };
+        for (size_t i = 0; i < sizeof(badStrings) / sizeof(badStrings[0]); i++) {
+            [[[OTLazyJSON objectWithData:[NSData dataWithBytes:badStrings[i] length:strlen(badStrings[i])] error:NULL] should] beNil];
+        }
+    });
+
+    it(@"should decode unpaired surrogates as replacement characters", ^{
+        NSArray *view = [OTLazyJSON objectWithData:dataOf(@"[\"a\\ud83db\", \"\\ude00\"]") error:NULL];
+        [[view[0] should] equal:@"a\ufffdb"];
+        [[view[1] should] equal:@"\ufffd"];
+    });
+});
+
+describe(@"The Network Controller lazy lists", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD", @"USD_JPY"]];
+        server.generatedRowCount = 50;
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    it(@"should hand over the orders as a lazy view equal to the full parse", ^{
+        __block NSDictionary *lazyResult = nil;
+        __block NSDictionary *parsedResult = nil;
+
+        [[theValue(networkController.decodesListsLazily) should] beNo];
+        networkController.decodesListsLazily = YES;
+        [networkController ordersListForAccountId:@1234 success:^(NSDictionary *result) {
+            lazyResult = result;
+        } failure:nil];
+        [[expectFutureValue(lazyResult) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+
+        networkController.decodesListsLazily = NO;
+        [networkController ordersListForAccountId:@1234 success:^(NSDictionary *result) {
+            parsedResult = result;
+        } failure:nil];
+        [[expectFutureValue(parsedResult) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+
+        [[lazyResult should] beMemberOfClass:NSClassFromString(@"OTLazyJSONDictionary")];
+        [[parsedResult shouldNot] beMemberOfClass:NSClassFromString(@"OTLazyJSONDictionary")];
+        [[[lazyResult objectForKey:@"orders"] should] haveCountOf:50];
+        [[lazyResult should] equal:parsedResult];
+    });
+
+    it(@"should hand one account list to every coalesced caller", ^{
+        NSMutableArray *results = [NSMutableArray array];
+        networkController.decodesListsLazily = YES;
+        server.responseDelay = 0.1;
+
+        for (NSUInteger i = 0; i < 3; i++) {
+            [networkController accountListForUsername:@"kyley" success:^(NSDictionary *result) {
+                [results addObject:result];
+            } failure:nil];
+        }
+
+        [[expectFutureValue(theValue(results.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(3)];
+        [[theValue(networkController.numRequestsCoalesced) should] equal:theValue(2)];
+        [[[results objectAtIndex:1] should] beIdenticalTo:[results objectAtIndex:0]];
+        [[[results objectAtIndex:2] should] beIdenticalTo:[results objectAtIndex:0]];
+        [[[results objectAtIndex:0] objectForKey:@"array"] shouldNot] beNil];
+    });
+
+    it(@"should fail the account list when the body is not JSON", ^{
+        __block NSDictionary *failure = nil;
+        [server setFixtureData:[@"<html>Bad Gateway</html>" dataUsingEncoding:NSUTF8StringEncoding] forMethod:@"GET" pathPattern:@"/v1/users/*/accounts"];
+
+        [networkController accountListForUsername:@"kyley" success:^(NSDictionary *result) {
+            NSLog(@"Unexpected success %@", result);
+        } failure:^(NSDictionary *error) {
+            failure = error;
+        }];
+
+        [[expectFutureValue(failure) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[theValue([[failure objectForKey:@"net error"] code]) should] equal:theValue(NSPropertyListReadCorruptError)];
+    });
+
+    it(@"should fail the orders whether or not they are read lazily, when the body is not JSON", ^{
+        NSMutableArray *failures = [NSMutableArray array];
+        [server setFixtureData:[@"<html>Bad Gateway</html>" dataUsingEncoding:NSUTF8StringEncoding] forMethod:@"GET" pathPattern:@"/v1/accounts/*/orders"];
+
+        for (NSNumber *lazily in @[@NO, @YES]) {
+            networkController.decodesListsLazily = [lazily boolValue];
+            [networkController ordersListForAccountId:@1234 success:^(NSDictionary *result) {
+                NSLog(@"Unexpected success %@", result);
+            } failure:^(NSDictionary *error) {
+                [failures addObject:error];
+            }];
+            [[expectFutureValue(theValue(failures.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue([lazily boolValue] ? 2 : 1)];
+        }
+
+        for (NSDictionary *failure in failures) {
+            [[theValue([[failure objectForKey:@"net error"] code]) should] equal:theValue(NSPropertyListReadCorruptError)];
+        }
+    });
+});
+
+SPEC_END
@@ -0,0 +1,1074 @@
+//
+//  OTNetworkBenchmarkSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+#import "OTBenchmarkReport.h"
+#import "JSONKit.h"
+#import "OTLazyJSON.h"
+
+// The decode stage is private to OTNetworkController; the benchmarks drive it directly with canned
+// responses so the numbers do not depend on the network.
+@interface OTNetworkController (BenchmarkAccess)
+- (void)completeWithResponseData:(NSData *)responseData
+                          decode:(id (^)(NSData *responseData))decodeBlock
+                         success:(void (^)(id result))successBlock;
+- (id)JSONObjectWithData:(NSData *)data;
+@end
+
+// Builds a /candles response of the given size, shaped like the sandbox output.
+static NSData *OTBenchmarkCandlesPayload(NSUInteger count)
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"instrument\":\"EUR_USD\",\"granularity\":\"S5\",\"candles\":["];
+    for (NSUInteger i = 0; i < count; i++) {
+        [json appendFormat:@"%@{\"time\":%lu,\"openMid\":1.3%04lu5,\"highMid\":1.3%04lu9,\"lowMid\":1.3%04lu1,\"closeMid\":1.3%04lu7,\"volume\":%lu,\"complete\":true}",
+         (i ? @"," : @""), (unsigned long)(1355000000 + i * 5), (unsigned long)(i % 10000), (unsigned long)(i % 10000), (unsigned long)(i % 10000), (unsigned long)(i % 10000), (unsigned long)(i % 97)];
+    }
+    [json appendString:@"]}"];
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Builds a /prices response for the given number of instruments, shaped like the sandbox output.
+static NSData *OTBenchmarkPricesPayload(NSUInteger count)
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"prices\":["];
+    for (NSUInteger i = 0; i < count; i++) {
+        [json appendFormat:@"%@{\"instrument\":\"I%03lu_USD\",\"time\":\"1354208555.%06lu\",\"bid\":1.2%04lu4,\"ask\":1.2%04lu6}",
+         (i ? @"," : @""), (unsigned long)i, (unsigned long)(i * 7919 % 1000000), (unsigned long)i, (unsigned long)i];
+    }
+    [json appendString:@"]}"];
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Builds an /instruments response for the given number of instruments, shaped like the sandbox output.
+static NSData *OTBenchmarkInstrumentsPayload(NSUInteger count)
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"instruments\":["];
+    for (NSUInteger i = 0; i < count; i++) {
+        [json appendFormat:@"%@{\"instrument\":\"I%03lu_USD\",\"displayName\":\"I%03lu/USD\",\"pip\":\"%@\",\"maxTradeUnits\":10000000}",
+         (i ? @"," : @""), (unsigned long)i, (unsigned long)i, (i % 5 ? @"0.0001" : @"0.01")];
+    }
+    [json appendString:@"]}"];
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Builds one page of an /accounts/N/transactions response with the given number of transactions, shaped like the sandbox output.
+static NSData *OTBenchmarkTransactionsPayload(NSUInteger count)
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"transactions\":["];
+    for (NSUInteger i = 0; i < count; i++) {
+        [json appendFormat:@"%@{\"id\":%lu,\"accountId\":506005,\"type\":\"MarketOrderCreate\",\"instrument\":\"EUR_USD\",\"units\":%lu,\"side\":\"%@\","
+                            "\"price\":1.2%04lu,\"time\":\"%lu.000000\",\"pl\":0,\"interest\":0,\"accountBalance\":100000}",
+         (i ? @"," : @""), (unsigned long)(177809412 - i), (unsigned long)(100 * (i % 10 + 1)), (i % 2 ? @"buy" : @"sell"),
+         (unsigned long)(i % 10000), (unsigned long)(1354208555 - i)];
+    }
+    [json appendFormat:@"],\"nextPage\":\"http://api-sandbox.oanda.com/v1/accounts/506005/transactions?maxTransId=%lu\"}", (unsigned long)(177809412 - count)];
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Builds an /accounts/N/orders response with the given number of orders, shaped like the sandbox output.
+static NSData *OTBenchmarkOrdersPayload(NSUInteger count)
+{
+    NSMutableString *json = [NSMutableString stringWithString:@"{\"orders\":["];
+    for (NSUInteger i = 0; i < count; i++) {
+        [json appendFormat:@"%@{\"id\":%lu,\"instrument\":\"I%03lu_USD\",\"units\":%lu,\"side\":\"%@\",\"type\":\"limit\",\"time\":\"%lu.000000\","
+                            "\"price\":1.2%04lu,\"expiry\":\"%lu.000000\",\"stopLoss\":0,\"takeProfit\":0,\"trailingStop\":0,\"lowerBound\":0,\"upperBound\":0}",
+         (i ? @"," : @""), (unsigned long)(177809412 - i), (unsigned long)(i % 100), (unsigned long)(100 * (i % 10 + 1)), (i % 2 ? @"buy" : @"sell"),
+         (unsigned long)(1354208555 - i), (unsigned long)(i % 10000), (unsigned long)(1354208555 + 86400)];
+    }
+    [json appendFormat:@"],\"maxOrderId\":%lu}", (unsigned long)177809412];
+
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+// Builds the successive /prices responses of a quote screen polled once a second: the same keys and instrument names every time,
+// prices moving by a pip or two from one tick to the next.
+static NSArray *OTBenchmarkQuoteStreamTicks(NSUInteger numInstruments, NSUInteger numTicks)
+{
+    NSMutableArray *ticks = [NSMutableArray arrayWithCapacity:numTicks];
+    NSMutableData *pips = [NSMutableData dataWithLength:numInstruments * sizeof(long)];
+    long *pip = pips.mutableBytes;
+
+    srandom(21);
+    for (NSUInteger i = 0; i < numInstruments; i++) {
+        pip[i] = 10000 + random() % 5000;
+    }
+    for (NSUInteger t = 0; t < numTicks; t++) {
+        NSMutableString *json = [NSMutableString stringWithString:@"{\"prices\":["];
+        for (NSUInteger i = 0; i < numInstruments; i++) {
+            pip[i] += random() % 5 - 2;
+            [json appendFormat:@"%@{\"instrument\":\"I%03lu_USD\",\"time\":\"%lu.%06lu\",\"bid\":1.%05ld,\"ask\":1.%05ld}",
+             (i ? @"," : @""), (unsigned long)i, (unsigned long)(1354208555 + t), (unsigned long)(random() % 1000000), pip[i], pip[i] + 3];
+        }
+        [json appendString:@"]}"];
+        [ticks addObject:[json dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+
+    return ticks;
+}
+
+// Makes iterations calls one after the other (plus one to warm up), each one starting once the previous one has called back, then hands the
+// time taken by each call and the most bytes in use above the baseline when a call called back (ie. with its result still alive).
+static void OTBenchmarkRunCalls(NSUInteger iterations, void (^callBlock)(void (^doneBlock)(void)), void (^finishedBlock)(NSArray *samples, int64_t peakBytes))
+{
+    NSMutableArray *samples = [NSMutableArray arrayWithCapacity:iterations];
+    __block NSUInteger numCalls = 0;
+    __block int64_t peakBytes = 0;
+    __block void (^nextCall)(void) = nil;
+
+    nextCall = ^{
+        if (samples.count == iterations) {
+            finishedBlock(samples, peakBytes);
+            nextCall = nil;
+            return;
+        }
+
+        BOOL warmUp = (numCalls++ == 0);
+        int64_t baseline = [OTBenchmarkReport bytesInUse];
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        callBlock(^{
+            if (!warmUp) {
+                [samples addObject:@(CFAbsoluteTimeGetCurrent() - start)];
+                peakBytes = MAX(peakBytes, [OTBenchmarkReport bytesInUse] - baseline);
+            }
+            dispatch_async(dispatch_get_main_queue(), nextCall);
+        });
+    };
+    nextCall();
+}
+
+// Returns the time taken by each of iterations calls to block (after one to warm up), each in its own autorelease pool, and sets
+// peakBytes to the most bytes in use above the baseline at the end of a call.
+static NSArray *OTBenchmarkRunLoop(NSUInteger iterations, void (^block)(void), int64_t *peakBytes)
+{
+    NSMutableArray *samples = [NSMutableArray arrayWithCapacity:iterations];
+    *peakBytes = 0;
+
+    for (NSUInteger i = 0; i <= iterations; i++) {
+        @autoreleasepool {
+            int64_t baseline = [OTBenchmarkReport bytesInUse];
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            block();
+            if (i > 0) {
+                [samples addObject:@(CFAbsoluteTimeGetCurrent() - start)];
+                *peakBytes = MAX(*peakBytes, [OTBenchmarkReport bytesInUse] - baseline);
+            }
+        }
+    }
+
+    return samples;
+}
+
+// Returns the given percentile (0 to 100) of a list of NSNumber samples.
+static double OTBenchmarkPercentile(NSArray *samples, double percentile)
+{
+    NSArray *sorted = [samples sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger index = MIN((NSUInteger)(percentile / 100.0 * sorted.count), sorted.count - 1);
+
+    return [[sorted objectAtIndex:index] doubleValue];
+}
+
+// What a chart or a quote list keeps of each row, filled in by the schema-directed decoder of JSONKit.
+typedef struct {
+    char    instrument[16];
+    double  time;
+    double  bid;
+    double  ask;
+} OTBenchmarkPriceRecord;
+
+typedef struct {
+    int64_t time;
+    double  openMid;
+    double  highMid;
+    double  lowMid;
+    double  closeMid;
+    int64_t volume;
+    BOOL    complete;
+} OTBenchmarkCandleRecord;
+
+static JKSchema *OTBenchmarkPriceSchema(void)
+{
+    const JKSchemaField fields[] = {
+        { JKSchemaFieldTypeString, offsetof(OTBenchmarkPriceRecord, instrument), sizeof(((OTBenchmarkPriceRecord *)0)->instrument) },
+        { JKSchemaFieldTypeDouble, offsetof(OTBenchmarkPriceRecord, time), sizeof(double) },
+        { JKSchemaFieldTypeDouble, offsetof(OTBenchmarkPriceRecord, bid), sizeof(double) },
+        { JKSchemaFieldTypeDouble, offsetof(OTBenchmarkPriceRecord, ask), sizeof(double) },
+    };
+    return [JKSchema schemaWithString:@"prices[].{instrument,time,bid,ask}" fields:fields recordSize:sizeof(OTBenchmarkPriceRecord) error:NULL];
+}
+
+static JKSchema *OTBenchmarkCandleSchema(void)
+{
+    const JKSchemaField fields[] = {
+        { JKSchemaFieldTypeInt64, offsetof(OTBenchmarkCandleRecord, time), sizeof(int64_t) },
+        { JKSchemaFieldTypeDouble, offsetof(OTBenchmarkCandleRecord, openMid), sizeof(double) },
+        { JKSchemaFieldTypeDouble, offsetof(OTBenchmarkCandleRecord, highMid), sizeof(double) },
+        { JKSchemaFieldTypeDouble, offsetof(OTBenchmarkCandleRecord, lowMid), sizeof(double) },
+        { JKSchemaFieldTypeDouble, offsetof(OTBenchmarkCandleRecord, closeMid), sizeof(double) },
+        { JKSchemaFieldTypeInt64, offsetof(OTBenchmarkCandleRecord, volume), sizeof(int64_t) },
+        { JKSchemaFieldTypeBool, offsetof(OTBenchmarkCandleRecord, complete), sizeof(BOOL) },
+    };
+    return [JKSchema schemaWithString:@"candles[].{time,openMid,highMid,lowMid,closeMid,volume,complete}" fields:fields recordSize:sizeof(OTBenchmarkCandleRecord) error:NULL];
+}
+
+SPEC_BEGIN(OTNetworkBenchmarkSpec)
+
+describe(@"The Network Controller decode stage", ^{
+
+    const NSUInteger numCalls = 20;
+    NSData *candlesPayload = OTBenchmarkCandlesPayload(5000);
+
+    it(@"should keep response parsing off the main thread", ^{
+
+        OTNetworkController *networkController = [[OTNetworkController alloc] init];
+        NetworkSuccessBlock successBlock = ^(NSDictionary *result) {};
+
+        // before: the body was parsed inside the AFNetworking success block, on the main queue
+        CFAbsoluteTime beforeStart = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numCalls; i++) {
+            successBlock([networkController JSONObjectWithData:candlesPayload]);
+        }
+        CFAbsoluteTime beforeMainThreadTime = CFAbsoluteTimeGetCurrent() - beforeStart;
+
+        // after: the main queue only hands the body off, and later runs the callback
+        __block NSUInteger numCompleted = 0;
+        __block CFAbsoluteTime afterMainThreadTime = 0;
+        __block BOOL parsedOffMain = YES;
+
+        for (NSUInteger i = 0; i < numCalls; i++) {
+            CFAbsoluteTime handOffStart = CFAbsoluteTimeGetCurrent();
+            dispatch_async(networkController.decodeQueue, ^{
+                parsedOffMain = parsedOffMain && ![NSThread isMainThread];
+                [networkController completeWithResponseData:candlesPayload decode:nil success:^(NSDictionary *result) {
+                    CFAbsoluteTime callbackStart = CFAbsoluteTimeGetCurrent();
+                    successBlock(result);
+                    numCompleted++;
+                    afterMainThreadTime += CFAbsoluteTimeGetCurrent() - callbackStart;
+                }];
+            });
+            afterMainThreadTime += CFAbsoluteTimeGetCurrent() - handOffStart;
+        }
+
+        [[expectFutureValue(theValue(numCompleted)) shouldEventuallyBeforeTimingOutAfter(30.0)] equal:theValue(numCalls)];
+        [[theValue(parsedOffMain) should] beYes];
+
+        NSLog(@"decode stage, %lu candles: main thread %.3f ms/call before, %.3f ms/call after",
+              (unsigned long)5000, beforeMainThreadTime * 1000.0 / numCalls, afterMainThreadTime * 1000.0 / numCalls);
+        [[theValue(afterMainThreadTime) should] beLessThan:theValue(beforeMainThreadTime)];
+    });
+});
+
+describe(@"The price tick decoder", ^{
+
+    const NSUInteger numInstruments = 150;
+    const NSUInteger numIterations = 200;
+    NSData *pricesPayload = OTBenchmarkPricesPayload(numInstruments);
+
+    it(@"should decode the same prices as the dictionary path", ^{
+
+        OTNetworkController *networkController = [[OTNetworkController alloc] init];
+        NSArray *prices = [[networkController JSONObjectWithData:pricesPayload] objectForKey:@"prices"];
+        OTPriceTickList *tickList = [OTPriceTickList tickListWithPricesData:pricesPayload];
+
+        [[theValue(tickList.count) should] equal:theValue(prices.count)];
+        [prices enumerateObjectsUsingBlock:^(NSDictionary *price, NSUInteger idx, BOOL *stop) {
+            const OTPriceTick *tick = [tickList tickAtIndex:idx];
+            [[[NSString stringWithUTF8String:tick->instrument] should] equal:[price objectForKey:@"instrument"]];
+            [[OTPriceTickDecimalNumber(tick->bid) should] equal:[NSDecimalNumber decimalNumberWithString:[[price objectForKey:@"bid"] stringValue]]];
+            [[OTPriceTickDecimalNumber(tick->ask) should] equal:[NSDecimalNumber decimalNumberWithString:[[price objectForKey:@"ask"] stringValue]]];
+        }];
+    });
+
+    it(@"should find a tick by its instrument", ^{
+        OTPriceTickList *tickList = [OTPriceTickList tickListWithPricesData:pricesPayload];
+        const OTPriceTick *lastTick = [tickList tickAtIndex:tickList.count - 1];
+
+        [[theValue([tickList tickForInstrument:[NSString stringWithUTF8String:lastTick->instrument]] == lastTick) should] beYes];
+        [[theValue([tickList tickForInstrument:@"XAU_XAG"] == NULL) should] beYes];
+        [[theValue([tickList tickForInstrument:nil] == NULL) should] beYes];
+    });
+
+    it(@"should be cheaper than building the dictionary tree", ^{
+
+        OTNetworkController *networkController = [[OTNetworkController alloc] init];
+
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numIterations; i++) {
+            @autoreleasepool {
+                [networkController JSONObjectWithData:pricesPayload];
+            }
+        }
+        CFAbsoluteTime dictionaryTime = CFAbsoluteTimeGetCurrent() - start;
+
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numIterations; i++) {
+            @autoreleasepool {
+                [OTPriceTickList tickListWithPricesData:pricesPayload];
+            }
+        }
+        CFAbsoluteTime tickListTime = CFAbsoluteTimeGetCurrent() - start;
+
+        // what a 1 Hz poller holding on to its list pays: no allocation at all after the first tick
+        OTPriceTickList *reusedList = [[OTPriceTickList alloc] init];
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numIterations; i++) {
+            [reusedList updateWithPricesData:pricesPayload];
+        }
+        CFAbsoluteTime reusedListTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"prices, %lu instruments: dictionary %.1f us/parse, ticks %.1f us/parse, reused ticks %.1f us/parse",
+              (unsigned long)numInstruments, dictionaryTime * 1e6 / numIterations, tickListTime * 1e6 / numIterations, reusedListTime * 1e6 / numIterations);
+        [[theValue(tickListTime) should] beLessThan:theValue(dictionaryTime)];
+    });
+});
+
+describe(@"The order price formatter", ^{
+
+    const NSUInteger numIterations = 100000;
+
+    it(@"should format exactly, to the precision of the instrument", ^{
+
+        NSDictionary *expected = @{ @"1.29564" : @[ @"1.29564", @5 ],
+                                    @"82.123" : @[ @"82.123", @3 ],
+                                    @"-0.50000" : @[ @"-0.5", @5 ],
+                                    @"0.00001" : @[ @"0.00001", @5 ],
+                                    @"1.23457" : @[ @"1.234565", @5 ],
+                                    @"-1.23457" : @[ @"-1.234565", @5 ],
+                                    @"1234.56700" : @[ @"1234.567", @5 ] };
+        [expected enumerateKeysAndObjectsUsingBlock:^(NSString *formatted, NSArray *input, BOOL *stop) {
+            OTPrice price;
+            [[theValue(OTPriceFromDecimalNumber([NSDecimalNumber decimalNumberWithString:[input objectAtIndex:0]], [[input objectAtIndex:1] unsignedIntValue], &price)) should] beYes];
+            [[OTPriceString(price) should] equal:formatted];
+        }];
+
+        // where the float round trip it replaces was off
+        NSDecimalNumber *goldPrice = [NSDecimalNumber decimalNumberWithString:@"1234.567"];
+        [[[NSString stringWithFormat:@"%.5f", [goldPrice floatValue]] shouldNot] equal:@"1234.56700"];
+
+        [[theValue(OTPriceDigitsForPip(@"0.0001")) should] equal:theValue(5)];
+        [[theValue(OTPriceDigitsForPip(@"0.01")) should] equal:theValue(3)];
+        [[theValue(OTPriceDigitsForPip(@"abc")) should] equal:theValue(0)];
+    });
+
+    it(@"should learn the precision of each instrument from the instrument list", ^{
+
+        OTStubServer *server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD", @"USD_JPY"]];
+        [[theValue([server start]) should] beYes];
+        OTNetworkController *networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        [[theValue([networkController priceDigitsForSymbol:@"USD_JPY"]) should] equal:theValue(OTPriceDefaultDigits)];
+
+        __block NSDictionary *instruments = nil;
+        [networkController rateListSymbolsSuccess:^(NSDictionary *result) {
+            instruments = result;
+        } failure:nil];
+
+        [[expectFutureValue(instruments) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[theValue([networkController priceDigitsForSymbol:@"EUR_USD"]) should] equal:theValue(5)];
+        [[theValue([networkController priceDigitsForSymbol:@"USD_JPY"]) should] equal:theValue(3)];
+        [server stop];
+    });
+
+    it(@"should be cheaper than printf through a float", ^{
+
+        NSArray *prices = @[ [NSDecimalNumber decimalNumberWithString:@"1.29564"], [NSDecimalNumber decimalNumberWithString:@"1.28500"],
+                             [NSDecimalNumber decimalNumberWithString:@"1.31020"], [NSDecimalNumber decimalNumberWithString:@"0.00150"] ];
+
+        // before: every field of an order went through a float and stringWithFormat:
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numIterations; i++) {
+            @autoreleasepool {
+                [NSString stringWithFormat:@"%.5f", [[prices objectAtIndex:i % prices.count] floatValue]];
+            }
+        }
+        CFAbsoluteTime printfTime = CFAbsoluteTimeGetCurrent() - start;
+
+        // the string handed to the request
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numIterations; i++) {
+            @autoreleasepool {
+                OTPrice price;
+                OTPriceFromDecimalNumber([prices objectAtIndex:i % prices.count], 5, &price);
+                OTPriceString(price);
+            }
+        }
+        CFAbsoluteTime priceTime = CFAbsoluteTimeGetCurrent() - start;
+
+        // formatting alone, into one reused buffer
+        char buffer[OTPriceMaxLength];
+        size_t length = 0;
+        start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numIterations; i++) {
+            length += OTPriceFormat(OTPriceMake(129564 + (int64_t)i, 5), buffer);
+        }
+        CFAbsoluteTime formatTime = CFAbsoluteTimeGetCurrent() - start;
+
+        NSLog(@"order prices: printf %.3f us/price, OTPrice %.3f us/price, OTPriceFormat alone %.3f us/price (%lu bytes)",
+              printfTime * 1e6 / numIterations, priceTime * 1e6 / numIterations, formatTime * 1e6 / numIterations, (unsigned long)length);
+        [[theValue(priceTime) should] beLessThan:theValue(printfTime)];
+    });
+});
+
+describe(@"The order ticket", ^{
+
+    const NSUInteger numOrders = 200;
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        [[theValue([server start]) should] beYes];
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        networkController.callbackQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    it(@"should send the same body as openTradeForAccount:", ^{
+
+        __block NSDictionary *trade = nil;
+        [networkController openTradeForAccount:@1234 symbol:@"EUR_USD" units:@100 type:@"sell" price:[NSDecimalNumber decimalNumberWithString:@"1.29564"]
+                             minExecutionPrice:nil maxExecutionPrice:nil stopLoss:nil takeProfit:nil trailingStop:nil
+                                       success:^(NSDictionary *result) { trade = result; } failure:nil];
+        [[expectFutureValue(trade) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        NSString *openTradeBody = server.lastRequestBody;
+
+        trade = nil;
+        OTOrderTicket *ticket = [networkController orderTicketForAccount:@1234 symbol:@"EUR_USD"];
+        [ticket fireWithUnits:100 side:OTOrderSideSell price:OTPriceMake(129564, 5) success:^(NSDictionary *result) { trade = result; } failure:nil];
+        [[expectFutureValue(trade) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+
+        [[server.lastRequestBody should] equal:openTradeBody];
+        [[[trade objectForKey:@"units"] should] equal:@100];
+        [[[trade objectForKey:@"side"] should] equal:@"sell"];
+    });
+
+    it(@"should get an order onto the socket sooner", ^{
+
+        NSMutableArray *openTradeCallTimes = [NSMutableArray array];
+        NSMutableArray *openTradeWireTimes = [NSMutableArray array];
+        NSMutableArray *ticketCallTimes = [NSMutableArray array];
+        NSMutableArray *ticketWireTimes = [NSMutableArray array];
+        NSDecimalNumber *price = [NSDecimalNumber decimalNumberWithString:@"1.29564"];
+        OTOrderTicket *ticket = [networkController orderTicketForAccount:@1234 symbol:@"EUR_USD"];
+
+        for (NSUInteger i = 0; i < 2 * numOrders; i++) {
+            __block volatile BOOL done = NO;
+            BOOL useTicket = (i % 2 == 1);
+
+            // one order at a time, alternating the two paths, so both see the same network conditions
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            if (useTicket) {
+                [ticket fireWithUnits:100 side:OTOrderSideBuy price:OTPriceMake(129564, 5) success:^(NSDictionary *result) { done = YES; } failure:^(NSDictionary *error) { done = YES; }];
+            } else {
+                [networkController openTradeForAccount:@1234 symbol:@"EUR_USD" units:@100 type:@"buy" price:price
+                                     minExecutionPrice:nil maxExecutionPrice:nil stopLoss:nil takeProfit:nil trailingStop:nil
+                                               success:^(NSDictionary *result) { done = YES; } failure:^(NSDictionary *error) { done = YES; }];
+            }
+            CFAbsoluteTime callTime = CFAbsoluteTimeGetCurrent() - start;
+
+            while (!done) {
+                usleep(50);
+            }
+            CFAbsoluteTime wireTime = server.lastRequestTime - start;
+
+            [(useTicket ? ticketCallTimes : openTradeCallTimes) addObject:@(callTime * 1e6)];
+            [(useTicket ? ticketWireTimes : openTradeWireTimes) addObject:@(wireTime * 1e6)];
+        }
+
+        NSLog(@"order entry, %lu orders: openTrade call p50 %.1f us p99 %.1f us, to socket p50 %.1f us p99 %.1f us; "
+              @"ticket call p50 %.1f us p99 %.1f us, to socket p50 %.1f us p99 %.1f us", (unsigned long)numOrders,
+              OTBenchmarkPercentile(openTradeCallTimes, 50), OTBenchmarkPercentile(openTradeCallTimes, 99),
+              OTBenchmarkPercentile(openTradeWireTimes, 50), OTBenchmarkPercentile(openTradeWireTimes, 99),
+              OTBenchmarkPercentile(ticketCallTimes, 50), OTBenchmarkPercentile(ticketCallTimes, 99),
+              OTBenchmarkPercentile(ticketWireTimes, 50), OTBenchmarkPercentile(ticketWireTimes, 99));
+        [[theValue(OTBenchmarkPercentile(ticketCallTimes, 50)) should] beLessThan:theValue(OTBenchmarkPercentile(openTradeCallTimes, 50))];
+    });
+});
+
+describe(@"The order batches", ^{
+
+    const NSUInteger numOrders = 500;
+    const NSTimeInterval serverDelay = 0.005;
+
+    it(@"should cancel every order in a predictable time", ^{
+
+        OTStubServer *server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        server.responseDelay = serverDelay;
+        [[theValue([server start]) should] beYes];
+        OTNetworkController *networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+
+        NSMutableArray *orderIds = [NSMutableArray array];
+        for (NSUInteger i = 1; i <= numOrders; i++) {
+            [orderIds addObject:@(i)];
+        }
+
+        NSMutableDictionary *elapsedTimes = [NSMutableDictionary dictionary];
+        for (NSNumber *maxConcurrentRequests in @[@1, @4, @8]) {
+            __block NSArray *batchErrors = nil;
+            [server resetPeakConcurrentRequests];
+
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            [networkController deleteOrdersForAccount:@1234 orderIds:orderIds maxConcurrentRequests:[maxConcurrentRequests unsignedIntegerValue] progress:nil completion:^(NSArray *results, NSArray *errors) {
+                batchErrors = errors;
+            }];
+            [[expectFutureValue(batchErrors) shouldEventuallyBeforeTimingOutAfter(30.0)] beNonNil];
+            CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - start;
+
+            // every request holds its slot for at least serverDelay, so the cap alone sets a floor on the time taken
+            NSTimeInterval floor = ceil((double)numOrders / [maxConcurrentRequests doubleValue]) * serverDelay;
+            NSLog(@"cancel %lu orders, %@ at a time: %.0f ms (floor %.0f ms, %.2f ms/order), peak %lu on the server",
+                  (unsigned long)numOrders, maxConcurrentRequests, elapsed * 1000.0, floor * 1000.0, elapsed * 1000.0 / numOrders, (unsigned long)server.peakConcurrentRequests);
+
+            [[theValue(elapsed) should] beGreaterThanOrEqualTo:theValue(floor)];
+            [[theValue(server.peakConcurrentRequests) should] beLessThanOrEqualTo:maxConcurrentRequests];
+            [[[batchErrors lastObject] should] equal:[NSNull null]];
+            [elapsedTimes setObject:@(elapsed) forKey:maxConcurrentRequests];
+        }
+
+        [[[elapsedTimes objectForKey:@4] should] beLessThan:[elapsedTimes objectForKey:@1]];
+        [server stop];
+    });
+});
+
+describe(@"The candle store cache", ^{
+
+    const NSUInteger numCandles = 5000;
+
+    it(@"should get to the first chart sooner when warm", ^{
+
+        OTStubServer *server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        server.candleCount = numCandles;
+        [[theValue([server start]) should] beYes];
+        OTNetworkController *networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        NSString *cachePath = [NSTemporaryDirectory() stringByAppendingPathComponent:@"OTNetworkBenchmarkSpec-EUR_USD-S5.candles"];
+        [[NSFileManager defaultManager] removeItemAtPath:cachePath error:NULL];
+
+        // cold: nothing to draw until the whole window has been downloaded and decoded
+        __block CFAbsoluteTime coldTime = 0;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        OTCandleStore *coldStore = [[OTCandleStore alloc] initWithNetworkController:networkController symbol:@"EUR_USD" granularity:@"S5" cachePath:cachePath];
+        coldStore.initialCount = numCandles;
+        [coldStore updateWithSuccess:^(NSRange changedRange) {
+            coldTime = CFAbsoluteTimeGetCurrent() - start;
+        } failure:nil];
+        [[expectFutureValue(theValue(coldTime)) shouldEventuallyBeforeTimingOutAfter(30.0)] beGreaterThan:theValue(0)];
+        [[expectFutureValue(theValue([[NSFileManager defaultManager] fileExistsAtPath:cachePath])) shouldEventuallyBeforeTimingOutAfter(5.0)] beYes];
+
+        // warm: the history is there as soon as the store is created; the missing tail follows
+        server.candleCount = numCandles + 10;
+        start = CFAbsoluteTimeGetCurrent();
+        OTCandleStore *warmStore = [[OTCandleStore alloc] initWithNetworkController:networkController symbol:@"EUR_USD" granularity:@"S5" cachePath:cachePath];
+        CFAbsoluteTime warmTime = CFAbsoluteTimeGetCurrent() - start;
+        [[theValue(warmStore.count) should] equal:theValue(numCandles)];
+
+        __block CFAbsoluteTime warmCaughtUpTime = 0;
+        [warmStore updateWithSuccess:^(NSRange changedRange) {
+            warmCaughtUpTime = CFAbsoluteTimeGetCurrent() - start;
+        } failure:nil];
+        [[expectFutureValue(theValue(warmCaughtUpTime)) shouldEventuallyBeforeTimingOutAfter(30.0)] beGreaterThan:theValue(0)];
+        [[theValue(warmStore.count) should] equal:theValue(numCandles + 10)];
+
+        NSLog(@"time to first chart, %lu candles: cold %.2f ms, warm %.2f ms (caught up after %.2f ms)",
+              (unsigned long)numCandles, coldTime * 1000.0, warmTime * 1000.0, warmCaughtUpTime * 1000.0);
+        [[theValue(warmTime) should] beLessThan:theValue(coldTime)];
+
+        [[NSFileManager defaultManager] removeItemAtPath:cachePath error:NULL];
+        [server stop];
+    });
+});
+
+describe(@"The endpoint decode paths", ^{
+
+    // Each endpoint is fed canned responses of increasing size through the simulator, and timed from the call to its success block:
+    // the request, the parse and the decode block of the method, and the dispatch back to the main queue.  The results go to the
+    // OTBenchmarkReport, to be compared between releases.
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+    NSNumber *accountId = @506005;
+
+    beforeAll(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        [server start];
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+    });
+
+    afterAll(^{
+        [server stop];
+        server = nil;
+    });
+
+    // fewer calls for the larger responses, so every size takes about as long
+    NSUInteger (^iterationsForSize)(NSUInteger) = ^NSUInteger(NSUInteger size) {
+        return MAX((NSUInteger)10, MIN((NSUInteger)100, (NSUInteger)20000 / size));
+    };
+
+    // runs one benchmark per size, each replaying the payload built for it, and checks the report got a sound result for every one
+    void (^benchmark)(NSString *, NSArray *, NSString *, NSData *(^)(NSUInteger), void (^)(NSUInteger, void (^)(void))) =
+        ^(NSString *name, NSArray *sizes, NSString *pathPattern, NSData *(^payloadBlock)(NSUInteger), void (^callBlock)(NSUInteger, void (^)(void))) {
+        for (NSNumber *size in sizes) {
+            NSUInteger rows = [size unsignedIntegerValue];
+            NSData *payload = payloadBlock(rows);
+            [server setFixtureData:payload forMethod:@"GET" pathPattern:pathPattern];
+
+            __block NSDictionary *result = nil;
+            OTBenchmarkRunCalls(iterationsForSize(rows), ^(void (^doneBlock)(void)) {
+                callBlock(rows, doneBlock);
+            }, ^(NSArray *samples, int64_t peakBytes) {
+                result = [[OTBenchmarkReport sharedReport] recordBenchmark:name size:rows payloadLength:payload.length samples:samples peakBytes:peakBytes];
+            });
+
+            [[expectFutureValue(result) shouldEventuallyBeforeTimingOutAfter(120.0)] beNonNil];
+            [[[result objectForKey:@"p50Us"] should] beLessThanOrEqualTo:[result objectForKey:@"p99Us"]];
+            [[[result objectForKey:@"callsPerSecond"] should] beGreaterThan:@0];
+        }
+    };
+
+    NSArray *candleSizes = @[ @10, @100, @1000, @10000 ];
+    NSArray *instrumentSizes = @[ @1, @10, @100, @500 ];
+    NSArray *transactionSizes = @[ @50, @500, @5000 ];
+
+    it(@"should measure rateCandlesForSymbol:", ^{
+        benchmark(@"rateCandles", candleSizes, @"/v1/candles", ^NSData *(NSUInteger rows) {
+            return OTBenchmarkCandlesPayload(rows);
+        }, ^(NSUInteger rows, void (^doneBlock)(void)) {
+            [networkController rateCandlesForSymbol:@"EUR_USD" granularity:@"S5" numberOfPoints:@(rows) success:^(NSDictionary *result) {
+                doneBlock();
+            } failure:^(NSDictionary *error) {
+                fail(@"candles request failed: %@", error);
+            }];
+        });
+    });
+
+    it(@"should measure rateCandleColumnsForSymbol:", ^{
+        benchmark(@"rateCandleColumns", candleSizes, @"/v1/candles", ^NSData *(NSUInteger rows) {
+            return OTBenchmarkCandlesPayload(rows);
+        }, ^(NSUInteger rows, void (^doneBlock)(void)) {
+            [networkController rateCandleColumnsForSymbol:@"EUR_USD" granularity:@"S5" sinceTime:nil numberOfPoints:@(rows) success:^(OTCandleStore *candles) {
+                doneBlock();
+            } failure:^(NSDictionary *error) {
+                fail(@"candles request failed: %@", error);
+            }];
+        });
+    });
+
+    it(@"should measure rateListSymbolsSuccess:", ^{
+        benchmark(@"rateListSymbols", instrumentSizes, @"/v1/instruments", ^NSData *(NSUInteger rows) {
+            return OTBenchmarkInstrumentsPayload(rows);
+        }, ^(NSUInteger rows, void (^doneBlock)(void)) {
+            [networkController rateListSymbolsSuccess:^(NSDictionary *result) {
+                doneBlock();
+            } failure:^(NSDictionary *error) {
+                fail(@"instruments request failed: %@", error);
+            }];
+        });
+    });
+
+    it(@"should measure rateQuote:", ^{
+        benchmark(@"rateQuote", instrumentSizes, @"/v1/prices", ^NSData *(NSUInteger rows) {
+            return OTBenchmarkPricesPayload(rows);
+        }, ^(NSUInteger rows, void (^doneBlock)(void)) {
+            [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) {
+                doneBlock();
+            } failure:^(NSDictionary *error) {
+                fail(@"prices request failed: %@", error);
+            }];
+        });
+    });
+
+    it(@"should measure rateQuoteTicks:", ^{
+        benchmark(@"rateQuoteTicks", instrumentSizes, @"/v1/prices", ^NSData *(NSUInteger rows) {
+            return OTBenchmarkPricesPayload(rows);
+        }, ^(NSUInteger rows, void (^doneBlock)(void)) {
+            [networkController rateQuoteTicks:@[@"EUR_USD"] success:^(OTPriceTickList *ticks) {
+                doneBlock();
+            } failure:^(NSDictionary *error) {
+                fail(@"prices request failed: %@", error);
+            }];
+        });
+    });
+
+    it(@"should measure transactionListForAccountId:", ^{
+        benchmark(@"transactionList", transactionSizes, @"/v1/accounts/*/transactions", ^NSData *(NSUInteger rows) {
+            return OTBenchmarkTransactionsPayload(rows);
+        }, ^(NSUInteger rows, void (^doneBlock)(void)) {
+            [networkController transactionListForAccountId:accountId success:^(NSDictionary *result) {
+                doneBlock();
+            } failure:^(NSDictionary *error) {
+                fail(@"transactions request failed: %@", error);
+            }];
+        });
+    });
+
+    it(@"should leave a machine-readable report behind", ^{
+        NSData *data = [NSData dataWithContentsOfFile:[OTBenchmarkReport sharedReport].path];
+        NSDictionary *report = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL] : nil;
+
+        [[[report objectForKey:@"version"] should] equal:@1];
+        [[[report objectForKey:@"results"] should] haveCountOfAtLeast:candleSizes.count * 2 + instrumentSizes.count * 3 + transactionSizes.count];
+    });
+});
+
+describe(@"The schema-directed decoder", ^{
+
+    // The current path builds the whole tree of dictionaries, then copies what it needs out of it; the schema path writes
+    // the same rows straight into the structs.  Both use the same JSONDecoder, so only the object creation differs.
+    const NSUInteger numInstruments = 150;
+    const NSUInteger numCandles = 5000;
+    NSData *pricesPayload = OTBenchmarkPricesPayload(numInstruments);
+    NSData *candlesPayload = OTBenchmarkCandlesPayload(numCandles);
+
+    void (^pricesFromTree)(NSArray *, OTBenchmarkPriceRecord *) = ^(NSArray *prices, OTBenchmarkPriceRecord *records) {
+        [prices enumerateObjectsUsingBlock:^(NSDictionary *price, NSUInteger idx, BOOL *stop) {
+            strlcpy(records[idx].instrument, [[price objectForKey:@"instrument"] UTF8String], sizeof(records[idx].instrument));
+            records[idx].time = strtod([[price objectForKey:@"time"] UTF8String], NULL);
+            records[idx].bid = [[price objectForKey:@"bid"] doubleValue];
+            records[idx].ask = [[price objectForKey:@"ask"] doubleValue];
+        }];
+    };
+
+    void (^candlesFromTree)(NSArray *, OTBenchmarkCandleRecord *) = ^(NSArray *candles, OTBenchmarkCandleRecord *records) {
+        [candles enumerateObjectsUsingBlock:^(NSDictionary *candle, NSUInteger idx, BOOL *stop) {
+            records[idx].time = [[candle objectForKey:@"time"] longLongValue];
+            records[idx].openMid = [[candle objectForKey:@"openMid"] doubleValue];
+            records[idx].highMid = [[candle objectForKey:@"highMid"] doubleValue];
+            records[idx].lowMid = [[candle objectForKey:@"lowMid"] doubleValue];
+            records[idx].closeMid = [[candle objectForKey:@"closeMid"] doubleValue];
+            records[idx].volume = [[candle objectForKey:@"volume"] longLongValue];
+            records[idx].complete = [[candle objectForKey:@"complete"] boolValue];
+        }];
+    };
+
+    it(@"should decode the same rows as the dictionary path", ^{
+
+        JSONDecoder *decoder = [JSONDecoder decoder];
+        NSMutableData *treeRecords = [NSMutableData dataWithLength:numCandles * sizeof(OTBenchmarkCandleRecord)];
+        NSMutableData *schemaRecords = [NSMutableData dataWithLength:numCandles * sizeof(OTBenchmarkCandleRecord)];
+
+        candlesFromTree([[decoder objectWithData:candlesPayload] objectForKey:@"candles"], treeRecords.mutableBytes);
+        NSUInteger count = [decoder decodeRecordsWithData:candlesPayload schema:OTBenchmarkCandleSchema() records:schemaRecords.mutableBytes capacity:numCandles error:NULL];
+        [[theValue(count) should] equal:theValue(numCandles)];
+        [[theValue(memcmp(treeRecords.bytes, schemaRecords.bytes, treeRecords.length)) should] equal:theValue(0)];
+
+        treeRecords.length = schemaRecords.length = numInstruments * sizeof(OTBenchmarkPriceRecord);
+        memset(treeRecords.mutableBytes, 0, treeRecords.length);
+        pricesFromTree([[decoder objectWithData:pricesPayload] objectForKey:@"prices"], treeRecords.mutableBytes);
+        count = [decoder decodeRecordsWithData:pricesPayload schema:OTBenchmarkPriceSchema() records:schemaRecords.mutableBytes capacity:numInstruments error:NULL];
+        [[theValue(count) should] equal:theValue(numInstruments)];
+        [[theValue(memcmp(treeRecords.bytes, schemaRecords.bytes, treeRecords.length)) should] equal:theValue(0)];
+    });
+
+    it(@"should be cheaper than building the dictionary tree", ^{
+
+        JSONDecoder *decoder = [JSONDecoder decoder];
+        JKSchema *priceSchema = OTBenchmarkPriceSchema();
+        JKSchema *candleSchema = OTBenchmarkCandleSchema();
+        OTBenchmarkPriceRecord *priceRecords = calloc(numInstruments, sizeof(OTBenchmarkPriceRecord));
+        OTBenchmarkCandleRecord *candleRecords = calloc(numCandles, sizeof(OTBenchmarkCandleRecord));
+        OTBenchmarkReport *report = [OTBenchmarkReport sharedReport];
+        int64_t peakBytes = 0;
+
+        NSArray *samples = OTBenchmarkRunLoop(200, ^{
+            pricesFromTree([[decoder objectWithData:pricesPayload] objectForKey:@"prices"], priceRecords);
+        }, &peakBytes);
+        NSDictionary *pricesTree = [report recordBenchmark:@"jsonkitTreePrices" size:numInstruments payloadLength:pricesPayload.length samples:samples peakBytes:peakBytes];
+
+        samples = OTBenchmarkRunLoop(200, ^{
+            [decoder decodeRecordsWithData:pricesPayload schema:priceSchema records:priceRecords capacity:numInstruments error:NULL];
+        }, &peakBytes);
+        NSDictionary *pricesSchema = [report recordBenchmark:@"jsonkitSchemaPrices" size:numInstruments payloadLength:pricesPayload.length samples:samples peakBytes:peakBytes];
+
+        samples = OTBenchmarkRunLoop(20, ^{
+            candlesFromTree([[decoder objectWithData:candlesPayload] objectForKey:@"candles"], candleRecords);
+        }, &peakBytes);
+        NSDictionary *candlesTree = [report recordBenchmark:@"jsonkitTreeCandles" size:numCandles payloadLength:candlesPayload.length samples:samples peakBytes:peakBytes];
+
+        samples = OTBenchmarkRunLoop(20, ^{
+            [decoder decodeRecordsWithData:candlesPayload schema:candleSchema records:candleRecords capacity:numCandles error:NULL];
+        }, &peakBytes);
+        NSDictionary *candlesSchema = [report recordBenchmark:@"jsonkitSchemaCandles" size:numCandles payloadLength:candlesPayload.length samples:samples peakBytes:peakBytes];
+
+        free(priceRecords);
+        free(candleRecords);
+
+        NSLog(@"schema decoding: prices %.1f us tree, %.1f us schema; candles %.1f us tree, %.1f us schema (p50)",
+              [[pricesTree objectForKey:@"p50Us"] doubleValue], [[pricesSchema objectForKey:@"p50Us"] doubleValue],
+              [[candlesTree objectForKey:@"p50Us"] doubleValue], [[candlesSchema objectForKey:@"p50Us"] doubleValue]);
+        [[[pricesSchema objectForKey:@"p50Us"] should] beLessThan:[pricesTree objectForKey:@"p50Us"]];
+        [[[candlesSchema objectForKey:@"p50Us"] should] beLessThan:[candlesTree objectForKey:@"p50Us"]];
+        [[[candlesSchema objectForKey:@"peakBytes"] should] beLessThan:[candlesTree objectForKey:@"peakBytes"]];
+    });
+});
+
+describe(@"The vector scanning in JSONKit", ^{
+
+    // Each payload shape is decoded with the byte at a time loops, then with SSE2 / NEON, by the same JSONDecoder.
+    // The pretty-printed transactions are what the sandbox sends: indentation on every line.
+    NSData *transactionsPayload = OTBenchmarkTransactionsPayload(2000);
+    NSDictionary *payloads = @{ @"prices" : OTBenchmarkPricesPayload(150),
+                                @"candles" : OTBenchmarkCandlesPayload(5000),
+                                @"transactions" : transactionsPayload,
+                                @"prettyTransactions" : [NSJSONSerialization dataWithJSONObject:[NSJSONSerialization JSONObjectWithData:transactionsPayload options:0 error:NULL]
+                                                                                        options:NSJSONWritingPrettyPrinted error:NULL] };
+
+    it(@"should decode every payload shape faster than a byte at a time", ^{
+        if (!JKVectorScanAvailable()) {
+            NSLog(@"vector scanning: not compiled in for this architecture");
+            return;
+        }
+
+        JSONDecoder *decoder = [JSONDecoder decoder];
+        OTBenchmarkReport *report = [OTBenchmarkReport sharedReport];
+        __block double scalarTotal = 0, vectorTotal = 0;
+
+        [payloads enumerateKeysAndObjectsUsingBlock:^(NSString *shape, NSData *payload, BOOL *stop) {
+            int64_t peakBytes = 0;
+            NSUInteger iterations = MAX((NSUInteger)10, (NSUInteger)(20000000 / payload.length));
+
+            JKSetVectorScanEnabled(NO);
+            NSArray *samples = OTBenchmarkRunLoop(iterations, ^{
+                [decoder objectWithData:payload];
+            }, &peakBytes);
+            NSDictionary *scalar = [report recordBenchmark:[@"jsonkitScalarScan-" stringByAppendingString:shape] size:1 payloadLength:payload.length samples:samples peakBytes:peakBytes];
+
+            JKSetVectorScanEnabled(YES);
+            samples = OTBenchmarkRunLoop(iterations, ^{
+                [decoder objectWithData:payload];
+            }, &peakBytes);
+            NSDictionary *vector = [report recordBenchmark:[@"jsonkitVectorScan-" stringByAppendingString:shape] size:1 payloadLength:payload.length samples:samples peakBytes:peakBytes];
+
+            NSLog(@"vector scanning, %@ (%lu bytes): %.1f MB/s a byte at a time, %.1f MB/s vector", shape, (unsigned long)payload.length,
+                  [[scalar objectForKey:@"megabytesPerSecond"] doubleValue], [[vector objectForKey:@"megabytesPerSecond"] doubleValue]);
+            scalarTotal += [[scalar objectForKey:@"p50Us"] doubleValue];
+            vectorTotal += [[vector objectForKey:@"p50Us"] doubleValue];
+        }];
+
+        [[theValue(vectorTotal) should] beLessThan:theValue(scalarTotal)];
+    });
+});
+
+describe(@"The JSON decoder pool", ^{
+
+    // A quote screen of 100 instruments polled once a second for a minute.  The ticks are parsed back to back, as time in between
+    // changes nothing but how long the pool holds on to its decoder.
+    const NSUInteger numInstruments = 100, numTicks = 60, numMinutes = 5;
+    NSArray *ticks = OTBenchmarkQuoteStreamTicks(numInstruments, numTicks);
+
+    it(@"should parse a steady quote stream faster, with fewer allocations, than a decoder per response", ^{
+        OTNetworkController *networkController = [[OTNetworkController alloc] init];
+        OTBenchmarkReport *report = [OTBenchmarkReport sharedReport];
+        NSMutableDictionary *results = [NSMutableDictionary dictionary];
+
+        // Each tick is parsed on the decodeQueue, as OTNetworkController does: by a decoder made for it (what USE_JSONKIT used to do),
+        // by the controller's decoderPool, or by NSJSONSerialization (what the library does without USE_JSONKIT).
+        NSDictionary *parsers = @{ @"quoteStreamDecoderPerResponse" : [^id (NSData *data) {
+                                       return [[JSONDecoder decoderWithParseOptions:JKParseOptionNone] objectWithData:data];
+                                   } copy],
+                                   @"quoteStreamDecoderPool" : [^id (NSData *data) {
+                                       return [networkController.decoderPool objectWithData:data error:NULL];
+                                   } copy],
+                                   @"quoteStreamNSJSONSerialization" : [^id (NSData *data) {
+                                       return [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingMutableContainers error:NULL];
+                                   } copy] };
+
+        [parsers enumerateKeysAndObjectsUsingBlock:^(NSString *name, id parser, BOOL *stop) {
+            id (^parse)(NSData *) = parser;
+            NSMutableArray *samples = [NSMutableArray arrayWithCapacity:numTicks * numMinutes];
+            int64_t peakBytes = 0, blocks = 0;
+            NSUInteger payloadLength = 0;
+
+            for (NSUInteger i = 0; i < numTicks * numMinutes; i++) {
+                @autoreleasepool {
+                    NSData *tick = [ticks objectAtIndex:i % numTicks];
+                    __block id prices = nil;
+                    int64_t baselineBytes = [OTBenchmarkReport bytesInUse], baselineBlocks = [OTBenchmarkReport blocksInUse];
+                    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                    dispatch_sync(networkController.decodeQueue, ^{
+                        prices = parse(tick);
+                    });
+                    [samples addObject:@(CFAbsoluteTimeGetCurrent() - start)];
+                    peakBytes = MAX(peakBytes, [OTBenchmarkReport bytesInUse] - baselineBytes);
+                    blocks += [OTBenchmarkReport blocksInUse] - baselineBlocks;
+                    payloadLength += tick.length;
+                    [[theValue([[prices objectForKey:@"prices"] count]) should] equal:theValue(numInstruments)];
+                }
+            }
+
+            NSMutableDictionary *result = [[report recordBenchmark:name size:numInstruments payloadLength:payloadLength / samples.count samples:samples peakBytes:peakBytes] mutableCopy];
+            [result setObject:@((double)blocks / samples.count) forKey:@"blocksPerParse"];
+            [results setObject:result forKey:name];
+            NSLog(@"quote stream, %@: %.1f us p50, %.1f us p99, %.0f blocks left allocated per parse", name,
+                  [[result objectForKey:@"p50Us"] doubleValue], [[result objectForKey:@"p99Us"] doubleValue], [[result objectForKey:@"blocksPerParse"] doubleValue]);
+        }];
+
+        NSDictionary *perResponse = [results objectForKey:@"quoteStreamDecoderPerResponse"], *pool = [results objectForKey:@"quoteStreamDecoderPool"];
+        [[[pool objectForKey:@"p50Us"] should] beLessThan:[perResponse objectForKey:@"p50Us"]];
+        [[[pool objectForKey:@"blocksPerParse"] should] beLessThan:[perResponse objectForKey:@"blocksPerParse"]];
+        [[theValue(networkController.decoderPool.numDecodersCreated) should] equal:theValue(1)];
+    });
+});
+
+describe(@"The JSONKit object cache", ^{
+
+    // Sweeps the geometry of the cache over the shapes of response the app parses most, each one parsed over and over by the same
+    // decoder (as the decoderPool of OTNetworkController does): a quote stream, where keys and symbols repeat and prices mostly do not,
+    // a history of candles and a page of transactions, where there are far more distinct values than slots, and the instrument list.
+    NSDictionary *payloads = @{ @"quoteStream" : OTBenchmarkQuoteStreamTicks(100, 60),
+                                @"candles" : @[ OTBenchmarkCandlesPayload(5000) ],
+                                @"transactions" : @[ OTBenchmarkTransactionsPayload(2000) ],
+                                @"instruments" : @[ OTBenchmarkInstrumentsPayload(150) ] };
+    NSArray *slotsBitsSweep = @[ @6, @8, @10, @12, @14 ];
+    NSArray *probesSweep = @[ @1, @2, @4, @8 ];
+
+    it(@"should find the geometry that parses OANDA responses fastest", ^{
+        OTBenchmarkReport *report = [OTBenchmarkReport sharedReport];
+        NSMutableDictionary *p50s = [NSMutableDictionary dictionary];       // shape -> geometry -> p50Us
+        NSMutableDictionary *hitRates = [NSMutableDictionary dictionary];   // shape -> geometry -> hits / lookups
+
+        [payloads enumerateKeysAndObjectsUsingBlock:^(NSString *shape, NSArray *responses, BOOL *stop) {
+            NSUInteger totalLength = [[responses valueForKeyPath:@"@sum.length"] unsignedIntegerValue];
+            NSUInteger iterations = MAX(responses.count, (NSUInteger)(10000000 / totalLength) * responses.count);
+            [p50s setObject:[NSMutableDictionary dictionary] forKey:shape];
+            [hitRates setObject:[NSMutableDictionary dictionary] forKey:shape];
+
+            for (NSNumber *slotsBits in slotsBitsSweep) {
+                for (NSNumber *probes in probesSweep) {
+                    NSString *geometry = [NSString stringWithFormat:@"%@x%@", slotsBits, probes];
+                    JSONDecoder *decoder = [JSONDecoder decoder];
+                    [decoder setCacheSlotsBits:slotsBits.unsignedIntegerValue probes:probes.unsignedIntegerValue];
+                    __block NSUInteger next = 0;
+                    int64_t peakBytes = 0;
+
+                    NSArray *samples = OTBenchmarkRunLoop(iterations, ^{
+                        [decoder objectWithData:[responses objectAtIndex:next++ % responses.count]];
+                    }, &peakBytes);
+                    NSDictionary *result = [report recordBenchmark:[NSString stringWithFormat:@"jsonkitCache-%@-%@", shape, geometry] size:1
+                                                     payloadLength:totalLength / responses.count samples:samples peakBytes:peakBytes];
+                    JKCacheStatistics statistics = [decoder cacheStatistics];
+
+                    [[p50s objectForKey:shape] setObject:[result objectForKey:@"p50Us"] forKey:geometry];
+                    [[hitRates objectForKey:shape] setObject:@((double)statistics.hits / MAX(statistics.hits + statistics.misses, (NSUInteger)1)) forKey:geometry];
+                }
+            }
+        }];
+
+        // Each geometry is scored by its time relative to the best one for each shape, added up over the shapes, so that the
+        // large payloads do not drown out the small ones.
+        NSMutableDictionary *scores = [NSMutableDictionary dictionary];
+        [p50s enumerateKeysAndObjectsUsingBlock:^(NSString *shape, NSDictionary *byGeometry, BOOL *stop) {
+            double best = [[[byGeometry allValues] valueForKeyPath:@"@min.self"] doubleValue];
+            [byGeometry enumerateKeysAndObjectsUsingBlock:^(NSString *geometry, NSNumber *p50, BOOL *stop) {
+                double score = [[scores objectForKey:geometry] doubleValue] + p50.doubleValue / MAX(best, 1e-3);
+                [scores setObject:@(score) forKey:geometry];
+            }];
+        }];
+        NSString *bestGeometry = [[scores keysSortedByValueUsingSelector:@selector(compare:)] objectAtIndex:0];
+        NSString *defaultGeometry = @"10x4";  // JK_CACHE_SLOTS_BITS x JK_CACHE_PROBES
+
+        for (NSString *shape in payloads) {
+            NSLog(@"jsonkit cache, %@: default %@ %.1f us (%.0f%% hits), best %@ %.1f us (%.0f%% hits)", shape,
+                  defaultGeometry, [[[p50s objectForKey:shape] objectForKey:defaultGeometry] doubleValue], 100 * [[[hitRates objectForKey:shape] objectForKey:defaultGeometry] doubleValue],
+                  bestGeometry, [[[p50s objectForKey:shape] objectForKey:bestGeometry] doubleValue], 100 * [[[hitRates objectForKey:shape] objectForKey:bestGeometry] doubleValue]);
+        }
+        NSLog(@"jsonkit cache: %@ is the best geometry overall (score %.2f, %lu shapes), the default %@ scores %.2f",
+              bestGeometry, [[scores objectForKey:bestGeometry] doubleValue], (unsigned long)payloads.count, defaultGeometry, [[scores objectForKey:defaultGeometry] doubleValue]);
+
+        // The four keys are half of the strings and numbers of each quote, so a cache which keeps them finds about half of what it looks up.
+        [[[[hitRates objectForKey:@"quoteStream"] objectForKey:defaultGeometry] should] beGreaterThan:@0.45];
+    });
+});
+
+describe(@"The lazy JSON view", ^{
+
+    // What an order list screen does with the response: read the instrument, units and price of every order, and nothing else.
+    double (^readOrders)(NSArray *) = ^double (NSArray *orders) {
+        double total = 0;
+        for (NSDictionary *order in orders) {
+            total += [[order objectForKey:@"units"] doubleValue] * [[order objectForKey:@"price"] doubleValue] + [[order objectForKey:@"instrument"] length];
+        }
+        return total;
+    };
+
+    it(@"should hand over a list read two or three fields at a time faster, and in less memory, than a full parse", ^{
+        OTNetworkController *networkController = [[OTNetworkController alloc] init];
+        OTBenchmarkReport *report = [OTBenchmarkReport sharedReport];
+
+        for (NSNumber *size in @[ @50, @500, @5000 ]) {
+            NSData *payload = OTBenchmarkOrdersPayload(size.unsignedIntegerValue);
+            NSUInteger iterations = MAX((NSUInteger)20, 5000000 / payload.length);
+            double expectedTotal = readOrders([[NSJSONSerialization JSONObjectWithData:payload options:0 error:NULL] objectForKey:@"orders"]);
+            NSMutableDictionary *results = [NSMutableDictionary dictionary];
+
+            NSDictionary *parsers = @{ @"ordersNSJSONSerialization" : [^id (NSData *data) {
+                                           return [NSJSONSerialization JSONObjectWithData:data options:NSJSONReadingMutableContainers error:NULL];
+                                       } copy],
+                                       @"ordersDecoderPool" : [^id (NSData *data) {
+                                           return [networkController.decoderPool objectWithData:data error:NULL];
+                                       } copy],
+                                       @"ordersLazyJSON" : [^id (NSData *data) {
+                                           return [OTLazyJSON objectWithData:data error:NULL];
+                                       } copy] };
+
+            [parsers enumerateKeysAndObjectsUsingBlock:^(NSString *name, id parser, BOOL *stop) {
+                id (^parse)(NSData *) = parser;
+                NSMutableArray *samples = [NSMutableArray arrayWithCapacity:iterations];
+                int64_t peakBytes = 0;
+                double total = 0;
+
+                // the memory is measured while the result is still held, so it counts both the parse and the fields read
+                for (NSUInteger i = 0; i <= iterations; i++) {
+                    @autoreleasepool {
+                        int64_t baseline = [OTBenchmarkReport bytesInUse];
+                        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+                        id result = parse(payload);
+                        total = readOrders([result objectForKey:@"orders"]);
+                        if (i > 0) {
+                            [samples addObject:@(CFAbsoluteTimeGetCurrent() - start)];
+                            peakBytes = MAX(peakBytes, [OTBenchmarkReport bytesInUse] - baseline);
+                        }
+                    }
+                }
+                [[theValue(total) should] equal:expectedTotal withDelta:1e-6 * fabs(expectedTotal)];
+
+                NSDictionary *result = [report recordBenchmark:name size:size.unsignedIntegerValue payloadLength:payload.length samples:samples peakBytes:peakBytes];
+                [results setObject:result forKey:name];
+                NSLog(@"%@ orders, %@: %.1f us p50, %.1f us p99, %lld bytes peak", size, name,
+                      [[result objectForKey:@"p50Us"] doubleValue], [[result objectForKey:@"p99Us"] doubleValue], (long long)peakBytes);
+            }];
+
+            NSDictionary *full = [results objectForKey:@"ordersNSJSONSerialization"], *lazy = [results objectForKey:@"ordersLazyJSON"];
+            [[[lazy objectForKey:@"p50Us"] should] beLessThan:[full objectForKey:@"p50Us"]];
+            [[[lazy objectForKey:@"peakBytes"] should] beLessThan:[full objectForKey:@"peakBytes"]];
+        }
+    });
+});
+
+SPEC_END
@@ -26,6 +26,7 @@
 
 #import "Kiwi.h"
 #import "OTNetworkController.h"
+#import "OTStubServer.h"
 
 SPEC_BEGIN(OTNetworkLayerSpec)
 
@@ -33,7 +34,13 @@ SPEC_BEGIN(OTNetworkLayerSpec)
 
 describe(@"The Network Controller", ^{
 
-    OTNetworkController *networkController = [[OTNetworkController alloc] init];
+    // the simulator stands in for the sandbox, serving recorded accounts and generated orders, trades and positions
+    OTStubServer *server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD", @"USD_JPY", @"GBP_USD"]];
+    server.generatedRowCount = 30;
+    server.transactionCount = 120;
+    [server start];
+
+    OTNetworkController *networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
     
     __block NSMutableArray *symbolsArray = nil;
     __block NSNumber *gAccountId = nil;
@@ -227,9 +234,69 @@ describe(@"The Network Controller", ^{
                 [[expectFutureValue(fetchedData) shouldEventually] beNonNil];
             });
 
+            it(@"should net the open trades into one position per instrument", ^{
+                
+                __block NSArray *positions = nil;
+                
+                [networkController positionsListForAccountId:gAccountId
+                                                success:^(NSDictionary *responseObject)
+                 {
+                     positions = [responseObject objectForKey:@"positions"];
+                     
+                 } failure:^(NSDictionary *error) {
+                     NSLog(@"Failure");
+                 }];
+                
+                [[expectFutureValue(positions) shouldEventually] haveCountOf:3];
+            });
+
             
         }); //context(@"when asking for reports"
         
+        context(@"when the server is flaky", ^{
+            
+            afterEach(^{
+                server.errorRate = 0;
+                server.responseDelay = 0;
+                server.responseJitter = 0;
+            });
+            
+            it(@"should report the server errors to the failure block", ^{
+                
+                __block NSDictionary *failure = nil;
+                server.errorRate = 1.0;
+                
+                [networkController tradesListForAccountId:gAccountId
+                                                  success:^(NSDictionary *responseObject)
+                 {
+                     NSLog(@"Unexpected success");
+                 } failure:^(NSDictionary *error) {
+                     failure = error;
+                 }];
+                
+                [[expectFutureValue([failure objectForKey:@"http status code"]) shouldEventually] equal:@500];
+            });
+            
+            it(@"should still answer every request when slowed down at random", ^{
+                
+                __block NSUInteger numAnswered = 0;
+                server.responseDelay = 0.01;
+                server.responseJitter = 0.05;
+                
+                for (int i = 0; i < 10; i++) {
+                    [networkController ordersListForAccountId:gAccountId
+                                                      success:^(NSDictionary *responseObject)
+                     {
+                         numAnswered++;
+                     } failure:^(NSDictionary *error) {
+                         NSLog(@"Failure");
+                     }];
+                }
+                
+                [[expectFutureValue(theValue(numAnswered)) shouldEventually] equal:theValue(10)];
+            });
+        }); //context(@"when the server is flaky"
+        
         
         
         
@@ -0,0 +1,130 @@
+//
+//  OTOrderBatchSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTOrderBatchSpec)
+
+describe(@"The order batches", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+    __block NSArray *batchResults = nil;
+    __block NSArray *batchErrors = nil;
+    NetworkBatchCompletionBlock completionBlock = ^(NSArray *results, NSArray *errors) {
+        batchResults = results;
+        batchErrors = errors;
+    };
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        [[theValue([server start]) should] beYes];
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        batchResults = nil;
+        batchErrors = nil;
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    it(@"should place a ladder of orders and report each one", ^{
+        NSMutableArray *ladder = [NSMutableArray array];
+        for (NSUInteger i = 0; i < 10; i++) {
+            NSDecimalNumber *price = [[NSDecimalNumber decimalNumberWithString:@"1.2900"] decimalNumberBySubtracting:[NSDecimalNumber decimalNumberWithMantissa:i * 5 exponent:-4 isNegative:NO]];
+            [ladder addObject:@{ @"instrument" : @"EUR_USD", @"units" : @1000, @"side" : @"buy", @"type" : @"limit", @"price" : price, @"expiry" : @3600 }];
+        }
+        __block NSUInteger numFinished = 0;
+
+        [networkController createOrdersForAccount:@1234 orders:ladder maxConcurrentRequests:0 progress:^(NSUInteger numberOfFinishedRequests, NSUInteger totalNumberOfRequests) {
+            numFinished = MAX(numFinished, numberOfFinishedRequests);
+        } completion:completionBlock];
+
+        [[expectFutureValue(batchResults) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[theValue(numFinished) should] equal:theValue(10)];
+        [[batchResults should] haveCountOf:10];
+        [batchErrors enumerateObjectsUsingBlock:^(id error, NSUInteger idx, BOOL *stop) {
+            [[error should] equal:[NSNull null]];
+        }];
+        [[[[batchResults objectAtIndex:0] objectForKey:@"price"] should] equal:@"1.29000"];
+        [[[[batchResults objectAtIndex:9] objectForKey:@"price"] should] equal:@"1.28550"];
+        [[theValue(server.numOrderRequests) should] equal:theValue(10)];
+    });
+
+    it(@"should keep no more than maxConcurrentRequests on the network", ^{
+        NSMutableArray *orderIds = [NSMutableArray array];
+        for (NSUInteger i = 1; i <= 40; i++) {
+            [orderIds addObject:@(i)];
+        }
+        server.responseDelay = 0.02;
+
+        [networkController deleteOrdersForAccount:@1234 orderIds:orderIds maxConcurrentRequests:3 progress:nil completion:completionBlock];
+
+        [[expectFutureValue(batchResults) shouldEventuallyBeforeTimingOutAfter(10.0)] beNonNil];
+        [[theValue(server.peakConcurrentRequests) should] beLessThanOrEqualTo:theValue(3)];
+        [[[batchResults valueForKey:@"id"] should] equal:orderIds];
+    });
+
+    it(@"should send every request as a trading call of the requestScheduler", ^{
+        NSMutableArray *orderIds = [NSMutableArray array];
+        for (NSUInteger i = 1; i <= 20; i++) {
+            [orderIds addObject:@(i)];
+        }
+        server.responseDelay = 0.01;
+        networkController.requestScheduler.maxConcurrentRequests = 1;
+        // 20 requests per second after the first: the batch cannot be done in much under a second
+        [networkController.requestScheduler setTokensPerSecond:20.0 burst:1 forPriority:OTRequestPriorityTrading];
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+        [networkController deleteOrdersForAccount:@1234 orderIds:orderIds maxConcurrentRequests:4 progress:nil completion:completionBlock];
+
+        [[expectFutureValue(batchResults) shouldEventuallyBeforeTimingOutAfter(10.0)] beNonNil];
+        [[theValue(CFAbsoluteTimeGetCurrent() - start) should] beGreaterThan:theValue(0.9)];
+        [[theValue(server.peakConcurrentRequests) should] equal:theValue(1)];
+        [[theValue([networkController.requestScheduler statsForPriority:OTRequestPriorityTrading].numStarted) should] equal:theValue(20)];
+        [[[batchResults valueForKey:@"id"] should] equal:orderIds];
+    });
+
+    it(@"should stop sending once the server turns the credentials down", ^{
+        NSMutableArray *orderIds = [NSMutableArray array];
+        for (NSUInteger i = 1; i <= 100; i++) {
+            [orderIds addObject:@(i)];
+        }
+        server.responseDelay = 0.01;
+        server.unauthorizedOrderId = 5;
+
+        [networkController deleteOrdersForAccount:@1234 orderIds:orderIds maxConcurrentRequests:2 progress:nil completion:completionBlock];
+
+        [[expectFutureValue(batchResults) shouldEventuallyBeforeTimingOutAfter(10.0)] beNonNil];
+        [[[[batchErrors objectAtIndex:4] objectForKey:@"http status code"] should] equal:@401];
+        [[[[batchResults objectAtIndex:0] objectForKey:@"id"] should] equal:@1];
+        [[theValue([[[batchErrors lastObject] objectForKey:@"net error"] code]) should] equal:theValue(NSURLErrorCancelled)];
+        [[theValue(server.numOrderRequests) should] beLessThan:theValue(10)];
+    });
+});
+
+SPEC_END
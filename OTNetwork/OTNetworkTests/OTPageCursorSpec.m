@@ -0,0 +1,145 @@
+//
+//  OTPageCursorSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTPageCursor.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTPageCursorSpec)
+
+describe(@"The Page Cursor", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD", @"USD_JPY"]];
+        server.transactionCount = 230;
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    it(@"should read every transaction once, following the nextPage links", ^{
+        OTPageCursor *cursor = [networkController transactionCursorForAccountId:@1234 pageSize:@50];
+        NSMutableArray *transactionIds = [NSMutableArray array];
+        NSMutableArray *pageSizes = [NSMutableArray array];
+        __block BOOL done = NO;
+        __block NSUInteger mostBufferedPages = 0;
+
+        __block void (^readPage)(void) = ^{
+            [cursor nextPageSuccess:^(NSArray *rows, BOOL lastPage) {
+                [transactionIds addObjectsFromArray:[rows valueForKey:@"id"]];
+                [pageSizes addObject:@(rows.count)];
+                mostBufferedPages = MAX(mostBufferedPages, cursor.numBufferedPages);
+                if (lastPage) {
+                    done = YES;
+                } else {
+                    readPage();
+                }
+            } failure:^(NSDictionary *error) {
+                done = YES;
+            }];
+        };
+        readPage();
+
+        [[expectFutureValue(theValue(done)) shouldEventuallyBeforeTimingOutAfter(5.0)] beYes];
+        readPage = nil;
+
+        [[pageSizes should] equal:@[@50, @50, @50, @50, @30]];
+        [[theValue(transactionIds.count) should] equal:theValue(230)];
+        [[[transactionIds objectAtIndex:0] should] equal:@230];
+        [[[transactionIds lastObject] should] equal:@1];
+        [[theValue([[NSSet setWithArray:transactionIds] count]) should] equal:theValue(230)];
+        [[theValue(mostBufferedPages) should] beLessThanOrEqualTo:theValue(cursor.maxBufferedPages)];
+        [[theValue(cursor.hasMorePages) should] beNo];
+        [[theValue(server.numTransactionRequests) should] equal:theValue(5)];
+    });
+
+    it(@"should prefetch up to maxBufferedPages while the caller holds a page", ^{
+        OTPageCursor *cursor = [networkController transactionCursorForAccountId:@1234 pageSize:@20];
+        cursor.maxBufferedPages = 3;
+        __block NSArray *firstPage = nil;
+
+        [cursor nextPageSuccess:^(NSArray *rows, BOOL lastPage) {
+            firstPage = rows;
+        } failure:nil];
+
+        [[expectFutureValue(firstPage) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[expectFutureValue(theValue(cursor.numBufferedPages)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(3)];
+
+        // nobody is reading: the cursor must not go past its cap
+        [NSThread sleepForTimeInterval:0.2];
+        [[theValue(cursor.numBufferedPages) should] equal:theValue(3)];
+        [[theValue(server.numTransactionRequests) should] equal:theValue(4)];
+
+        // a buffered page is handed out right away, and its slot refilled
+        __block NSArray *secondPage = nil;
+        [cursor nextPageSuccess:^(NSArray *rows, BOOL lastPage) {
+            secondPage = rows;
+        } failure:nil];
+        [[[[secondPage objectAtIndex:0] objectForKey:@"id"] should] equal:@210];
+        [[expectFutureValue(theValue(server.numTransactionRequests)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(5)];
+    });
+
+    it(@"should only fetch on demand without a buffer", ^{
+        OTPageCursor *cursor = [networkController transactionCursorForAccountId:@1234 pageSize:@20];
+        cursor.maxBufferedPages = 0;
+        __block NSArray *firstPage = nil;
+
+        [cursor nextPageSuccess:^(NSArray *rows, BOOL lastPage) {
+            firstPage = rows;
+        } failure:nil];
+
+        [[expectFutureValue(firstPage) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [NSThread sleepForTimeInterval:0.2];
+        [[theValue(server.numTransactionRequests) should] equal:theValue(1)];
+        [[theValue(cursor.numBufferedPages) should] equal:theValue(0)];
+    });
+
+    it(@"should report a page which could not be fetched", ^{
+        OTNetworkController *brokenController = [[OTNetworkController alloc] initWithServerUrl:[server.serverUrl stringByAppendingString:@"missing/"]
+                                                                                  streamUrl:server.streamUrl];
+        OTPageCursor *cursor = [brokenController transactionCursorForAccountId:@1234 pageSize:nil];
+        __block NSDictionary *failure = nil;
+
+        [cursor nextPageSuccess:^(NSArray *rows, BOOL lastPage) {
+            fail(@"no page expected");
+        } failure:^(NSDictionary *error) {
+            failure = error;
+        }];
+
+        [[expectFutureValue(failure) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[[failure objectForKey:@"http status code"] should] equal:@404];
+        [[theValue(cursor.hasMorePages) should] beYes];
+    });
+});
+
+SPEC_END
@@ -0,0 +1,113 @@
+//
+//  OTPriceStreamSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTPriceStreamSpec)
+
+describe(@"The Price Stream", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+    __block OTPriceStream *priceStream = nil;
+    __block id subscription = nil;
+    __block NSUInteger numTicks = 0;
+    __block BOOL onlySubscribedInstrument = YES;
+
+    PriceStreamTickBlock tickBlock = ^(OTPriceTick tick) {
+        numTicks++;
+        onlySubscribedInstrument = onlySubscribedInstrument && strcmp(tick.instrument, "EUR_USD") == 0;
+    };
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD", @"USD_JPY", @"GBP_USD"]];
+        server.ticksPerSecond = 20.0;
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        priceStream = networkController.priceStream;
+        priceStream.reconnectDelay = 0.1;
+        priceStream.minPollInterval = 0.1;
+        priceStream.maxPollInterval = 0.5;
+
+        numTicks = 0;
+        onlySubscribedInstrument = YES;
+    });
+
+    afterEach(^{
+        [priceStream unsubscribe:subscription];
+        [server stop];
+    });
+
+    it(@"should deliver streamed ticks to the subscribers of their instrument", ^{
+
+        subscription = [priceStream subscribeToInstrument:@"EUR_USD" tickBlock:tickBlock];
+
+        [[expectFutureValue(theValue(numTicks)) shouldEventuallyBeforeTimingOutAfter(5.0)] beGreaterThanOrEqualTo:theValue(20)];
+        [[theValue(priceStream.state) should] equal:theValue(OTPriceStreamStateStreaming)];
+        [[theValue(onlySubscribedInstrument) should] beYes];
+        [[theValue(server.numPriceRequests) should] equal:theValue(0)];
+    });
+
+    it(@"should stop once the last subscriber is gone", ^{
+
+        subscription = [priceStream subscribeToInstrument:@"EUR_USD" tickBlock:tickBlock];
+        [[expectFutureValue(theValue(numTicks)) shouldEventuallyBeforeTimingOutAfter(5.0)] beGreaterThan:theValue(0)];
+
+        [priceStream unsubscribe:subscription];
+        [[expectFutureValue(theValue(priceStream.state)) shouldEventuallyBeforeTimingOutAfter(2.0)] equal:theValue(OTPriceStreamStateStopped)];
+    });
+
+    it(@"should reconnect when the connection drops", ^{
+
+        subscription = [priceStream subscribeToInstrument:@"EUR_USD" tickBlock:tickBlock];
+        [[expectFutureValue(theValue(numTicks)) shouldEventuallyBeforeTimingOutAfter(5.0)] beGreaterThanOrEqualTo:theValue(5)];
+
+        [server dropStreamConnections];
+        NSUInteger numTicksBeforeDrop = numTicks;
+
+        [[expectFutureValue(theValue(server.numStreamConnections)) shouldEventuallyBeforeTimingOutAfter(5.0)] beGreaterThanOrEqualTo:theValue(2)];
+        [[expectFutureValue(theValue(numTicks)) shouldEventuallyBeforeTimingOutAfter(5.0)] beGreaterThanOrEqualTo:theValue(numTicksBeforeDrop + 10)];
+        [[theValue(priceStream.state) should] equal:theValue(OTPriceStreamStateStreaming)];
+    });
+
+    it(@"should poll while streaming is unavailable, and stream again once it is back", ^{
+
+        server.streamingEnabled = NO;
+        priceStream.streamRetryInterval = 1.0;
+        subscription = [priceStream subscribeToInstrument:@"EUR_USD" tickBlock:tickBlock];
+
+        [[expectFutureValue(theValue(priceStream.state)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(OTPriceStreamStatePolling)];
+        [[expectFutureValue(theValue(numTicks)) shouldEventuallyBeforeTimingOutAfter(5.0)] beGreaterThanOrEqualTo:theValue(3)];
+        [[theValue(server.numPriceRequests) should] beGreaterThanOrEqualTo:theValue(3)];
+
+        server.streamingEnabled = YES;
+        [[expectFutureValue(theValue(priceStream.state)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(OTPriceStreamStateStreaming)];
+    });
+});
+
+SPEC_END
@@ -0,0 +1,232 @@
+//
+//  OTRequestCoalescingSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTRequestCoalescingSpec)
+
+describe(@"The Network Controller request coalescing", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD", @"USD_JPY"]];
+        server.responseDelay = 0.2;
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    it(@"should send identical concurrent requests only once, and share the result", ^{
+        NSMutableArray *results = [NSMutableArray array];
+        for (NSUInteger i = 0; i < 3; i++) {
+            [networkController rateQuote:@[@"EUR_USD", @"USD_JPY"] success:^(NSDictionary *result) {
+                [results addObject:result];
+            } failure:^(NSDictionary *error) {
+                NSLog(@"Failure");
+            }];
+        }
+
+        [[expectFutureValue(theValue(results.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(3)];
+        [[theValue(server.numPriceRequests) should] equal:theValue(1)];
+        [[theValue(networkController.numRequestsSent) should] equal:theValue(1)];
+        [[theValue(networkController.numRequestsCoalesced) should] equal:theValue(2)];
+        [[theValue([results objectAtIndex:0] == [results objectAtIndex:2]) should] beYes];
+        [[[[results objectAtIndex:0] objectForKey:@"prices"] should] haveCountOf:2];
+    });
+
+    it(@"should keep requests with different parameters apart", ^{
+        __block NSUInteger numResults = 0;
+        [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) { numResults++; } failure:nil];
+        [networkController rateQuote:@[@"USD_JPY"] success:^(NSDictionary *result) { numResults++; } failure:nil];
+
+        [[expectFutureValue(theValue(numResults)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(2)];
+        [[theValue(server.numPriceRequests) should] equal:theValue(2)];
+        [[theValue(networkController.numRequestsCoalesced) should] equal:theValue(0)];
+    });
+
+    it(@"should decode a shared response once per kind of result", ^{
+        __block NSDictionary *dictionaryResult = nil;
+        __block OTPriceTickList *ticksResult = nil;
+        [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) { dictionaryResult = result; } failure:nil];
+        [networkController rateQuoteTicks:@[@"EUR_USD"] success:^(OTPriceTickList *ticks) { ticksResult = ticks; } failure:nil];
+
+        [[expectFutureValue(ticksResult) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[expectFutureValue(dictionaryResult) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[theValue(server.numPriceRequests) should] equal:theValue(1)];
+        [[theValue(ticksResult.count) should] equal:theValue(1)];
+        [[[[[dictionaryResult objectForKey:@"prices"] lastObject] objectForKey:@"instrument"] should] equal:@"EUR_USD"];
+    });
+
+    it(@"should fail the ticks when the prices are not JSON", ^{
+        __block NSDictionary *failure = nil;
+        [server setFixtureData:[@"<html>Bad Gateway</html>" dataUsingEncoding:NSUTF8StringEncoding] forMethod:@"GET" pathPattern:@"/v1/prices"];
+
+        [networkController rateQuoteTicks:@[@"EUR_USD"] success:^(OTPriceTickList *ticks) {
+            NSLog(@"Unexpected success %@", ticks);
+        } failure:^(NSDictionary *error) {
+            failure = error;
+        }];
+
+        [[expectFutureValue(failure) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[theValue([[failure objectForKey:@"net error"] code]) should] equal:theValue(NSPropertyListReadCorruptError)];
+    });
+
+    it(@"should go back to the network once the shared request is over", ^{
+        __block NSUInteger numResults = 0;
+        [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) { numResults++; } failure:nil];
+        [[expectFutureValue(theValue(numResults)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(1)];
+
+        [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) { numResults++; } failure:nil];
+        [[expectFutureValue(theValue(numResults)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(2)];
+        [[theValue(server.numPriceRequests) should] equal:theValue(2)];
+    });
+
+    it(@"should hand a shared failure to every caller", ^{
+        __block NSUInteger numFailures = 0;
+        for (NSUInteger i = 0; i < 2; i++) {
+            [networkController positionsListForAccountId:@1234 success:^(NSDictionary *result) {
+                NSLog(@"Unexpected success");
+            } failure:^(NSDictionary *error) {
+                numFailures++;
+            }];
+        }
+
+        [[expectFutureValue(theValue(numFailures)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(2)];
+        [[theValue(server.numRequests) should] equal:theValue(1)];
+        [[theValue(networkController.numRequestsCoalesced) should] equal:theValue(1)];
+    });
+});
+
+describe(@"The Network Controller quote batching", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+    NSArray *symbolLists = @[ @[@"EUR_USD"], @[@"USD_JPY"], @[@"GBP_USD", @"EUR_USD"] ];
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD", @"USD_JPY", @"GBP_USD"]];
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    it(@"should merge the symbols of calls made within the window into one request", ^{
+        networkController.quoteBatchingWindow = 0.05;
+        NSMutableDictionary *results = [NSMutableDictionary dictionary];
+
+        [symbolLists enumerateObjectsUsingBlock:^(NSArray *symbols, NSUInteger idx, BOOL *stop) {
+            [networkController rateQuote:symbols success:^(NSDictionary *result) {
+                [results setObject:result forKey:@(idx)];
+            } failure:nil];
+        }];
+
+        [[expectFutureValue(theValue(results.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(symbolLists.count)];
+        [[theValue(server.numPriceRequests) should] equal:theValue(1)];
+
+        // each caller only sees what it asked for, in its own order
+        [symbolLists enumerateObjectsUsingBlock:^(NSArray *symbols, NSUInteger idx, BOOL *stop) {
+            NSArray *prices = [[results objectForKey:@(idx)] objectForKey:@"prices"];
+            [[[prices valueForKey:@"instrument"] should] equal:symbols];
+        }];
+    });
+
+    it(@"should send every call right away without a window", ^{
+        __block NSUInteger numResults = 0;
+        for (NSArray *symbols in symbolLists) {
+            [networkController rateQuote:symbols success:^(NSDictionary *result) { numResults++; } failure:nil];
+        }
+
+        [[expectFutureValue(theValue(numResults)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(symbolLists.count)];
+        [[theValue(server.numPriceRequests) should] equal:theValue(symbolLists.count)];
+    });
+
+    it(@"should leave out the prices which have no instrument", ^{
+        [server setFixture:@{ @"prices" : @[ @{ @"instrument" : @"EUR_USD", @"bid" : @1.3012, @"ask" : @1.3014 }, @{ @"bid" : @82.51, @"ask" : @82.54 } ] }
+                 forMethod:@"GET" pathPattern:@"/v1/prices"];
+        networkController.quoteBatchingWindow = 0.05;
+        NSMutableDictionary *results = [NSMutableDictionary dictionary];
+
+        [symbolLists enumerateObjectsUsingBlock:^(NSArray *symbols, NSUInteger idx, BOOL *stop) {
+            [networkController rateQuote:symbols success:^(NSDictionary *result) {
+                [results setObject:result forKey:@(idx)];
+            } failure:nil];
+        }];
+
+        [[expectFutureValue(theValue(results.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(symbolLists.count)];
+        [[[[[results objectForKey:@0] objectForKey:@"prices"] valueForKey:@"instrument"] should] equal:@[@"EUR_USD"]];
+        [[[[results objectForKey:@1] objectForKey:@"prices"] should] beEmpty];
+        [[[[[results objectForKey:@2] objectForKey:@"prices"] valueForKey:@"instrument"] should] equal:@[@"EUR_USD"]];
+    });
+
+    it(@"should fail every call of the window when the response has no prices", ^{
+        [server setFixture:@{ @"code" : @46, @"message" : @"Unexpected response" } forMethod:@"GET" pathPattern:@"/v1/prices"];
+        networkController.quoteBatchingWindow = 0.05;
+        __block NSUInteger numFailures = 0;
+
+        for (NSArray *symbols in symbolLists) {
+            [networkController rateQuote:symbols success:^(NSDictionary *result) {
+                NSLog(@"Unexpected success %@", result);
+            } failure:^(NSDictionary *error) {
+                [[theValue([[error objectForKey:@"net error"] code]) should] equal:theValue(NSPropertyListReadCorruptError)];
+                numFailures++;
+            }];
+        }
+
+        [[expectFutureValue(theValue(numFailures)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(symbolLists.count)];
+        [[theValue(server.numFixtureResponses) should] equal:theValue(1)];
+    });
+
+    it(@"should fail every call of the window when the response is not JSON", ^{
+        [server setFixtureData:[@"<html>Bad Gateway</html>" dataUsingEncoding:NSUTF8StringEncoding] forMethod:@"GET" pathPattern:@"/v1/prices"];
+        networkController.quoteBatchingWindow = 0.05;
+        __block NSUInteger numFailures = 0;
+
+        for (NSArray *symbols in symbolLists) {
+            [networkController rateQuote:symbols success:^(NSDictionary *result) {
+                NSLog(@"Unexpected success %@", result);
+            } failure:^(NSDictionary *error) {
+                [[theValue([[error objectForKey:@"net error"] code]) should] equal:theValue(NSPropertyListReadCorruptError)];
+                numFailures++;
+            }];
+        }
+
+        [[expectFutureValue(theValue(numFailures)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(symbolLists.count)];
+        [[theValue(server.numFixtureResponses) should] equal:theValue(1)];
+    });
+});
+
+SPEC_END
@@ -0,0 +1,239 @@
+//
+//  OTRequestMetricsSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTRequestMetrics.h"
+#import "OTStubServer.h"
+
+// Keeps every request it is told about.
+@interface OTMetricsRecorder : NSObject <OTRequestMetricsDelegate>
+@property (atomic, strong) NSMutableArray *endpoints;
+@end
+
+@implementation OTMetricsRecorder
+
+- (void)requestMetrics:(OTRequestMetrics *)metrics didRecordRequestToEndpoint:(NSString *)endpoint timestamps:(OTRequestTimestamps)timestamps failed:(BOOL)failed
+{
+    [self.endpoints addObject:endpoint];
+}
+
+@end
+
+SPEC_BEGIN(OTRequestMetricsSpec)
+
+describe(@"The Request Metrics", ^{
+
+    it(@"should file requests under their endpoint, whatever the ids", ^{
+        [[[OTRequestMetrics endpointForMethod:@"GET" path:@"/v1/accounts/506005/trades" basePath:@"/v1"] should] equal:@"GET accounts/:id/trades"];
+        [[[OTRequestMetrics endpointForMethod:@"DELETE" path:@"/v1/accounts/1/orders/42" basePath:@"/v1/"] should] equal:@"DELETE accounts/:id/orders/:id"];
+        [[[OTRequestMetrics endpointForMethod:@"GET" path:@"/v1/candles" basePath:@"/v1"] should] equal:@"GET candles"];
+        [[[OTRequestMetrics endpointForMethod:@"GET" path:@"/prices" basePath:nil] should] equal:@"GET prices"];
+    });
+
+    it(@"should sort each phase into its histogram", ^{
+        OTRequestMetrics *metrics = [[OTRequestMetrics alloc] init];
+
+        // 100 requests with a 1 to 100 ms server phase, 1 ms everywhere else
+        for (NSUInteger i = 1; i <= 100; i++) {
+            OTRequestTimestamps timestamps;
+            timestamps.queued = 1000.0;
+            timestamps.sent = timestamps.queued + 0.001;
+            timestamps.responded = timestamps.sent + 0.001 * i;
+            timestamps.finished = timestamps.responded + 0.001;
+            timestamps.decoded = timestamps.finished + 0.001;
+            timestamps.delivered = timestamps.decoded + 0.001;
+            [metrics recordRequestToEndpoint:@"GET prices" timestamps:&timestamps failed:(i % 10 == 0)];
+        }
+
+        OTEndpointMetrics *prices = [[metrics snapshot] objectForKey:@"GET prices"];
+        [[theValue(prices.numRequests) should] equal:theValue(100)];
+        [[theValue(prices.numFailures) should] equal:theValue(10)];
+        [[theValue([prices maxDurationForPhase:OTRequestPhaseServer]) should] equal:0.1 withDelta:1e-9];
+        [[theValue([prices meanDurationForPhase:OTRequestPhaseServer]) should] equal:0.0505 withDelta:1e-9];
+        [[theValue([prices meanDurationForPhase:OTRequestPhaseTotal]) should] equal:0.0545 withDelta:1e-9];
+
+        // to within a power of two
+        [[theValue([prices percentile:50 forPhase:OTRequestPhaseServer]) should] beGreaterThanOrEqualTo:theValue(0.050)];
+        [[theValue([prices percentile:50 forPhase:OTRequestPhaseServer]) should] beLessThanOrEqualTo:theValue(0.100)];
+        [[theValue([prices percentile:99 forPhase:OTRequestPhaseServer]) should] equal:0.1 withDelta:1e-9];
+
+        NSUInteger numDecoded = 0;
+        const uint32_t *histogram = [prices histogramForPhase:OTRequestPhaseDecode];
+        for (NSUInteger bucket = 0; bucket < OTRequestMetricsBucketCount; bucket++) {
+            numDecoded += histogram[bucket];
+        }
+        [[theValue(numDecoded) should] equal:theValue(100)];
+
+        [metrics reset];
+        [[[metrics snapshot] should] beEmpty];
+    });
+
+    it(@"should leave out the phases a request never got to", ^{
+        OTRequestMetrics *metrics = [[OTRequestMetrics alloc] init];
+
+        // a connection that failed before any response
+        OTRequestTimestamps timestamps = { 0 };
+        timestamps.queued = 1000.0;
+        timestamps.sent = 1000.5;
+        timestamps.finished = 1001.0;
+        timestamps.decoded = 1001.0;
+        timestamps.delivered = 1001.25;
+        [metrics recordRequestToEndpoint:@"GET prices" timestamps:&timestamps failed:YES];
+
+        OTEndpointMetrics *prices = [[metrics snapshot] objectForKey:@"GET prices"];
+        [[theValue([prices maxDurationForPhase:OTRequestPhaseServer]) should] equal:theValue(0)];
+        [[theValue([prices percentile:50 forPhase:OTRequestPhaseDownload]) should] equal:theValue(0)];
+        [[theValue([prices maxDurationForPhase:OTRequestPhaseQueueing]) should] equal:0.5 withDelta:1e-9];
+        [[theValue([prices maxDurationForPhase:OTRequestPhaseTotal]) should] equal:1.25 withDelta:1e-9];
+    });
+
+    it(@"should add up the bytes of the responses whose size on the wire is known", ^{
+        OTRequestMetrics *metrics = [[OTRequestMetrics alloc] init];
+        OTRequestTimestamps timestamps = { 0 };
+
+        OTRequestTransfer gzipped = { .wireBytes = 1000, .decodedBytes = 8000, .compressed = YES };
+        OTRequestTransfer chunked = { .wireBytes = -1, .decodedBytes = 5000, .compressed = YES };
+        OTRequestTransfer identity = { .wireBytes = 300, .decodedBytes = 300, .compressed = NO };
+        [metrics recordRequestToEndpoint:@"GET candles" timestamps:&timestamps transfer:&gzipped failed:NO];
+        [metrics recordRequestToEndpoint:@"GET candles" timestamps:&timestamps transfer:&chunked failed:NO];
+        [metrics recordRequestToEndpoint:@"GET candles" timestamps:&timestamps transfer:&identity failed:NO];
+        [metrics recordRequestToEndpoint:@"GET candles" timestamps:&timestamps failed:NO];
+
+        OTEndpointMetrics *candles = [[metrics snapshot] objectForKey:@"GET candles"];
+        [[theValue(candles.numRequests) should] equal:theValue(4)];
+        [[theValue(candles.numCompressedResponses) should] equal:theValue(2)];
+        [[theValue(candles.bytesOnWire) should] equal:theValue((int64_t)1300)];
+        [[theValue(candles.bytesDecoded) should] equal:theValue((int64_t)8300)];
+    });
+});
+
+describe(@"The Network Controller metrics", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        [server start];
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        networkController.coalescesRequests = NO;
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    it(@"should time every phase of each request", ^{
+        OTMetricsRecorder *recorder = [[OTMetricsRecorder alloc] init];
+        recorder.endpoints = [NSMutableArray array];
+        networkController.requestMetrics.delegate = recorder;
+        networkController.collectsMetrics = YES;
+        server.responseDelay = 0.05;
+
+        __block NSUInteger numAnswered = 0;
+        for (NSUInteger i = 0; i < 5; i++) {
+            [networkController tradesListForAccountId:@506005 success:^(NSDictionary *result) {
+                numAnswered++;
+            } failure:nil];
+        }
+        [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) {
+            numAnswered++;
+        } failure:nil];
+
+        [[expectFutureValue(theValue(recorder.endpoints.count)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(6)];
+        [[theValue(numAnswered) should] equal:theValue(6)];
+
+        NSDictionary *snapshot = [networkController metricsSnapshot];
+        OTEndpointMetrics *trades = [snapshot objectForKey:@"GET accounts/:id/trades"];
+        [[theValue(trades.numRequests) should] equal:theValue(5)];
+        [[theValue(trades.numFailures) should] equal:theValue(0)];
+        [[[snapshot objectForKey:@"GET prices"] should] beNonNil];
+
+        // the stub holds every answer back by responseDelay: that is server time
+        [[theValue([trades percentile:50 forPhase:OTRequestPhaseServer]) should] beGreaterThanOrEqualTo:theValue(0.05)];
+        [[theValue([trades maxDurationForPhase:OTRequestPhaseServer]) should] beLessThanOrEqualTo:theValue([trades maxDurationForPhase:OTRequestPhaseTotal])];
+        for (OTRequestPhase phase = 0; phase < OTRequestPhaseCount; phase++) {
+            [[theValue([trades maxDurationForPhase:phase]) should] beGreaterThan:theValue(0)];
+        }
+    });
+
+    it(@"should count failed requests", ^{
+        networkController.collectsMetrics = YES;
+        server.errorRate = 1.0;
+
+        __block NSDictionary *failure = nil;
+        [networkController ordersListForAccountId:@506005 success:nil failure:^(NSDictionary *error) {
+            failure = error;
+        }];
+
+        [[expectFutureValue(failure) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[expectFutureValue(theValue([[[networkController metricsSnapshot] objectForKey:@"GET accounts/:id/orders"] numFailures]))
+          shouldEventuallyBeforeTimingOutAfter(1.0)] equal:theValue(1)];
+    });
+
+    it(@"should time each request of an order batch", ^{
+        networkController.collectsMetrics = YES;
+        server.unauthorizedOrderId = 5;
+
+        __block NSArray *batchErrors = nil;
+        [networkController deleteOrdersForAccount:@506005 orderIds:@[@1, @2, @3, @4, @5] maxConcurrentRequests:1 progress:nil completion:^(NSArray *results, NSArray *errors) {
+            batchErrors = errors;
+        }];
+
+        [[expectFutureValue(batchErrors) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        OTEndpointMetrics *deletes = [[networkController metricsSnapshot] objectForKey:@"DELETE accounts/:id/orders/:id"];
+        [[theValue(deletes.numRequests) should] equal:theValue(5)];
+        [[theValue(deletes.numFailures) should] equal:theValue(1)];
+        [[theValue([deletes maxDurationForPhase:OTRequestPhaseServer]) should] beGreaterThan:theValue(0)];
+    });
+
+    it(@"should record nothing, and cost next to nothing, when off", ^{
+        __block NSDictionary *result = nil;
+        [networkController tradesListForAccountId:@506005 success:^(NSDictionary *trades) {
+            result = trades;
+        } failure:nil];
+
+        [[expectFutureValue(result) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        [[[networkController metricsSnapshot] should] beEmpty];
+
+        // all a request pays when metrics are off
+        const NSUInteger numChecks = 1000000;
+        NSUInteger numOn = 0;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        for (NSUInteger i = 0; i < numChecks; i++) {
+            if (networkController.collectsMetrics) {
+                numOn++;
+            }
+        }
+        NSTimeInterval checkTime = (CFAbsoluteTimeGetCurrent() - start) / numChecks;
+
+        NSLog(@"metrics off: %.1f ns/request", checkTime * 1e9);
+        [[theValue(numOn) should] equal:theValue(0)];
+        [[theValue(checkTime) should] beLessThan:theValue(1e-6)];
+    });
+});
+
+SPEC_END
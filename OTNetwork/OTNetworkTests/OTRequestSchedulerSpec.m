@@ -0,0 +1,153 @@
+//
+//  OTRequestSchedulerSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTRequestScheduler.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTRequestSchedulerSpec)
+
+describe(@"The Request Scheduler", ^{
+
+    __block OTRequestScheduler *scheduler = nil;
+    __block NSTimeInterval now = 0;
+    __block NSMutableArray *started = nil;         // names of the requests, in the order they started
+    __block NSMutableDictionary *doneBlocks = nil;  // name -> RequestSchedulerDoneBlock
+
+    void (^schedule)(NSString *, OTRequestPriority) = ^(NSString *name, OTRequestPriority priority) {
+        [scheduler scheduleRequestWithPriority:priority startBlock:^(RequestSchedulerDoneBlock doneBlock) {
+            [started addObject:name];
+            [doneBlocks setObject:doneBlock forKey:name];
+        }];
+    };
+
+    beforeEach(^{
+        now = 1000;
+        started = [NSMutableArray array];
+        doneBlocks = [NSMutableDictionary dictionary];
+        scheduler = [[OTRequestScheduler alloc] init];
+        scheduler.clock = ^NSTimeInterval {
+            return now;
+        };
+    });
+
+    it(@"should give a free slot to the most urgent class first", ^{
+        scheduler.maxConcurrentRequests = 1;
+
+        schedule(@"first", OTRequestPriorityHistory);
+        schedule(@"candles", OTRequestPriorityHistory);
+        schedule(@"prices", OTRequestPriorityQuotes);
+        schedule(@"orders", OTRequestPriorityAccount);
+        schedule(@"trade", OTRequestPriorityTrading);
+        [[started should] equal:@[@"first"]];
+        [[theValue([scheduler statsForPriority:OTRequestPriorityHistory].queueDepth) should] equal:theValue(1)];
+
+        for (NSString *name in @[@"first", @"trade", @"orders", @"prices"]) {
+            ((RequestSchedulerDoneBlock)[doneBlocks objectForKey:name])();
+        }
+
+        [[started should] equal:@[@"first", @"trade", @"orders", @"prices", @"candles"]];
+        [[theValue(scheduler.numActiveRequests) should] equal:theValue(1)];
+    });
+
+    it(@"should hold a class to the rate of its token bucket", ^{
+        scheduler.maxConcurrentRequests = 100;
+        [scheduler setTokensPerSecond:2 burst:2 forPriority:OTRequestPriorityQuotes];
+
+        for (NSUInteger i = 0; i < 5; i++) {
+            schedule([NSString stringWithFormat:@"prices%lu", (unsigned long)i], OTRequestPriorityQuotes);
+        }
+        [[theValue(started.count) should] equal:theValue(2)];
+        [[theValue([scheduler statsForPriority:OTRequestPriorityQuotes].queueDepth) should] equal:theValue(3)];
+
+        now += 0.25;
+        [scheduler startPendingRequests];
+        [[theValue(started.count) should] equal:theValue(2)];
+
+        now += 0.25;
+        [scheduler startPendingRequests];
+        [[theValue(started.count) should] equal:theValue(3)];
+
+        now += 1.0;
+        [scheduler startPendingRequests];
+        [[theValue(started.count) should] equal:theValue(5)];
+
+        // the last two waited 1.5 seconds; the first two not at all
+        OTRequestClassStats stats = [scheduler statsForPriority:OTRequestPriorityQuotes];
+        [[theValue(stats.numStarted) should] equal:theValue(5)];
+        [[theValue(stats.queueDepth) should] equal:theValue(0)];
+        [[theValue(stats.maxWaitTime) should] equal:1.5 withDelta:1e-9];
+        [[theValue(stats.totalWaitTime) should] equal:3.5 withDelta:1e-9];
+    });
+
+    it(@"should let other classes through while one waits for tokens", ^{
+        scheduler.maxConcurrentRequests = 100;
+        [scheduler setTokensPerSecond:1 burst:1 forPriority:OTRequestPriorityTrading];
+
+        schedule(@"trade1", OTRequestPriorityTrading);
+        schedule(@"trade2", OTRequestPriorityTrading);
+        schedule(@"candles", OTRequestPriorityHistory);
+        [[started should] equal:@[@"trade1", @"candles"]];
+
+        now += 1.0;
+        [scheduler startPendingRequests];
+        [[started should] equal:@[@"trade1", @"candles", @"trade2"]];
+    });
+
+    it(@"should start waiting requests by itself once their tokens are back", ^{
+        scheduler.clock = ^NSTimeInterval {
+            return CFAbsoluteTimeGetCurrent();
+        };
+        [scheduler setTokensPerSecond:10 burst:1 forPriority:OTRequestPriorityHistory];
+
+        schedule(@"candles1", OTRequestPriorityHistory);
+        schedule(@"candles2", OTRequestPriorityHistory);
+        [[theValue(started.count) should] equal:theValue(1)];
+
+        [[expectFutureValue(theValue(started.count)) shouldEventuallyBeforeTimingOutAfter(1.0)] equal:theValue(2)];
+    });
+
+    it(@"should schedule the calls of a network controller by class", ^{
+        OTStubServer *server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        [[theValue([server start]) should] beYes];
+        OTNetworkController *networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        __block NSUInteger numAnswers = 0;
+
+        [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) { numAnswers++; } failure:nil];
+        [networkController ordersListForAccountId:@1234 success:^(NSDictionary *result) { numAnswers++; } failure:nil];
+        [networkController rateCandlesForSymbol:@"EUR_USD" granularity:@"S5" numberOfPoints:@10 success:^(NSDictionary *result) { numAnswers++; } failure:nil];
+        [[networkController orderTicketForAccount:@1234 symbol:@"EUR_USD"] fireWithUnits:10 side:OTOrderSideBuy success:^(NSDictionary *result) { numAnswers++; } failure:nil];
+
+        [[expectFutureValue(theValue(numAnswers)) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:theValue(4)];
+        for (NSUInteger priority = 0; priority < OTRequestPriorityCount; priority++) {
+            [[theValue([networkController.requestScheduler statsForPriority:(OTRequestPriority)priority].numStarted) should] equal:theValue(1)];
+        }
+        [[theValue(networkController.requestScheduler.numActiveRequests) should] equal:theValue(0)];
+        [server stop];
+    });
+});
+
+SPEC_END
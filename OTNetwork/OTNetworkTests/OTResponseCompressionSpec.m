@@ -0,0 +1,147 @@
+//
+//  OTResponseCompressionSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+
+SPEC_BEGIN(OTResponseCompressionSpec)
+
+describe(@"The Network Controller response compression", ^{
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        server.candleCount = 5000;
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+        networkController.coalescesRequests = NO;
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    // Fetches every candle of the stub, and returns the store they were parsed into.
+    OTCandleStore *(^fetchCandles)(void) = ^OTCandleStore *{
+        __block OTCandleStore *candles = nil;
+        [networkController rateCandleColumnsForSymbol:@"EUR_USD" granularity:@"S5" sinceTime:nil numberOfPoints:@5000 success:^(OTCandleStore *result) {
+            candles = result;
+        } failure:^(NSDictionary *error) {
+            NSLog(@"Failure %@", error);
+        }];
+
+        [[expectFutureValue(candles) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+        return candles;
+    };
+
+    // Quotes EUR_USD, and returns once the answer is in.
+    void (^fetchQuote)(void) = ^{
+        __block NSDictionary *quote = nil;
+        [networkController rateQuote:@[@"EUR_USD"] success:^(NSDictionary *result) {
+            quote = result;
+        } failure:nil];
+
+        [[expectFutureValue(quote) shouldEventuallyBeforeTimingOutAfter(5.0)] beNonNil];
+    };
+
+    it(@"should ask for compressed history, and uncompressed quotes", ^{
+        [[theValue([networkController acceptsCompressionForPriority:OTRequestPriorityHistory]) should] beYes];
+        [[theValue([networkController acceptsCompressionForPriority:OTRequestPriorityAccount]) should] beYes];
+        [[theValue([networkController acceptsCompressionForPriority:OTRequestPriorityQuotes]) should] beNo];
+        [[theValue([networkController acceptsCompressionForPriority:OTRequestPriorityTrading]) should] beNo];
+
+        fetchCandles();
+        [[server.lastRequestAcceptEncoding should] equal:@"gzip, deflate"];
+
+        fetchQuote();
+        [[server.lastRequestAcceptEncoding should] equal:@"identity"];
+    });
+
+    it(@"should follow the setting of each class of calls", ^{
+        [networkController setAcceptsCompression:NO forPriority:OTRequestPriorityHistory];
+        [networkController setAcceptsCompression:YES forPriority:OTRequestPriorityQuotes];
+
+        fetchCandles();
+        [[server.lastRequestAcceptEncoding should] equal:@"identity"];
+
+        fetchQuote();
+        [[server.lastRequestAcceptEncoding should] equal:@"gzip, deflate"];
+    });
+
+    it(@"should hand over the same candles, compressed or not", ^{
+        server.compressesResponses = YES;
+
+        OTCandleStore *compressed = fetchCandles();
+        [[theValue(server.numCompressedResponses) should] equal:theValue(1)];
+
+        [networkController setAcceptsCompression:NO forPriority:OTRequestPriorityHistory];
+        OTCandleStore *uncompressed = fetchCandles();
+        [[theValue(server.numCompressedResponses) should] equal:theValue(1)];
+
+        [[theValue(compressed.count) should] equal:theValue(5000)];
+        [[theValue(uncompressed.count) should] equal:theValue(compressed.count)];
+        for (OTCandleColumn column = 0; column < OTCandleColumnCount; column++) {
+            [[theValue(memcmp([compressed column:column], [uncompressed column:column], compressed.count * sizeof(int64_t))) should] equal:theValue(0)];
+        }
+    });
+
+    it(@"should also inflate history downloaded to a file", ^{
+        server.compressesResponses = YES;
+        networkController.downloadsHistoryToFile = YES;
+
+        OTCandleStore *candles = fetchCandles();
+        [[theValue(server.numCompressedResponses) should] equal:theValue(1)];
+        [[theValue(candles.count) should] equal:theValue(5000)];
+    });
+
+    it(@"should count the bytes on the wire against the bytes decoded, per endpoint", ^{
+        server.compressesResponses = YES;
+        networkController.collectsMetrics = YES;
+
+        fetchCandles();
+        fetchQuote();
+
+        [[expectFutureValue(theValue([[networkController metricsSnapshot] count])) shouldEventuallyBeforeTimingOutAfter(1.0)] equal:theValue(2)];
+        NSDictionary *snapshot = [networkController metricsSnapshot];
+
+        OTEndpointMetrics *candles = [snapshot objectForKey:@"GET candles"];
+        NSLog(@"%@", candles);
+        [[theValue(candles.numCompressedResponses) should] equal:theValue(1)];
+        [[theValue(candles.bytesOnWire) should] beGreaterThan:theValue((int64_t)0)];
+        // thousands of candles alike but for a few digits shrink several times over
+        [[theValue(candles.bytesOnWire * 3) should] beLessThan:theValue(candles.bytesDecoded)];
+
+        OTEndpointMetrics *prices = [snapshot objectForKey:@"GET prices"];
+        [[theValue(prices.numCompressedResponses) should] equal:theValue(0)];
+        [[theValue(prices.bytesOnWire) should] beGreaterThan:theValue((int64_t)0)];
+        [[theValue(prices.bytesOnWire) should] equal:theValue(prices.bytesDecoded)];
+    });
+});
+
+SPEC_END
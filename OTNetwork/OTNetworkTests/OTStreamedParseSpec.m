@@ -0,0 +1,119 @@
+//
+//  OTStreamedParseSpec.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "Kiwi.h"
+#import "OTNetworkController.h"
+#import "OTStubServer.h"
+
+// A transaction history of count rows, with strings to unescape and values of every kind, newest first like the server's.
+static NSDictionary *OTStreamedParseTransactions(NSUInteger count)
+{
+    NSMutableArray *transactions = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger i = count; i > 0; i--) {
+        [transactions addObject:@{ @"id" : @(i),
+                                   @"accountId" : @1234,
+                                   @"type" : (i % 3) ? @"MARKET_ORDER_CREATE" : @"TRADE_CLOSE",
+                                   @"instrument" : (i % 2) ? @"EUR_USD" : @"USD_JPY",
+                                   @"units" : @(100 * (i % 10 + 1)),
+                                   @"price" : @(1.2 + (i % 100) * 0.0001),
+                                   @"reason" : (i % 7) ? [NSNull null] : @"CLIENT_REQUEST \"manual\"\né",
+                                   @"tradeOpened" : @{ @"id" : @(i + 100000), @"units" : @(i % 10), @"closed" : @((BOOL)(i % 2)) } }];
+    }
+
+    return @{ @"transactions" : transactions };
+}
+
+SPEC_BEGIN(OTStreamedParseSpec)
+
+describe(@"The Network Controller parse while downloading", ^{
+
+    NSDictionary *history = OTStreamedParseTransactions(20000);
+
+    __block OTStubServer *server = nil;
+    __block OTNetworkController *networkController = nil;
+
+    beforeEach(^{
+        server = [[OTStubServer alloc] initWithInstruments:@[@"EUR_USD"]];
+        [server setFixture:history forMethod:@"GET" pathPattern:@"/v1/accounts/*/transactions"];
+        [[theValue([server start]) should] beYes];
+
+        networkController = [[OTNetworkController alloc] initWithServerUrl:server.serverUrl streamUrl:server.streamUrl];
+    });
+
+    afterEach(^{
+        [server stop];
+    });
+
+    // Fetches the transactions of the account, and returns what the successBlock got.
+    NSDictionary *(^fetchTransactions)(void) = ^NSDictionary *{
+        __block NSDictionary *transactions = nil;
+
+        [networkController transactionListForAccountId:@1234 success:^(NSDictionary *result) {
+            transactions = result;
+        } failure:^(NSDictionary *error) {
+            NSLog(@"Failure %@", error);
+        }];
+
+        [[expectFutureValue(transactions) shouldEventuallyBeforeTimingOutAfter(30.0)] beNonNil];
+        return transactions;
+    };
+
+    it(@"should be on by default", ^{
+        [[theValue(networkController.parsesTransactionsWhileDownloading) should] beYes];
+    });
+
+    it(@"should hand over the same transactions as a parse of the whole body", ^{
+        NSDictionary *streamed = fetchTransactions();
+        networkController.parsesTransactionsWhileDownloading = NO;
+        NSDictionary *parsed = fetchTransactions();
+
+        [[[streamed objectForKey:@"transactions"] should] haveCountOf:20000];
+        [[streamed should] equal:parsed];
+        [[streamed should] equal:history];
+    });
+
+    it(@"should parse a compressed body as it is inflated", ^{
+        server.compressesResponses = YES;
+
+        [[fetchTransactions() should] equal:history];
+        [[theValue(server.numCompressedResponses) should] equal:theValue(1)];
+    });
+
+    it(@"should still hand over the error the server sent", ^{
+        __block NSDictionary *failure = nil;
+        server.errorRate = 1.0;
+
+        [networkController transactionListForAccountId:@1234 success:^(NSDictionary *result) {
+            NSLog(@"Unexpected success");
+        } failure:^(NSDictionary *error) {
+            failure = error;
+        }];
+
+        [[expectFutureValue([failure objectForKey:@"http status code"]) shouldEventuallyBeforeTimingOutAfter(5.0)] equal:@500];
+        [[[failure objectForKey:@"message"] should] equal:@"Internal Server Error"];
+    });
+});
+
+SPEC_END
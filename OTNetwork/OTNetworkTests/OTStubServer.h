@@ -0,0 +1,146 @@
+//
+//  OTStubServer.h
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+
+/** A tiny HTTP server on 127.0.0.1 standing in for the OANDA servers, so specs and benchmarks do not depend on the sandbox.
+ 
+ It answers the instruments, prices and candles endpoints of the REST API under serverUrl, and streams ticks under streamUrl, at ticksPerSecond
+ per instrument, one {"tick":{...}} line per tick plus a {"heartbeat":{...}} line every second.
+ 
+ Every account has the same open orders and trades, as set through orders and trades (or generated, see generatedRowCount), the positions
+ those trades add up to, and the same transactionCount transactions.
+ 
+ Anything else (user accounts, account status, alerts...) is answered from fixtures: responses recorded from the sandbox, loaded from
+ OTStubServerFixtures.json in the test bundle, and matched by method and path pattern.  A fixture also overrides the generated response
+ of its endpoint.
+ 
+ The candle history is the same for every instrument and granularity: candleCount candles, 5 seconds apart from
+ OTStubServerCandleEpoch, the last one still forming.
+ */
+#define OTStubServerCandleEpoch     1354200000LL
+#define OTStubServerCandleSeconds   5
+
+@interface OTStubServer : NSObject
+
+/** Creates a server quoting the given instruments (eg. @"EUR_USD"). */
+- (id)initWithInstruments:(NSArray *)instruments;
+
+/** Starts listening on a free port.  Returns NO if no socket could be opened. */
+- (BOOL)start;
+
+/** Stops listening and closes every open connection. */
+- (void)stop;
+
+/** Base URL of the REST API, eg. @"http://127.0.0.1:50123/v1/". */
+@property (nonatomic, readonly) NSString *serverUrl;
+
+/** Base URL of the streaming API, eg. @"http://127.0.0.1:50123/stream/v1/". */
+@property (nonatomic, readonly) NSString *streamUrl;
+
+/** Ticks sent per second for each streamed instrument.  Default: 10. */
+@property (atomic, assign) double ticksPerSecond;
+
+/** When NO, the streaming endpoint answers 404, like a server without streaming.  Default: YES. */
+@property (atomic, assign) BOOL streamingEnabled;
+
+/** How long the REST API takes to answer, on top of the loopback time.  Default: 0. */
+@property (atomic, assign) NSTimeInterval responseDelay;
+
+/** Up to how much longer, picked at random for each request, the REST API takes to answer on top of responseDelay.  Default: 0. */
+@property (atomic, assign) NSTimeInterval responseJitter;
+
+/** Share of REST requests, from 0 to 1, answered with a 500 Internal Server Error instead, picked at random.  Default: 0. */
+@property (atomic, assign) double errorRate;
+
+/** When YES, REST responses to requests whose Accept-Encoding takes gzip are sent gzipped, with a Content-Encoding header.  Default: NO. */
+@property (atomic, assign) BOOL compressesResponses;
+
+/** Number of candles in the history, the last one still forming.  Default: 1000. */
+@property (atomic, assign) NSUInteger candleCount;
+
+/** Bump to move the close of the forming candle, as a new tick would. */
+@property (atomic, assign) NSUInteger formingCandleRevision;
+
+/** Open orders and trades of every account, NSDictionary each with at least an "id".  Served newest first in pages of count (default 50)
+ with ids up to maxOrderId or maxTradeId, and a nextPage link while older ones remain.  The max id reported with either list is its highest id. */
+@property (atomic, copy) NSArray *orders;
+@property (atomic, copy) NSArray *trades;
+
+/** When orders or trades are not set, number of orders and trades generated for their lists, spread over the instruments.  Default: 0. */
+@property (atomic, assign) NSUInteger generatedRowCount;
+
+/** To answer every request matching method and pathPattern with a fixture, rather than what the server would generate.
+ 
+ @param JSONObject **Required**.  The body of the response, NSDictionary or NSArray.
+ @param method **Required**.  eg. @"GET".
+ @param pathPattern **Required**.  Path of the request, where * stands for any one path component (eg. @"/v1/accounts/*").
+ */
+- (void)setFixture:(id)JSONObject forMethod:(NSString *)method pathPattern:(NSString *)pathPattern;
+
+/** Same as setFixture:forMethod:pathPattern:, with a body that is already encoded, eg. a canned response replayed by a benchmark.  Replaces
+ any fixture set before for the same method and pathPattern. */
+- (void)setFixtureData:(NSData *)body forMethod:(NSString *)method pathPattern:(NSString *)pathPattern;
+
+/** Adds the fixtures of a JSON file holding an object such as {"GET /v1/accounts/*": {...}}, the way OTStubServerFixtures.json is loaded.
+ 
+ @return NO if the file could not be read or parsed.
+ */
+- (BOOL)loadFixturesFromFile:(NSString *)path;
+
+/** Market orders POSTed to the trades endpoint are filled at once, at the current price of the instrument.  Limit orders POSTed to the orders
+ endpoint are accepted as they are, and DELETEs of an order always succeed, except for unauthorizedOrderId (if not 0) which gets a 401. */
+@property (atomic, assign) NSUInteger unauthorizedOrderId;
+
+/** Number of transactions in the history of every account, with ids 1 to transactionCount, served newest first in pages of count
+ (default 50) with a nextPage link while older ones remain.  Default: 0. */
+@property (atomic, assign) NSUInteger transactionCount;
+
+/** Abruptly closes every open streaming connection, as a flaky network would. */
+- (void)dropStreamConnections;
+
+/** Requests of any kind, streaming connections, requests to each endpoint, and responses from fixtures or injected errors, served so far. */
+@property (atomic, readonly) NSUInteger numRequests;
+@property (atomic, readonly) NSUInteger numStreamConnections;
+@property (atomic, readonly) NSUInteger numPriceRequests;
+@property (atomic, readonly) NSUInteger numCandleRequests;
+@property (atomic, readonly) NSUInteger numOrderRequests;
+@property (atomic, readonly) NSUInteger numTradeRequests;
+@property (atomic, readonly) NSUInteger numTransactionRequests;
+@property (atomic, readonly) NSUInteger numPositionRequests;
+@property (atomic, readonly) NSUInteger numFixtureResponses;
+@property (atomic, readonly) NSUInteger numErrorResponses;
+@property (atomic, readonly) NSUInteger numCompressedResponses;
+
+/** Most requests (other than streaming) being answered at the same time since the server started, or since resetPeakConcurrentRequests. */
+@property (atomic, readonly) NSUInteger peakConcurrentRequests;
+- (void)resetPeakConcurrentRequests;
+
+/** When the last request had been read in full, its body if it had one, and its Accept-Encoding if it sent one. */
+@property (atomic, readonly) CFAbsoluteTime lastRequestTime;
+@property (atomic, readonly, copy) NSString *lastRequestBody;
+@property (atomic, readonly, copy) NSString *lastRequestAcceptEncoding;
+
+@end
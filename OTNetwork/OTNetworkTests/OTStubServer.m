@@ -0,0 +1,777 @@
+//
+//  OTStubServer.m
+//  OTNetworkLayerTest
+//
+//  Copyright (c) 2012 OANDA Corporation. (http://www.oanda.com/)
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy
+//  of this software and associated documentation files (the "Software"), to deal
+//  in the Software without restriction, including without limitation the rights
+//  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//  copies of the Software, and to permit persons to whom the Software is
+//  furnished to do so, subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in
+//  all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//  THE SOFTWARE.
+//
+
+#import "OTStubServer.h"
+#import <sys/socket.h>
+#import <netinet/in.h>
+#import <arpa/inet.h>
+#import <poll.h>
+#import <unistd.h>
+#import <fnmatch.h>
+#import <zlib.h>
+
+static BOOL OTStubWriteAll(int fd, const void *bytes, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written <= 0) {
+            return NO;
+        }
+        bytes = (const char *)bytes + written;
+        length -= (size_t)written;
+    }
+    return YES;
+}
+
+// The body gzipped, as a server honouring Accept-Encoding: gzip sends it.  nil if zlib fails.
+static NSData *OTStubGzip(NSData *data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // a window of 2^15 bytes, plus 16 for a gzip header and trailer rather than a zlib one
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nil;
+    }
+
+    NSMutableData *gzipped = [NSMutableData dataWithLength:deflateBound(&stream, (uLong)data.length)];
+    stream.next_in = (Bytef *)data.bytes;
+    stream.avail_in = (uInt)data.length;
+    stream.next_out = (Bytef *)gzipped.mutableBytes;
+    stream.avail_out = (uInt)gzipped.length;
+    int status = deflate(&stream, Z_FINISH);
+    gzipped.length = stream.total_out;
+    deflateEnd(&stream);
+
+    return status == Z_STREAM_END ? gzipped : nil;
+}
+
+static BOOL OTStubWriteChunk(int fd, NSString *string)
+{
+    NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
+    NSString *header = [NSString stringWithFormat:@"%lx\r\n", (unsigned long)data.length];
+
+    return OTStubWriteAll(fd, [header UTF8String], strlen([header UTF8String]))
+        && OTStubWriteAll(fd, data.bytes, data.length)
+        && OTStubWriteAll(fd, "\r\n", 2);
+}
+
+@interface OTStubServer () {
+    int _listenSocket;
+    NSArray *_instruments;
+    NSMutableDictionary *_tickCounts;           // instrument -> NSNumber, drives the fake price walk
+    NSArray *_orders;
+    NSArray *_trades;
+    NSUInteger _numActiveRequests;              // guarded by @synchronized(self)
+    NSUInteger _peakConcurrentRequests;
+    NSMutableArray *_fixtures;                  // of @[method, pathPattern, body], the last match wins
+    NSMutableIndexSet *_gzipClients;            // sockets of the requests being answered gzipped; guarded by @synchronized(self)
+}
+
+@property (atomic, assign) BOOL running;
+@property (atomic, assign) NSUInteger dropGeneration;
+@property (atomic, assign) NSUInteger numRequests;
+@property (atomic, assign) NSUInteger numStreamConnections;
+@property (atomic, assign) NSUInteger numPriceRequests;
+@property (atomic, assign) NSUInteger numCandleRequests;
+@property (atomic, assign) NSUInteger numOrderRequests;
+@property (atomic, assign) NSUInteger numTradeRequests;
+@property (atomic, assign) NSUInteger numTransactionRequests;
+@property (atomic, assign) NSUInteger numPositionRequests;
+@property (atomic, assign) NSUInteger numFixtureResponses;
+@property (atomic, assign) NSUInteger numErrorResponses;
+@property (atomic, assign) NSUInteger numCompressedResponses;
+@property (atomic, assign) CFAbsoluteTime lastRequestTime;
+@property (atomic, copy) NSString *lastRequestBody;
+@property (atomic, copy) NSString *lastRequestAcceptEncoding;
+@property (nonatomic, strong) NSString *serverUrl;
+@property (nonatomic, strong) NSString *streamUrl;
+@end
+
+@implementation OTStubServer
+
+- (id)initWithInstruments:(NSArray *)instruments
+{
+    self = [super init];
+    if (self) {
+        _instruments = [instruments copy];
+        _tickCounts = [NSMutableDictionary dictionary];
+        _listenSocket = -1;
+        _ticksPerSecond = 10.0;
+        _streamingEnabled = YES;
+        _candleCount = 1000;
+        _fixtures = [NSMutableArray array];
+        _gzipClients = [NSMutableIndexSet indexSet];
+
+        NSString *fixturesPath = [[NSBundle bundleForClass:[self class]] pathForResource:@"OTStubServerFixtures" ofType:@"json"];
+        if (fixturesPath) {
+            [self loadFixturesFromFile:fixturesPath];
+        }
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+}
+
+- (BOOL)start
+{
+    _listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listenSocket < 0) {
+        return NO;
+    }
+
+    int yes = 1;
+    setsockopt(_listenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_port = 0;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t addressLength = sizeof(address);
+    if (bind(_listenSocket, (struct sockaddr *)&address, sizeof(address)) != 0
+        || listen(_listenSocket, 16) != 0
+        || getsockname(_listenSocket, (struct sockaddr *)&address, &addressLength) != 0) {
+        close(_listenSocket);
+        _listenSocket = -1;
+        return NO;
+    }
+
+    unsigned int port = ntohs(address.sin_port);
+    self.serverUrl = [NSString stringWithFormat:@"http://127.0.0.1:%u/v1/", port];
+    self.streamUrl = [NSString stringWithFormat:@"http://127.0.0.1:%u/stream/v1/", port];
+
+    self.running = YES;
+    int listenSocket = _listenSocket;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [self acceptConnectionsOnSocket:listenSocket];
+    });
+
+    return YES;
+}
+
+- (void)stop
+{
+    // the accept loop notices within its poll timeout and closes the socket itself
+    self.running = NO;
+    self.dropGeneration++;
+    _listenSocket = -1;
+}
+
+- (NSArray *)orders
+{
+    @synchronized(self) {
+        return _orders;
+    }
+}
+
+- (void)setOrders:(NSArray *)orders
+{
+    @synchronized(self) {
+        _orders = [orders copy];
+    }
+}
+
+- (NSArray *)trades
+{
+    @synchronized(self) {
+        return _trades;
+    }
+}
+
+- (void)setTrades:(NSArray *)trades
+{
+    @synchronized(self) {
+        _trades = [trades copy];
+    }
+}
+
+- (void)setFixture:(id)JSONObject forMethod:(NSString *)method pathPattern:(NSString *)pathPattern
+{
+    NSAssert(JSONObject, @"fixture is required");
+
+    [self setFixtureData:[NSJSONSerialization dataWithJSONObject:JSONObject options:0 error:NULL] forMethod:method pathPattern:pathPattern];
+}
+
+- (void)setFixtureData:(NSData *)body forMethod:(NSString *)method pathPattern:(NSString *)pathPattern
+{
+    NSAssert(body && method && pathPattern, @"fixture, method and pathPattern are required");
+
+    @synchronized(self) {
+        NSUInteger index = [_fixtures indexOfObjectPassingTest:^BOOL(NSArray *fixture, NSUInteger idx, BOOL *stop) {
+            return [[fixture objectAtIndex:0] isEqualToString:method] && [[fixture objectAtIndex:1] isEqualToString:pathPattern];
+        }];
+        if (index != NSNotFound) {
+            [_fixtures removeObjectAtIndex:index];
+        }
+        [_fixtures addObject:@[ method, pathPattern, body ]];
+    }
+}
+
+- (BOOL)loadFixturesFromFile:(NSString *)path
+{
+    NSData *data = [NSData dataWithContentsOfFile:path];
+    NSDictionary *fixtures = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL] : nil;
+    if (![fixtures isKindOfClass:[NSDictionary class]]) {
+        return NO;
+    }
+
+    // sorted, so that which of two overlapping patterns wins does not depend on the order of the dictionary
+    for (NSString *request in [[fixtures allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        NSRange space = [request rangeOfString:@" "];
+        if (space.location != NSNotFound) {
+            [self setFixture:[fixtures objectForKey:request] forMethod:[request substringToIndex:space.location] pathPattern:[request substringFromIndex:NSMaxRange(space)]];
+        }
+    }
+
+    return YES;
+}
+
+- (NSUInteger)peakConcurrentRequests
+{
+    @synchronized(self) {
+        return _peakConcurrentRequests;
+    }
+}
+
+- (void)resetPeakConcurrentRequests
+{
+    @synchronized(self) {
+        _peakConcurrentRequests = _numActiveRequests;
+    }
+}
+
+- (void)dropStreamConnections
+{
+    self.dropGeneration++;
+}
+
+#pragma mark Helper/Private functions
+
+- (void)acceptConnectionsOnSocket:(int)listenSocket
+{
+    struct pollfd pollDescriptor = { listenSocket, POLLIN, 0 };
+
+    while (self.running) {
+        if (poll(&pollDescriptor, 1, 100) <= 0) {
+            continue;
+        }
+
+        int client = accept(listenSocket, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+
+        int yes = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            @autoreleasepool {
+                [self handleClient:client];
+            }
+            close(client);
+        });
+    }
+
+    close(listenSocket);
+}
+
+- (void)handleClient:(int)client
+{
+    // read the request head, then the form-encoded body if there is one
+    char request[4096];
+    size_t length = 0;
+    char *bodyStart = NULL;
+    while (length < sizeof(request) - 1) {
+        ssize_t numRead = read(client, request + length, sizeof(request) - 1 - length);
+        if (numRead <= 0) {
+            return;
+        }
+        length += (size_t)numRead;
+        request[length] = '\0';
+        if ((bodyStart = strstr(request, "\r\n\r\n"))) {
+            bodyStart += 4;
+            break;
+        }
+    }
+    if (!bodyStart) {
+        return;
+    }
+
+    size_t contentLength = 0;
+    const char *contentLengthHeader = strcasestr(request, "\r\nContent-Length:");
+    if (contentLengthHeader && contentLengthHeader < bodyStart) {
+        contentLength = MIN((size_t)strtoul(contentLengthHeader + 17, NULL, 10), sizeof(request) - 1 - (size_t)(bodyStart - request));
+    }
+    while ((size_t)(request + length - bodyStart) < contentLength) {
+        ssize_t numRead = read(client, request + length, contentLength - (size_t)(request + length - bodyStart));
+        if (numRead <= 0) {
+            return;
+        }
+        length += (size_t)numRead;
+        request[length] = '\0';
+    }
+    self.lastRequestTime = CFAbsoluteTimeGetCurrent();
+
+    NSString *acceptEncoding = nil;
+    const char *acceptEncodingHeader = strcasestr(request, "\r\nAccept-Encoding:");
+    if (acceptEncodingHeader && acceptEncodingHeader < bodyStart) {
+        const char *value = acceptEncodingHeader + 18;
+        acceptEncoding = [[[NSString alloc] initWithBytes:value length:(NSUInteger)(strstr(value, "\r\n") - value) encoding:NSUTF8StringEncoding]
+                          stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    }
+    self.lastRequestAcceptEncoding = acceptEncoding;
+
+    char method[16], target[2048];
+    if (sscanf(request, "%15s %2047s", method, target) != 2) {
+        return;
+    }
+
+    NSURL *url = [NSURL URLWithString:[NSString stringWithFormat:@"http://127.0.0.1%s", target]];
+    NSMutableDictionary *parameters = [[self parametersFromQuery:url.query] mutableCopy];
+    NSString *body = [[NSString alloc] initWithBytes:bodyStart length:contentLength encoding:NSUTF8StringEncoding];
+    if (contentLength > 0) {
+        self.lastRequestBody = body;
+        [parameters addEntriesFromDictionary:[self parametersFromQuery:body]];
+    }
+    NSString *instrumentsParameter = [parameters objectForKey:@"instruments"];
+    NSArray *instruments = instrumentsParameter ? [instrumentsParameter componentsSeparatedByString:@","] : _instruments;
+
+    self.numRequests++;
+    if ([url.path hasPrefix:@"/stream/"]) {
+        [self routeRequestWithMethod:method url:url parameters:parameters instruments:instruments toClient:client];
+        return;
+    }
+
+    BOOL gzipped = self.compressesResponses && [acceptEncoding rangeOfString:@"gzip"].location != NSNotFound;
+    @synchronized(self) {
+        _numActiveRequests++;
+        _peakConcurrentRequests = MAX(_peakConcurrentRequests, _numActiveRequests);
+        if (gzipped) {
+            [_gzipClients addIndex:(NSUInteger)client];
+        }
+    }
+    [self routeRequestWithMethod:method url:url parameters:parameters instruments:instruments toClient:client];
+    @synchronized(self) {
+        _numActiveRequests--;
+        [_gzipClients removeIndex:(NSUInteger)client];
+    }
+}
+
+- (void)routeRequestWithMethod:(const char *)method url:(NSURL *)url parameters:(NSDictionary *)parameters instruments:(NSArray *)instruments toClient:(int)client
+{
+    if (![url.path hasPrefix:@"/stream/"]) {
+        NSTimeInterval delay = self.responseDelay + self.responseJitter * ((double)arc4random_uniform(1000001) / 1e6);
+        if (delay > 0) {
+            usleep((useconds_t)(delay * 1e6));
+        }
+
+        if (self.errorRate > 0 && (double)arc4random_uniform(1000000) < self.errorRate * 1e6) {
+            self.numErrorResponses++;
+            [self respondToClient:client status:500 body:@"{\"code\":500,\"message\":\"Internal Server Error\"}"];
+            return;
+        }
+
+        NSData *fixture = [self fixtureForMethod:method path:url.path];
+        if (fixture) {
+            self.numFixtureResponses++;
+            [self respondToClient:client status:200 bodyData:fixture];
+            return;
+        }
+    }
+
+    if ([url.path isEqualToString:@"/stream/v1/prices"] && self.streamingEnabled) {
+        [self streamPricesForInstruments:instruments toClient:client];
+    } else if ([url.path isEqualToString:@"/v1/prices"]) {
+        self.numPriceRequests++;
+        NSMutableArray *prices = [NSMutableArray array];
+        for (NSString *instrument in instruments) {
+            [prices addObject:[self nextPriceForInstrument:instrument]];
+        }
+        [self respondToClient:client status:200 body:[NSString stringWithFormat:@"{\"prices\":[%@]}", [prices componentsJoinedByString:@","]]];
+    } else if ([url.path isEqualToString:@"/v1/instruments"]) {
+        NSMutableArray *list = [NSMutableArray array];
+        for (NSString *instrument in _instruments) {
+            [list addObject:[NSString stringWithFormat:@"{\"instrument\":\"%@\",\"displayName\":\"%@\",\"pip\":\"%@\",\"maxTradeUnits\":10000000}",
+                             instrument, [instrument stringByReplacingOccurrencesOfString:@"_" withString:@"/"], ([instrument hasSuffix:@"_JPY"] ? @"0.01" : @"0.0001")]];
+        }
+        [self respondToClient:client status:200 body:[NSString stringWithFormat:@"{\"instruments\":[%@]}", [list componentsJoinedByString:@","]]];
+    } else if ([url.path isEqualToString:@"/v1/candles"]) {
+        self.numCandleRequests++;
+        [self respondToClient:client status:200 body:[self candlesForParameters:parameters]];
+    } else if ([url.path hasPrefix:@"/v1/accounts/"] && [url.path hasSuffix:@"/orders"] && strcmp(method, "POST") == 0) {
+        self.numOrderRequests++;
+        [self respondToClient:client status:200 body:[self createdOrderForParameters:parameters]];
+    } else if ([url.path hasPrefix:@"/v1/accounts/"] && [[url.path stringByDeletingLastPathComponent] hasSuffix:@"/orders"] && strcmp(method, "DELETE") == 0) {
+        self.numOrderRequests++;
+        NSInteger orderId = [[url.path lastPathComponent] integerValue];
+        if (self.unauthorizedOrderId && (NSUInteger)orderId == self.unauthorizedOrderId) {
+            [self respondToClient:client status:401 body:@"{\"code\":401,\"message\":\"Unauthorized\"}"];
+        } else {
+            [self respondToClient:client status:200 body:[NSString stringWithFormat:@"{\"id\":%ld,\"instrument\":\"%@\"}", (long)orderId, [_instruments objectAtIndex:0]]];
+        }
+    } else if ([url.path hasPrefix:@"/v1/accounts/"] && [url.path hasSuffix:@"/orders"]) {
+        self.numOrderRequests++;
+        @synchronized(self) {
+            [self respondToClient:client status:200 body:[self listBodyWithKey:@"orders" rows:[self currentOrders] maxIdKey:@"maxOrderId" path:url.path parameters:parameters]];
+        }
+    } else if ([url.path hasPrefix:@"/v1/accounts/"] && [url.path hasSuffix:@"/trades"] && strcmp(method, "POST") == 0) {
+        self.numTradeRequests++;
+        [self respondToClient:client status:200 body:[self openedTradeForParameters:parameters]];
+    } else if ([url.path hasPrefix:@"/v1/accounts/"] && [url.path hasSuffix:@"/trades"]) {
+        self.numTradeRequests++;
+        @synchronized(self) {
+            [self respondToClient:client status:200 body:[self listBodyWithKey:@"trades" rows:[self currentTrades] maxIdKey:@"maxTradeId" path:url.path parameters:parameters]];
+        }
+    } else if ([url.path hasPrefix:@"/v1/accounts/"] && [url.path hasSuffix:@"/positions"]) {
+        self.numPositionRequests++;
+        @synchronized(self) {
+            [self respondToClient:client status:200 body:[self positionsForTrades:[self currentTrades]]];
+        }
+    } else if ([url.path hasPrefix:@"/v1/accounts/"] && [url.path hasSuffix:@"/transactions"]) {
+        self.numTransactionRequests++;
+        [self respondToClient:client status:200 body:[self transactionsForAccountPath:url.path parameters:parameters]];
+    } else {
+        [self respondToClient:client status:404 body:@"{\"code\":404,\"message\":\"Not Found\"}"];
+    }
+}
+
+- (void)streamPricesForInstruments:(NSArray *)instruments toClient:(int)client
+{
+    self.numStreamConnections++;
+
+    const char *head = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
+    if (!OTStubWriteAll(client, head, strlen(head))) {
+        return;
+    }
+
+    NSUInteger dropGeneration = self.dropGeneration;
+    CFAbsoluteTime lastHeartbeat = CFAbsoluteTimeGetCurrent();
+
+    while (self.running && self.dropGeneration == dropGeneration) {
+        @autoreleasepool {
+            NSMutableString *lines = [NSMutableString string];
+            for (NSString *instrument in instruments) {
+                [lines appendFormat:@"{\"tick\":%@}\n", [self nextPriceForInstrument:instrument]];
+            }
+
+            CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+            if (now - lastHeartbeat >= 1.0) {
+                [lines appendFormat:@"{\"heartbeat\":{\"time\":\"%.6f\"}}\n", [[NSDate date] timeIntervalSince1970]];
+                lastHeartbeat = now;
+            }
+
+            if (!OTStubWriteChunk(client, lines)) {
+                return;
+            }
+        }
+
+        usleep((useconds_t)(1e6 / MAX(self.ticksPerSecond, 0.1)));
+    }
+}
+
+- (void)respondToClient:(int)client status:(NSInteger)status body:(NSString *)body
+{
+    [self respondToClient:client status:status bodyData:[body dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+- (void)respondToClient:(int)client status:(NSInteger)status bodyData:(NSData *)bodyData
+{
+    NSString *reason;
+    switch (status) {
+        case 200: reason = @"OK"; break;
+        case 401: reason = @"Unauthorized"; break;
+        case 404: reason = @"Not Found"; break;
+        default:  reason = @"Internal Server Error"; break;
+    }
+
+    NSString *contentEncoding = @"";
+    BOOL gzipped;
+    @synchronized(self) {
+        gzipped = [_gzipClients containsIndex:(NSUInteger)client];
+    }
+    NSData *gzippedData = gzipped && bodyData.length > 0 ? OTStubGzip(bodyData) : nil;
+    if (gzippedData) {
+        bodyData = gzippedData;
+        contentEncoding = @"Content-Encoding: gzip\r\n";
+        self.numCompressedResponses++;
+    }
+    NSString *head = [NSString stringWithFormat:@"HTTP/1.1 %ld %@\r\nContent-Type: application/json\r\n%@Content-Length: %lu\r\nConnection: close\r\n\r\n",
+                      (long)status, reason, contentEncoding, (unsigned long)bodyData.length];
+
+    OTStubWriteAll(client, [head UTF8String], strlen([head UTF8String]));
+    OTStubWriteAll(client, bodyData.bytes, bodyData.length);
+}
+
+- (NSData *)fixtureForMethod:(const char *)method path:(NSString *)path
+{
+    @synchronized(self) {
+        for (NSArray *fixture in [_fixtures reverseObjectEnumerator]) {
+            if (strcmp(method, [[fixture objectAtIndex:0] UTF8String]) == 0
+                && fnmatch([[fixture objectAtIndex:1] UTF8String], [path UTF8String], FNM_PATHNAME) == 0) {
+                return [fixture objectAtIndex:2];
+            }
+        }
+    }
+
+    return nil;
+}
+
+- (NSDictionary *)parametersFromQuery:(NSString *)query
+{
+    NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+    for (NSString *parameter in [query componentsSeparatedByString:@"&"]) {
+        NSRange equals = [parameter rangeOfString:@"="];
+        if (equals.location != NSNotFound) {
+            NSString *value = [[parameter substringFromIndex:NSMaxRange(equals)] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+            [parameters setObject:value forKey:[parameter substringToIndex:equals.location]];
+        }
+    }
+
+    return parameters;
+}
+
+// Serves the page of rows, newest first, with ids up to the maxIdKey parameter, count of them (default 50) and a nextPage link while
+// older ones remain, like the real server.  The max id of the body is the highest id of all the rows: it does not move when a row
+// changes or goes away.
+- (NSString *)listBodyWithKey:(NSString *)key rows:(NSArray *)rows maxIdKey:(NSString *)maxIdKey path:(NSString *)path parameters:(NSDictionary *)parameters
+{
+    NSString *countParameter = [parameters objectForKey:@"count"];
+    NSString *maxIdParameter = [parameters objectForKey:maxIdKey];
+    NSUInteger count = countParameter ? (NSUInteger)[countParameter integerValue] : 50;
+    long long pageMaxId = maxIdParameter ? [maxIdParameter longLongValue] : LLONG_MAX;
+
+    NSArray *newestFirst = [rows sortedArrayUsingDescriptors:@[ [NSSortDescriptor sortDescriptorWithKey:@"id" ascending:NO] ]];
+    NSMutableArray *page = [NSMutableArray arrayWithCapacity:MIN(count, newestFirst.count)];
+    BOOL morePages = NO;
+    for (NSDictionary *row in newestFirst) {
+        if ([[row objectForKey:@"id"] longLongValue] > pageMaxId) {
+            continue;
+        }
+        if (page.count == count) {
+            morePages = YES;
+            break;
+        }
+        [page addObject:row];
+    }
+
+    NSNumber *maxId = [rows valueForKeyPath:@"@max.id"];
+    NSMutableDictionary *body = [NSMutableDictionary dictionaryWithObjectsAndKeys:page, key, (maxId ?: @0), maxIdKey, nil];
+    if (morePages) {
+        long long nextMaxId = [[[page lastObject] objectForKey:@"id"] longLongValue] - 1;
+        NSURL *pageUrl = [NSURL URLWithString:[NSString stringWithFormat:@"%@?%@=%lld", path, maxIdKey, nextMaxId] relativeToURL:[NSURL URLWithString:self.serverUrl]];
+        [body setObject:[pageUrl absoluteString] forKey:@"nextPage"];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:body options:0 error:NULL];
+
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+// The orders set, or generatedRowCount made-up ones.  Called with self locked.
+- (NSArray *)currentOrders
+{
+    if (_orders || self.generatedRowCount == 0) {
+        return _orders;
+    }
+
+    NSMutableArray *orders = [NSMutableArray arrayWithCapacity:self.generatedRowCount];
+    for (NSUInteger i = 1; i <= self.generatedRowCount; i++) {
+        [orders addObject:@{ @"id" : @(i),
+                             @"instrument" : [_instruments objectAtIndex:i % _instruments.count],
+                             @"units" : @(100 * (i % 10 + 1)),
+                             @"side" : (i % 2) ? @"buy" : @"sell",
+                             @"type" : @"limit",
+                             @"time" : [NSString stringWithFormat:@"%lld.000000", OTStubServerCandleEpoch + (long long)i],
+                             @"price" : @(1.2 + (i % 100) * 0.0001),
+                             @"expiry" : [NSString stringWithFormat:@"%lld.000000", OTStubServerCandleEpoch + 86400LL],
+                             @"stopLoss" : @0, @"takeProfit" : @0, @"trailingStop" : @0,
+                             @"lowerBound" : @0, @"upperBound" : @0 }];
+    }
+
+    return orders;
+}
+
+// The trades set, or generatedRowCount made-up ones.  Called with self locked.
+- (NSArray *)currentTrades
+{
+    if (_trades || self.generatedRowCount == 0) {
+        return _trades;
+    }
+
+    NSMutableArray *trades = [NSMutableArray arrayWithCapacity:self.generatedRowCount];
+    for (NSUInteger i = 1; i <= self.generatedRowCount; i++) {
+        [trades addObject:@{ @"id" : @(i),
+                             @"instrument" : [_instruments objectAtIndex:i % _instruments.count],
+                             @"units" : @(100 * (i % 10 + 1)),
+                             @"side" : (i % 3) ? @"buy" : @"sell",
+                             @"time" : [NSString stringWithFormat:@"%lld.000000", OTStubServerCandleEpoch + (long long)i],
+                             @"price" : @(1.2 + (i % 100) * 0.0001),
+                             @"stopLoss" : @0, @"takeProfit" : @0, @"trailingStop" : @0 }];
+    }
+
+    return trades;
+}
+
+// Nets the trades of each instrument into one position, priced at the units-weighted average, like the real endpoint.
+- (NSString *)positionsForTrades:(NSArray *)trades
+{
+    NSMutableDictionary *units = [NSMutableDictionary dictionary];      // instrument -> signed units
+    NSMutableDictionary *costs = [NSMutableDictionary dictionary];      // instrument -> signed units * price
+    for (NSDictionary *trade in trades) {
+        NSString *instrument = [trade objectForKey:@"instrument"];
+        if (!instrument) {
+            continue;
+        }
+        double tradeUnits = [[trade objectForKey:@"units"] doubleValue] * ([[trade objectForKey:@"side"] isEqualToString:@"sell"] ? -1.0 : 1.0);
+        [units setObject:@([[units objectForKey:instrument] doubleValue] + tradeUnits) forKey:instrument];
+        [costs setObject:@([[costs objectForKey:instrument] doubleValue] + tradeUnits * [[trade objectForKey:@"price"] doubleValue]) forKey:instrument];
+    }
+
+    NSMutableArray *positions = [NSMutableArray array];
+    for (NSString *instrument in [[units allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        double netUnits = [[units objectForKey:instrument] doubleValue];
+        if (netUnits == 0) {
+            continue;
+        }
+        [positions addObject:@{ @"instrument" : instrument,
+                                @"units" : @(fabs(netUnits)),
+                                @"side" : (netUnits > 0) ? @"buy" : @"sell",
+                                @"avgPrice" : @(round([[costs objectForKey:instrument] doubleValue] / netUnits * 1e5) / 1e5) }];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:@{ @"positions" : positions } options:0 error:NULL];
+
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+// Answers a new limit order with the parameters it was given, under a new id.
+- (NSString *)createdOrderForParameters:(NSDictionary *)parameters
+{
+    NSMutableDictionary *order = [NSMutableDictionary dictionaryWithDictionary:parameters];
+    [order setObject:@(self.numOrderRequests) forKey:@"id"];
+    NSData *data = [NSJSONSerialization dataWithJSONObject:order options:0 error:NULL];
+
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+// Answers a new market order as if it had been filled straight away, at the price given or the current one.
+- (NSString *)openedTradeForParameters:(NSDictionary *)parameters
+{
+    NSString *instrument = [parameters objectForKey:@"instrument"] ?: [_instruments objectAtIndex:0];
+    NSDictionary *tick = [NSJSONSerialization JSONObjectWithData:[[self nextPriceForInstrument:instrument] dataUsingEncoding:NSUTF8StringEncoding] options:0 error:NULL];
+    BOOL sell = [[parameters objectForKey:@"side"] isEqualToString:@"sell"];
+    NSDictionary *body = @{ @"instrument" : instrument,
+                            @"units" : @([[parameters objectForKey:@"units"] integerValue]),
+                            @"side" : sell ? @"sell" : @"buy",
+                            @"price" : [tick objectForKey:(sell ? @"bid" : @"ask")] ?: @0,
+                            @"ids" : @[ @(self.numTradeRequests) ] };
+    NSData *data = [NSJSONSerialization dataWithJSONObject:body options:0 error:NULL];
+
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+// Serves count transactions (default 50) from maxTransId down, newest first, with a nextPage link while older ones remain, like the real endpoint.
+- (NSString *)transactionsForAccountPath:(NSString *)path parameters:(NSDictionary *)parameters
+{
+    NSString *countParameter = [parameters objectForKey:@"count"];
+    NSString *maxIdParameter = [parameters objectForKey:@"maxTransId"];
+    NSUInteger count = countParameter ? (NSUInteger)[countParameter integerValue] : 50;
+    NSUInteger maxId = MIN(maxIdParameter ? (NSUInteger)[maxIdParameter integerValue] : NSUIntegerMax, self.transactionCount);
+    NSUInteger minId = maxId > count ? maxId - count + 1 : 1;
+    NSNumber *accountId = @([[[path pathComponents] objectAtIndex:3] integerValue]);
+
+    NSMutableArray *transactions = [NSMutableArray arrayWithCapacity:count];
+    for (NSUInteger transactionId = maxId; transactionId >= minId && transactionId > 0; transactionId--) {
+        [transactions addObject:@{ @"id" : @(transactionId),
+                                   @"accountId" : accountId,
+                                   @"type" : @"MarketOrderCreate",
+                                   @"instrument" : [_instruments objectAtIndex:transactionId % _instruments.count],
+                                   @"units" : @(100 * (transactionId % 10 + 1)),
+                                   @"side" : (transactionId % 2) ? @"buy" : @"sell",
+                                   @"price" : @(1.29 + (transactionId % 100) * 0.0001),
+                                   @"time" : [NSString stringWithFormat:@"%lld.000000", OTStubServerCandleEpoch + (long long)transactionId] }];
+    }
+
+    NSMutableDictionary *body = [NSMutableDictionary dictionaryWithObject:transactions forKey:@"transactions"];
+    if (minId > 1) {
+        NSURL *pageUrl = [NSURL URLWithString:[NSString stringWithFormat:@"%@?maxTransId=%lu", path, (unsigned long)(minId - 1)] relativeToURL:[NSURL URLWithString:self.serverUrl]];
+        [body setObject:[pageUrl absoluteString] forKey:@"nextPage"];
+    }
+    NSData *data = [NSJSONSerialization dataWithJSONObject:body options:0 error:NULL];
+
+    return [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+}
+
+// Serves count candles (default 500) from start, or the most recent ones without a start, like the real endpoint.
+- (NSString *)candlesForParameters:(NSDictionary *)parameters
+{
+    NSUInteger candleCount = self.candleCount;
+    NSString *countParameter = [parameters objectForKey:@"count"];
+    NSUInteger count = countParameter ? (NSUInteger)[countParameter integerValue] : 500;
+    NSString *startParameter = [parameters objectForKey:@"start"];
+
+    NSUInteger first;
+    if (startParameter) {
+        double offset = ([startParameter doubleValue] - OTStubServerCandleEpoch) / OTStubServerCandleSeconds;
+        BOOL includeFirst = [[parameters objectForKey:@"includeFirst"] isEqualToString:@"true"];
+        first = (NSUInteger)MAX(0.0, includeFirst ? ceil(offset) : floor(offset) + 1.0);
+    } else {
+        first = (candleCount > count) ? candleCount - count : 0;
+    }
+    NSUInteger last = MIN(candleCount, first + count);
+
+    NSMutableArray *candles = [NSMutableArray array];
+    for (NSUInteger i = first; i < last; i++) {
+        BOOL forming = (i == candleCount - 1);
+        double open = 1.2 + 0.00001 * (double)(i % 200);
+        double close = open + 0.0001 + (forming ? 0.00001 * (double)self.formingCandleRevision : 0.0);
+        [candles addObject:[NSString stringWithFormat:@"{\"time\":%lld,\"openMid\":%.5f,\"highMid\":%.5f,\"lowMid\":%.5f,\"closeMid\":%.5f,\"volume\":%lu,\"complete\":%@}",
+                            OTStubServerCandleEpoch + (long long)i * OTStubServerCandleSeconds, open, MAX(open, close) + 0.0001, open - 0.0001, close,
+                            (unsigned long)(i % 50 + 1), (forming ? @"false" : @"true")]];
+    }
+
+    return [NSString stringWithFormat:@"{\"instrument\":\"%@\",\"granularity\":\"%@\",\"candles\":[%@]}",
+            [parameters objectForKey:@"instrument"], [parameters objectForKey:@"granularity"], [candles componentsJoinedByString:@","]];
+}
+
+// Moves the instrument's price one step along a fixed walk, so consecutive quotes always differ.
+- (NSString *)nextPriceForInstrument:(NSString *)instrument
+{
+    NSUInteger tickCount;
+    @synchronized(_tickCounts) {
+        tickCount = [[_tickCounts objectForKey:instrument] unsignedIntegerValue] + 1;
+        [_tickCounts setObject:@(tickCount) forKey:instrument];
+    }
+
+    double bid = 1.2 + 0.00001 * (double)((tickCount * 7) % 500);
+    return [NSString stringWithFormat:@"{\"instrument\":\"%@\",\"time\":\"%.6f\",\"bid\":%.5f,\"ask\":%.5f}",
+            instrument, [[NSDate date] timeIntervalSince1970], bid, bid + 0.0003];
+}
+
+@end
@@ -112,6 +112,7 @@ typedef NSUInteger JKFlags;
   JKParseOptionLooseUnicode    : Normally the decoder will stop with an error at any malformed Unicode.
                                  This option allows JSON with malformed Unicode to be parsed without reporting an error.
                                  Any malformed Unicode is replaced with \uFFFD, or "REPLACEMENT CHARACTER".
+  JKParseOptionDecimalNumbers  : Numbers with a fraction or an exponent are returned as NSDecimalNumber, holding exactly the digits of the JSON (up to the 38 an NSDecimal holds), instead of a double NSNumber.
  */
 
 enum {
@@ -121,7 +122,8 @@ enum {
   JKParseOptionUnicodeNewlines          = (1 << 1),
   JKParseOptionLooseUnicode             = (1 << 2),
   JKParseOptionPermitTextAfterValidJSON = (1 << 3),
-  JKParseOptionValidFlags               = (JKParseOptionComments | JKParseOptionUnicodeNewlines | JKParseOptionLooseUnicode | JKParseOptionPermitTextAfterValidJSON),
+  JKParseOptionDecimalNumbers           = (1 << 4),
+  JKParseOptionValidFlags               = (JKParseOptionComments | JKParseOptionUnicodeNewlines | JKParseOptionLooseUnicode | JKParseOptionPermitTextAfterValidJSON | JKParseOptionDecimalNumbers),
 };
 typedef JKFlags JKParseOptionFlags;
 
@@ -138,6 +140,34 @@ typedef JKFlags JKSerializeOptionFlags;
 
 typedef struct JKParseState JKParseState; // Opaque internal, private type.
 
+// Strings and runs of blanks are scanned 16 bytes at a time with SSE2 or NEON when the compiler targets either, and a byte at a time otherwise.
+// Turning vector scanning off (for every decoder, eg. to compare the two) falls back to the byte at a time loops.  Both decode the same.
+BOOL JKVectorScanAvailable(void);
+void JKSetVectorScanEnabled(BOOL enabled);
+
+// Plain decimals, ie. -?[0-9]+(\.[0-9]{1,9})? with at most 19 digits (eg. prices like 1.32145), are converted by the decoder without going through libc.
+// The double is the same as strtod() returns.  Anything else (exponents, more fraction digits, longer numbers) still goes through strtod()/strtoll().
+#define JK_FIXED_DECIMAL_MAX_DIGITS 9
+
+// Converts a plain decimal, which must be the whole of bytes, to value * 10^scaleDigits (eg. "1.32145" with 6 scaleDigits is 1321450), without going through libc.
+// Fraction digits beyond scaleDigits are rounded half away from zero.  Returns NO if bytes is not a plain decimal, scaleDigits is more than
+// JK_FIXED_DECIMAL_MAX_DIGITS, or the result does not fit in an int64_t.
+BOOL JKScanFixedDecimal(const unsigned char *bytes, size_t length, NSUInteger scaleDigits, int64_t *scaledValue);
+
+// The object cache of a decoder interns the strings and numbers it has already seen (keys, symbols...), so that they are created only once.
+// It is a hash table of 2^slotsBits slots, in which a value may go in any of probes slots; a value which finds neither a free nor a stale slot
+// is not cached.  Defaults: 10 slotsBits (1024 slots) and 4 probes.
+#define JK_CACHE_MAX_SLOTS_BITS 16
+#define JK_CACHE_MAX_PROBES     16
+
+typedef struct {
+  NSUInteger hits;           // Strings and numbers found in the cache.
+  NSUInteger misses;         // Strings and numbers created, cached or not.
+  NSUInteger evictions;      // Misses cached in place of another value.
+  NSUInteger uncachedMisses; // Misses which found no slot, and were not cached.
+  NSUInteger slotsInUse;     // Slots holding a value now, out of 2^slotsBits.
+} JKCacheStatistics;
+
 // As a general rule of thumb, if you use a method that doesn't accept a JKParseOptionFlags argument, it defaults to JKParseOptionStrict
 
 @interface JSONDecoder : NSObject {
@@ -147,6 +177,14 @@ typedef struct JKParseState JKParseState; // Opaque internal, private type.
 + (id)decoderWithParseOptions:(JKParseOptionFlags)parseOptionFlags;
 - (id)initWithParseOptions:(JKParseOptionFlags)parseOptionFlags;
 - (void)clearCache;
+// Empties the cache, and resizes it.  slotsBits is from 1 to JK_CACHE_MAX_SLOTS_BITS, probes from 1 to JK_CACHE_MAX_PROBES.
+// Returns NO, keeping the cache as it was, if the memory for the new one could not be allocated.
+- (BOOL)setCacheSlotsBits:(NSUInteger)slotsBits probes:(NSUInteger)probes;
+- (NSUInteger)cacheSlotsBits;
+- (NSUInteger)cacheProbes;
+// The counts since the decoder was created, or resetCacheStatistics was last called.
+- (JKCacheStatistics)cacheStatistics;
+- (void)resetCacheStatistics;
 
 // The parse... methods were deprecated in v1.4 in favor of the v1.4 objectWith... methods.
 - (id)parseUTF8String:(const unsigned char *)string length:(size_t)length                         JK_DEPRECATED_ATTRIBUTE; // Deprecated in JSONKit v1.4.  Use objectWithUTF8String:length:        instead.
@@ -171,6 +209,127 @@ typedef struct JKParseState JKParseState; // Opaque internal, private type.
 
 @end
 
+////////////
+#pragma mark Schema-directed decoding
+////////////
+
+/*
+  Decodes an array of records straight into an array of C structs, without creating a single object.
+
+  The schema string names where the array is and which keys of each record to keep, eg. @"prices[].{instrument,bid,ask,time}" for
+  {"prices":[{"instrument":"EUR_USD","time":"1354208555.548539","bid":1.29564,"ask":1.29596}, ...]}.  The keys before the [] lead
+  from the top level object to the array (none for a top level array), and each key between the {} is described, in the same order,
+  by one JKSchemaField giving where and how it is stored in the record.
+
+  Keys of a record that are not in the schema are skipped without being converted, and fields missing from a record (or null) are left zeroed.
+  Decoding stops as soon as the array has been read, so whatever follows it in the JSON is neither validated nor looked at.
+
+  JKSchemaFieldTypeString  : char[size], NUL terminated, truncated to size - 1 bytes.
+  JKSchemaFieldTypeDouble  : double, from a number or from a string holding one (eg. "1354208555.548539").
+  JKSchemaFieldTypeInt64   : int64_t, from an integer or from a string holding one.
+  JKSchemaFieldTypeBool    : BOOL, from true or false.
+  JKSchemaFieldTypeFixed   : int64_t, value * 10^scaleDigits, from a plain decimal number or a string holding one.  See JKScanFixedDecimal().
+ */
+
+enum {
+  JKSchemaFieldTypeString = 1,
+  JKSchemaFieldTypeDouble = 2,
+  JKSchemaFieldTypeInt64  = 3,
+  JKSchemaFieldTypeBool   = 4,
+  JKSchemaFieldTypeFixed  = 5,
+};
+typedef JKFlags JKSchemaFieldType;
+
+typedef struct {
+  JKSchemaFieldType type;
+  size_t            offset; // offsetof() the field in the record.
+  size_t            size;   // sizeof() the field.
+  NSUInteger        scaleDigits; // JKSchemaFieldTypeFixed only, at most JK_FIXED_DECIMAL_MAX_DIGITS.
+} JKSchemaField;
+
+typedef struct JKSchemaState JKSchemaState; // Opaque internal, private type.
+
+// A compiled schema is immutable, and may be shared by any number of decoders and threads.
+@interface JKSchema : NSObject {
+  JKSchemaState *schemaState;
+}
+// fields must hold one JKSchemaField per key between the {} of schemaString.  Returns nil, setting error, if the schema is malformed.
++ (id)schemaWithString:(NSString *)schemaString fields:(const JKSchemaField *)fields recordSize:(size_t)recordSize error:(NSError **)error;
+- (id)initWithString:(NSString *)schemaString fields:(const JKSchemaField *)fields recordSize:(size_t)recordSize error:(NSError **)error;
+- (size_t)recordSize;
+- (NSUInteger)fieldCount;
+@end
+
+@interface JSONDecoder (JKSchemaDecoding)
+// Writes the first capacity records to records, an array of capacity structs of [schema recordSize] bytes.
+// Returns how many records the array holds, which may be more than capacity (grow the array and decode again), or NSNotFound on error.
+- (NSUInteger)decodeRecordsWithUTF8String:(const unsigned char *)string length:(NSUInteger)length schema:(JKSchema *)schema records:(void *)records capacity:(NSUInteger)capacity error:(NSError **)error;
+// The NSData MUST be UTF8 encoded JSON.
+- (NSUInteger)decodeRecordsWithData:(NSData *)jsonData schema:(JKSchema *)schema records:(void *)records capacity:(NSUInteger)capacity error:(NSError **)error;
+@end
+
+////////////
+#pragma mark Streaming decoding
+////////////
+
+/*
+  Decodes JSON pushed to it chunk by chunk, as it arrives, reporting what it finds to its delegate instead of building a tree.
+
+  Only the bytes of a token cut in two by the end of a chunk are kept between pushes, so the memory used does not grow with the
+  size of the document, only with its nesting and its longest string.  Events are sent from within pushData:error:, in document order:
+
+    {"transactions":[{"id":1,"pl":0.5}]}
+
+  decoderDidStartObject:, foundKey:@"transactions", decoderDidStartArray:, decoderDidStartObject:, foundKey:@"id", foundValue:@1,
+  foundKey:@"pl", foundValue:@0.5, decoderDidEndObject:, decoderDidEndArray:, decoderDidEndObject:.
+
+  Keys and values are interned through the decoder's cache, like those of objectWithData:.  Values are NSString, NSNumber or NSNull,
+  and are only valid for the duration of the callback unless retained.  JKParseOptionComments is not supported.
+ */
+
+// Defined by this version of JSONKit, for code which may also be built against one without JSONStreamDecoder.
+#define JK_STREAM_DECODER_AVAILABLE 1
+
+@class JSONStreamDecoder;
+
+@protocol JSONStreamDecoderDelegate <NSObject>
+@optional
+- (void)decoderDidStartObject:(JSONStreamDecoder *)decoder;
+- (void)decoderDidEndObject:(JSONStreamDecoder *)decoder;
+- (void)decoderDidStartArray:(JSONStreamDecoder *)decoder;
+- (void)decoderDidEndArray:(JSONStreamDecoder *)decoder;
+- (void)decoder:(JSONStreamDecoder *)decoder foundKey:(NSString *)key;
+- (void)decoder:(JSONStreamDecoder *)decoder foundValue:(id)value;
+@end
+
+typedef struct JKStreamState JKStreamState; // Opaque internal, private type.
+
+@interface JSONStreamDecoder : JSONDecoder {
+  JKStreamState *streamState;
+}
++ (id)streamDecoderWithDelegate:(id <JSONStreamDecoderDelegate>)delegate;
+- (id)initWithDelegate:(id <JSONStreamDecoderDelegate>)delegate parseOptions:(JKParseOptionFlags)parseOptionFlags;
+// The delegate is not retained.
+- (id <JSONStreamDecoderDelegate>)delegate;
+- (void)setDelegate:(id <JSONStreamDecoderDelegate>)delegate;
+
+// Returns NO, setting error, if the JSON is malformed.  Once an error is reported, every following push fails with it, until reset.
+- (BOOL)pushUTF8String:(const unsigned char *)string length:(NSUInteger)length error:(NSError **)error;
+// The NSData MUST be UTF8 encoded JSON.
+- (BOOL)pushData:(NSData *)jsonData error:(NSError **)error;
+// To be called once every chunk has been pushed.  Returns NO, setting error, if the document is incomplete or malformed.
+- (BOOL)finishWithError:(NSError **)error;
+// Starts over with a new document, keeping the cache.
+- (void)reset;
+
+// How many objects and arrays are open at the point the decoder has reached.
+- (NSUInteger)depth;
+// How many bytes of an unfinished token are held until the next push.
+- (NSUInteger)bufferedLength;
+// Whether the top level object or array has been closed.
+- (BOOL)isFinished;
+@end
+
 ////////////
 #pragma mark Deserializing methods
 ////////////
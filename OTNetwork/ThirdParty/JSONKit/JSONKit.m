@@ -170,10 +170,21 @@
 // Use __builtin_clz() instead of trailingBytesForUTF8[] table lookup.
 #define JK_FAST_TRAILING_BYTES
 
-// JK_CACHE_SLOTS must be a power of 2.  Default size is 1024 slots.
+// Use SSE2 / NEON to scan strings and runs of blanks 16 bytes at a time, where the compiler targets either.  Define JK_DISABLE_VECTOR_SCAN to always scan a byte at a time.
+#if !defined(JK_DISABLE_VECTOR_SCAN) && (defined(__SSE2__) || defined(__ARM_NEON__) || defined(__ARM_NEON))
+#define JK_VECTOR_SCAN
+#endif
+
+#if   defined(JK_VECTOR_SCAN) && defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(JK_VECTOR_SCAN)
+#include <arm_neon.h>
+#endif
+
+// JK_CACHE_SLOTS must be a power of 2.  Default size is 1024 slots, which setCacheSlotsBits:probes: changes at run time.
 #define JK_CACHE_SLOTS_BITS    (10)
 #define JK_CACHE_SLOTS         (1UL << JK_CACHE_SLOTS_BITS)
-// JK_CACHE_PROBES is the number of probe attempts.
+// JK_CACHE_PROBES is the default number of probe attempts.
 #define JK_CACHE_PROBES        (4UL)
 // JK_INIT_CACHE_AGE must be < (1 << AGE) - 1, where AGE is sizeof(typeof(AGE)) * 8.
 #define JK_INIT_CACHE_AGE      (0)
@@ -320,6 +331,7 @@ enum {
   JKValueTypeLongLong         = 7,
   JKValueTypeUnsignedLongLong = 11,
   JKValueTypeDouble           = 13,
+  JKValueTypeDecimal          = 17, // JKParseOptionDecimalNumbers: the bytes are those of the number token, number.doubleValue is also set.
 };
 typedef NSUInteger JKValueType;
 
@@ -405,6 +417,12 @@ struct JKTokenValue {
     unsigned long long unsignedLongLongValue;
     double             doubleValue;
   } number;
+  struct {
+    unsigned long long mantissa;       // Only valid if isPlain, ie. the number is a plain decimal (see jk_scan_decimal).
+    int                fractionDigits;
+    int                isNegative;
+    int                isPlain;
+  } decimal;
   JKTokenCacheItem *cacheItem;
 };
 
@@ -427,8 +445,10 @@ struct JKTokenCacheItem {
 struct JKTokenCache {
   JKTokenCacheItem *items;
   size_t            count;
+  size_t            slotsBits, probes;
   unsigned int      prng_lfsr;
-  unsigned char     age[JK_CACHE_SLOTS];
+  unsigned char    *age;
+  size_t            hits, misses, evictions, uncachedMisses;
 };
 
 struct JKObjCImpCache {
@@ -578,6 +598,7 @@ static int  jk_objectStack_resize(JKObjectStack *objectStack, size_t newCount);
 
 static void   jk_error(JKParseState *parseState, NSString *format, ...);
 static int    jk_parse_string(JKParseState *parseState);
+JK_STATIC_INLINE int jk_scan_decimal(const unsigned char *ptr, const unsigned char *endPtr, unsigned long long *mantissa, int *fractionDigits, int *isNegative);
 static int    jk_parse_number(JKParseState *parseState);
 static size_t jk_parse_is_newline(JKParseState *parseState, const unsigned char *atCharacterPtr);
 JK_STATIC_INLINE int jk_parse_skip_newline(JKParseState *parseState);
@@ -589,6 +610,7 @@ static void  *jk_parse_dictionary(JKParseState *parseState);
 static void  *jk_parse_array(JKParseState *parseState);
 static void  *jk_object_for_token(JKParseState *parseState);
 static void  *jk_cachedObjects(JKParseState *parseState);
+static id     jk_create_decimal_number(JKParseState *parseState);
 JK_STATIC_INLINE void jk_cache_age(JKParseState *parseState);
 JK_STATIC_INLINE void jk_set_parsed_token(JKParseState *parseState, const unsigned char *ptr, size_t length, JKTokenType type, size_t advanceBy);
 
@@ -1416,6 +1438,82 @@ JK_STATIC_INLINE int jk_string_add_unicodeCodePoint(JKParseState *parseState, ui
   return(0);
 }
 
+////////////
+#pragma mark -
+#pragma mark Vector scanning functions
+
+static int jk_vectorScanEnabled = 1;
+
+BOOL JKVectorScanAvailable(void) {
+#ifdef JK_VECTOR_SCAN
+  return(YES);
+#else
+  return(NO);
+#endif
+}
+
+void JKSetVectorScanEnabled(BOOL enabled) {
+  jk_vectorScanEnabled = (enabled == NO) ? 0 : 1;
+}
+
+#ifdef JK_VECTOR_SCAN
+
+#ifdef __SSE2__
+
+// Returns the index of the first of the 16 bytes at ptr that ends a run of plain string characters: '"', '\\', a control character or the start of a UTF8 sequence.  16 if none does.
+JK_STATIC_INLINE size_t jk_vector_string_stop(const unsigned char *ptr) {
+  __m128i chars = _mm_loadu_si128((const __m128i *)ptr);
+  __m128i stops = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('"')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\\'))), _mm_cmplt_epi8(chars, _mm_set1_epi8(0x20))); // Signed, so >= 0x80 is < 0x20 as well.
+  unsigned int mask = (unsigned int)_mm_movemask_epi8(stops);
+  return((mask == 0U) ? 16UL : (size_t)__builtin_ctz(mask));
+}
+
+// Returns the index of the first of the 16 bytes at ptr that is neither ' ' nor '\t'.  16 if all are.
+JK_STATIC_INLINE size_t jk_vector_blank_stop(const unsigned char *ptr) {
+  __m128i chars  = _mm_loadu_si128((const __m128i *)ptr);
+  __m128i blanks = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')));
+  unsigned int mask = (~(unsigned int)_mm_movemask_epi8(blanks)) & 0xffffU;
+  return((mask == 0U) ? 16UL : (size_t)__builtin_ctz(mask));
+}
+
+#else  // __SSE2__, so NEON.
+
+JK_STATIC_INLINE size_t jk_vector_first_set(uint8x16_t matches) {
+  uint64x2_t lanes = vreinterpretq_u64_u8(matches);
+  uint64_t   low   = vgetq_lane_u64(lanes, 0), high = vgetq_lane_u64(lanes, 1);
+  if(low  != 0ULL) { return((size_t)__builtin_ctzll(low) >> 3); }
+  if(high != 0ULL) { return(8UL + ((size_t)__builtin_ctzll(high) >> 3)); }
+  return(16UL);
+}
+
+JK_STATIC_INLINE size_t jk_vector_string_stop(const unsigned char *ptr) {
+  uint8x16_t chars = vld1q_u8(ptr);
+  uint8x16_t stops = vorrq_u8(vorrq_u8(vceqq_u8(chars, vdupq_n_u8('"')), vceqq_u8(chars, vdupq_n_u8('\\'))), vcltq_s8(vreinterpretq_s8_u8(chars), vdupq_n_s8(0x20))); // Signed, so >= 0x80 is < 0x20 as well.
+  return(jk_vector_first_set(stops));
+}
+
+JK_STATIC_INLINE size_t jk_vector_blank_stop(const unsigned char *ptr) {
+  uint8x16_t chars  = vld1q_u8(ptr);
+  uint8x16_t blanks = vorrq_u8(vceqq_u8(chars, vdupq_n_u8(' ')), vceqq_u8(chars, vdupq_n_u8('\t')));
+  return(jk_vector_first_set(vmvnq_u8(blanks)));
+}
+
+#endif // __SSE2__
+
+// Skips plain string characters 16 at a time, for as long as 16 bytes are left before endPtr.  The caller deals with the rest a byte at a time.
+JK_STATIC_INLINE const unsigned char *jk_scan_plain_string(const unsigned char *ptr, const unsigned char *endPtr) {
+  while((endPtr - ptr) >= 16L) { size_t stop = jk_vector_string_stop(ptr); ptr += stop; if(stop < 16UL) { break; } }
+  return(ptr);
+}
+
+// Skips ' ' and '\t' 16 at a time, for as long as 16 bytes are left before endPtr.
+JK_STATIC_INLINE const unsigned char *jk_scan_blanks(const unsigned char *ptr, const unsigned char *endPtr) {
+  while((endPtr - ptr) >= 16L) { size_t stop = jk_vector_blank_stop(ptr); ptr += stop; if(stop < 16UL) { break; } }
+  return(ptr);
+}
+
+#endif // JK_VECTOR_SCAN
+
 ////////////
 #pragma mark -
 #pragma mark Decoding / parsing / deserializing functions
@@ -1437,6 +1535,13 @@ static int jk_parse_string(JKParseState *parseState) {
   while(1) {
     unsigned long currentChar;
 
+#ifdef JK_VECTOR_SCAN
+    if(JK_EXPECT_T(jk_vectorScanEnabled)) {
+      const unsigned char *plainEnd = jk_scan_plain_string(atStringCharacter, endOfBuffer);
+      while(atStringCharacter < plainEnd) { stringHash = jk_calculateHash(stringHash, *atStringCharacter++); }
+    }
+#endif
+
     if(JK_EXPECT_F(atStringCharacter == endOfBuffer)) { /* XXX Add error message */ stringState = JSONStringStateError; goto finishedParsing; }
     
     if(JK_EXPECT_F((currentChar = *atStringCharacter++) >= 0x80UL)) {
@@ -1472,6 +1577,19 @@ static int jk_parse_string(JKParseState *parseState) {
   for(atStringCharacter = (stringStart + ((atStringCharacter - stringStart) - 1L)); (atStringCharacter < endOfBuffer) && (tokenBufferIdx < parseState->token.tokenBuffer.bytes.length); atStringCharacter++) {
     if((tokenBufferIdx + 16UL) > parseState->token.tokenBuffer.bytes.length) { if((tokenBuffer = jk_managedBuffer_resize(&parseState->token.tokenBuffer, tokenBufferIdx + 1024UL)) == NULL) { jk_error(parseState, @"Internal error: Unable to resize temporary buffer. %@ line #%ld", [NSString stringWithUTF8String:__FILE__], (long)__LINE__); stringState = JSONStringStateError; goto finishedParsing; } }
 
+#ifdef JK_VECTOR_SCAN
+    // Stops short of the last byte, so there is always a character left for the loop below.
+    if(JK_EXPECT_T(stringState == JSONStringStateParsing) && JK_EXPECT_T(jk_vectorScanEnabled)) {
+      size_t plainLength = jk_scan_plain_string(atStringCharacter, endOfBuffer - 1) - atStringCharacter;
+      if(plainLength > 0UL) {
+        if((tokenBufferIdx + plainLength + 16UL) > parseState->token.tokenBuffer.bytes.length) { if((tokenBuffer = jk_managedBuffer_resize(&parseState->token.tokenBuffer, tokenBufferIdx + plainLength + 1024UL)) == NULL) { jk_error(parseState, @"Internal error: Unable to resize temporary buffer. %@ line #%ld", [NSString stringWithUTF8String:__FILE__], (long)__LINE__); stringState = JSONStringStateError; goto finishedParsing; } }
+        memcpy(&tokenBuffer[tokenBufferIdx], atStringCharacter, plainLength);
+        tokenBufferIdx += plainLength;
+        while(plainLength-- > 0UL) { stringHash = jk_calculateHash(stringHash, *atStringCharacter++); }
+      }
+    }
+#endif
+
     NSCParameterAssert(tokenBufferIdx < parseState->token.tokenBuffer.bytes.length);
 
     unsigned long currentChar = (*atStringCharacter), escapedChar;
@@ -1630,6 +1748,59 @@ finishedParsing:
   return(JK_EXPECT_T(stringState == JSONStringStateFinished) ? 0 : 1);
 }
 
+// Exact powers of ten, as integers and as doubles (every one of them up to 10^22 is exactly representable).
+static const unsigned long long jk_pow10_ull[JK_FIXED_DECIMAL_MAX_DIGITS + 1] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL };
+static const double             jk_pow10_dbl[JK_FIXED_DECIMAL_MAX_DIGITS + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+// Scans a plain decimal, -?[0-9]+(\.[0-9]{1,9})? with at most 19 digits so that they always fit in the mantissa, which must be the whole of ptr..endPtr.
+// Returns 1 with the digits (without the '.') in mantissa, or 0 if it is anything else.
+JK_STATIC_INLINE int jk_scan_decimal(const unsigned char *ptr, const unsigned char *endPtr, unsigned long long *mantissa, int *fractionDigits, int *isNegative) {
+  const unsigned char *atPtr = ptr, *digitsPtr = NULL, *fractionPtr = NULL;
+  unsigned long long   value = 0ULL;
+  size_t               digits = 0UL;
+
+  *isNegative = 0; *fractionDigits = 0;
+  if((atPtr < endPtr) && (*atPtr == '-')) { *isNegative = 1; atPtr++; }
+
+  for(digitsPtr = atPtr; (atPtr < endPtr) && (JK_EXPECT_T((unsigned int)(*atPtr - '0') < 10U)); atPtr++) { value = (value * 10ULL) + (unsigned long long)(*atPtr - '0'); }
+  if(JK_EXPECT_F(atPtr == digitsPtr)) { return(0); }
+  digits = atPtr - digitsPtr;
+
+  if((atPtr < endPtr) && (*atPtr == '.')) {
+    for(fractionPtr = ++atPtr; (atPtr < endPtr) && (JK_EXPECT_T((unsigned int)(*atPtr - '0') < 10U)); atPtr++) { value = (value * 10ULL) + (unsigned long long)(*atPtr - '0'); }
+    if(JK_EXPECT_F(atPtr == fractionPtr) || JK_EXPECT_F((atPtr - fractionPtr) > JK_FIXED_DECIMAL_MAX_DIGITS)) { return(0); }
+    *fractionDigits = (int)(atPtr - fractionPtr);
+    digits += atPtr - fractionPtr;
+  }
+
+  if(JK_EXPECT_F(atPtr != endPtr) || JK_EXPECT_F(digits > 19UL)) { return(0); }
+  *mantissa = value;
+  return(1);
+}
+
+BOOL JKScanFixedDecimal(const unsigned char *bytes, size_t length, NSUInteger scaleDigits, int64_t *scaledValue) {
+  unsigned long long mantissa = 0ULL, maxMagnitude = 0ULL;
+  int                fractionDigits = 0, isNegative = 0;
+
+  if(JK_EXPECT_F(bytes == NULL) || JK_EXPECT_F(scaleDigits > JK_FIXED_DECIMAL_MAX_DIGITS)) { return(NO); }
+  if(JK_EXPECT_F(jk_scan_decimal(bytes, bytes + length, &mantissa, &fractionDigits, &isNegative) == 0)) { return(NO); }
+  maxMagnitude = (isNegative) ? ((unsigned long long)LLONG_MAX + 1ULL) : (unsigned long long)LLONG_MAX;
+
+  if((NSUInteger)fractionDigits <= scaleDigits) {
+    unsigned long long multiplier = jk_pow10_ull[scaleDigits - (NSUInteger)fractionDigits];
+    if(JK_EXPECT_F(mantissa > (maxMagnitude / multiplier))) { return(NO); }
+    mantissa *= multiplier;
+  } else {
+    unsigned long long divisor = jk_pow10_ull[(NSUInteger)fractionDigits - scaleDigits], remainder = mantissa % divisor;
+    mantissa /= divisor;
+    if(remainder >= (divisor / 2ULL)) { mantissa++; } // Half away from zero, as the sign is applied afterwards.
+    if(JK_EXPECT_F(mantissa > maxMagnitude)) { return(NO); }
+  }
+
+  if(scaledValue != NULL) { *scaledValue = (isNegative) ? (int64_t)(0ULL - mantissa) : (int64_t)mantissa; }
+  return(YES);
+}
+
 static int jk_parse_number(JKParseState *parseState) {
   NSCParameterAssert((parseState != NULL) && (JK_AT_STRING_PTR(parseState) <= JK_END_STRING_PTR(parseState)));
   const unsigned char *numberStart       = JK_AT_STRING_PTR(parseState);
@@ -1665,51 +1836,89 @@ static int jk_parse_number(JKParseState *parseState) {
   parseState->atIndex                    = (parseState->token.tokenPtrRange.ptr + parseState->token.tokenPtrRange.length) - parseState->stringBuffer.bytes.ptr;
 
   if(JK_EXPECT_T(numberState == JSONNumberStateFinished)) {
-    unsigned char  numberTempBuf[parseState->token.tokenPtrRange.length + 4UL];
-    unsigned char *endOfNumber = NULL;
+    int isDecimal = (isFloatingPoint && (parseState->parseOptionFlags & JKParseOptionDecimalNumbers)) ? 1 : 0;
 
-    memcpy(numberTempBuf, parseState->token.tokenPtrRange.ptr, parseState->token.tokenPtrRange.length);
-    numberTempBuf[parseState->token.tokenPtrRange.length] = 0;
-
-    errno = 0;
-    
     // Treat "-0" as a floating point number, which is capable of representing negative zeros.
-    if(JK_EXPECT_F(parseState->token.tokenPtrRange.length == 2UL) && JK_EXPECT_F(numberTempBuf[1] == '0') && JK_EXPECT_F(isNegative)) { isFloatingPoint = 1; }
-
-    if(isFloatingPoint) {
-      parseState->token.value.number.doubleValue = strtod((const char *)numberTempBuf, (char **)&endOfNumber); // strtod is documented to return U+2261 (identical to) 0.0 on an underflow error (along with setting errno to ERANGE).
-      parseState->token.value.type               = JKValueTypeDouble;
-      parseState->token.value.ptrRange.ptr       = (const unsigned char *)&parseState->token.value.number.doubleValue;
-      parseState->token.value.ptrRange.length    = sizeof(double);
-      parseState->token.value.hash               = (JK_HASH_INIT + parseState->token.value.type);
-    } else {
-      if(isNegative) {
-        parseState->token.value.number.longLongValue = strtoll((const char *)numberTempBuf, (char **)&endOfNumber, 10);
+    if(JK_EXPECT_F(parseState->token.tokenPtrRange.length == 2UL) && JK_EXPECT_F(parseState->token.tokenPtrRange.ptr[1] == '0') && JK_EXPECT_F(isNegative)) { isFloatingPoint = 1; }
+
+    parseState->token.value.decimal.isPlain = jk_scan_decimal(parseState->token.tokenPtrRange.ptr, parseState->token.tokenPtrRange.ptr + parseState->token.tokenPtrRange.length, &parseState->token.value.decimal.mantissa, &parseState->token.value.decimal.fractionDigits, &parseState->token.value.decimal.isNegative);
+
+    // The fast path: a plain decimal whose digits are exactly representable as a double (<= 2^53) is divided by an exact power of ten, which is
+    // correctly rounded and so the same double strtod() returns.  Integers only need to fit.
+    if(JK_EXPECT_T(parseState->token.value.decimal.isPlain) && ((isFloatingPoint) ? (parseState->token.value.decimal.mantissa <= (1ULL << 53)) : ((isNegative == 0) || (parseState->token.value.decimal.mantissa <= ((unsigned long long)LLONG_MAX + 1ULL))))) {
+      unsigned long long mantissa = parseState->token.value.decimal.mantissa;
+      if(isFloatingPoint) {
+        double doubleValue = (double)mantissa / jk_pow10_dbl[parseState->token.value.decimal.fractionDigits];
+        parseState->token.value.number.doubleValue = (isNegative) ? -doubleValue : doubleValue;
+        parseState->token.value.type               = JKValueTypeDouble;
+        parseState->token.value.ptrRange.ptr       = (const unsigned char *)&parseState->token.value.number.doubleValue;
+        parseState->token.value.ptrRange.length    = sizeof(double);
+        parseState->token.value.hash               = (JK_HASH_INIT + parseState->token.value.type);
+      } else if(isNegative) {
+        parseState->token.value.number.longLongValue = (long long)(0ULL - mantissa);
         parseState->token.value.type                 = JKValueTypeLongLong;
         parseState->token.value.ptrRange.ptr         = (const unsigned char *)&parseState->token.value.number.longLongValue;
         parseState->token.value.ptrRange.length      = sizeof(long long);
         parseState->token.value.hash                 = (JK_HASH_INIT + parseState->token.value.type) + (JKHash)parseState->token.value.number.longLongValue;
       } else {
-        parseState->token.value.number.unsignedLongLongValue = strtoull((const char *)numberTempBuf, (char **)&endOfNumber, 10);
+        parseState->token.value.number.unsignedLongLongValue = mantissa;
         parseState->token.value.type                         = JKValueTypeUnsignedLongLong;
         parseState->token.value.ptrRange.ptr                 = (const unsigned char *)&parseState->token.value.number.unsignedLongLongValue;
         parseState->token.value.ptrRange.length              = sizeof(unsigned long long);
         parseState->token.value.hash                         = (JK_HASH_INIT + parseState->token.value.type) + (JKHash)parseState->token.value.number.unsignedLongLongValue;
       }
-    }
+    } else { // Anything else goes through libc.
+      unsigned char  numberTempBuf[parseState->token.tokenPtrRange.length + 4UL];
+      unsigned char *endOfNumber = NULL;
 
-    if(JK_EXPECT_F(errno != 0)) {
-      numberState = JSONNumberStateError;
-      if(errno == ERANGE) {
-        switch(parseState->token.value.type) {
-          case JKValueTypeDouble:           jk_error(parseState, @"The value '%s' could not be represented as a 'double' due to %s.",           numberTempBuf, (parseState->token.value.number.doubleValue == 0.0) ? "underflow" : "overflow"); break; // see above for == 0.0.
-          case JKValueTypeLongLong:         jk_error(parseState, @"The value '%s' exceeded the minimum value that could be represented: %lld.", numberTempBuf, parseState->token.value.number.longLongValue);                                   break;
-          case JKValueTypeUnsignedLongLong: jk_error(parseState, @"The value '%s' exceeded the maximum value that could be represented: %llu.", numberTempBuf, parseState->token.value.number.unsignedLongLongValue);                           break;
-          default:                          jk_error(parseState, @"Internal error: Unknown token value type. %@ line #%ld",                     [NSString stringWithUTF8String:__FILE__], (long)__LINE__);                                      break;
+      memcpy(numberTempBuf, parseState->token.tokenPtrRange.ptr, parseState->token.tokenPtrRange.length);
+      numberTempBuf[parseState->token.tokenPtrRange.length] = 0;
+
+      errno = 0;
+
+      if(isFloatingPoint) {
+        parseState->token.value.number.doubleValue = strtod((const char *)numberTempBuf, (char **)&endOfNumber); // strtod is documented to return U+2261 (identical to) 0.0 on an underflow error (along with setting errno to ERANGE).
+        parseState->token.value.type               = JKValueTypeDouble;
+        parseState->token.value.ptrRange.ptr       = (const unsigned char *)&parseState->token.value.number.doubleValue;
+        parseState->token.value.ptrRange.length    = sizeof(double);
+        parseState->token.value.hash               = (JK_HASH_INIT + parseState->token.value.type);
+      } else {
+        if(isNegative) {
+          parseState->token.value.number.longLongValue = strtoll((const char *)numberTempBuf, (char **)&endOfNumber, 10);
+          parseState->token.value.type                 = JKValueTypeLongLong;
+          parseState->token.value.ptrRange.ptr         = (const unsigned char *)&parseState->token.value.number.longLongValue;
+          parseState->token.value.ptrRange.length      = sizeof(long long);
+          parseState->token.value.hash                 = (JK_HASH_INIT + parseState->token.value.type) + (JKHash)parseState->token.value.number.longLongValue;
+        } else {
+          parseState->token.value.number.unsignedLongLongValue = strtoull((const char *)numberTempBuf, (char **)&endOfNumber, 10);
+          parseState->token.value.type                         = JKValueTypeUnsignedLongLong;
+          parseState->token.value.ptrRange.ptr                 = (const unsigned char *)&parseState->token.value.number.unsignedLongLongValue;
+          parseState->token.value.ptrRange.length              = sizeof(unsigned long long);
+          parseState->token.value.hash                         = (JK_HASH_INIT + parseState->token.value.type) + (JKHash)parseState->token.value.number.unsignedLongLongValue;
         }
       }
+
+      if(JK_EXPECT_F(errno != 0)) {
+        numberState = JSONNumberStateError;
+        if(errno == ERANGE) {
+          switch(parseState->token.value.type) {
+            case JKValueTypeDouble:           jk_error(parseState, @"The value '%s' could not be represented as a 'double' due to %s.",           numberTempBuf, (parseState->token.value.number.doubleValue == 0.0) ? "underflow" : "overflow"); break; // see above for == 0.0.
+            case JKValueTypeLongLong:         jk_error(parseState, @"The value '%s' exceeded the minimum value that could be represented: %lld.", numberTempBuf, parseState->token.value.number.longLongValue);                                   break;
+            case JKValueTypeUnsignedLongLong: jk_error(parseState, @"The value '%s' exceeded the maximum value that could be represented: %llu.", numberTempBuf, parseState->token.value.number.unsignedLongLongValue);                           break;
+            default:                          jk_error(parseState, @"Internal error: Unknown token value type. %@ line #%ld",                     [NSString stringWithUTF8String:__FILE__], (long)__LINE__);                                      break;
+          }
+        }
+      }
+      if(JK_EXPECT_F(endOfNumber != &numberTempBuf[parseState->token.tokenPtrRange.length]) && JK_EXPECT_F(numberState != JSONNumberStateError)) { numberState = JSONNumberStateError; jk_error(parseState, @"The conversion function did not consume all of the number tokens characters."); }
+    }
+
+    // The NSDecimalNumber is made from the digits themselves, so two numbers which round to the same double must not share a cache bucket.
+    if(JK_EXPECT_F(isDecimal)) {
+      parseState->token.value.type            = JKValueTypeDecimal;
+      parseState->token.value.ptrRange.ptr    = parseState->token.tokenPtrRange.ptr;
+      parseState->token.value.ptrRange.length = parseState->token.tokenPtrRange.length;
+      parseState->token.value.hash            = (JK_HASH_INIT + parseState->token.value.type);
     }
-    if(JK_EXPECT_F(endOfNumber != &numberTempBuf[parseState->token.tokenPtrRange.length]) && JK_EXPECT_F(numberState != JSONNumberStateError)) { numberState = JSONNumberStateError; jk_error(parseState, @"The conversion function did not consume all of the number tokens characters."); }
 
     size_t hashIndex = 0UL;
     for(hashIndex = 0UL; hashIndex < parseState->token.value.ptrRange.length; hashIndex++) { parseState->token.value.hash = jk_calculateHash(parseState->token.value.hash, parseState->token.value.ptrRange.ptr[hashIndex]); }
@@ -1755,7 +1964,13 @@ JK_STATIC_INLINE void jk_parse_skip_whitespace(JKParseState *parseState) {
   const unsigned char *endOfStringPtr   = JK_END_STRING_PTR(parseState);
 
   for(atCharacterPtr = JK_AT_STRING_PTR(parseState); (JK_EXPECT_T((atCharacterPtr = JK_AT_STRING_PTR(parseState)) < endOfStringPtr)); parseState->atIndex++) {
-    if(((*(atCharacterPtr + 0)) == ' ') || ((*(atCharacterPtr + 0)) == '\t')) { continue; }
+    if(((*(atCharacterPtr + 0)) == ' ') || ((*(atCharacterPtr + 0)) == '\t')) {
+#ifdef JK_VECTOR_SCAN
+      // Indentation: skip the whole run at once.  The first blank is left for the loop to step over.
+      if(JK_EXPECT_T(jk_vectorScanEnabled) && ((endOfStringPtr - atCharacterPtr) >= 16L) && (((*(atCharacterPtr + 1)) == ' ') || ((*(atCharacterPtr + 1)) == '\t'))) { parseState->atIndex += (jk_scan_blanks(atCharacterPtr, endOfStringPtr) - atCharacterPtr) - 1UL; }
+#endif
+      continue;
+    }
     if(jk_parse_skip_newline(parseState)) { continue; }
     if(parseState->parseOptionFlags & JKParseOptionComments) {
       if((JK_EXPECT_F((*(atCharacterPtr + 0)) == '/')) && (JK_EXPECT_T((atCharacterPtr + 1) < endOfStringPtr))) {
@@ -1982,7 +2197,7 @@ JK_STATIC_INLINE void jk_cache_age(JKParseState *parseState) {
   parseState->cache.age[parseState->cache.prng_lfsr & (parseState->cache.count - 1UL)] >>= 1;
 }
 
-// The object cache is nothing more than a hash table with open addressing collision resolution that is bounded by JK_CACHE_PROBES attempts.
+// The object cache is nothing more than a hash table with open addressing collision resolution that is bounded by cache.probes attempts (JK_CACHE_PROBES unless set with setCacheSlotsBits:probes:).
 //
 // The hash table is a linear C array of JKTokenCacheItem.  The terms "item" and "bucket" are synonymous with the index in to the cache array, i.e. cache.items[bucket].
 //
@@ -1997,18 +2212,32 @@ JK_STATIC_INLINE void jk_cache_age(JKParseState *parseState) {
 //
 // If a value is not found in the cache, and no useable bucket has been found, that value is not added to the cache.
 
+// Returns a +1 NSDecimalNumber with the digits of the number token.  Plain decimals are made from the mantissa already scanned, anything else from the string.
+static id jk_create_decimal_number(JKParseState *parseState) {
+  if(JK_EXPECT_T(parseState->token.value.decimal.isPlain)) {
+    BOOL isNegative = (parseState->token.value.decimal.isNegative && (parseState->token.value.decimal.mantissa != 0ULL)) ? YES : NO; // A negative zero NSDecimal is a NaN.
+    return([[NSDecimalNumber alloc] initWithMantissa:parseState->token.value.decimal.mantissa exponent:(short)(-parseState->token.value.decimal.fractionDigits) isNegative:isNegative]);
+  }
+
+  NSString *numberString  = [[NSString alloc] initWithBytes:parseState->token.tokenPtrRange.ptr length:parseState->token.tokenPtrRange.length encoding:NSASCIIStringEncoding];
+  id        decimalNumber = [[NSDecimalNumber alloc] initWithString:numberString locale:[NSDictionary dictionaryWithObject:@"." forKey:NSLocaleDecimalSeparator]];
+  [numberString release];
+  return(decimalNumber);
+}
+
 static void *jk_cachedObjects(JKParseState *parseState) {
   unsigned long  bucket     = parseState->token.value.hash & (parseState->cache.count - 1UL), setBucket = 0UL, useableBucket = 0UL, x = 0UL;
   void          *parsedAtom = NULL;
     
   if(JK_EXPECT_F(parseState->token.value.ptrRange.length == 0UL) && JK_EXPECT_T(parseState->token.value.type == JKValueTypeString)) { return(@""); }
 
-  for(x = 0UL; x < JK_CACHE_PROBES; x++) {
+  for(x = 0UL; x < parseState->cache.probes; x++) {
     if(JK_EXPECT_F(parseState->cache.items[bucket].object == NULL)) { setBucket = 1UL; useableBucket = bucket; break; }
     
     if((JK_EXPECT_T(parseState->cache.items[bucket].hash == parseState->token.value.hash)) && (JK_EXPECT_T(parseState->cache.items[bucket].size == parseState->token.value.ptrRange.length)) && (JK_EXPECT_T(parseState->cache.items[bucket].type == parseState->token.value.type)) && (JK_EXPECT_T(parseState->cache.items[bucket].bytes != NULL)) && (JK_EXPECT_T(memcmp(parseState->cache.items[bucket].bytes, parseState->token.value.ptrRange.ptr, parseState->token.value.ptrRange.length) == 0U))) {
       parseState->cache.age[bucket]     = (((uint32_t)parseState->cache.age[bucket]) + 1U) - (((((uint32_t)parseState->cache.age[bucket]) + 1U) >> 31) ^ 1U);
       parseState->token.value.cacheItem = &parseState->cache.items[bucket];
+      parseState->cache.hits++;
       NSCParameterAssert(parseState->cache.items[bucket].object != NULL);
       return((void *)CFRetain(parseState->cache.items[bucket].object));
     } else {
@@ -2028,12 +2257,16 @@ static void *jk_cachedObjects(JKParseState *parseState) {
       else { parsedAtom = (void *)parseState->objCImpCache.NSNumberInitWithUnsignedLongLong(parseState->objCImpCache.NSNumberAlloc(parseState->objCImpCache.NSNumberClass, @selector(alloc)), @selector(initWithUnsignedLongLong:), parseState->token.value.number.unsignedLongLongValue); }
       break;
     case JKValueTypeDouble:           parsedAtom = (void *)CFNumberCreate(NULL, kCFNumberDoubleType,   &parseState->token.value.number.doubleValue);                                               break;
+    case JKValueTypeDecimal:          parsedAtom = (void *)jk_create_decimal_number(parseState);                                                                                                    break;
     default: jk_error(parseState, @"Internal error: Unknown token value type. %@ line #%ld", [NSString stringWithUTF8String:__FILE__], (long)__LINE__); break;
   }
   
+  parseState->cache.misses++;
+  if(JK_EXPECT_F(setBucket == 0UL)) { parseState->cache.uncachedMisses++; }
+
   if(JK_EXPECT_T(setBucket) && (JK_EXPECT_T(parsedAtom != NULL))) {
     bucket = useableBucket;
-    if(JK_EXPECT_T((parseState->cache.items[bucket].object != NULL))) { CFRelease(parseState->cache.items[bucket].object); parseState->cache.items[bucket].object = NULL; }
+    if(JK_EXPECT_T((parseState->cache.items[bucket].object != NULL))) { CFRelease(parseState->cache.items[bucket].object); parseState->cache.items[bucket].object = NULL; parseState->cache.evictions++; }
     
     if(JK_EXPECT_T((parseState->cache.items[bucket].bytes = (unsigned char *)reallocf(parseState->cache.items[bucket].bytes, parseState->token.value.ptrRange.length)) != NULL)) {
       memcpy(parseState->cache.items[bucket].bytes, parseState->token.value.ptrRange.ptr, parseState->token.value.ptrRange.length);
@@ -2111,7 +2344,10 @@ static void *jk_object_for_token(JKParseState *parseState) {
   
   parseState->cache.prng_lfsr = 1U;
   parseState->cache.count     = JK_CACHE_SLOTS;
+  parseState->cache.slotsBits = JK_CACHE_SLOTS_BITS;
+  parseState->cache.probes    = JK_CACHE_PROBES;
   if((parseState->cache.items = (JKTokenCacheItem *)calloc(1UL, sizeof(JKTokenCacheItem) * parseState->cache.count)) == NULL) { goto errorExit; }
+  if((parseState->cache.age   = (unsigned char *)   calloc(1UL, sizeof(unsigned char)    * parseState->cache.count)) == NULL) { goto errorExit; }
 
   return(self);
 
@@ -2128,6 +2364,7 @@ static void _JSONDecoderCleanup(JSONDecoder *decoder) {
     
     [decoder clearCache];
     if(decoder->parseState->cache.items != NULL) { free(decoder->parseState->cache.items); decoder->parseState->cache.items = NULL; }
+    if(decoder->parseState->cache.age   != NULL) { free(decoder->parseState->cache.age);   decoder->parseState->cache.age   = NULL; }
     
     free(decoder->parseState); decoder->parseState = NULL;
   }
@@ -2154,6 +2391,61 @@ static void _JSONDecoderCleanup(JSONDecoder *decoder) {
   }
 }
 
+- (BOOL)setCacheSlotsBits:(NSUInteger)slotsBits probes:(NSUInteger)probes
+{
+  if(parseState == NULL) { [NSException raise:NSInternalInconsistencyException format:@"parseState is NULL."]; }
+  if((slotsBits < 1UL) || (slotsBits > JK_CACHE_MAX_SLOTS_BITS)) { [NSException raise:NSInvalidArgumentException format:@"The cache slotsBits must be from 1 to %d.", JK_CACHE_MAX_SLOTS_BITS]; }
+  if((probes    < 1UL) || (probes    > JK_CACHE_MAX_PROBES))     { [NSException raise:NSInvalidArgumentException format:@"The cache probes must be from 1 to %d.",    JK_CACHE_MAX_PROBES];     }
+
+  size_t            count = (1UL << slotsBits);
+  JKTokenCacheItem *items = NULL;
+  unsigned char    *age   = NULL;
+
+  if((items = (JKTokenCacheItem *)calloc(1UL, sizeof(JKTokenCacheItem) * count)) == NULL) { return(NO); }
+  if((age   = (unsigned char *)   calloc(1UL, sizeof(unsigned char)    * count)) == NULL) { free(items); return(NO); }
+
+  [self clearCache];
+  free(parseState->cache.items);
+  free(parseState->cache.age);
+  parseState->cache.items     = items;
+  parseState->cache.age       = age;
+  parseState->cache.count     = count;
+  parseState->cache.slotsBits = slotsBits;
+  parseState->cache.probes    = probes;
+  return(YES);
+}
+
+- (NSUInteger)cacheSlotsBits
+{
+  return((parseState != NULL) ? parseState->cache.slotsBits : 0UL);
+}
+
+- (NSUInteger)cacheProbes
+{
+  return((parseState != NULL) ? parseState->cache.probes : 0UL);
+}
+
+- (JKCacheStatistics)cacheStatistics
+{
+  JKCacheStatistics statistics;
+  memset(&statistics, 0, sizeof(statistics));
+  if(JK_EXPECT_F(parseState == NULL)) { return(statistics); }
+
+  statistics.hits           = parseState->cache.hits;
+  statistics.misses         = parseState->cache.misses;
+  statistics.evictions      = parseState->cache.evictions;
+  statistics.uncachedMisses = parseState->cache.uncachedMisses;
+  size_t idx = 0UL;
+  for(idx = 0UL; idx < parseState->cache.count; idx++) { if(parseState->cache.items[idx].object != NULL) { statistics.slotsInUse++; } }
+  return(statistics);
+}
+
+- (void)resetCacheStatistics
+{
+  if(JK_EXPECT_F(parseState == NULL)) { return; }
+  parseState->cache.hits = parseState->cache.misses = parseState->cache.evictions = parseState->cache.uncachedMisses = 0UL;
+}
+
 // This needs to be completely rewritten.
 static id _JKParseUTF8String(JKParseState *parseState, BOOL mutableCollections, const unsigned char *string, size_t length, NSError **error) {
   NSCParameterAssert((parseState != NULL) && (string != NULL) && (parseState->cache.prng_lfsr != 0U));
@@ -2285,6 +2577,766 @@ static id _JKParseUTF8String(JKParseState *parseState, BOOL mutableCollections,
 
 @end
 
+////////////
+#pragma mark Schema-directed decoding
+////////////
+
+#define JK_SCHEMA_MAX_SKIP_DEPTH    (64UL)
+#define JK_SCHEMA_NUMBER_STRING_MAX (64UL)
+
+typedef struct {
+  unsigned char *name;
+  size_t         nameLength;
+  JKSchemaField  field;
+} JKSchemaFieldEntry;
+
+struct JKSchemaState {
+  unsigned char      **pathKeys;
+  size_t              *pathKeyLengths;
+  size_t               numPathKeys;
+  JKSchemaFieldEntry  *fields;
+  size_t               numFields;
+  size_t               recordSize;
+};
+
+static NSError *jk_create_error(NSString *format, ...) {
+  va_list varArgsList;
+  va_start(varArgsList, format);
+  NSString *formatString = [[[NSString alloc] initWithFormat:format arguments:varArgsList] autorelease];
+  va_end(varArgsList);
+
+  return([NSError errorWithDomain:@"JKErrorDomain" code:-1L userInfo:[NSDictionary dictionaryWithObject:formatString forKey:NSLocalizedDescriptionKey]]);
+}
+
+static unsigned char *jk_schema_copy_key(NSString *key, size_t *length) {
+  const char *utf8Key = [key UTF8String];
+  *length = strlen(utf8Key);
+  unsigned char *copiedKey = (unsigned char *)malloc(*length + 1UL);
+  if(copiedKey != NULL) { memcpy(copiedKey, utf8Key, *length + 1UL); }
+  return(copiedKey);
+}
+
+static void jk_schema_free(JKSchemaState *schemaState) {
+  if(schemaState == NULL) { return; }
+  size_t idx = 0UL;
+  if(schemaState->pathKeys != NULL) { for(idx = 0UL; idx < schemaState->numPathKeys; idx++) { if(schemaState->pathKeys[idx] != NULL) { free(schemaState->pathKeys[idx]); } } free(schemaState->pathKeys); }
+  if(schemaState->pathKeyLengths != NULL) { free(schemaState->pathKeyLengths); }
+  if(schemaState->fields != NULL) { for(idx = 0UL; idx < schemaState->numFields; idx++) { if(schemaState->fields[idx].name != NULL) { free(schemaState->fields[idx].name); } } free(schemaState->fields); }
+  free(schemaState);
+}
+
+// Parses "key.key[].{field,field}" (or "[].{field,field}") into a JKSchemaState.
+static JKSchemaState *jk_schema_compile(NSString *schemaString, const JKSchemaField *fields, size_t recordSize, NSError **error) {
+  JKSchemaState *schemaState  = NULL;
+  NSError       *compileError = NULL;
+  NSRange        arrayRange   = [schemaString rangeOfString:@"[]."];
+  size_t         idx          = 0UL;
+  
+  if((arrayRange.location == NSNotFound) || ([schemaString hasSuffix:@"}"] == NO) || ([schemaString characterAtIndex:NSMaxRange(arrayRange)] != '{')) { compileError = jk_create_error(@"The schema '%@' is not of the form 'key.key[].{field,field}'.", schemaString); goto errorExit; }
+
+  NSString *pathString   = [schemaString substringToIndex:arrayRange.location];
+  NSString *fieldsString = [schemaString substringWithRange:NSMakeRange(NSMaxRange(arrayRange) + 1UL, [schemaString length] - NSMaxRange(arrayRange) - 2UL)];
+  NSArray  *pathKeys     = ([pathString length] > 0UL) ? [pathString componentsSeparatedByString:@"."] : [NSArray array];
+  NSArray  *fieldNames   = [fieldsString componentsSeparatedByString:@","];
+  
+  if((schemaState = (JKSchemaState *)calloc(1UL, sizeof(JKSchemaState))) == NULL) { compileError = jk_create_error(@"Unable to allocate memory for the schema."); goto errorExit; }
+
+  schemaState->recordSize     = recordSize;
+  schemaState->numPathKeys    = [pathKeys count];
+  schemaState->numFields      = [fieldNames count];
+  schemaState->pathKeys       = (unsigned char **)calloc(schemaState->numPathKeys + 1UL, sizeof(unsigned char *));
+  schemaState->pathKeyLengths = (size_t *)calloc(schemaState->numPathKeys + 1UL, sizeof(size_t));
+  schemaState->fields         = (JKSchemaFieldEntry *)calloc(schemaState->numFields, sizeof(JKSchemaFieldEntry));
+  if((schemaState->pathKeys == NULL) || (schemaState->pathKeyLengths == NULL) || (schemaState->fields == NULL)) { compileError = jk_create_error(@"Unable to allocate memory for the schema."); goto errorExit; }
+
+  for(idx = 0UL; idx < schemaState->numPathKeys; idx++) {
+    NSString *key = [[pathKeys objectAtIndex:idx] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    if([key length] == 0UL) { compileError = jk_create_error(@"The schema '%@' has an empty key in its path.", schemaString); goto errorExit; }
+    if((schemaState->pathKeys[idx] = jk_schema_copy_key(key, &schemaState->pathKeyLengths[idx])) == NULL) { compileError = jk_create_error(@"Unable to allocate memory for the schema."); goto errorExit; }
+  }
+
+  for(idx = 0UL; idx < schemaState->numFields; idx++) {
+    NSString      *name  = [[fieldNames objectAtIndex:idx] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    JKSchemaField  field = fields[idx];
+    if([name length] == 0UL) { compileError = jk_create_error(@"The schema '%@' has an empty field name.", schemaString); goto errorExit; }
+    if((field.offset + field.size) > recordSize) { compileError = jk_create_error(@"The field '%@' does not fit in a record of %lu bytes.", name, (unsigned long)recordSize); goto errorExit; }
+    switch(field.type) {
+      case JKSchemaFieldTypeString: if(field.size < 1UL)              { compileError = jk_create_error(@"The string field '%@' has no room for its NUL terminator.", name); goto errorExit; } break;
+      case JKSchemaFieldTypeDouble: if(field.size != sizeof(double))  { compileError = jk_create_error(@"The field '%@' is not the size of a double.",                name); goto errorExit; } break;
+      case JKSchemaFieldTypeInt64:  if(field.size != sizeof(int64_t)) { compileError = jk_create_error(@"The field '%@' is not the size of an int64_t.",              name); goto errorExit; } break;
+      case JKSchemaFieldTypeBool:   if(field.size != sizeof(BOOL))    { compileError = jk_create_error(@"The field '%@' is not the size of a BOOL.",                  name); goto errorExit; } break;
+      case JKSchemaFieldTypeFixed:  if(field.size != sizeof(int64_t)) { compileError = jk_create_error(@"The field '%@' is not the size of an int64_t.",              name); goto errorExit; }
+                                    if(field.scaleDigits > JK_FIXED_DECIMAL_MAX_DIGITS) { compileError = jk_create_error(@"The field '%@' has more than %lu scale digits.", name, (unsigned long)JK_FIXED_DECIMAL_MAX_DIGITS); goto errorExit; } break;
+      default:                      compileError = jk_create_error(@"The field '%@' has an unknown type %lu.", name, (unsigned long)field.type); goto errorExit; break;
+    }
+    schemaState->fields[idx].field = field;
+    if((schemaState->fields[idx].name = jk_schema_copy_key(name, &schemaState->fields[idx].nameLength)) == NULL) { compileError = jk_create_error(@"Unable to allocate memory for the schema."); goto errorExit; }
+  }
+
+  return(schemaState);
+
+errorExit:
+  jk_schema_free(schemaState);
+  if(error != NULL) { *error = compileError; }
+  return(NULL);
+}
+
+JK_STATIC_INLINE int jk_schema_token_is_value(JKTokenType type) {
+  return((type == JKTokenTypeString) || (type == JKTokenTypeNumber) || (type == JKTokenTypeObjectBegin) || (type == JKTokenTypeArrayBegin) || (type == JKTokenTypeTrue) || (type == JKTokenTypeFalse) || (type == JKTokenTypeNull));
+}
+
+JK_STATIC_INLINE int jk_schema_token_matches(JKParseState *parseState, const unsigned char *key, size_t keyLength) {
+  return((parseState->token.value.ptrRange.length == keyLength) && (memcmp(parseState->token.value.ptrRange.ptr, key, keyLength) == 0));
+}
+
+// Steps over the value whose first token was just read.  Nothing is converted into an object, containers are only checked for balance.
+static int jk_schema_skip_value(JKParseState *parseState) {
+  size_t   depth       = 0UL;
+  uint64_t arrayLevels = 0ULL;
+
+  if(JK_EXPECT_F(jk_schema_token_is_value(parseState->token.type) == 0)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected a value, not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(1); }
+
+  do {
+    switch(parseState->token.type) {
+      case JKTokenTypeObjectBegin:
+      case JKTokenTypeArrayBegin:
+        if(JK_EXPECT_F(depth == JK_SCHEMA_MAX_SKIP_DEPTH)) { jk_error(parseState, @"Values nested more than %lu deep cannot be skipped.", JK_SCHEMA_MAX_SKIP_DEPTH); return(1); }
+        arrayLevels = (arrayLevels << 1) | ((parseState->token.type == JKTokenTypeArrayBegin) ? 1ULL : 0ULL);
+        depth++;
+        break;
+      case JKTokenTypeObjectEnd:
+      case JKTokenTypeArrayEnd:
+        if(JK_EXPECT_F((arrayLevels & 1ULL) != ((parseState->token.type == JKTokenTypeArrayEnd) ? 1ULL : 0ULL))) { parseState->errorIsPrev = 1; jk_error(parseState, @"Unbalanced '%c'.", (int)*parseState->token.tokenPtrRange.ptr); return(1); }
+        arrayLevels >>= 1;
+        depth--;
+        break;
+      default: break; // Scalars, ',' and ':' inside the containers being skipped.
+    }
+  } while((depth > 0UL) && (jk_parse_next_token(parseState) == 0));
+
+  return((depth == 0UL) ? 0 : 1);
+}
+
+// Reads the next key of the object being walked, whose '{' (or previous value) was just read.  Sets *endOfObject at its '}'.
+static int jk_schema_next_key(JKParseState *parseState, int *firstKey, int *endOfObject) {
+  if(JK_EXPECT_F(jk_parse_next_token(parseState))) { return(1); }
+  if(parseState->token.type == JKTokenTypeObjectEnd) { *endOfObject = 1; return(0); }
+  if(*firstKey == 0) {
+    if(JK_EXPECT_F(parseState->token.type != JKTokenTypeComma)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected ',' or '}', not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(1); }
+    if(JK_EXPECT_F(jk_parse_next_token(parseState))) { return(1); }
+  }
+  *firstKey = 0;
+  if(JK_EXPECT_F(parseState->token.type != JKTokenTypeString)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected a \"STRING\" key, not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(1); }
+  return(0);
+}
+
+// Reads the ':' after a key, then the first token of its value.
+static int jk_schema_next_value(JKParseState *parseState) {
+  if(JK_EXPECT_F(jk_parse_next_token(parseState))) { return(1); }
+  if(JK_EXPECT_F(parseState->token.type != JKTokenTypeSeparator)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected ':', not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(1); }
+  if(JK_EXPECT_F(jk_parse_next_token(parseState))) { return(1); }
+  if(JK_EXPECT_F(jk_schema_token_is_value(parseState->token.type) == 0)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected a value, not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(1); }
+  return(0);
+}
+
+// Converts a string value holding a number, eg. "1354208555.548539", which must be consumed whole.
+static int jk_schema_number_from_string(JKParseState *parseState, const JKSchemaFieldEntry *entry, void *fieldPtr) {
+  size_t length = parseState->token.value.ptrRange.length;
+  char   numberTempBuf[JK_SCHEMA_NUMBER_STRING_MAX + 1UL], *endOfNumber = NULL;
+
+  if(JK_EXPECT_F(length == 0UL) || JK_EXPECT_F(length > JK_SCHEMA_NUMBER_STRING_MAX)) { goto invalidNumber; }
+  memcpy(numberTempBuf, parseState->token.value.ptrRange.ptr, length);
+  numberTempBuf[length] = 0;
+
+  errno = 0;
+  if(entry->field.type == JKSchemaFieldTypeDouble) { double    doubleValue   = strtod (numberTempBuf, &endOfNumber);     memcpy(fieldPtr, &doubleValue,   sizeof(double));  }
+  else                                             { long long longLongValue = strtoll(numberTempBuf, &endOfNumber, 10); memcpy(fieldPtr, &longLongValue, sizeof(int64_t)); }
+  if(JK_EXPECT_F(errno != 0) || JK_EXPECT_F(endOfNumber != &numberTempBuf[length])) { goto invalidNumber; }
+  return(0);
+
+invalidNumber:
+  parseState->errorIsPrev = 1;
+  jk_error(parseState, @"The field '%s' holds '%*.*s', which is not a number.", entry->name, (int)length, (int)length, parseState->token.value.ptrRange.ptr);
+  return(1);
+}
+
+// Stores the value whose first token was just read into its field of the record.
+static int jk_schema_store_field(JKParseState *parseState, const JKSchemaFieldEntry *entry, unsigned char *record) {
+  void        *fieldPtr  = record + entry->field.offset;
+  JKTokenType  tokenType = parseState->token.type;
+
+  if(tokenType == JKTokenTypeNull) { return(0); } // Left zeroed.
+
+  switch(entry->field.type) {
+    case JKSchemaFieldTypeString:
+      if(JK_EXPECT_T(tokenType == JKTokenTypeString)) {
+        size_t copyLength = parseState->token.value.ptrRange.length;
+        if(copyLength > (entry->field.size - 1UL)) { copyLength = entry->field.size - 1UL; }
+        memcpy(fieldPtr, parseState->token.value.ptrRange.ptr, copyLength);
+        ((unsigned char *)fieldPtr)[copyLength] = 0;
+        return(0);
+      }
+      break;
+
+    case JKSchemaFieldTypeDouble:
+      if(JK_EXPECT_T(tokenType == JKTokenTypeNumber)) {
+        double doubleValue = 0.0;
+        switch(parseState->token.value.type) {
+          case JKValueTypeDouble:
+          case JKValueTypeDecimal:          doubleValue = parseState->token.value.number.doubleValue;                   break;
+          case JKValueTypeLongLong:         doubleValue = (double)parseState->token.value.number.longLongValue;         break;
+          case JKValueTypeUnsignedLongLong: doubleValue = (double)parseState->token.value.number.unsignedLongLongValue; break;
+          default: break;
+        }
+        memcpy(fieldPtr, &doubleValue, sizeof(double));
+        return(0);
+      }
+      if(tokenType == JKTokenTypeString) { return(jk_schema_number_from_string(parseState, entry, fieldPtr)); }
+      break;
+
+    case JKSchemaFieldTypeInt64:
+      if(JK_EXPECT_T(tokenType == JKTokenTypeNumber)) {
+        int64_t longLongValue = 0LL;
+        switch(parseState->token.value.type) {
+          case JKValueTypeLongLong:         longLongValue = parseState->token.value.number.longLongValue; break;
+          case JKValueTypeUnsignedLongLong: if(parseState->token.value.number.unsignedLongLongValue > (unsigned long long)LLONG_MAX) { goto wrongType; } longLongValue = (int64_t)parseState->token.value.number.unsignedLongLongValue; break;
+          default: goto wrongType; break;
+        }
+        memcpy(fieldPtr, &longLongValue, sizeof(int64_t));
+        return(0);
+      }
+      if(tokenType == JKTokenTypeString) { return(jk_schema_number_from_string(parseState, entry, fieldPtr)); }
+      break;
+
+    case JKSchemaFieldTypeFixed:
+      if(JK_EXPECT_T((tokenType == JKTokenTypeNumber) || (tokenType == JKTokenTypeString))) {
+        const JKConstPtrRange *numberRange = (tokenType == JKTokenTypeNumber) ? &parseState->token.tokenPtrRange : &parseState->token.value.ptrRange;
+        int64_t                fixedValue  = 0LL;
+        if(JK_EXPECT_F(JKScanFixedDecimal(numberRange->ptr, numberRange->length, entry->field.scaleDigits, &fixedValue) == NO)) {
+          parseState->errorIsPrev = 1;
+          jk_error(parseState, @"The field '%s' holds '%*.*s', which is not a decimal with %lu digits or less after the decimal point.", entry->name, (int)numberRange->length, (int)numberRange->length, numberRange->ptr, (unsigned long)JK_FIXED_DECIMAL_MAX_DIGITS);
+          return(1);
+        }
+        memcpy(fieldPtr, &fixedValue, sizeof(int64_t));
+        return(0);
+      }
+      break;
+
+    case JKSchemaFieldTypeBool:
+      if(JK_EXPECT_T((tokenType == JKTokenTypeTrue) || (tokenType == JKTokenTypeFalse))) { *((BOOL *)fieldPtr) = (tokenType == JKTokenTypeTrue) ? YES : NO; return(0); }
+      break;
+
+    default: break;
+  }
+
+wrongType:
+  parseState->errorIsPrev = 1;
+  jk_error(parseState, @"The field '%s' cannot be set from '%*.*s'.", entry->name, (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr);
+  return(1);
+}
+
+// Decodes the record whose '{' was just read.  With a NULL record (past the caller's capacity), the record is only stepped over.
+static int jk_schema_decode_record(JKParseState *parseState, const JKSchemaState *schemaState, unsigned char *record) {
+  int firstKey = 1, endOfObject = 0;
+
+  if(record != NULL) { memset(record, 0, schemaState->recordSize); }
+
+  while(1) {
+    const JKSchemaFieldEntry *entry = NULL;
+    
+    if(JK_EXPECT_F(jk_schema_next_key(parseState, &firstKey, &endOfObject))) { return(1); }
+    if(endOfObject) { return(0); }
+
+    if(record != NULL) {
+      size_t idx = 0UL;
+      for(idx = 0UL; idx < schemaState->numFields; idx++) { if(jk_schema_token_matches(parseState, schemaState->fields[idx].name, schemaState->fields[idx].nameLength)) { entry = &schemaState->fields[idx]; break; } }
+    }
+
+    if(JK_EXPECT_F(jk_schema_next_value(parseState))) { return(1); }
+    
+    if(entry != NULL) { if(JK_EXPECT_F(jk_schema_store_field(parseState, entry, record))) { return(1); } }
+    else              { if(JK_EXPECT_F(jk_schema_skip_value(parseState)))                 { return(1); } }
+  }
+}
+
+static NSUInteger jk_schema_decode(JKParseState *parseState, const JKSchemaState *schemaState, unsigned char *records, NSUInteger capacity) {
+  NSUInteger recordCount = 0UL;
+  size_t     pathIdx     = 0UL;
+
+  if(JK_EXPECT_F(jk_parse_next_token(parseState))) { return(NSNotFound); }
+
+  for(pathIdx = 0UL; pathIdx < schemaState->numPathKeys; pathIdx++) {
+    int firstKey = 1, endOfObject = 0, foundKey = 0;
+    
+    if(JK_EXPECT_F(parseState->token.type != JKTokenTypeObjectBegin)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected an object holding '%s', not '%*.*s'.", schemaState->pathKeys[pathIdx], (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(NSNotFound); }
+
+    while(foundKey == 0) {
+      if(JK_EXPECT_F(jk_schema_next_key(parseState, &firstKey, &endOfObject))) { return(NSNotFound); }
+      if(endOfObject) { return(0UL); } // The array is not there, so there are no records.
+      foundKey = jk_schema_token_matches(parseState, schemaState->pathKeys[pathIdx], schemaState->pathKeyLengths[pathIdx]);
+      if(JK_EXPECT_F(jk_schema_next_value(parseState)))                      { return(NSNotFound); }
+      if((foundKey == 0) && JK_EXPECT_F(jk_schema_skip_value(parseState))) { return(NSNotFound); }
+    }
+  }
+
+  if(parseState->token.type == JKTokenTypeNull) { return(0UL); }
+  if(JK_EXPECT_F(parseState->token.type != JKTokenTypeArrayBegin)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected an array of records, not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(NSNotFound); }
+
+  while(1) {
+    if(JK_EXPECT_F(jk_parse_next_token(parseState))) { return(NSNotFound); }
+    if(parseState->token.type == JKTokenTypeArrayEnd) { break; }
+    if(recordCount > 0UL) {
+      if(JK_EXPECT_F(parseState->token.type != JKTokenTypeComma)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected ',' or ']', not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(NSNotFound); }
+      if(JK_EXPECT_F(jk_parse_next_token(parseState))) { return(NSNotFound); }
+    }
+    if(JK_EXPECT_F(parseState->token.type != JKTokenTypeObjectBegin)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected a record '{', not '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr); return(NSNotFound); }
+    if(JK_EXPECT_F(jk_schema_decode_record(parseState, schemaState, (recordCount < capacity) ? (records + (recordCount * schemaState->recordSize)) : NULL))) { return(NSNotFound); }
+    recordCount++;
+  }
+
+  return(recordCount);
+}
+
+static NSUInteger _JKDecodeRecordsWithUTF8String(JKParseState *parseState, const JKSchemaState *schemaState, const unsigned char *string, size_t length, unsigned char *records, NSUInteger capacity, NSError **error) {
+  NSCParameterAssert((parseState != NULL) && (schemaState != NULL) && (string != NULL));
+  parseState->stringBuffer.bytes.ptr    = string;
+  parseState->stringBuffer.bytes.length = length;
+  parseState->atIndex                   = 0UL;
+  parseState->lineNumber                = 1UL;
+  parseState->lineStartIndex            = 0UL;
+  parseState->prev_atIndex              = 0UL;
+  parseState->prev_lineNumber           = 1UL;
+  parseState->prev_lineStartIndex       = 0UL;
+  parseState->error                     = NULL;
+  parseState->errorIsPrev               = 0;
+
+  // Only the tokenizer is used: no object stack is needed, since no object is ever created.
+  unsigned char stackTokenBuffer[JK_TOKENBUFFER_SIZE] JK_ALIGNED(64);
+  jk_managedBuffer_setToStackBuffer(&parseState->token.tokenBuffer, stackTokenBuffer, sizeof(stackTokenBuffer));
+
+  NSUInteger recordCount = jk_schema_decode(parseState, schemaState, records, capacity);
+
+  if((error != NULL) && (parseState->error != NULL)) { *error = parseState->error; }
+
+  jk_managedBuffer_release(&parseState->token.tokenBuffer);
+
+  parseState->stringBuffer.bytes.ptr    = NULL;
+  parseState->stringBuffer.bytes.length = 0UL;
+  parseState->atIndex                   = 0UL;
+  parseState->lineNumber                = 1UL;
+  parseState->lineStartIndex            = 0UL;
+  parseState->prev_atIndex              = 0UL;
+  parseState->prev_lineNumber           = 1UL;
+  parseState->prev_lineStartIndex       = 0UL;
+  parseState->error                     = NULL;
+  parseState->errorIsPrev               = 0;
+
+  return(recordCount);
+}
+
+@interface JKSchema ()
+- (JKSchemaState *)schemaState;
+@end
+
+@implementation JKSchema
+
++ (id)schemaWithString:(NSString *)schemaString fields:(const JKSchemaField *)fields recordSize:(size_t)recordSize error:(NSError **)error
+{
+  return([[[self alloc] initWithString:schemaString fields:fields recordSize:recordSize error:error] autorelease]);
+}
+
+- (id)initWithString:(NSString *)schemaString fields:(const JKSchemaField *)fields recordSize:(size_t)recordSize error:(NSError **)error
+{
+  if((self = [super init]) == NULL) { return(NULL); }
+
+  if(schemaString == NULL) { [self autorelease]; [NSException raise:NSInvalidArgumentException format:@"The schemaString argument is NULL."]; }
+  if(fields       == NULL) { [self autorelease]; [NSException raise:NSInvalidArgumentException format:@"The fields argument is NULL."];       }
+
+  if((schemaState = jk_schema_compile(schemaString, fields, recordSize, error)) == NULL) { [self autorelease]; return(NULL); }
+
+  return(self);
+}
+
+- (void)dealloc
+{
+  jk_schema_free(schemaState);
+  schemaState = NULL;
+  [super dealloc];
+}
+
+- (size_t)recordSize
+{
+  return(schemaState->recordSize);
+}
+
+- (NSUInteger)fieldCount
+{
+  return(schemaState->numFields);
+}
+
+- (JKSchemaState *)schemaState
+{
+  return(schemaState);
+}
+
+@end
+
+@implementation JSONDecoder (JKSchemaDecoding)
+
+- (NSUInteger)decodeRecordsWithUTF8String:(const unsigned char *)string length:(NSUInteger)length schema:(JKSchema *)schema records:(void *)records capacity:(NSUInteger)capacity error:(NSError **)error
+{
+  if(parseState == NULL)                        { [NSException raise:NSInternalInconsistencyException format:@"parseState is NULL."];           }
+  if(string     == NULL)                        { [NSException raise:NSInvalidArgumentException       format:@"The string argument is NULL."];  }
+  if(schema     == NULL)                        { [NSException raise:NSInvalidArgumentException       format:@"The schema argument is NULL."];  }
+  if((records   == NULL) && (capacity > 0UL))   { [NSException raise:NSInvalidArgumentException       format:@"The records argument is NULL."]; }
+
+  return(_JKDecodeRecordsWithUTF8String(parseState, [schema schemaState], string, (size_t)length, (unsigned char *)records, capacity, error));
+}
+
+- (NSUInteger)decodeRecordsWithData:(NSData *)jsonData schema:(JKSchema *)schema records:(void *)records capacity:(NSUInteger)capacity error:(NSError **)error
+{
+  if(jsonData == NULL) { [NSException raise:NSInvalidArgumentException format:@"The jsonData argument is NULL."]; }
+  return([self decodeRecordsWithUTF8String:(const unsigned char *)[jsonData bytes] length:[jsonData length] schema:schema records:records capacity:capacity error:error]);
+}
+
+@end
+
+////////////
+#pragma mark Streaming decoding
+////////////
+
+enum {
+  JKStreamExpectNothing   = 0,
+  JKStreamExpectValue     = (1 << 0),
+  JKStreamExpectKey       = (1 << 1),
+  JKStreamExpectSeparator = (1 << 2),
+  JKStreamExpectComma     = (1 << 3),
+  JKStreamExpectEnd       = (1 << 4),
+};
+
+struct JKStreamState {
+  id <JSONStreamDecoderDelegate> delegate;
+  struct {
+    unsigned int startObject:1, endObject:1, startArray:1, endArray:1, key:1, value:1;
+  } delegateResponds;
+  unsigned char *pendingBytes;        // The start of a token cut in two by the end of the last chunk.
+  size_t         pendingLength;
+  size_t         pendingCapacity;
+  size_t         pendingOffset;       // Where pendingBytes start in the document.
+  unsigned char *containers;          // One per open container: 1 for an array, 0 for an object.
+  size_t         depth;
+  size_t         containersCapacity;
+  int            expect;
+  int            finishedDocument;
+  NSError       *error;               // Retained.  Set once the document turned out to be malformed.
+};
+
+static int jk_stream_reserve(unsigned char **bytes, size_t *capacity, size_t length) {
+  if(JK_EXPECT_T(length <= *capacity)) { return(0); }
+  size_t newCapacity = (*capacity > 0UL) ? *capacity : 256UL;
+  while(newCapacity < length) { newCapacity *= 2UL; }
+  if((*bytes = (unsigned char *)reallocf(*bytes, newCapacity)) == NULL) { *capacity = 0UL; return(1); }
+  *capacity = newCapacity;
+  return(0);
+}
+
+// Whether the token starting at tokenStartIndex, which could not be parsed, runs into the end of the buffer and may be completed by the next chunk.
+static int jk_stream_token_is_truncated(JKParseState *parseState, size_t tokenStartIndex) {
+  const unsigned char *atCharacterPtr = parseState->stringBuffer.bytes.ptr + tokenStartIndex;
+  const unsigned char *endOfStringPtr = JK_END_STRING_PTR(parseState);
+
+  switch(*atCharacterPtr) {
+    case '"':
+      for(atCharacterPtr++; atCharacterPtr < endOfStringPtr; atCharacterPtr++) { if(*atCharacterPtr == '\\') { atCharacterPtr++; } else if(*atCharacterPtr == '"') { return(0); } }
+      return(1);
+    case 't':
+    case 'n': return((endOfStringPtr - atCharacterPtr) <= 4); // jk_parse_next_token wants one more byte after a literal.
+    case 'f': return((endOfStringPtr - atCharacterPtr) <= 5);
+    default:
+      for(; atCharacterPtr < endOfStringPtr; atCharacterPtr++) { if(!(((*atCharacterPtr >= '0') && (*atCharacterPtr <= '9')) || (*atCharacterPtr == '-') || (*atCharacterPtr == '+') || (*atCharacterPtr == '.') || (*atCharacterPtr == 'e') || (*atCharacterPtr == 'E'))) { return(0); } }
+      return(1);
+  }
+}
+
+JK_STATIC_INLINE void jk_stream_did_end_value(JKStreamState *streamState) {
+  if(streamState->depth == 0UL) { streamState->expect = JKStreamExpectNothing; streamState->finishedDocument = 1; }
+  else                          { streamState->expect = JKStreamExpectComma | JKStreamExpectEnd; }
+}
+
+// Sends the key or value of the token just read to the delegate.
+static void jk_stream_send_atom(JSONStreamDecoder *decoder, JKParseState *parseState, JKStreamState *streamState, int isKey) {
+  void *parsedAtom = NULL;
+
+  switch(parseState->token.type) {
+    case JKTokenTypeString:
+    case JKTokenTypeNumber: parseState->token.value.cacheItem = NULL; parsedAtom = jk_cachedObjects(parseState); break;
+    case JKTokenTypeTrue:   parsedAtom = (void *)CFRetain(kCFBooleanTrue);                                      break;
+    case JKTokenTypeFalse:  parsedAtom = (void *)CFRetain(kCFBooleanFalse);                                     break;
+    case JKTokenTypeNull:   parsedAtom = (void *)CFRetain(kCFNull);                                             break;
+    default: break;
+  }
+  if(JK_EXPECT_F(parsedAtom == NULL)) { return; }
+
+  if(isKey) { [streamState->delegate decoder:decoder foundKey:(NSString *)parsedAtom]; }
+  else      { [streamState->delegate decoder:decoder foundValue:(id)parsedAtom];       }
+  CFRelease(parsedAtom);
+}
+
+static int jk_stream_handle_token(JSONStreamDecoder *decoder, JKParseState *parseState, JKStreamState *streamState) {
+  JKTokenType tokenType = parseState->token.type;
+  
+  switch(tokenType) {
+    case JKTokenTypeObjectBegin:
+    case JKTokenTypeArrayBegin:
+      if(JK_EXPECT_F((streamState->expect & JKStreamExpectValue) == 0)) { goto unexpectedToken; }
+      if(JK_EXPECT_F(jk_stream_reserve(&streamState->containers, &streamState->containersCapacity, streamState->depth + 1UL))) { jk_error(parseState, @"Unable to allocate memory for the stack of open containers."); return(1); }
+      streamState->containers[streamState->depth++] = (tokenType == JKTokenTypeArrayBegin) ? 1 : 0;
+      if(tokenType == JKTokenTypeArrayBegin) { streamState->expect = JKStreamExpectValue | JKStreamExpectEnd; if(streamState->delegateResponds.startArray)  { [streamState->delegate decoderDidStartArray:decoder];  } }
+      else                                   { streamState->expect = JKStreamExpectKey   | JKStreamExpectEnd; if(streamState->delegateResponds.startObject) { [streamState->delegate decoderDidStartObject:decoder]; } }
+      break;
+
+    case JKTokenTypeObjectEnd:
+    case JKTokenTypeArrayEnd:
+      if(JK_EXPECT_F((streamState->expect & JKStreamExpectEnd) == 0) || JK_EXPECT_F(streamState->containers[streamState->depth - 1UL] != ((tokenType == JKTokenTypeArrayEnd) ? 1 : 0))) { goto unexpectedToken; }
+      streamState->depth--;
+      jk_stream_did_end_value(streamState);
+      if(tokenType == JKTokenTypeArrayEnd) { if(streamState->delegateResponds.endArray)  { [streamState->delegate decoderDidEndArray:decoder];  } }
+      else                                 { if(streamState->delegateResponds.endObject) { [streamState->delegate decoderDidEndObject:decoder]; } }
+      break;
+
+    case JKTokenTypeString:
+      if(streamState->expect & JKStreamExpectKey) {
+        streamState->expect = JKStreamExpectSeparator;
+        if(streamState->delegateResponds.key) { jk_stream_send_atom(decoder, parseState, streamState, 1); }
+        break;
+      }
+      // Fall through, a string value.
+    case JKTokenTypeNumber:
+    case JKTokenTypeTrue:
+    case JKTokenTypeFalse:
+    case JKTokenTypeNull:
+      if(JK_EXPECT_F((streamState->expect & JKStreamExpectValue) == 0)) { goto unexpectedToken; }
+      if(JK_EXPECT_F(streamState->depth == 0UL)) { parseState->errorIsPrev = 1; jk_error(parseState, @"Expected either '[' or '{'."); return(1); }
+      jk_stream_did_end_value(streamState);
+      if(streamState->delegateResponds.value) { jk_stream_send_atom(decoder, parseState, streamState, 0); }
+      break;
+
+    case JKTokenTypeSeparator:
+      if(JK_EXPECT_F((streamState->expect & JKStreamExpectSeparator) == 0)) { goto unexpectedToken; }
+      streamState->expect = JKStreamExpectValue;
+      break;
+
+    case JKTokenTypeComma:
+      if(JK_EXPECT_F((streamState->expect & JKStreamExpectComma) == 0)) { goto unexpectedToken; }
+      streamState->expect = (streamState->containers[streamState->depth - 1UL] == 1) ? JKStreamExpectValue : JKStreamExpectKey;
+      break;
+
+    default: goto unexpectedToken; break;
+  }
+  return(0);
+
+unexpectedToken:
+  parseState->errorIsPrev = 1;
+  jk_error(parseState, @"Unexpected '%*.*s'.", (int)parseState->token.tokenPtrRange.length, (int)parseState->token.tokenPtrRange.length, parseState->token.tokenPtrRange.ptr);
+  return(1);
+}
+
+// Parses every whole token of the buffer.  Returns how many bytes were consumed, the rest being the start of a token cut in two by the
+// end of the buffer (unless it is the last one), or NSNotFound on error.
+static size_t jk_stream_parse(JSONStreamDecoder *decoder, JKParseState *parseState, JKStreamState *streamState, const unsigned char *string, size_t length, int lastBuffer) {
+  size_t consumedLength = 0UL;
+
+  parseState->stringBuffer.bytes.ptr    = string;
+  parseState->stringBuffer.bytes.length = length;
+  parseState->atIndex                   = 0UL;
+  parseState->lineStartIndex            = 0UL;
+  parseState->prev_atIndex              = 0UL;
+  parseState->prev_lineNumber           = parseState->lineNumber;
+  parseState->prev_lineStartIndex       = 0UL;
+  parseState->error                     = NULL;
+  parseState->errorIsPrev               = 0;
+
+  unsigned char stackTokenBuffer[JK_TOKENBUFFER_SIZE] JK_ALIGNED(64);
+  jk_managedBuffer_setToStackBuffer(&parseState->token.tokenBuffer, stackTokenBuffer, sizeof(stackTokenBuffer));
+
+  while(1) {
+    jk_parse_skip_whitespace(parseState);
+
+    size_t tokenStartIndex = parseState->atIndex;
+    if(tokenStartIndex == length) { consumedLength = length; break; }
+
+    if(JK_EXPECT_F(streamState->finishedDocument)) {
+      if(parseState->parseOptionFlags & JKParseOptionPermitTextAfterValidJSON) { consumedLength = length; break; }
+      jk_error(parseState, @"A valid JSON object was parsed but there were additional non-white-space characters remaining.");
+      consumedLength = NSNotFound;
+      break;
+    }
+
+    if(JK_EXPECT_F(jk_parse_next_token(parseState))) {
+      // jk_parse_number never finishes a number at the end of the buffer, so numbers that may go on in the next chunk end up here as well.
+      if((lastBuffer == 0) && jk_stream_token_is_truncated(parseState, tokenStartIndex)) { parseState->error = NULL; parseState->errorIsPrev = 0; consumedLength = tokenStartIndex; }
+      else                                                                             { consumedLength = NSNotFound;                                                       }
+      break;
+    }
+    if(JK_EXPECT_F(jk_stream_handle_token(decoder, parseState, streamState))) { consumedLength = NSNotFound; break; }
+  }
+
+  if(JK_EXPECT_F(consumedLength == NSNotFound)) {
+    NSError             *parseError = (parseState->error != NULL) ? parseState->error : jk_create_error(@"Unable to parse JSON.");
+    NSMutableDictionary *userInfo   = [NSMutableDictionary dictionaryWithDictionary:[parseError userInfo]];
+    [userInfo setObject:[NSNumber numberWithUnsignedLong:streamState->pendingOffset + ((parseState->errorIsPrev != 0) ? parseState->prev_atIndex : parseState->atIndex)] forKey:@"JKAtIndexKey"];
+    streamState->error = [[NSError alloc] initWithDomain:[parseError domain] code:[parseError code] userInfo:userInfo];
+  }
+
+  jk_managedBuffer_release(&parseState->token.tokenBuffer);
+
+  parseState->stringBuffer.bytes.ptr    = NULL;
+  parseState->stringBuffer.bytes.length = 0UL;
+  parseState->atIndex                   = 0UL;
+  parseState->error                     = NULL;
+  parseState->errorIsPrev               = 0;
+
+  return(consumedLength);
+}
+
+static BOOL jk_stream_push(JSONStreamDecoder *decoder, JKParseState *parseState, JKStreamState *streamState, const unsigned char *string, size_t length, int lastBuffer, NSError **error) {
+  const unsigned char *parseBytes  = string;
+  size_t               parseLength = length;
+
+  if(JK_EXPECT_F(streamState->error != NULL)) { goto errorExit; }
+
+  // Tokens are parsed straight from the chunk, unless the last one ended in the middle of a token.
+  if(streamState->pendingLength > 0UL) {
+    if(JK_EXPECT_F(jk_stream_reserve(&streamState->pendingBytes, &streamState->pendingCapacity, streamState->pendingLength + length))) { streamState->error = [jk_create_error(@"Unable to allocate memory for the unfinished token.") retain]; goto errorExit; }
+    if(length > 0UL) { memcpy(streamState->pendingBytes + streamState->pendingLength, string, length); }
+    streamState->pendingLength += length;
+    parseBytes                  = streamState->pendingBytes;
+    parseLength                 = streamState->pendingLength;
+  }
+
+  size_t consumedLength = (parseLength > 0UL) ? jk_stream_parse(decoder, parseState, streamState, parseBytes, parseLength, lastBuffer) : 0UL;
+  if(JK_EXPECT_F(consumedLength == NSNotFound)) { goto errorExit; }
+
+  size_t remainingLength = parseLength - consumedLength;
+  if(parseBytes == streamState->pendingBytes) { memmove(streamState->pendingBytes, streamState->pendingBytes + consumedLength, remainingLength); }
+  else if(remainingLength > 0UL) {
+    if(JK_EXPECT_F(jk_stream_reserve(&streamState->pendingBytes, &streamState->pendingCapacity, remainingLength))) { streamState->error = [jk_create_error(@"Unable to allocate memory for the unfinished token.") retain]; goto errorExit; }
+    memcpy(streamState->pendingBytes, string + consumedLength, remainingLength);
+  }
+  streamState->pendingLength  = remainingLength;
+  streamState->pendingOffset += consumedLength;
+
+  if(lastBuffer && (streamState->finishedDocument == 0)) { streamState->error = [jk_create_error(@"Reached the end of the buffer before the top level object or array was closed.") retain]; goto errorExit; }
+
+  return(YES);
+
+errorExit:
+  if(error != NULL) { *error = streamState->error; }
+  return(NO);
+}
+
+@implementation JSONStreamDecoder
+
++ (id)streamDecoderWithDelegate:(id <JSONStreamDecoderDelegate>)delegate
+{
+  return([[[self alloc] initWithDelegate:delegate parseOptions:JKParseOptionStrict] autorelease]);
+}
+
+- (id)initWithParseOptions:(JKParseOptionFlags)parseOptionFlags
+{
+  return([self initWithDelegate:NULL parseOptions:parseOptionFlags]);
+}
+
+- (id)initWithDelegate:(id <JSONStreamDecoderDelegate>)delegate parseOptions:(JKParseOptionFlags)parseOptionFlags
+{
+  if((self = [super initWithParseOptions:parseOptionFlags]) == NULL) { return(NULL); }
+
+  if(parseOptionFlags & JKParseOptionComments) { [self autorelease]; [NSException raise:NSInvalidArgumentException format:@"JKParseOptionComments is not supported when streaming."]; }
+
+  if((streamState = (JKStreamState *)calloc(1UL, sizeof(JKStreamState))) == NULL) { [self autorelease]; return(NULL); }
+  streamState->expect = JKStreamExpectValue;
+  [self setDelegate:delegate];
+
+  return(self);
+}
+
+- (void)dealloc
+{
+  if(streamState != NULL) {
+    if(streamState->pendingBytes != NULL) { free(streamState->pendingBytes); }
+    if(streamState->containers   != NULL) { free(streamState->containers);   }
+    [streamState->error release];
+    free(streamState); streamState = NULL;
+  }
+  [super dealloc];
+}
+
+- (id <JSONStreamDecoderDelegate>)delegate
+{
+  return(streamState->delegate);
+}
+
+- (void)setDelegate:(id <JSONStreamDecoderDelegate>)delegate
+{
+  streamState->delegate                     = delegate;
+  streamState->delegateResponds.startObject = [delegate respondsToSelector:@selector(decoderDidStartObject:)] ? 1U : 0U;
+  streamState->delegateResponds.endObject   = [delegate respondsToSelector:@selector(decoderDidEndObject:)]   ? 1U : 0U;
+  streamState->delegateResponds.startArray  = [delegate respondsToSelector:@selector(decoderDidStartArray:)]  ? 1U : 0U;
+  streamState->delegateResponds.endArray    = [delegate respondsToSelector:@selector(decoderDidEndArray:)]    ? 1U : 0U;
+  streamState->delegateResponds.key         = [delegate respondsToSelector:@selector(decoder:foundKey:)]      ? 1U : 0U;
+  streamState->delegateResponds.value       = [delegate respondsToSelector:@selector(decoder:foundValue:)]    ? 1U : 0U;
+}
+
+- (BOOL)pushUTF8String:(const unsigned char *)string length:(NSUInteger)length error:(NSError **)error
+{
+  if((parseState == NULL) || (streamState == NULL)) { [NSException raise:NSInternalInconsistencyException format:@"parseState is NULL."];          }
+  if((string == NULL) && (length > 0UL))            { [NSException raise:NSInvalidArgumentException       format:@"The string argument is NULL."]; }
+
+  return(jk_stream_push(self, parseState, streamState, string, (size_t)length, 0, error));
+}
+
+- (BOOL)pushData:(NSData *)jsonData error:(NSError **)error
+{
+  if(jsonData == NULL) { [NSException raise:NSInvalidArgumentException format:@"The jsonData argument is NULL."]; }
+  return([self pushUTF8String:(const unsigned char *)[jsonData bytes] length:[jsonData length] error:error]);
+}
+
+- (BOOL)finishWithError:(NSError **)error
+{
+  if((parseState == NULL) || (streamState == NULL)) { [NSException raise:NSInternalInconsistencyException format:@"parseState is NULL."]; }
+
+  return(jk_stream_push(self, parseState, streamState, NULL, 0UL, 1, error));
+}
+
+- (void)reset
+{
+  [streamState->error release];
+  streamState->error            = NULL;
+  streamState->pendingLength    = 0UL;
+  streamState->pendingOffset    = 0UL;
+  streamState->depth            = 0UL;
+  streamState->expect           = JKStreamExpectValue;
+  streamState->finishedDocument = 0;
+  parseState->lineNumber        = 1UL;
+}
+
+- (NSUInteger)depth
+{
+  return(streamState->depth);
+}
+
+- (NSUInteger)bufferedLength
+{
+  return(streamState->pendingLength);
+}
+
+- (BOOL)isFinished
+{
+  return((streamState->finishedDocument != 0) ? YES : NO);
+}
+
+@end
+
 /*
  The NSString and NSData convenience methods need a little bit of explanation.
  
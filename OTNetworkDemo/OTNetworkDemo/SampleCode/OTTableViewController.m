@@ -36,8 +36,9 @@
 @property (weak, nonatomic) OTNetworkController *networkDelegate;
 @property (strong, nonatomic) NSArray *listSymbols;         // detailed list of symbols (for table cells)
 @property (strong, nonatomic) NSMutableArray *symbolsArray; // simplified list of symbols (for network quoting)
-@property (strong, nonatomic) NSArray *listRates;           // list of prices, updated periodically
-@property (strong, nonatomic) NSTimer *syncTimer;
+@property (strong, nonatomic) NSMutableDictionary *latestTicks;  // latest OTPriceTick (in an NSValue) of each symbol, pushed by the price stream
+@property (strong, nonatomic) NSMutableArray *priceSubscriptions;
+@property (strong, nonatomic) OTAccountSyncEngine *accountSync;      // keeps the orders and trades of the account up to date
 
 @end
 
@@ -45,8 +46,9 @@
 
 @synthesize listSymbols = _listSymbols;
 @synthesize symbolsArray = _symbolsArray;
-@synthesize listRates = _listRates;
-@synthesize syncTimer = _syncTimer;
+@synthesize latestTicks = _latestTicks;
+@synthesize priceSubscriptions = _priceSubscriptions;
+@synthesize accountSync = _accountSync;
 
 - (id)initWithStyle:(UITableViewStyle)style
 {
@@ -76,7 +78,18 @@
 }
 
 - (void)viewDidAppear:(BOOL)animated {
-    self.syncTimer = [NSTimer scheduledTimerWithTimeInterval:1 target:self selector:@selector(doGetRatePrices) userInfo:nil repeats:YES];
+    [super viewDidAppear:animated];
+    [self doGetRatePrices];
+}
+
+- (void)viewWillDisappear:(BOOL)animated {
+    [super viewWillDisappear:animated];
+    
+    // nothing on screen to update, so let the stream close its connection
+    for (id subscription in self.priceSubscriptions) {
+        [self.networkDelegate.priceStream unsubscribe:subscription];
+    }
+    self.priceSubscriptions = nil;
 }
 
 - (void)didReceiveMemoryWarning
@@ -94,7 +107,7 @@
 
 - (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section
 {
-    return self.listRates.count;
+    return self.listSymbols.count;
 }
 
 - (UITableViewCell *)tableView:(UITableView *)tableView cellForRowAtIndexPath:(NSIndexPath *)indexPath
@@ -107,7 +120,14 @@
     }
     
     cell.textLabel.text = [[self.listSymbols objectAtIndex:indexPath.row] valueForKey:@"displayName"];
-    cell.detailTextLabel.text = [NSString stringWithFormat:@"Buy: %@  Sell: %@", [[self.listRates objectAtIndex:indexPath.row] valueForKey:@"bid"], [[self.listRates objectAtIndex:indexPath.row] valueForKey:@"ask"]];
+    NSValue *tickValue = [self.latestTicks objectForKey:[self.symbolsArray objectAtIndex:indexPath.row]];
+    if (tickValue) {
+        OTPriceTick tick;
+        [tickValue getValue:&tick];
+        cell.detailTextLabel.text = [NSString stringWithFormat:@"Buy: %@  Sell: %@", OTPriceTickDecimalNumber(tick.bid), OTPriceTickDecimalNumber(tick.ask)];
+    } else {
+        cell.detailTextLabel.text = @"Buy: -  Sell: -";
+    }
     cell.detailTextLabel.textColor = [UIColor redColor];
     
     return cell;
@@ -181,6 +201,9 @@
          }
          
          allowRatesFetching = YES;
+         self.latestTicks = [[NSMutableDictionary alloc] initWithCapacity:self.symbolsArray.count];
+         [self.tableView reloadData];
+         [self doGetRatePrices];
      } failure:^(NSDictionary *error) {
          NSLog(@"soGetRateList Failure");
      }];
@@ -188,41 +211,37 @@
 
 -(void) doGetRatePrices
 {
-    static int callCount = 0;
-    if(allowRatesFetching) {
+    if(allowRatesFetching && !self.priceSubscriptions) {
+        
+        // Prices are pushed by the stream as they change, so there is nothing to poll
+        self.priceSubscriptions = [[NSMutableArray alloc] initWithCapacity:self.symbolsArray.count];
+        [self.symbolsArray enumerateObjectsUsingBlock:^(NSString *symbol, NSUInteger row, BOOL *stop) {
+            NSIndexPath *indexPath = [NSIndexPath indexPathForRow:row inSection:0];
+            
+            id subscription = [self.networkDelegate.priceStream subscribeToInstrument:symbol
+                                                                           tickBlock:^(OTPriceTick tick)
+            {
+                [self.latestTicks setObject:[NSValue valueWithBytes:&tick objCType:@encode(OTPriceTick)] forKey:symbol];
+                if ([[self.tableView indexPathsForVisibleRows] containsObject:indexPath]) {
+                    [self.tableView reloadRowsAtIndexPaths:@[indexPath] withRowAnimation:UITableViewRowAnimationNone];
+                }
+            }];
+            [self.priceSubscriptions addObject:subscription];
+        }];
         
         // TODO: delete this small test when ready
         // A quick little hack to trigger a chain of network calls to test
         // the OANDA API.  The main purpose of this app is still just to show
-        // rates for tradable instruments, refreshed periodically.  Please feel
-        // free to delete the IF case
-        static int numReps = 2;
-        if (numReps == 0)
+        // rates for tradable instruments, refreshed as they change.  Please feel
+        // free to delete these lines
+        static BOOL didRunNetworkCalls = NO;
+        if (!didRunNetworkCalls)
         {
             // Start running internal tests for network calls
             //[self doAccountList];
             [self doAccountStatus:@1774248];
+            didRunNetworkCalls = YES;
         }
-        else
-        {
-            // Test get Actual Rates
-            
-            // Invoke the actual network call
-            [self.networkDelegate rateQuote:self.symbolsArray
-                             success:^(NSDictionary *responseObject)
-             {
-                 NSLog(@"Success!  %d", callCount++);
-                 self.listRates = [responseObject objectForKey:@"prices"];
-                 [self.tableView reloadData];
-                 //NSLog(@"Rates: %@", responseObject);
-                 
-             } failure:^(NSDictionary *error) {
-                 NSLog(@"doGetRatePrices Failure");
-             }];
-        }
-        
-        // TODO: delete this from the hack as well
-        --numReps;
     }
 }
 
@@ -236,9 +255,7 @@
 /////////////////////////////////////////////////////////////////////
 static NSNumber *gAccountId;
 static NSNumber *gOrderId;
-static NSNumber *gMaxOrderIdForOrderPoll;
 static NSNumber *gTradeId;
-static NSNumber *gMaxTradeIdForTradePoll;
 
 -(void) doAccountList
 {
@@ -392,8 +409,7 @@ static NSNumber *gMaxTradeIdForTradePoll;
                                         success:^(NSDictionary *responseObject)
      {
          NSLog(@"Success!  Order Changed");
-         gMaxOrderIdForOrderPoll = [NSNumber numberWithInt:0];
-         [self doPollOrder:gAccountId withMaxOrderId:gMaxOrderIdForOrderPoll];
+         [self doPollOrder:gAccountId];
          
      } failure:^(NSDictionary *error) {
          NSLog(@"doChangeOrder Failure");
@@ -401,20 +417,22 @@ static NSNumber *gMaxTradeIdForTradePoll;
 }
 
 -(void) doPollOrder:(NSNumber *)accountId
-     withMaxOrderId:(NSNumber *)maxOrderId
 {
-    // Test polling orders
-    [self.networkDelegate pollOrderForAccount:accountId
-                            maxOrderId:maxOrderId
-                               success:^(NSDictionary *responseObject)
-     {
-         NSLog(@"Success!  Order Polled: %@", responseObject);
-         gMaxOrderIdForOrderPoll = [responseObject valueForKey:@"max_order_id"];
-         [self doDeleteOrder:gAccountId withOrderId:gOrderId];
-         
-     } failure:^(NSDictionary *error) {
-         NSLog(@"doPollOrder Failure");
-     }];
+    // Test polling orders: rather than keeping track of max ids, let the sync engine poll and report the differences
+    if (!self.accountSync) {
+        self.accountSync = [[OTAccountSyncEngine alloc] initWithNetworkController:self.networkDelegate accountId:accountId];
+        self.accountSync.ordersChangedBlock = ^(NSArray *added, NSArray *changed, NSArray *removed) {
+            NSLog(@"Success!  Orders Polled: added %@, changed %@, removed %@", added, changed, removed);
+        };
+        self.accountSync.tradesChangedBlock = ^(NSArray *added, NSArray *changed, NSArray *removed) {
+            NSLog(@"Success!  Trades Polled: added %@, changed %@, removed %@", added, changed, removed);
+        };
+        [self.accountSync start];
+    } else {
+        [self.accountSync syncNow];
+    }
+    
+    [self doDeleteOrder:gAccountId withOrderId:gOrderId];
 }
 
 -(void) doDeleteOrder:(NSNumber *)accountId
@@ -486,8 +504,7 @@ static NSNumber *gMaxTradeIdForTradePoll;
                                  success:^(NSDictionary *responseObject)
      {
          NSLog(@"Success!  Trade Changed");
-         gMaxTradeIdForTradePoll = [NSNumber numberWithInt:0];
-         [self doPollTrade:gAccountId withMaxTradeId:gMaxTradeIdForTradePoll];
+         [self doPollTrade:gAccountId];
          
      } failure:^(NSDictionary *error) {
          NSLog(@"doChangeTrade Failure");
@@ -495,20 +512,10 @@ static NSNumber *gMaxTradeIdForTradePoll;
 }
 
 -(void) doPollTrade:(NSNumber *)accountId
-     withMaxTradeId:(NSNumber *)maxTradeId
 {
-    // Test polling trades
-    [self.networkDelegate pollTradeForAccount:accountId
-                            maxTradeId:maxTradeId
-                               success:^(NSDictionary *responseObject)
-     {
-         NSLog(@"Success!  Trades Polled: %@", responseObject);
-         gMaxTradeIdForTradePoll = [responseObject valueForKey:@"max_trade_id"];
-         [self doDeleteTrade:gAccountId withTradeId:gTradeId];
-         
-     } failure:^(NSDictionary *error) {
-         NSLog(@"doPollTrade Failure");
-     }];
+    // Test polling trades: the sync engine started by doPollOrder: keeps the trades up to date too
+    [self.accountSync syncNow];
+    [self doDeleteTrade:gAccountId withTradeId:gTradeId];
 }
 
 -(void) doDeleteTrade:(NSNumber *)accountId